@@ -0,0 +1,21 @@
+//
+//  SeafCacheEntry.h
+//  Seafile
+//
+//  Access record of a downloaded object in the objects directory.
+//
+
+#import "RLMObject.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface SeafCacheEntry : RLMObject
+
+@property (nonatomic, copy) NSString *oid;           // Object id, the file name in the objects directory
+@property (nonatomic, assign) long long size;        // File size in bytes
+@property (nonatomic, assign) double lastAccess;     // Time of the last access, since 1970
+@property (nonatomic, assign) NSInteger accessCount; // Number of accesses since the object was cached
+
+@end
+
+NS_ASSUME_NONNULL_END
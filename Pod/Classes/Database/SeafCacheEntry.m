@@ -0,0 +1,17 @@
+//
+//  SeafCacheEntry.m
+//  Seafile
+//
+//  Access record of a downloaded object in the objects directory.
+//
+
+#import "SeafCacheEntry.h"
+
+@implementation SeafCacheEntry
+
++ (NSString *)primaryKey
+{
+    return @"oid";
+}
+
+@end
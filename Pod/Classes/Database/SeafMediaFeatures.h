@@ -0,0 +1,24 @@
+//
+//  SeafMediaFeatures.h
+//  Seafile
+//
+//  Media features of a downloaded object, found once so that viewers need not parse it again.
+//
+
+#import "RLMObject.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface SeafMediaFeatures : RLMObject
+
+@property (nonatomic, copy) NSString *oid;                       // Object id, the file name in the objects directory
+@property (nonatomic, assign) BOOL isMotionPhoto;                // Whether the file is an image with an embedded video
+@property (nonatomic, assign) long long imageLength;             // Length of the still image at the start of the file
+@property (nonatomic, assign) long long videoOffset;             // Offset of the embedded video
+@property (nonatomic, assign) long long videoLength;             // Length of the embedded video
+@property (nonatomic, assign) long long presentationTimestampUs; // Time of the still image in the video, -1 if unknown
+@property (nonatomic, copy) NSString *containerBrand;            // Major brand of the video, or its first box type if it has no ftyp
+
+@end
+
+NS_ASSUME_NONNULL_END
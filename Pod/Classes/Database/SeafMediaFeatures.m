@@ -0,0 +1,22 @@
+//
+//  SeafMediaFeatures.m
+//  Seafile
+//
+//  Media features of a downloaded object, found once so that viewers need not parse it again.
+//
+
+#import "SeafMediaFeatures.h"
+
+@implementation SeafMediaFeatures
+
++ (NSString *)primaryKey
+{
+    return @"oid";
+}
+
++ (NSDictionary *)defaultPropertyValues
+{
+    return @{@"presentationTimestampUs": @(-1), @"containerBrand": @""};
+}
+
+@end
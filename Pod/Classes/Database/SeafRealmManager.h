@@ -7,6 +7,8 @@
 
 #import <Foundation/Foundation.h>
 #import "SeafFileStatus.h"
+#import "SeafCacheEntry.h"
+#import "SeafMediaFeatures.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -60,8 +62,31 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (void)updateFileStatuses:(NSArray<SeafFileStatus *> *)statuses;
 
+// Apply the status changes of a directory refresh in one transaction: statuses of the
+// directory's previous version move to its new version, those of deleted files are removed
+- (void)updateFileStatuses:(NSArray<SeafFileStatus *> *)statuses
+             removingPaths:(NSArray<NSString *> *)removedPaths
+                 fromDirId:(NSString *)oldDirId
+                   toDirId:(NSString *)dirId
+                forAccount:(NSString *)account;
+
 - (void)deleteFileStatusesWithDirIdsNotIn:(NSSet *)dirIds forAccount:(NSString *)account;
 
+// Get all cache entries by ascending lastAccess, detached from the realm
+- (NSArray<SeafCacheEntry *> *)getAllCacheEntries;
+
+// Add or update entries and delete the entries and media features of removed objects in one transaction
+- (void)updateCacheEntries:(NSArray<SeafCacheEntry *> *)entries removingOids:(NSArray<NSString *> *)oids;
+
+// Clear all cache entries and media features
+- (void)clearAllCacheEntries;
+
+// Get the media features of an object, detached from the realm
+- (nullable SeafMediaFeatures *)getMediaFeaturesWithOid:(NSString *)oid;
+
+// Add or update the media features of an object
+- (void)updateMediaFeatures:(SeafMediaFeatures *)features;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -74,10 +74,12 @@ static SeafRealmManager* instance;
         }
 
         // Schema version 2: removed uploadedAsLivePhoto property
-        config.schemaVersion = 2;
+        // Schema version 3: added SeafCacheEntry
+        // Schema version 4: added SeafMediaFeatures
+        config.schemaVersion = 4;
         config.migrationBlock = ^(RLMMigration *migration, uint64_t oldSchemaVersion) {
-            if (oldSchemaVersion < 2) {
-                Debug(@"Migrating Realm schema from version %llu to 2", oldSchemaVersion);
+            if (oldSchemaVersion < 4) {
+                Debug(@"Migrating Realm schema from version %llu to 4", oldSchemaVersion);
             }
         };
 
@@ -270,6 +272,13 @@ static SeafRealmManager* instance;
     
     // Query existing file status
     SeafFileStatus *existingStatus = [SeafFileStatus objectInRealm:realm forPrimaryKey:newStatus.uniquePath];
+    [self handleFileStatusUpdate:newStatus existingStatus:existingStatus inRealm:realm];
+}
+
+- (void)handleFileStatusUpdate:(SeafFileStatus *)newStatus existingStatus:(SeafFileStatus *)existingStatus inRealm:(RLMRealm *)realm {
+    if (!newStatus || newStatus.uniquePath.length == 0) {
+        return;
+    }
     
     if (!existingStatus) {
         // If not exists, add new status directly
@@ -353,12 +362,60 @@ static SeafRealmManager* instance;
     }];
 }
 
+// Existing statuses of a batch, fetched with one query instead of one lookup per status
+- (NSDictionary<NSString *, SeafFileStatus *> *)existingFileStatuses:(NSArray<SeafFileStatus *> *)statuses inRealm:(RLMRealm *)realm {
+    NSMutableArray<NSString *> *paths = [NSMutableArray arrayWithCapacity:statuses.count];
+    for (SeafFileStatus *status in statuses) {
+        if (status.uniquePath.length > 0) {
+            [paths addObject:status.uniquePath];
+        }
+    }
+    NSMutableDictionary<NSString *, SeafFileStatus *> *existing = [NSMutableDictionary dictionaryWithCapacity:paths.count];
+    if (paths.count == 0) {
+        return existing;
+    }
+    for (SeafFileStatus *status in [SeafFileStatus objectsInRealm:realm where:@"uniquePath IN %@", paths]) {
+        [existing setObject:status forKey:status.uniquePath];
+    }
+    return existing;
+}
+
 // Batch update file statuses
 - (void)updateFileStatuses:(NSArray<SeafFileStatus *> *)statuses {
+    if (statuses.count == 0) {
+        return;
+    }
+    RLMRealm *realm = [RLMRealm defaultRealm];
+    [realm transactionWithBlock:^{
+        NSDictionary<NSString *, SeafFileStatus *> *existing = [self existingFileStatuses:statuses inRealm:realm];
+        for (SeafFileStatus *newStatus in statuses) {
+            [self handleFileStatusUpdate:newStatus existingStatus:[existing objectForKey:newStatus.uniquePath] inRealm:realm];
+        }
+    }];
+}
+
+- (void)updateFileStatuses:(NSArray<SeafFileStatus *> *)statuses
+             removingPaths:(NSArray<NSString *> *)removedPaths
+                 fromDirId:(NSString *)oldDirId
+                   toDirId:(NSString *)dirId
+                forAccount:(NSString *)account {
+    BOOL moveDir = oldDirId.length > 0 && dirId.length > 0 && account && ![oldDirId isEqualToString:dirId];
+    if (statuses.count == 0 && removedPaths.count == 0 && !moveDir) {
+        return;
+    }
     RLMRealm *realm = [RLMRealm defaultRealm];
     [realm transactionWithBlock:^{
+        if (removedPaths.count > 0) {
+            [realm deleteObjects:[SeafFileStatus objectsInRealm:realm where:@"uniquePath IN %@", removedPaths]];
+        }
+        if (moveDir) {
+            // Unchanged files keep their status, only the directory version they belong to changes
+            RLMResults *unchanged = [SeafFileStatus objectsInRealm:realm where:@"dirId == %@ AND accountIdentifier == %@", oldDirId, account];
+            [unchanged setValue:dirId forKey:@"dirId"];
+        }
+        NSDictionary<NSString *, SeafFileStatus *> *existing = [self existingFileStatuses:statuses inRealm:realm];
         for (SeafFileStatus *newStatus in statuses) {
-            [self handleFileStatusUpdate:newStatus inRealm:realm];
+            [self handleFileStatusUpdate:newStatus existingStatus:[existing objectForKey:newStatus.uniquePath] inRealm:realm];
         }
     }];
 }
@@ -387,4 +444,54 @@ static SeafRealmManager* instance;
     }
 }
 
+#pragma mark - SeafCacheEntry
+- (NSArray<SeafCacheEntry *> *)getAllCacheEntries {
+    // Oldest access first, the cache index then appends each entry at its tail.
+    RLMResults<SeafCacheEntry *> *allEntries = [[SeafCacheEntry allObjects] sortedResultsUsingKeyPath:@"lastAccess" ascending:YES];
+    NSMutableArray *entries = [NSMutableArray arrayWithCapacity:allEntries.count];
+    for (SeafCacheEntry *entry in allEntries) {
+        // Unmanaged copies can be used on any thread
+        [entries addObject:[[SeafCacheEntry alloc] initWithValue:entry]];
+    }
+    return entries;
+}
+
+- (void)updateCacheEntries:(NSArray<SeafCacheEntry *> *)entries removingOids:(NSArray<NSString *> *)oids {
+    if (entries.count == 0 && oids.count == 0) {
+        return;
+    }
+    RLMRealm *realm = [RLMRealm defaultRealm];
+    [realm transactionWithBlock:^{
+        if (entries.count > 0) {
+            [realm addOrUpdateObjects:entries];
+        }
+        if (oids.count > 0) {
+            [realm deleteObjects:[SeafCacheEntry objectsInRealm:realm where:@"oid IN %@", oids]];
+            [realm deleteObjects:[SeafMediaFeatures objectsInRealm:realm where:@"oid IN %@", oids]];
+        }
+    }];
+}
+
+- (void)clearAllCacheEntries {
+    RLMRealm *realm = [RLMRealm defaultRealm];
+    [realm transactionWithBlock:^{
+        [realm deleteObjects:[SeafCacheEntry allObjects]];
+        [realm deleteObjects:[SeafMediaFeatures allObjects]];
+    }];
+}
+
+#pragma mark - SeafMediaFeatures
+- (SeafMediaFeatures *)getMediaFeaturesWithOid:(NSString *)oid {
+    SeafMediaFeatures *features = [SeafMediaFeatures objectForPrimaryKey:oid];
+    // Unmanaged copies can be used on any thread
+    return features ? [[SeafMediaFeatures alloc] initWithValue:features] : nil;
+}
+
+- (void)updateMediaFeatures:(SeafMediaFeatures *)features {
+    RLMRealm *realm = [RLMRealm defaultRealm];
+    [realm transactionWithBlock:^{
+        [realm addOrUpdateObject:features];
+    }];
+}
+
 @end
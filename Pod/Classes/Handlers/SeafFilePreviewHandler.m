@@ -148,6 +148,7 @@
                                to:tempFileName
                             error:nil]) {
             _exportItemURL = [NSURL fileURLWithPath:tempFileName isDirectory:NO];
+            [[SeafCacheManager sharedManager] recordAccessToObject:sFile.ooid];
         } else {
             Warning("Copy file to exportURL failed.\n");
             sFile.ooid = nil;
@@ -624,40 +624,28 @@ static const NSTimeInterval kLivePhotoRetryDelay = 1.0; // seconds
             return;
         }
         
-        // Read image and video data
-        NSData *imageData = [NSData dataWithContentsOfFile:tempImagePath];
-        NSData *videoData = [NSData dataWithContentsOfFile:tempVideoPath];
-        
-        if (!imageData || !videoData) {
-            cleanup();
-            
-            dispatch_async(dispatch_get_main_queue(), ^{
-                [self getImageDataForAsset:file completion:completion];
-            });
-            return;
-        }
-        
-        [self composeV1V2MotionPhoto:imageData
-                           videoData:videoData
-                                file:file
-                             cleanup:cleanup
-                          completion:completion];
+        [self composeV1V2MotionPhotoAtImagePath:tempImagePath
+                                      videoPath:tempVideoPath
+                                           file:file
+                                        cleanup:cleanup
+                                     completion:completion];
     });
 }
 
-- (void)composeV1V2MotionPhoto:(NSData *)imageData
-                     videoData:(NSData *)videoData
-                          file:(SeafUploadFile *)file
-                       cleanup:(void (^)(void))cleanup
-                    completion:(void (^)(BOOL success, NSError *error))completion {
+// The parts are streamed from the temporary files into the upload file, none is loaded whole.
+- (void)composeV1V2MotionPhotoAtImagePath:(NSString *)imagePath
+                                videoPath:(NSString *)videoPath
+                                     file:(SeafUploadFile *)file
+                                  cleanup:(void (^)(void))cleanup
+                               completion:(void (^)(BOOL success, NSError *error))completion {
+    
+    // Mapped, only the header is read for the format checks
+    NSData *imageData = [NSData dataWithContentsOfFile:imagePath options:NSDataReadingMappedIfSafe error:nil];
     
     // Convert JPEG to HEIC if necessary
-    NSData *heicImageData = imageData;
     if ([self isJPEGData:imageData]) {
         NSData *convertedData = [self convertJPEGDataToHEIC:imageData];
-        if (convertedData) {
-            heicImageData = convertedData;
-        } else {
+        if (!convertedData || ![convertedData writeToFile:imagePath options:NSDataWritingAtomic error:nil]) {
             cleanup();
             dispatch_async(dispatch_get_main_queue(), ^{
                 [self getImageDataForAsset:file completion:completion];
@@ -671,29 +659,27 @@ static const NSTimeInterval kLivePhotoRetryDelay = 1.0; // seconds
         });
         return;
     }
-    
-    // Compose Motion Photo
-    NSData *motionPhotoData = [SeafMotionPhotoComposer composeV1V2MotionPhotoWithImageData:heicImageData
-                                                                                 videoData:videoData];
-    if (!motionPhotoData) {
-        cleanup();
-        dispatch_async(dispatch_get_main_queue(), ^{
-            [self getImageDataForAsset:file completion:completion];
-        });
-        return;
-    }
-    
-    // Write to file
-    NSError *writeError = nil;
-    BOOL writeSuccess = [motionPhotoData writeToFile:file.model.lpath 
-                                             options:NSDataWritingAtomic 
-                                               error:&writeError];
+    imageData = nil;
+    
+    // Compose Motion Photo into the upload file
+    NSError *composeError = nil;
+    BOOL composeSuccess = [SeafMotionPhotoComposer composeV1V2MotionPhotoWithImageAtPath:imagePath
+                                                                             videoAtPath:videoPath
+                                                                                  toPath:file.model.lpath
+                                                                                   error:&composeError];
     cleanup();
     
-    if (!writeSuccess) {
-        dispatch_async(dispatch_get_main_queue(), ^{
-            if (completion) completion(NO, writeError);
-        });
+    if (!composeSuccess) {
+        if ([composeError.domain isEqualToString:NSPOSIXErrorDomain]) {
+            // The files were fine, writing the upload file failed
+            dispatch_async(dispatch_get_main_queue(), ^{
+                if (completion) completion(NO, composeError);
+            });
+        } else {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [self getImageDataForAsset:file completion:completion];
+            });
+        }
         return;
     }
     
@@ -30,7 +30,7 @@ NS_ASSUME_NONNULL_BEGIN
 /// Size of the box header (typically 8 bytes, or 16 for extended size)
 @property (nonatomic, assign) uint32_t headerSize;
 
-/// Box payload data (loaded on demand, may be nil)
+/// Box payload data (read from the parsed bytes on first access, may be nil)
 @property (nonatomic, strong, nullable) NSData *payload;
 
 /// Child boxes for container boxes (e.g., moov contains trak, meta contains iloc)
@@ -52,14 +52,42 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @interface SeafISOBMFFParser : NSObject
 
-/// The raw data being parsed (readonly)
+/// The raw data being parsed (readonly). A parser initialized with a path maps the file on first access.
 @property (nonatomic, strong, readonly) NSData *data;
 
+/// Size of the parsed file in bytes
+@property (nonatomic, readonly) uint64_t length;
+
 /// Initialize with file data
 - (instancetype)initWithData:(NSData *)data;
 
-/// Initialize with file path
-- (instancetype)initWithPath:(NSString *)path;
+/// Initialize with file path. The file is not loaded: box headers and payloads are read as needed.
+- (nullable instancetype)initWithPath:(NSString *)path;
+
+/// Read bytes at an offset, returns NO if the range is out of the file or unreadable
+- (BOOL)readBytes:(void *)buffer offset:(uint64_t)offset length:(NSUInteger)length;
+
+/// Get the bytes of a range, or nil if the range is out of the file or unreadable
+- (nullable NSData *)dataAtOffset:(uint64_t)offset length:(uint64_t)length;
+
+/**
+ * Write a range of the file at the current position of a file descriptor, a chunk at a time.
+ * @return YES on success
+ */
+- (BOOL)writeBytesFromOffset:(uint64_t)offset
+                      length:(uint64_t)length
+            toFileDescriptor:(int)fd
+                       error:(NSError * _Nullable * _Nullable)error;
+
+/**
+ * Copy a range of the file to a new file, a chunk at a time, without loading the range.
+ * @param path The destination, replaced atomically
+ * @return YES on success
+ */
+- (BOOL)copyBytesFromOffset:(uint64_t)offset
+                     length:(uint64_t)length
+                     toPath:(NSString *)path
+                      error:(NSError * _Nullable * _Nullable)error;
 
 /// Parse all top-level boxes in the file
 - (NSArray<SeafISOBMFFBox *> *)parseTopLevelBoxes;
@@ -8,6 +8,220 @@
 #import "SeafISOBMFFParser.h"
 #import "Debug.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Header reads go through a few cached pages, so that walking the boxes costs few reads.
+static const NSUInteger SeafByteSourcePageSize = 16 * 1024;
+static const NSUInteger SeafByteSourcePageCount = 8;
+
+// Range copies go through a buffer of this size.
+static const NSUInteger SeafByteSourceCopyChunk = 1024 * 1024;
+
+#pragma mark - SeafISOBMFFByteSource
+
+/**
+ * Random access to the bytes being parsed, either held in memory or read from a file
+ * with pread, so that a large file is never loaded for reading its box headers.
+ */
+@interface SeafISOBMFFByteSource : NSObject
+@property (nonatomic, readonly) uint64_t length;
+- (instancetype)initWithData:(NSData *)data;
+- (nullable instancetype)initWithPath:(NSString *)path;
+- (BOOL)readBytes:(void *)buffer offset:(uint64_t)offset length:(NSUInteger)length;
+- (nullable NSData *)dataAtOffset:(uint64_t)offset length:(uint64_t)length;
+/// The whole content, mapped if read from a file.
+- (NSData *)data;
+/// Returns 0, or the errno of the failure.
+- (int)writeBytesFromOffset:(uint64_t)offset length:(uint64_t)length toFileDescriptor:(int)fd;
+@end
+
+static int SeafWriteFully(int fd, const uint8_t *bytes, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(fd, bytes, length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return errno;
+        }
+        bytes += n;
+        length -= n;
+    }
+    return 0;
+}
+
+@implementation SeafISOBMFFByteSource {
+    NSData *_data;
+    NSData *_mapped;
+    NSString *_path;
+    int _fd;
+    uint64_t _pageIndex[SeafByteSourcePageCount];
+    NSData *_pages[SeafByteSourcePageCount];
+    NSUInteger _pageUse[SeafByteSourcePageCount];
+    NSUInteger _useClock;
+}
+
+- (instancetype)initWithData:(NSData *)data {
+    self = [super init];
+    if (self) {
+        _data = data ?: [NSData data];
+        _length = _data.length;
+        _fd = -1;
+    }
+    return self;
+}
+
+- (nullable instancetype)initWithPath:(NSString *)path {
+    int fd = open(path.fileSystemRepresentation, O_RDONLY);
+    if (fd < 0) {
+        return nil;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return nil;
+    }
+    self = [super init];
+    if (self) {
+        _path = [path copy];
+        _fd = fd;
+        _length = (uint64_t)st.st_size;
+    } else {
+        close(fd);
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+- (BOOL)preadBytes:(void *)buffer offset:(uint64_t)offset length:(NSUInteger)length {
+    uint8_t *out = buffer;
+    while (length > 0) {
+        ssize_t n = pread(_fd, out, length, (off_t)offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return NO;
+        }
+        out += n;
+        offset += n;
+        length -= n;
+    }
+    return YES;
+}
+
+// Called while synchronized.
+- (nullable NSData *)pageAtIndex:(uint64_t)index {
+    NSUInteger victim = 0;
+    for (NSUInteger i = 0; i < SeafByteSourcePageCount; i++) {
+        if (_pages[i] && _pageIndex[i] == index) {
+            _pageUse[i] = ++_useClock;
+            return _pages[i];
+        }
+        if (!_pages[i] || _pageUse[i] < _pageUse[victim]) {
+            victim = i;
+        }
+    }
+    uint64_t start = index * SeafByteSourcePageSize;
+    NSUInteger size = (NSUInteger)MIN((uint64_t)SeafByteSourcePageSize, _length - start);
+    NSMutableData *page = [NSMutableData dataWithLength:size];
+    if (![self preadBytes:page.mutableBytes offset:start length:size]) {
+        return nil;
+    }
+    _pages[victim] = page;
+    _pageIndex[victim] = index;
+    _pageUse[victim] = ++_useClock;
+    return page;
+}
+
+- (BOOL)readBytes:(void *)buffer offset:(uint64_t)offset length:(NSUInteger)length {
+    if (offset > _length || length > _length - offset) {
+        return NO;
+    }
+    if (_data) {
+        [_data getBytes:buffer range:NSMakeRange((NSUInteger)offset, length)];
+        return YES;
+    }
+    if (length >= SeafByteSourcePageSize) {
+        return [self preadBytes:buffer offset:offset length:length];
+    }
+    @synchronized (self) {
+        uint8_t *out = buffer;
+        while (length > 0) {
+            uint64_t index = offset / SeafByteSourcePageSize;
+            NSData *page = [self pageAtIndex:index];
+            NSUInteger inPage = (NSUInteger)(offset - index * SeafByteSourcePageSize);
+            if (!page || inPage >= page.length) {
+                return NO;
+            }
+            NSUInteger n = MIN(length, page.length - inPage);
+            memcpy(out, (const uint8_t *)page.bytes + inPage, n);
+            out += n;
+            offset += n;
+            length -= n;
+        }
+    }
+    return YES;
+}
+
+- (nullable NSData *)dataAtOffset:(uint64_t)offset length:(uint64_t)length {
+    if (offset > _length || length > _length - offset) {
+        return nil;
+    }
+    if (_data) {
+        return [_data subdataWithRange:NSMakeRange((NSUInteger)offset, (NSUInteger)length)];
+    }
+    NSMutableData *data = [NSMutableData dataWithLength:(NSUInteger)length];
+    if (![self readBytes:data.mutableBytes offset:offset length:(NSUInteger)length]) {
+        return nil;
+    }
+    return data;
+}
+
+- (int)writeBytesFromOffset:(uint64_t)offset length:(uint64_t)length toFileDescriptor:(int)fd {
+    if (offset > _length || length > _length - offset) {
+        return EINVAL;
+    }
+    if (_data) {
+        return SeafWriteFully(fd, (const uint8_t *)_data.bytes + offset, (size_t)length);
+    }
+    NSMutableData *buffer = [NSMutableData dataWithLength:(NSUInteger)MIN((uint64_t)SeafByteSourceCopyChunk, length)];
+    while (length > 0) {
+        NSUInteger chunk = (NSUInteger)MIN((uint64_t)buffer.length, length);
+        if (![self preadBytes:buffer.mutableBytes offset:offset length:chunk]) {
+            return EIO;
+        }
+        int err = SeafWriteFully(fd, buffer.bytes, chunk);
+        if (err) {
+            return err;
+        }
+        offset += chunk;
+        length -= chunk;
+    }
+    return 0;
+}
+
+- (NSData *)data {
+    if (_data) {
+        return _data;
+    }
+    @synchronized (self) {
+        if (!_mapped) {
+            _mapped = [NSData dataWithContentsOfFile:_path options:NSDataReadingMappedIfSafe error:nil] ?: [NSData data];
+        }
+        return _mapped;
+    }
+}
+
+@end
+
 #pragma mark - SeafIlocExtent Implementation
 
 @implementation SeafIlocExtent
@@ -74,8 +288,21 @@
 
 #pragma mark - SeafISOBMFFBox Implementation
 
+@interface SeafISOBMFFBox ()
+@property (nonatomic, strong, nullable) SeafISOBMFFByteSource *source;
+@end
+
 @implementation SeafISOBMFFBox
 
+@synthesize payload = _payload;
+
+- (nullable NSData *)payload {
+    if (!_payload && self.source && self.payloadSize > 0) {
+        _payload = [self.source dataAtOffset:self.payloadOffset length:self.payloadSize];
+    }
+    return _payload;
+}
+
 - (uint64_t)payloadOffset {
     return self.offset + self.headerSize;
 }
@@ -97,7 +324,7 @@
 #pragma mark - SeafISOBMFFParser Implementation
 
 @interface SeafISOBMFFParser ()
-@property (nonatomic, strong, readwrite) NSData *data;
+@property (nonatomic, strong) SeafISOBMFFByteSource *source;
 @property (nonatomic, strong, nullable) NSArray<SeafISOBMFFBox *> *cachedTopLevelBoxes;
 @end
 
@@ -108,17 +335,84 @@
 - (instancetype)initWithData:(NSData *)data {
     self = [super init];
     if (self) {
-        _data = data;
+        _source = [[SeafISOBMFFByteSource alloc] initWithData:data];
     }
     return self;
 }
 
-- (instancetype)initWithPath:(NSString *)path {
-    NSData *data = [NSData dataWithContentsOfFile:path];
-    if (!data) {
+- (nullable instancetype)initWithPath:(NSString *)path {
+    SeafISOBMFFByteSource *source = [[SeafISOBMFFByteSource alloc] initWithPath:path];
+    if (!source) {
         return nil;
     }
-    return [self initWithData:data];
+    self = [super init];
+    if (self) {
+        _source = source;
+    }
+    return self;
+}
+
+#pragma mark - Byte Access
+
+- (NSData *)data {
+    return [self.source data];
+}
+
+- (uint64_t)length {
+    return self.source.length;
+}
+
+- (BOOL)readBytes:(void *)buffer offset:(uint64_t)offset length:(NSUInteger)length {
+    return [self.source readBytes:buffer offset:offset length:length];
+}
+
+- (nullable NSData *)dataAtOffset:(uint64_t)offset length:(uint64_t)length {
+    return [self.source dataAtOffset:offset length:length];
+}
+
+- (BOOL)writeBytesFromOffset:(uint64_t)offset
+                      length:(uint64_t)length
+            toFileDescriptor:(int)fd
+                       error:(NSError * _Nullable * _Nullable)error {
+    int err = [self.source writeBytesFromOffset:offset length:length toFileDescriptor:fd];
+    if (err) {
+        if (error) {
+            *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:err userInfo:nil];
+        }
+        return NO;
+    }
+    return YES;
+}
+
+- (BOOL)copyBytesFromOffset:(uint64_t)offset
+                     length:(uint64_t)length
+                     toPath:(NSString *)path
+                      error:(NSError * _Nullable * _Nullable)error {
+    // Written next to the destination and renamed, as an atomic write would.
+    NSString *tmpPath = [path stringByAppendingFormat:@".%@", [[NSUUID UUID] UUIDString]];
+    int fd = open(tmpPath.fileSystemRepresentation, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        if (error) {
+            *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+        }
+        return NO;
+    }
+
+    int err = [self.source writeBytesFromOffset:offset length:length toFileDescriptor:fd];
+    if (close(fd) != 0 && !err) {
+        err = errno;
+    }
+    if (!err && rename(tmpPath.fileSystemRepresentation, path.fileSystemRepresentation) != 0) {
+        err = errno;
+    }
+    if (err) {
+        unlink(tmpPath.fileSystemRepresentation);
+        if (error) {
+            *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:err userInfo:nil];
+        }
+        return NO;
+    }
+    return YES;
 }
 
 #pragma mark - Box Parsing
@@ -128,7 +422,7 @@
         return self.cachedTopLevelBoxes;
     }
     
-    self.cachedTopLevelBoxes = [self parseBoxesInRange:NSMakeRange(0, self.data.length)];
+    self.cachedTopLevelBoxes = [self parseBoxesInRange:NSMakeRange(0, self.length)];
     return self.cachedTopLevelBoxes;
 }
 
@@ -152,43 +446,50 @@
 }
 
 - (nullable SeafISOBMFFBox *)parseBoxAtOffset:(uint64_t)offset maxOffset:(uint64_t)maxOffset {
-    if (offset + 8 > maxOffset || offset + 8 > self.data.length) {
+    if (offset + 8 > maxOffset || offset + 8 > self.length) {
         return nil;
     }
     
     SeafISOBMFFBox *box = [[SeafISOBMFFBox alloc] init];
     box.offset = offset;
+    box.source = self.source;
     
     // Read size (4 bytes, big-endian)
     uint32_t size32 = 0;
-    [self.data getBytes:&size32 range:NSMakeRange(offset, 4)];
+    if (![self readBytes:&size32 offset:offset length:4]) {
+        return nil;
+    }
     size32 = CFSwapInt32BigToHost(size32);
     
     // Read type (4 bytes)
     char typeBytes[5] = {0};
-    [self.data getBytes:typeBytes range:NSMakeRange(offset + 4, 4)];
+    if (![self readBytes:typeBytes offset:offset + 4 length:4]) {
+        return nil;
+    }
     box.type = [NSString stringWithUTF8String:typeBytes];
     
     box.headerSize = 8;
     
     if (size32 == 1) {
         // Extended size (64-bit)
-        if (offset + 16 > maxOffset || offset + 16 > self.data.length) {
+        if (offset + 16 > maxOffset || offset + 16 > self.length) {
             return nil;
         }
         uint64_t size64 = 0;
-        [self.data getBytes:&size64 range:NSMakeRange(offset + 8, 8)];
+        if (![self readBytes:&size64 offset:offset + 8 length:8]) {
+            return nil;
+        }
         box.size = CFSwapInt64BigToHost(size64);
         box.headerSize = 16;
     } else if (size32 == 0) {
         // Box extends to end of file
-        box.size = self.data.length - offset;
+        box.size = self.length - offset;
     } else {
         box.size = size32;
     }
     
     // Validate box size
-    if (box.size < box.headerSize || offset + box.size > self.data.length) {
+    if (box.size < box.headerSize || offset + box.size > self.length) {
         // Invalid box, might be at end of parseable content
         return nil;
     }
@@ -309,11 +610,11 @@
     uint64_t payloadOffset = box.payloadOffset;
     uint64_t payloadSize = box.payloadSize;
     
-    if (payloadOffset + payloadSize > self.data.length) {
+    if (payloadOffset + payloadSize > self.length) {
         return nil;
     }
     
-    return [self.data subdataWithRange:NSMakeRange(payloadOffset, payloadSize)];
+    return [self dataAtOffset:payloadOffset length:payloadSize];
 }
 
 #pragma mark - Format Detection
@@ -565,11 +866,11 @@
     uint64_t payloadOffset = ilocBox.offset + ilocBox.headerSize;
     uint64_t payloadSize = ilocBox.size - ilocBox.headerSize;
     
-    if (payloadOffset + payloadSize > self.data.length) {
+    if (payloadOffset + payloadSize > self.length) {
         return nil;
     }
     
-    NSData *payload = [self.data subdataWithRange:NSMakeRange(payloadOffset, payloadSize)];
+    NSData *payload = [self dataAtOffset:payloadOffset length:payloadSize];
     if (payload.length < 8) {
         return nil;
     }
@@ -833,7 +1134,7 @@
     
     // Read version/flags from original
     uint8_t versionFlags[4];
-    [self.data getBytes:versionFlags range:NSMakeRange(metaPayloadStart, 4)];
+    [self readBytes:versionFlags offset:metaPayloadStart length:4];
     
     // Start building meta content
     NSMutableData *metaContent = [NSMutableData data];
@@ -851,11 +1152,11 @@
                 [metaContent appendData:newIlocBox];
             } else {
                 // Fallback to original
-                [metaContent appendData:[self.data subdataWithRange:NSMakeRange(child.offset, child.size)]];
+                [metaContent appendData:[self dataAtOffset:child.offset length:child.size]];
             }
         } else {
             // Copy original child box
-            [metaContent appendData:[self.data subdataWithRange:NSMakeRange(child.offset, child.size)]];
+            [metaContent appendData:[self dataAtOffset:child.offset length:child.size]];
         }
     }
     
@@ -920,11 +1221,11 @@
     uint64_t payloadOffset = iinfBox.offset + iinfBox.headerSize;
     uint64_t payloadSize = iinfBox.size - iinfBox.headerSize;
     
-    if (payloadOffset + payloadSize > self.data.length) {
+    if (payloadOffset + payloadSize > self.length) {
         return nil;
     }
     
-    NSData *payload = [self.data subdataWithRange:NSMakeRange(payloadOffset, payloadSize)];
+    NSData *payload = [self dataAtOffset:payloadOffset length:payloadSize];
     if (payload.length < 6) {
         return nil;
     }
@@ -1207,7 +1508,7 @@
     // Read original version/flags
     uint64_t metaPayloadStart = metaBox.offset + metaBox.headerSize;
     uint8_t versionFlags[4];
-    [self.data getBytes:versionFlags range:NSMakeRange(metaPayloadStart, 4)];
+    [self readBytes:versionFlags offset:metaPayloadStart length:4];
     [metaContent appendBytes:versionFlags length:4];
     
     // Serialize new iinf and iloc
@@ -1222,7 +1523,7 @@
             [metaContent appendData:newIlocBox];
         } else {
             // Copy original child box
-            [metaContent appendData:[self.data subdataWithRange:NSMakeRange(child.offset, child.size)]];
+            [metaContent appendData:[self dataAtOffset:child.offset length:child.size]];
         }
     }
     
@@ -1260,11 +1561,11 @@
     uint64_t payloadOffset = irefBox.offset + irefBox.headerSize;
     uint64_t payloadSize = irefBox.size - irefBox.headerSize;
     
-    if (payloadOffset + payloadSize > self.data.length || payloadSize < 4) {
+    if (payloadOffset + payloadSize > self.length || payloadSize < 4) {
         return nil;
     }
     
-    NSData *payload = [self.data subdataWithRange:NSMakeRange(payloadOffset, payloadSize)];
+    NSData *payload = [self dataAtOffset:payloadOffset length:payloadSize];
     
     // Read version and flags
     uint8_t version;
@@ -1362,20 +1663,20 @@
             uint64_t payloadOffset = child.offset + child.headerSize;
             uint64_t payloadSize = child.size - child.headerSize;
             
-            if (payloadOffset + payloadSize > self.data.length || payloadSize < 6) {
+            if (payloadOffset + payloadSize > self.length || payloadSize < 6) {
                 return 0;
             }
             
             uint8_t version;
-            [self.data getBytes:&version range:NSMakeRange(payloadOffset, 1)];
+            [self readBytes:&version offset:payloadOffset length:1];
             
             if (version == 0) {
                 uint16_t itemID;
-                [self.data getBytes:&itemID range:NSMakeRange(payloadOffset + 4, 2)];
+                [self readBytes:&itemID offset:payloadOffset + 4 length:2];
                 return CFSwapInt16BigToHost(itemID);
             } else {
                 uint32_t itemID;
-                [self.data getBytes:&itemID range:NSMakeRange(payloadOffset + 4, 4)];
+                [self readBytes:&itemID offset:payloadOffset + 4 length:4];
                 return CFSwapInt32BigToHost(itemID);
             }
         }
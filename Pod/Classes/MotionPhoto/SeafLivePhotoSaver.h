@@ -47,6 +47,20 @@ typedef void (^SeafLivePhotoSaveCompletion)(BOOL success, NSError * _Nullable er
 + (void)saveLivePhotoFromData:(NSData *)data
                    completion:(nullable SeafLivePhotoSaveCompletion)completion;
 
+/**
+ * Save a downloaded Motion Photo as an iOS Live Photo, reading its parts where the
+ * Motion Photo index recorded them. Falls back to parsing the file at path.
+ *
+ * @param path Path to the Motion Photo file
+ * @param oid Object id of the file, or nil if not known
+ * @param name File name
+ * @param completion Completion block called when save finishes
+ */
++ (void)saveLivePhotoFromPath:(NSString *)path
+                          oid:(nullable NSString *)oid
+                         name:(NSString *)name
+                   completion:(nullable SeafLivePhotoSaveCompletion)completion;
+
 #pragma mark - Detection Helper
 
 /**
@@ -57,6 +71,17 @@ typedef void (^SeafLivePhotoSaveCompletion)(BOOL success, NSError * _Nullable er
  */
 + (BOOL)canSaveAsLivePhotoAtPath:(NSString *)path;
 
+/**
+ * Check if a downloaded file is a Motion Photo, by looking up the Motion Photo index.
+ * Falls back to parsing the file at path.
+ *
+ * @param path Path to the file
+ * @param oid Object id of the file, or nil if not known
+ * @param name File name
+ * @return YES if the file is a Motion Photo
+ */
++ (BOOL)canSaveAsLivePhotoAtPath:(NSString *)path oid:(nullable NSString *)oid name:(NSString *)name;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -7,6 +7,9 @@
 
 #import "SeafLivePhotoSaver.h"
 #import "SeafMotionPhotoExtractor.h"
+#import "SeafMotionPhotoIndex.h"
+#import "SeafMediaFeatures.h"
+#import "SeafStorage.h"
 #import <Photos/Photos.h>
 #import <AVFoundation/AVFoundation.h>
 #import <ImageIO/ImageIO.h>
@@ -47,6 +50,32 @@
         return;
     }
     
+    [self saveLivePhotoWithImageData:imageData tempVideoPath:tempVideoPath completion:completion];
+}
+
++ (void)saveLivePhotoFromPath:(NSString *)path
+                          oid:(nullable NSString *)oid
+                         name:(NSString *)name
+                   completion:(nullable SeafLivePhotoSaveCompletion)completion {
+    SeafMediaFeatures *features = [self indexedFeaturesForOid:oid name:name];
+    if (features.isMotionPhoto) {
+        // Step 1: Read image and video by range from the object
+        NSString *objectPath = [SeafStorage.sharedObject documentPath:oid];
+        NSData *imageData = [SeafMotionPhotoIndex imageDataAtPath:objectPath features:features];
+        NSString *tempVideoPath = imageData ? [SeafMotionPhotoIndex extractVideoToTempFileAtPath:objectPath features:features] : nil;
+        if (tempVideoPath) {
+            [self saveLivePhotoWithImageData:imageData tempVideoPath:tempVideoPath completion:completion];
+            return;
+        }
+    }
+    
+    [self saveLivePhotoFromPath:path completion:completion];
+}
+
+// Steps 2-5 of saving, once image and video are extracted
++ (void)saveLivePhotoWithImageData:(NSData *)imageData
+                     tempVideoPath:(NSString *)tempVideoPath
+                        completion:(nullable SeafLivePhotoSaveCompletion)completion {
     // Step 2: Generate shared content identifier for Live Photo pairing
     NSString *contentIdentifier = [[NSUUID UUID] UUIDString];
     
@@ -103,8 +132,26 @@
            [SeafMotionPhotoExtractor isMotionPhotoAtPath:path];
 }
 
++ (BOOL)canSaveAsLivePhotoAtPath:(NSString *)path oid:(nullable NSString *)oid name:(NSString *)name {
+    SeafMediaFeatures *features = [self indexedFeaturesForOid:oid name:name];
+    if (features) {
+        return features.isMotionPhoto;
+    }
+    return [self canSaveAsLivePhotoAtPath:path];
+}
+
 #pragma mark - Private Methods
 
+/**
+ * Features of a downloaded object from the Motion Photo index, parsed from the objects directory if not recorded yet.
+ */
++ (nullable SeafMediaFeatures *)indexedFeaturesForOid:(nullable NSString *)oid name:(NSString *)name {
+    if (oid.length == 0) {
+        return nil;
+    }
+    return [SeafMotionPhotoIndex featuresForFileAtPath:[SeafStorage.sharedObject documentPath:oid] oid:oid name:name];
+}
+
 /**
  * Write HEIC image data with Live Photo content identifier metadata.
  */
@@ -70,6 +70,22 @@ NS_ASSUME_NONNULL_BEGIN
 + (nullable NSData *)composeV1V2MotionPhotoWithImageData:(NSData *)imageData
                                                videoData:(NSData *)videoData;
 
+/**
+ * Compose a V1+V2 hybrid Motion Photo from files, straight into the destination file.
+ * Only the box headers and the meta box of the image are read into memory, the image
+ * data and the video are copied a chunk at a time.
+ *
+ * @param imagePath Path of the HEIC image
+ * @param videoPath Path of the MOV video
+ * @param destinationPath Path of the Motion Photo, replaced atomically
+ * @param error Error pointer
+ * @return YES on success, NO on failure
+ */
++ (BOOL)composeV1V2MotionPhotoWithImageAtPath:(NSString *)imagePath
+                                  videoAtPath:(NSString *)videoPath
+                                       toPath:(NSString *)destinationPath
+                                        error:(NSError * _Nullable * _Nullable)error;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -12,6 +12,9 @@
 #import "SeafISOBMFFParser.h"
 #import "SeafVideoConverter.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #pragma mark - Helper Structures
 
 // Structure to track box positions and offsets
@@ -21,6 +24,29 @@ typedef struct {
     uint64_t size;
 } BoxOffsetMapping;
 
+/// A range of the composed file: bytes of a source file, or bytes built for the new file.
+@interface SeafComposeSegment : NSObject
+@property (nonatomic, strong) SeafISOBMFFParser *source;
+@property (nonatomic, assign) uint64_t offset;
+@property (nonatomic, assign) uint64_t length;
+@end
+
+@implementation SeafComposeSegment
+
++ (instancetype)segmentOf:(SeafISOBMFFParser *)source offset:(uint64_t)offset length:(uint64_t)length {
+    SeafComposeSegment *segment = [[SeafComposeSegment alloc] init];
+    segment.source = source;
+    segment.offset = offset;
+    segment.length = length;
+    return segment;
+}
+
++ (instancetype)segmentWithData:(NSData *)data {
+    return [self segmentOf:[[SeafISOBMFFParser alloc] initWithData:data] offset:0 length:data.length];
+}
+
+@end
+
 @implementation SeafMotionPhotoComposer
 
 #pragma mark - Box Creation Methods
@@ -47,23 +73,23 @@ typedef struct {
     return [box copy];
 }
 
-/// Create MPVD (Motion Photo Video Data) box containing the video
+/// Create the header of the MPVD (Motion Photo Video Data) box containing the video
 /// This follows the structure shown in the user's diagram
-+ (NSData *)createMPVDBox:(NSData *)videoData {
++ (NSData *)createMPVDBoxHeaderForVideoLength:(uint64_t)videoLength {
     NSMutableData *box = [NSMutableData data];
     
     // mpvd box structure:
     // - size (4 bytes)
     // - type 'mpvd' (4 bytes)  
-    // - video data (complete MP4/MOV file)
+    // - video data (complete MP4/MOV file), written after this header
     
-    uint32_t boxSize = 8 + (uint32_t)videoData.length;
+    uint32_t boxSize = 8 + (uint32_t)videoLength;
     
     // Use extended size if video is larger than 4GB - 8 bytes
-    if (videoData.length > (UINT32_MAX - 8)) {
+    if (videoLength > (UINT32_MAX - 8)) {
         // Extended size format
         uint32_t sizeBE = CFSwapInt32HostToBig(1); // 1 indicates extended size
-        uint64_t extSizeBE = CFSwapInt64HostToBig(16 + videoData.length);
+        uint64_t extSizeBE = CFSwapInt64HostToBig(16 + videoLength);
         
         [box appendBytes:&sizeBE length:4];
         [box appendBytes:"mpvd" length:4];
@@ -74,8 +100,6 @@ typedef struct {
         [box appendBytes:"mpvd" length:4];
     }
     
-    [box appendData:videoData];
-    
     return [box copy];
 }
 
@@ -206,14 +230,102 @@ typedef struct {
         return nil;
     }
     
-    // Video size for XMP (actual video data size, no mpvd wrapper)
-    NSUInteger videoDataSize = videoData.length;
-    
     // Extract accurate presentation timestamp from video metadata
     // iOS Live Photo videos contain 'com.apple.quicktime.still-image-time' metadata
     // that indicates the exact frame corresponding to the still image
     int64_t presentationTimestampUs = [SeafVideoConverter extractPresentationTimestampFromVideoData:videoData];
     
+    NSArray<SeafComposeSegment *> *segments = [self v1v2SegmentsWithImage:[[SeafISOBMFFParser alloc] initWithData:imageData]
+                                                                     video:[[SeafISOBMFFParser alloc] initWithData:videoData]
+                                                   presentationTimestampUs:presentationTimestampUs];
+    if (!segments) {
+        return nil;
+    }
+    
+    NSMutableData *result = [NSMutableData data];
+    for (SeafComposeSegment *segment in segments) {
+        NSData *data = [segment.source dataAtOffset:segment.offset length:segment.length];
+        if (!data) {
+            return nil;
+        }
+        [result appendData:data];
+    }
+    
+    return [result copy];
+}
+
++ (BOOL)composeV1V2MotionPhotoWithImageAtPath:(NSString *)imagePath
+                                  videoAtPath:(NSString *)videoPath
+                                       toPath:(NSString *)destinationPath
+                                        error:(NSError * _Nullable * _Nullable)error {
+    SeafISOBMFFParser *image = [[SeafISOBMFFParser alloc] initWithPath:imagePath];
+    SeafISOBMFFParser *video = [[SeafISOBMFFParser alloc] initWithPath:videoPath];
+    
+    NSArray<SeafComposeSegment *> *segments = nil;
+    if (image && video &&
+        [self isValidImageDataForComposition:[self headerDataOf:image]] &&
+        [self isValidVideoDataForComposition:[self headerDataOf:video]] &&
+        [self isHEICData:[self headerDataOf:image]]) {
+        int64_t presentationTimestampUs = [SeafVideoConverter extractPresentationTimestampFromVideo:[NSURL fileURLWithPath:videoPath]];
+        segments = [self v1v2SegmentsWithImage:image video:video presentationTimestampUs:presentationTimestampUs];
+    }
+    if (!segments) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"SeafMotionPhotoComposer"
+                                         code:-1
+                                     userInfo:@{NSLocalizedDescriptionKey: @"Failed to compose Motion Photo"}];
+        }
+        return NO;
+    }
+    
+    // Written next to the destination and renamed, as an atomic write would
+    NSString *tmpPath = [destinationPath stringByAppendingFormat:@".%@", [[NSUUID UUID] UUIDString]];
+    int fd = open(tmpPath.fileSystemRepresentation, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        if (error) {
+            *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+        }
+        return NO;
+    }
+    
+    BOOL success = YES;
+    for (SeafComposeSegment *segment in segments) {
+        if (![segment.source writeBytesFromOffset:segment.offset length:segment.length toFileDescriptor:fd error:error]) {
+            success = NO;
+            break;
+        }
+    }
+    if (close(fd) != 0 && success) {
+        success = NO;
+        if (error) {
+            *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+        }
+    }
+    if (success && rename(tmpPath.fileSystemRepresentation, destinationPath.fileSystemRepresentation) != 0) {
+        success = NO;
+        if (error) {
+            *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+        }
+    }
+    if (!success) {
+        unlink(tmpPath.fileSystemRepresentation);
+    }
+    return success;
+}
+
+// Enough of the start of a file for the format checks, which look at the ftyp box
++ (NSData *)headerDataOf:(SeafISOBMFFParser *)parser {
+    return [parser dataAtOffset:0 length:MIN((uint64_t)4096, parser.length)] ?: [NSData data];
+}
+
+/// Lays out the Motion Photo from the box headers and the meta box of the image, which are all that is read.
+/// The image data and the video are referenced by range, to be copied into the new file.
++ (nullable NSArray<SeafComposeSegment *> *)v1v2SegmentsWithImage:(SeafISOBMFFParser *)parser
+                                                             video:(SeafISOBMFFParser *)video
+                                           presentationTimestampUs:(int64_t)presentationTimestampUs {
+    // Video size for XMP (actual video data size, no mpvd wrapper)
+    NSUInteger videoDataSize = (NSUInteger)video.length;
+    
     // Generate XMP metadata in V1+V2 hybrid format
     // This format is compatible with:
     // - V1 readers (via GCamera:MotionPhoto, GCamera:MotionPhotoVersion, MicroVideoOffset)
@@ -224,7 +336,6 @@ typedef struct {
     NSData *xmpData = [xmpString dataUsingEncoding:NSUTF8StringEncoding];
     
     // Parse original HEIC structure
-    SeafISOBMFFParser *parser = [[SeafISOBMFFParser alloc] initWithData:imageData];
     NSArray<SeafISOBMFFBox *> *boxes = [parser parseTopLevelBoxes];
     
     if (boxes.count == 0) {
@@ -363,16 +474,20 @@ typedef struct {
     // Serialize final iloc box
     NSData *newIlocBox = [parser serializeIlocData:ilocData];
     
-    // Build the new file
-    NSMutableData *result = [NSMutableData data];
+    // Lay out the new file
+    NSMutableArray<SeafComposeSegment *> *result = [NSMutableArray array];
     
     // 1. Copy ftyp
-    [result appendData:[imageData subdataWithRange:NSMakeRange(ftypBox.offset, ftypBox.size)]];
+    [result addObject:[SeafComposeSegment segmentOf:parser offset:ftypBox.offset length:ftypBox.size]];
     
     // 2. Build new meta box
     NSMutableData *newMetaContent = [NSMutableData data];
     uint64_t metaPayloadStart = metaBox.offset + metaBox.headerSize;
-    [newMetaContent appendData:[imageData subdataWithRange:NSMakeRange(metaPayloadStart, 4)]];
+    NSData *metaVersionFlags = [parser dataAtOffset:metaPayloadStart length:4];
+    if (!metaVersionFlags) {
+        return nil;
+    }
+    [newMetaContent appendData:metaVersionFlags];
     
     for (SeafISOBMFFBox *child in metaBox.children) {
         if ([child.type isEqualToString:@"iinf"]) {
@@ -383,41 +498,49 @@ typedef struct {
             // Replace iref with updated version containing cdsc reference
             [newMetaContent appendData:newIrefBox];
         } else {
-            [newMetaContent appendData:[imageData subdataWithRange:NSMakeRange(child.offset, child.size)]];
+            NSData *childData = [parser dataAtOffset:child.offset length:child.size];
+            if (!childData) {
+                return nil;
+            }
+            [newMetaContent appendData:childData];
         }
     }
     
+    NSMutableData *newMetaBox = [NSMutableData data];
     uint32_t metaSize = 8 + (uint32_t)newMetaContent.length;
     uint32_t metaSizeBE = CFSwapInt32HostToBig(metaSize);
-    [result appendBytes:&metaSizeBE length:4];
-    [result appendBytes:"meta" length:4];
-    [result appendData:newMetaContent];
+    [newMetaBox appendBytes:&metaSizeBE length:4];
+    [newMetaBox appendBytes:"meta" length:4];
+    [newMetaBox appendData:newMetaContent];
+    [result addObject:[SeafComposeSegment segmentWithData:newMetaBox]];
     
     // 3. Copy boxes between meta and mdat
     for (SeafISOBMFFBox *box in otherBoxes) {
         if (box.offset > metaBox.offset && box.offset < mdatBox.offset) {
-            [result appendData:[imageData subdataWithRange:NSMakeRange(box.offset, box.size)]];
+            [result addObject:[SeafComposeSegment segmentOf:parser offset:box.offset length:box.size]];
         }
     }
     
     // 4. Build new mdat with XMP appended
+    NSMutableData *mdatHeader = [NSMutableData data];
     uint64_t newMdatTotalSize = mdatBox.size + xmpData.length;
     uint32_t mdatSizeBE = CFSwapInt32HostToBig((uint32_t)newMdatTotalSize);
-    [result appendBytes:&mdatSizeBE length:4];
-    [result appendBytes:"mdat" length:4];
-    [result appendData:[imageData subdataWithRange:NSMakeRange(mdatBox.offset + 8, mdatBox.size - 8)]];
-    [result appendData:xmpData];
+    [mdatHeader appendBytes:&mdatSizeBE length:4];
+    [mdatHeader appendBytes:"mdat" length:4];
+    [result addObject:[SeafComposeSegment segmentWithData:mdatHeader]];
+    [result addObject:[SeafComposeSegment segmentOf:parser offset:mdatBox.offset + 8 length:mdatBox.size - 8]];
+    [result addObject:[SeafComposeSegment segmentWithData:xmpData]];
     
     // 5. Copy trailing boxes from original HEIC (if any)
     for (SeafISOBMFFBox *box in otherBoxes) {
         if (box.offset >= mdatBox.offset + mdatBox.size) {
-            [result appendData:[imageData subdataWithRange:NSMakeRange(box.offset, box.size)]];
+            [result addObject:[SeafComposeSegment segmentOf:parser offset:box.offset length:box.size]];
         }
     }
     
     // 6. Append video with mpvd box wrapper
-    NSData *mpvdBox = [self createMPVDBox:videoData];
-    [result appendData:mpvdBox];
+    [result addObject:[SeafComposeSegment segmentWithData:[self createMPVDBoxHeaderForVideoLength:video.length]]];
+    [result addObject:[SeafComposeSegment segmentOf:video offset:0 length:video.length]];
     
     return [result copy];
 }
@@ -11,6 +11,7 @@
 NS_ASSUME_NONNULL_BEGIN
 
 @class SeafMotionPhotoXMP;
+@class SeafISOBMFFParser;
 
 #pragma mark - Android Spec Compliance Types
 
@@ -163,6 +164,7 @@ typedef NS_ENUM(NSInteger, SeafMotionPhotoComplianceStatus) {
 
 /**
  * Extract video from Motion Photo file and save to specified path.
+ * The video is copied from the file by range, without loading the file.
  *
  * @param sourcePath Path to Motion Photo file
  * @param destinationPath Path where video should be saved
@@ -185,6 +187,68 @@ typedef NS_ENUM(NSInteger, SeafMotionPhotoComplianceStatus) {
                                    toPath:(NSString *)destinationPath
                                     error:(NSError * _Nullable * _Nullable)error;
 
+#pragma mark - Parsed Files
+
+/**
+ * Check if the file or data behind a parser is a Motion Photo.
+ * The mpvd box is found from box headers, without reading the rest of the file.
+ *
+ * @param parser Parser over the file or data
+ * @return YES if it appears to be a Motion Photo
+ */
++ (BOOL)isMotionPhotoInParser:(SeafISOBMFFParser *)parser;
+
+/**
+ * Get Motion Photo metadata through a parser.
+ *
+ * @param parser Parser over the file or data
+ * @return XMP metadata object, or nil if not a Motion Photo
+ */
++ (nullable SeafMotionPhotoXMP *)getMotionPhotoInfoInParser:(SeafISOBMFFParser *)parser;
+
+/**
+ * Get the length of the still image at the start of a Motion Photo.
+ *
+ * @param parser Parser over the file or data
+ * @return Image length in bytes, or 0 if not found
+ */
++ (uint64_t)imageLengthInParser:(SeafISOBMFFParser *)parser;
+
+/**
+ * Get the range of the embedded video in a Motion Photo.
+ *
+ * @param parser Parser over the file or data
+ * @param offset Output for the video offset
+ * @param length Output for the video length
+ * @return YES if the video was found
+ */
++ (BOOL)getVideoRangeInParser:(SeafISOBMFFParser *)parser
+                       offset:(uint64_t *)offset
+                       length:(uint64_t *)length;
+
+/**
+ * Get the container brand of a video from its first bytes: the major brand of its ftyp box,
+ * or the type of its first box for legacy QuickTime files.
+ *
+ * @param header At least the first 12 bytes of the video
+ * @return Four character brand, or an empty string if unknown
+ */
++ (NSString *)videoContainerBrandForHeader:(nullable NSData *)header;
+
+/**
+ * Copy a known video range to a temporary file, named for its container brand.
+ *
+ * @param parser Parser over the Motion Photo file
+ * @param offset Video offset
+ * @param length Video length
+ * @param brand Container brand of the video, see videoContainerBrandForHeader:
+ * @return Path to temporary video file, or nil on failure
+ */
++ (nullable NSString *)extractVideoToTempFileFromParser:(SeafISOBMFFParser *)parser
+                                                 offset:(uint64_t)offset
+                                                 length:(uint64_t)length
+                                         containerBrand:(NSString *)brand;
+
 #pragma mark - Debug / Utility
 
 /**
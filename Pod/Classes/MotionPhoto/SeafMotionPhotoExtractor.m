@@ -10,8 +10,13 @@
 #import "Debug.h"
 #import "SeafXMPHandler.h"
 #import "SeafISOBMFFParser.h"
+#import "SeafSignatureScanner.h"
 #import <AVFoundation/AVFoundation.h>
 
+// Video signatures to search for (ftyp + brand): the specific brands come first, the generic marker last
+static NSUInteger const SeafVideoBrandSignatureCount = 7;
+static NSUInteger const SeafVideoGenericSignatureIndex = 8;
+
 @implementation SeafMotionPhotoExtractor
 
 #pragma mark - Detection Methods
@@ -21,21 +26,29 @@
         return NO;
     }
     
-    // Method 1: Check for mpvd box (standard HEIC Motion Photo format)
-    if ([self hasMPVDBox:data]) {
+    return [self isMotionPhotoInParser:[[SeafISOBMFFParser alloc] initWithData:data]];
+}
+
++ (BOOL)isMotionPhotoInParser:(SeafISOBMFFParser *)parser {
+    if (parser.length < 100) {
+        return NO;
+    }
+    
+    // Method 1: Check for mpvd box (standard HEIC Motion Photo format), only box headers are read
+    if ([self findMPVDBoxInParser:parser]) {
         Debug(@"SeafMotionPhotoExtractor: Detected Motion Photo via mpvd box");
         return YES;
     }
     
     // Method 2: Check XMP metadata
-    SeafMotionPhotoXMP *xmp = [SeafXMPHandler parseXMPFromImageData:data];
+    SeafMotionPhotoXMP *xmp = [SeafXMPHandler parseXMPFromImageData:parser.data];
     if (xmp && xmp.isValidMotionPhoto) {
         Debug(@"SeafMotionPhotoExtractor: Detected Motion Photo via XMP metadata");
         return YES;
     }
     
     // Method 3: Search for video signatures in the data (fallback for non-standard formats)
-    if ([self hasEmbeddedVideoSignature:data]) {
+    if ([self hasEmbeddedVideoSignatureInParser:parser]) {
         Debug(@"SeafMotionPhotoExtractor: Detected Motion Photo via video signature");
         return YES;
     }
@@ -49,12 +62,12 @@
         return NO;
     }
     
-    NSData *data = [NSData dataWithContentsOfFile:path];
-    if (!data) {
+    SeafISOBMFFParser *parser = [[SeafISOBMFFParser alloc] initWithPath:path];
+    if (!parser) {
         return NO;
     }
     
-    return [self isMotionPhoto:data];
+    return [self isMotionPhotoInParser:parser];
 }
 
 + (BOOL)mightBeMotionPhotoAtPath:(NSString *)path {
@@ -79,20 +92,12 @@
 
 #pragma mark - MPVD Box Detection (Standard Format)
 
-+ (BOOL)hasMPVDBox:(NSData *)data {
++ (nullable SeafISOBMFFBox *)findMPVDBox:(NSData *)data {
     SeafISOBMFFParser *parser = [[SeafISOBMFFParser alloc] initWithData:data];
-    NSArray<SeafISOBMFFBox *> *boxes = [parser parseTopLevelBoxes];
-    
-    for (SeafISOBMFFBox *box in boxes) {
-        if ([box.type isEqualToString:@"mpvd"]) {
-            return YES;
-        }
-    }
-    return NO;
+    return [self findMPVDBoxInParser:parser];
 }
 
-+ (nullable SeafISOBMFFBox *)findMPVDBox:(NSData *)data {
-    SeafISOBMFFParser *parser = [[SeafISOBMFFParser alloc] initWithData:data];
++ (nullable SeafISOBMFFBox *)findMPVDBoxInParser:(SeafISOBMFFParser *)parser {
     NSArray<SeafISOBMFFBox *> *boxes = [parser parseTopLevelBoxes];
     
     for (SeafISOBMFFBox *box in boxes) {
@@ -103,8 +108,7 @@
     return nil;
 }
 
-+ (nullable SeafISOBMFFBox *)findXMPUuidBox:(NSData *)data {
-    SeafISOBMFFParser *parser = [[SeafISOBMFFParser alloc] initWithData:data];
++ (nullable SeafISOBMFFBox *)findXMPUuidBoxInParser:(SeafISOBMFFParser *)parser {
     NSArray<SeafISOBMFFBox *> *boxes = [parser parseTopLevelBoxes];
     
     // XMP UUID: BE7ACFCB-97A9-42E8-9C71-999491E3AFAC
@@ -118,8 +122,8 @@
             // Check if this is the XMP UUID
             if (box.size >= 24) { // 8 (header) + 16 (UUID)
                 uint8_t boxUUID[16];
-                [data getBytes:boxUUID range:NSMakeRange(box.offset + 8, 16)];
-                if (memcmp(boxUUID, xmpUUID, 16) == 0) {
+                if ([parser readBytes:boxUUID offset:box.offset + 8 length:16] &&
+                    memcmp(boxUUID, xmpUUID, 16) == 0) {
                     return box;
                 }
             }
@@ -130,53 +134,53 @@
 
 #pragma mark - Video Signature Detection (Fallback)
 
-+ (BOOL)hasEmbeddedVideoSignature:(NSData *)data {
-    if (data.length < 100) {
++ (SeafSignatureScanner *)videoSignatureScanner {
+    static SeafSignatureScanner *scanner = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        scanner = [SeafSignatureScanner scannerWithStrings:@[
+            @"ftypisom",
+            @"ftypiso2",
+            @"ftypmp41",
+            @"ftypmp42",
+            @"ftypqt  ",  // QuickTime - used by iOS Live Photo MOV
+            @"ftypM4V ",
+            @"ftypavc1",
+            @"ftypmp4",   // partial match for mp41/mp42
+            @"ftyp"       // generic "ftyp" followed by any brand
+        ]];
+    });
+    return scanner;
+}
+
++ (BOOL)hasEmbeddedVideoSignatureInParser:(SeafISOBMFFParser *)parser {
+    uint64_t length = parser.length;
+    if (length < 100) {
         return NO;
     }
     
-    // Search for video ftyp signatures
-    NSArray *signatures = @[
-        @"ftypisom",
-        @"ftypiso2",
-        @"ftypmp41",
-        @"ftypmp42",
-        @"ftypqt  ",  // QuickTime - used by iOS Live Photo MOV
-        @"ftypM4V ",
-        @"ftypavc1",
-        @"ftypmp4"    // partial match for mp41/mp42
-    ];
-    
     // For Motion Photo, video is appended at the end of the image
     // Minimum image size is around 50KB, so start from there
-    NSUInteger minImageSize = 50 * 1024;
-    NSUInteger searchStart = data.length > minImageSize ? minImageSize : 0;
+    uint64_t minImageSize = 50 * 1024;
+    uint64_t searchStart = length > minImageSize ? minImageSize : 0;
     
     // If file is larger than 10MB, limit search to last 10MB for performance
-    if (data.length > 10 * 1024 * 1024) {
-        searchStart = data.length - 10 * 1024 * 1024;
+    if (length > 10 * 1024 * 1024) {
+        searchStart = length - 10 * 1024 * 1024;
     }
     
-    NSRange searchRange = NSMakeRange(searchStart, data.length - searchStart);
-    
-    for (NSString *sig in signatures) {
-        NSData *sigData = [sig dataUsingEncoding:NSUTF8StringEncoding];
-        NSRange found = [data rangeOfData:sigData options:0 range:searchRange];
-        if (found.location != NSNotFound) {
-            Debug(@"SeafMotionPhotoExtractor: Found video signature '%@' at offset %lu", sig, (unsigned long)found.location);
+    // All signatures are looked for in one pass, which stops at the first hit
+    __block BOOL found = NO;
+    [[self videoSignatureScanner] scanParser:parser fromOffset:searchStart length:length - searchStart handler:^BOOL(NSUInteger patternIndex, uint64_t offset) {
+        if (patternIndex == SeafVideoGenericSignatureIndex && offset < 4) {
             return YES;
         }
-    }
-    
-    // Also check for generic "ftyp" followed by any brand
-    NSData *ftypMarker = [@"ftyp" dataUsingEncoding:NSUTF8StringEncoding];
-    NSRange found = [data rangeOfData:ftypMarker options:0 range:searchRange];
-    if (found.location != NSNotFound && found.location >= 4) {
-        Debug(@"SeafMotionPhotoExtractor: Found generic ftyp marker at offset %lu", (unsigned long)found.location);
-        return YES;
-    }
+        Debug(@"SeafMotionPhotoExtractor: Found video signature at offset %llu", offset);
+        found = YES;
+        return NO;
+    }];
     
-    return NO;
+    return found;
 }
 
 #pragma mark - Information Extraction
@@ -186,18 +190,22 @@
         return nil;
     }
     
+    return [self getMotionPhotoInfoInParser:[[SeafISOBMFFParser alloc] initWithData:data]];
+}
+
++ (nullable SeafMotionPhotoXMP *)getMotionPhotoInfoInParser:(SeafISOBMFFParser *)parser {
     // First check for XMP uuid box at file level
-    SeafISOBMFFBox *xmpBox = [self findXMPUuidBox:data];
+    SeafISOBMFFBox *mpvdBox = [self findMPVDBoxInParser:parser];
+    SeafISOBMFFBox *xmpBox = [self findXMPUuidBoxInParser:parser];
     if (xmpBox) {
         // Extract XMP data from uuid box (after the 16-byte UUID)
-        NSUInteger xmpOffset = xmpBox.offset + 8 + 16; // header(8) + uuid(16)
-        NSUInteger xmpLength = xmpBox.size - 8 - 16;
-        if (xmpOffset + xmpLength <= data.length) {
-            NSData *xmpData = [data subdataWithRange:NSMakeRange(xmpOffset, xmpLength)];
+        uint64_t xmpOffset = xmpBox.offset + 8 + 16; // header(8) + uuid(16)
+        uint64_t xmpLength = xmpBox.size - 8 - 16;
+        NSData *xmpData = [parser dataAtOffset:xmpOffset length:xmpLength];
+        if (xmpData) {
             SeafMotionPhotoXMP *xmp = [SeafXMPHandler parseXMPData:xmpData];
             if (xmp && xmp.isMotionPhoto) {
                 // Also get video length from mpvd box if available
-                SeafISOBMFFBox *mpvdBox = [self findMPVDBox:data];
                 if (mpvdBox) {
                     xmp.videoLength = mpvdBox.size - mpvdBox.headerSize;
                 }
@@ -207,23 +215,23 @@
     }
     
     // Try parsing XMP from image metadata
+    NSData *data = parser.data;
     SeafMotionPhotoXMP *xmp = [SeafXMPHandler parseXMPFromImageData:data];
     
     // If XMP parsing failed but we detect embedded video, create a basic XMP object
     if (!xmp) {
-        BOOL hasVideo = [self hasMPVDBox:data] || [self hasEmbeddedVideoSignature:data];
+        BOOL hasVideo = mpvdBox || [self hasEmbeddedVideoSignatureInParser:parser];
         if (hasVideo) {
             xmp = [[SeafMotionPhotoXMP alloc] init];
             xmp.isMotionPhoto = YES;
             
             // Try to find video length
-            SeafISOBMFFBox *mpvdBox = [self findMPVDBox:data];
             if (mpvdBox) {
                 xmp.videoLength = mpvdBox.size - mpvdBox.headerSize;
             } else {
-                NSUInteger videoOffset = [self findVideoOffsetBySignature:data];
+                NSUInteger videoOffset = [self findVideoOffsetBySignatureInParser:parser];
                 if (videoOffset != NSNotFound) {
-                    xmp.videoLength = data.length - videoOffset;
+                    xmp.videoLength = (NSUInteger)parser.length - videoOffset;
                 }
             }
         }
@@ -233,8 +241,11 @@
 }
 
 + (nullable SeafMotionPhotoXMP *)getMotionPhotoInfoAtPath:(NSString *)path {
-    NSData *data = [NSData dataWithContentsOfFile:path];
-    return [self getMotionPhotoInfo:data];
+    SeafISOBMFFParser *parser = [[SeafISOBMFFParser alloc] initWithPath:path];
+    if (!parser) {
+        return nil;
+    }
+    return [self getMotionPhotoInfoInParser:parser];
 }
 
 + (NSUInteger)getVideoOffsetInMotionPhoto:(NSData *)data {
@@ -278,54 +289,46 @@
 }
 
 + (NSUInteger)findVideoOffsetBySignature:(NSData *)data {
-    if (data.length < 100) {
+    return [self findVideoOffsetBySignatureInParser:[[SeafISOBMFFParser alloc] initWithData:data]];
+}
+
++ (NSUInteger)findVideoOffsetBySignatureInParser:(SeafISOBMFFParser *)parser {
+    uint64_t length = parser.length;
+    if (length < 100) {
         return NSNotFound;
     }
     
-    // Video signatures to search for (ftyp + brand)
-    NSArray *signatures = @[
-        @"ftypisom",
-        @"ftypiso2",
-        @"ftypmp41",
-        @"ftypmp42",
-        @"ftypqt  ",  // QuickTime - iOS Live Photo
-        @"ftypM4V ",
-        @"ftypavc1"
-    ];
-    
     // Minimum image size - start searching after this
-    NSUInteger minImageSize = 50 * 1024;
-    NSUInteger searchStart = data.length > minImageSize ? minImageSize : 0;
-    
-    NSUInteger earliestOffset = NSNotFound;
-    
-    for (NSString *sig in signatures) {
-        NSData *sigData = [sig dataUsingEncoding:NSUTF8StringEncoding];
-        NSRange searchRange = NSMakeRange(searchStart, data.length - searchStart);
-        NSRange found = [data rangeOfData:sigData options:0 range:searchRange];
-        
-        if (found.location != NSNotFound) {
+    uint64_t minImageSize = 50 * 1024;
+    uint64_t searchStart = length > minImageSize ? minImageSize : 0;
+    
+    // Hits come in order of offset, so the first specific brand is the earliest video.
+    // The generic ftyp marker is only used if no specific brand is found.
+    __block NSUInteger earliestOffset = NSNotFound;
+    __block NSUInteger genericOffset = NSNotFound;
+    [[self videoSignatureScanner] scanParser:parser fromOffset:searchStart length:length - searchStart handler:^BOOL(NSUInteger patternIndex, uint64_t offset) {
+        if (patternIndex < SeafVideoBrandSignatureCount) {
             // The ftyp box starts 4 bytes before the "ftyp" string (size field)
-            NSUInteger videoStart = found.location - 4;
-            if (videoStart >= searchStart && videoStart < earliestOffset) {
-                earliestOffset = videoStart;
-                Debug(@"SeafMotionPhotoExtractor: Found video at offset %lu with signature '%@'", 
-                      (unsigned long)videoStart, sig);
+            if (offset >= searchStart + 4) {
+                earliestOffset = (NSUInteger)(offset - 4);
+                Debug(@"SeafMotionPhotoExtractor: Found video at offset %lu with signature '%@'",
+                      (unsigned long)earliestOffset,
+                      [[NSString alloc] initWithData:[self videoSignatureScanner].patterns[patternIndex] encoding:NSUTF8StringEncoding]);
+                return NO;
+            }
+        } else if (patternIndex == SeafVideoGenericSignatureIndex) {
+            if (genericOffset == NSNotFound && offset >= 4) {
+                genericOffset = (NSUInteger)(offset - 4);
             }
         }
-    }
+        return YES;
+    }];
     
-    // If no specific brand found, try generic ftyp search
-    if (earliestOffset == NSNotFound) {
-        NSData *ftypMarker = [@"ftyp" dataUsingEncoding:NSUTF8StringEncoding];
-        NSRange searchRange = NSMakeRange(searchStart, data.length - searchStart);
-        NSRange found = [data rangeOfData:ftypMarker options:0 range:searchRange];
-        
-        if (found.location != NSNotFound && found.location >= 4) {
-            earliestOffset = found.location - 4;
-            Debug(@"SeafMotionPhotoExtractor: Found video at offset %lu with generic ftyp marker", 
-                  (unsigned long)earliestOffset);
-        }
+    // If no specific brand found, use the generic ftyp marker
+    if (earliestOffset == NSNotFound && genericOffset != NSNotFound) {
+        earliestOffset = genericOffset;
+        Debug(@"SeafMotionPhotoExtractor: Found video at offset %lu with generic ftyp marker", 
+              (unsigned long)earliestOffset);
     }
     
     return earliestOffset;
@@ -333,19 +336,15 @@
 
 #pragma mark - Data Extraction
 
-+ (nullable NSData *)extractImageFromMotionPhoto:(NSData *)data {
-    if (!data || data.length < 100) {
-        return nil;
-    }
-    
+// Length of the original image at the start of the file, or 0 if it is not found
++ (uint64_t)imageLengthInParser:(SeafISOBMFFParser *)parser {
     // For standard HEIC Motion Photo format, we need to remove trailing boxes (uuid, mpvd)
     // and return just the original HEIC structure (ftyp + meta + mdat)
-    SeafISOBMFFParser *parser = [[SeafISOBMFFParser alloc] initWithData:data];
     NSArray<SeafISOBMFFBox *> *boxes = [parser parseTopLevelBoxes];
     
     // Find the last original HEIC box (usually mdat or free)
     // Skip uuid (XMP) and mpvd (video) boxes
-    NSUInteger imageEndOffset = 0;
+    uint64_t imageEndOffset = 0;
     
     for (SeafISOBMFFBox *box in boxes) {
         if ([box.type isEqualToString:@"uuid"] || [box.type isEqualToString:@"mpvd"]) {
@@ -355,18 +354,64 @@
         imageEndOffset = box.offset + box.size;
     }
     
-    if (imageEndOffset > 0 && imageEndOffset <= data.length) {
-        Debug(@"SeafMotionPhotoExtractor: Extracting image (0 - %lu bytes)", (unsigned long)imageEndOffset);
-        return [data subdataWithRange:NSMakeRange(0, imageEndOffset)];
+    if (imageEndOffset > 0 && imageEndOffset <= parser.length) {
+        Debug(@"SeafMotionPhotoExtractor: Extracting image (0 - %llu bytes)", imageEndOffset);
+        return imageEndOffset;
     }
     
     // Fallback: use video offset
-    NSUInteger videoOffset = [self getVideoOffsetInMotionPhoto:data];
-    if (videoOffset != NSNotFound && videoOffset > 0) {
-        return [data subdataWithRange:NSMakeRange(0, videoOffset)];
+    uint64_t videoOffset = 0, videoLength = 0;
+    if ([self getVideoRangeInParser:parser offset:&videoOffset length:&videoLength]) {
+        return videoOffset;
     }
     
-    return nil;
+    return 0;
+}
+
+// Range of the embedded video in the file
++ (BOOL)getVideoRangeInParser:(SeafISOBMFFParser *)parser
+                       offset:(uint64_t *)offset
+                       length:(uint64_t *)length {
+    // Method 1: Extract from mpvd box (standard format)
+    SeafISOBMFFBox *mpvdBox = [self findMPVDBoxInParser:parser];
+    if (mpvdBox && mpvdBox.payloadSize > 0) {
+        Debug(@"SeafMotionPhotoExtractor: Extracting video from mpvd box (%llu bytes)", mpvdBox.payloadSize);
+        *offset = mpvdBox.payloadOffset;
+        *length = mpvdBox.payloadSize;
+        return YES;
+    }
+    
+    // Method 2: Fallback - extract from video offset, by XMP metadata or by signature
+    NSUInteger videoOffset = NSNotFound;
+    SeafMotionPhotoXMP *xmp = [self getMotionPhotoInfoInParser:parser];
+    if (xmp && xmp.videoLength > 0) {
+        videoOffset = [xmp videoOffsetInFileOfSize:(NSUInteger)parser.length];
+    } else {
+        videoOffset = [self findVideoOffsetBySignatureInParser:parser];
+    }
+    
+    if (videoOffset != NSNotFound && videoOffset < parser.length) {
+        Debug(@"SeafMotionPhotoExtractor: Extracting video from offset %lu", (unsigned long)videoOffset);
+        *offset = videoOffset;
+        *length = parser.length - videoOffset;
+        return YES;
+    }
+    
+    return NO;
+}
+
++ (nullable NSData *)extractImageFromMotionPhoto:(NSData *)data {
+    if (!data || data.length < 100) {
+        return nil;
+    }
+    
+    SeafISOBMFFParser *parser = [[SeafISOBMFFParser alloc] initWithData:data];
+    uint64_t imageLength = [self imageLengthInParser:parser];
+    if (imageLength == 0) {
+        return nil;
+    }
+    
+    return [data subdataWithRange:NSMakeRange(0, (NSUInteger)imageLength)];
 }
 
 + (nullable NSData *)extractVideoFromMotionPhoto:(NSData *)data {
@@ -374,26 +419,50 @@
         return nil;
     }
     
-    // Method 1: Extract from mpvd box (standard format)
-    SeafISOBMFFBox *mpvdBox = [self findMPVDBox:data];
-    if (mpvdBox) {
-        NSUInteger videoOffset = mpvdBox.offset + mpvdBox.headerSize;
-        NSUInteger videoLength = mpvdBox.size - mpvdBox.headerSize;
-        
-        if (videoOffset + videoLength <= data.length) {
-            Debug(@"SeafMotionPhotoExtractor: Extracting video from mpvd box (%lu bytes)", (unsigned long)videoLength);
-            return [data subdataWithRange:NSMakeRange(videoOffset, videoLength)];
-        }
+    SeafISOBMFFParser *parser = [[SeafISOBMFFParser alloc] initWithData:data];
+    uint64_t videoOffset = 0, videoLength = 0;
+    if (![self getVideoRangeInParser:parser offset:&videoOffset length:&videoLength]) {
+        return nil;
     }
     
-    // Method 2: Fallback - extract from video offset
-    NSUInteger videoOffset = [self getVideoOffsetInMotionPhoto:data];
-    if (videoOffset != NSNotFound && videoOffset < data.length) {
-        Debug(@"SeafMotionPhotoExtractor: Extracting video from offset %lu", (unsigned long)videoOffset);
-        return [data subdataWithRange:NSMakeRange(videoOffset, data.length - videoOffset)];
+    return [data subdataWithRange:NSMakeRange((NSUInteger)videoOffset, (NSUInteger)videoLength)];
+}
+
++ (NSString *)videoContainerBrandForHeader:(nullable NSData *)header {
+    if (header.length < 12) {
+        return @"";
     }
     
-    return nil;
+    char typeBytes[5] = {0};
+    [header getBytes:typeBytes range:NSMakeRange(4, 4)];
+    if (strcmp(typeBytes, "ftyp") == 0) {
+        char brand[5] = {0};
+        [header getBytes:brand range:NSMakeRange(8, 4)];
+        return [[NSString alloc] initWithBytes:brand length:4 encoding:NSASCIIStringEncoding] ?: @"";
+    } else if (strcmp(typeBytes, "moov") == 0 || strcmp(typeBytes, "wide") == 0) {
+        // Legacy QuickTime format
+        return [NSString stringWithUTF8String:typeBytes];
+    }
+    return @"";
+}
+
++ (NSString *)videoExtensionForContainerBrand:(NSString *)brand {
+    if ([@[@"qt  ", @"M4V ", @"moov", @"wide"] containsObject:brand]) {
+        return @"mov";
+    }
+    return @"mp4"; // Default to MP4
+}
+
+// Determine video extension based on format, from the first bytes of the video
++ (NSString *)videoExtensionForHeader:(nullable NSData *)header {
+    return [self videoExtensionForContainerBrand:[self videoContainerBrandForHeader:header]];
+}
+
++ (NSString *)tempVideoPathWithExtension:(NSString *)ext {
+    NSString *tempDir = NSTemporaryDirectory();
+    NSString *filename = [NSString stringWithFormat:@"motion_photo_video_%@.%@",
+                          [[NSUUID UUID] UUIDString], ext];
+    return [tempDir stringByAppendingPathComponent:filename];
 }
 
 + (nullable NSString *)extractVideoToTempFileFromMotionPhoto:(NSData *)data {
@@ -403,28 +472,8 @@
         return nil;
     }
     
-    // Determine video extension based on format
-    NSString *ext = @"mp4"; // Default to MP4
-    if (videoData.length >= 12) {
-        char typeBytes[5] = {0};
-        [videoData getBytes:typeBytes range:NSMakeRange(4, 4)];
-        
-        if (strcmp(typeBytes, "ftyp") == 0) {
-            char brand[5] = {0};
-            [videoData getBytes:brand range:NSMakeRange(8, 4)];
-            if (strcmp(brand, "qt  ") == 0 || strcmp(brand, "M4V ") == 0) {
-                ext = @"mov";
-            }
-        } else if (strcmp(typeBytes, "moov") == 0 || strcmp(typeBytes, "wide") == 0) {
-            ext = @"mov"; // Legacy QuickTime format
-        }
-    }
-    
     // Create temporary file
-    NSString *tempDir = NSTemporaryDirectory();
-    NSString *filename = [NSString stringWithFormat:@"motion_photo_video_%@.%@",
-                          [[NSUUID UUID] UUIDString], ext];
-    NSString *tempPath = [tempDir stringByAppendingPathComponent:filename];
+    NSString *tempPath = [self tempVideoPathWithExtension:[self videoExtensionForHeader:videoData]];
     
     NSError *error = nil;
     if (![videoData writeToFile:tempPath options:NSDataWritingAtomic error:&error]) {
@@ -437,12 +486,33 @@
 }
 
 + (nullable NSString *)extractVideoToTempFileFromMotionPhotoAtPath:(NSString *)sourcePath {
-    NSData *data = [NSData dataWithContentsOfFile:sourcePath];
-    if (!data) {
+    SeafISOBMFFParser *parser = [[SeafISOBMFFParser alloc] initWithPath:sourcePath];
+    uint64_t videoOffset = 0, videoLength = 0;
+    if (!parser || ![self getVideoRangeInParser:parser offset:&videoOffset length:&videoLength]) {
         return nil;
     }
     
-    return [self extractVideoToTempFileFromMotionPhoto:data];
+    NSData *header = [parser dataAtOffset:videoOffset length:MIN((uint64_t)12, videoLength)];
+    return [self extractVideoToTempFileFromParser:parser
+                                           offset:videoOffset
+                                           length:videoLength
+                                   containerBrand:[self videoContainerBrandForHeader:header]];
+}
+
++ (nullable NSString *)extractVideoToTempFileFromParser:(SeafISOBMFFParser *)parser
+                                                 offset:(uint64_t)offset
+                                                 length:(uint64_t)length
+                                         containerBrand:(NSString *)brand {
+    NSString *tempPath = [self tempVideoPathWithExtension:[self videoExtensionForContainerBrand:brand]];
+    
+    NSError *error = nil;
+    if (![parser copyBytesFromOffset:offset length:length toPath:tempPath error:&error]) {
+        Debug(@"SeafMotionPhotoExtractor: Failed to write video to temp file: %@", error);
+        return nil;
+    }
+    
+    Debug(@"SeafMotionPhotoExtractor: Video extracted to temp file: %@", tempPath);
+    return tempPath;
 }
 
 + (BOOL)extractFromMotionPhoto:(NSData *)data
@@ -472,16 +542,15 @@
 
 #pragma mark - File Operations
 
+// The parts are copied from the source file by range, neither the file nor the part is loaded.
+
 + (BOOL)extractVideoFromMotionPhotoAtPath:(NSString *)sourcePath
                                    toPath:(NSString *)destinationPath
                                     error:(NSError * _Nullable * _Nullable)error {
-    NSData *data = [NSData dataWithContentsOfFile:sourcePath options:0 error:error];
-    if (!data) {
-        return NO;
-    }
-    
-    NSData *videoData = [self extractVideoFromMotionPhoto:data];
-    if (!videoData) {
+    SeafISOBMFFParser *parser = [[SeafISOBMFFParser alloc] initWithPath:sourcePath];
+    uint64_t videoOffset = 0, videoLength = 0;
+    if (!parser || parser.length < 100 ||
+        ![self getVideoRangeInParser:parser offset:&videoOffset length:&videoLength]) {
         if (error) {
             *error = [NSError errorWithDomain:@"SeafMotionPhotoExtractor"
                                          code:-1
@@ -490,19 +559,15 @@
         return NO;
     }
     
-    return [videoData writeToFile:destinationPath options:NSDataWritingAtomic error:error];
+    return [parser copyBytesFromOffset:videoOffset length:videoLength toPath:destinationPath error:error];
 }
 
 + (BOOL)extractImageFromMotionPhotoAtPath:(NSString *)sourcePath
                                    toPath:(NSString *)destinationPath
                                     error:(NSError * _Nullable * _Nullable)error {
-    NSData *data = [NSData dataWithContentsOfFile:sourcePath options:0 error:error];
-    if (!data) {
-        return NO;
-    }
-    
-    NSData *imageData = [self extractImageFromMotionPhoto:data];
-    if (!imageData) {
+    SeafISOBMFFParser *parser = [[SeafISOBMFFParser alloc] initWithPath:sourcePath];
+    uint64_t imageLength = (parser && parser.length >= 100) ? [self imageLengthInParser:parser] : 0;
+    if (imageLength == 0) {
         if (error) {
             *error = [NSError errorWithDomain:@"SeafMotionPhotoExtractor"
                                          code:-1
@@ -511,7 +576,7 @@
         return NO;
     }
     
-    return [imageData writeToFile:destinationPath options:NSDataWritingAtomic error:error];
+    return [parser copyBytesFromOffset:0 length:imageLength toPath:destinationPath error:error];
 }
 
 #pragma mark - Debug / Utility
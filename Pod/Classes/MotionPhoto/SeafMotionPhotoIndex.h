@@ -0,0 +1,70 @@
+//
+//  SeafMotionPhotoIndex.h
+//  Seafile
+//
+//  Records which downloaded objects are Motion Photos, and where their parts are.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class SeafMediaFeatures;
+
+/**
+ * Index of the media features of downloaded objects, by object id.
+ *
+ * An object is parsed once, usually right after it was downloaded; later lookups are answered
+ * from memory or from the database, and its parts are read by range from the objects directory.
+ * Records are removed along with the cache entries of their objects.
+ */
+@interface SeafMotionPhotoIndex : NSObject
+
+/**
+ * The recorded features of an object, without parsing it.
+ *
+ * @param oid Object id
+ * @return Features, or nil if the object was not indexed yet
+ */
++ (nullable SeafMediaFeatures *)featuresForOid:(NSString *)oid;
+
+/**
+ * The features of a downloaded object, parsed and recorded on first use.
+ *
+ * @param path Path of the object
+ * @param oid Object id
+ * @param name File name, objects have no extension of their own
+ * @return Features, or nil if the file cannot be read
+ */
++ (nullable SeafMediaFeatures *)featuresForFileAtPath:(NSString *)path oid:(NSString *)oid name:(NSString *)name;
+
+/**
+ * The features of a downloaded object for the main thread: the record is looked up right away,
+ * an object not indexed yet is parsed and recorded on a background queue.
+ *
+ * @param completion Called on the main queue with the features, or nil if the file cannot be read
+ */
++ (void)featuresForFileAtPath:(NSString *)path oid:(NSString *)oid name:(NSString *)name completion:(void (^)(SeafMediaFeatures * _Nullable features))completion;
+
+/**
+ * Parses and records the features of a newly downloaded object on a background queue.
+ */
++ (void)indexFileAtPath:(NSString *)path oid:(NSString *)oid name:(NSString *)name;
+
+/**
+ * Reads the still image of an indexed Motion Photo, without its video.
+ *
+ * @return Image data, or nil on failure
+ */
++ (nullable NSData *)imageDataAtPath:(NSString *)path features:(SeafMediaFeatures *)features;
+
+/**
+ * Copies the video of an indexed Motion Photo to a temporary file.
+ *
+ * @return Path to temporary video file, or nil on failure
+ */
++ (nullable NSString *)extractVideoToTempFileAtPath:(NSString *)path features:(SeafMediaFeatures *)features;
+
+@end
+
+NS_ASSUME_NONNULL_END
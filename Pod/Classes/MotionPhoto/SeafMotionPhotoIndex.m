@@ -0,0 +1,183 @@
+//
+//  SeafMotionPhotoIndex.m
+//  Seafile
+//
+//  Records which downloaded objects are Motion Photos, and where their parts are.
+//
+
+#import "SeafMotionPhotoIndex.h"
+#import "SeafMotionPhotoExtractor.h"
+#import "SeafXMPHandler.h"
+#import "SeafISOBMFFParser.h"
+#import "SeafRealmManager.h"
+#import "Debug.h"
+
+@implementation SeafMotionPhotoIndex
+
+// Detached features by oid, so that paging through a gallery does not query the database
++ (NSCache<NSString *, SeafMediaFeatures *> *)cache {
+    static NSCache *cache;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        cache = [[NSCache alloc] init];
+        cache.countLimit = 1000;
+    });
+    return cache;
+}
+
++ (dispatch_queue_t)queue {
+    static dispatch_queue_t queue;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        queue = dispatch_queue_create("com.seafile.motionPhotoIndex", DISPATCH_QUEUE_SERIAL);
+    });
+    return queue;
+}
+
++ (nullable SeafMediaFeatures *)featuresForOid:(NSString *)oid {
+    if (oid.length == 0) {
+        return nil;
+    }
+    
+    SeafMediaFeatures *features = [self.cache objectForKey:oid];
+    if (!features) {
+        features = [[SeafRealmManager shared] getMediaFeaturesWithOid:oid];
+        if (features) {
+            [self.cache setObject:features forKey:oid];
+        }
+    }
+    return features;
+}
+
++ (nullable SeafMediaFeatures *)featuresForFileAtPath:(NSString *)path oid:(NSString *)oid name:(NSString *)name {
+    SeafMediaFeatures *features = [self featuresForOid:oid];
+    if (features) {
+        return features;
+    }
+    // Not recorded: the name belongs to the file, not to the object, which may be shared by a renamed copy
+    if (![self mayBeMotionPhotoNamed:name]) {
+        return [self plainFeaturesWithOid:oid];
+    }
+    
+    features = [self parseFeaturesOfFileAtPath:path oid:oid name:name];
+    if (!features) {
+        return nil;
+    }
+    
+    // The realm manages the object it is given, keep a detached one
+    [[SeafRealmManager shared] updateMediaFeatures:[[SeafMediaFeatures alloc] initWithValue:features]];
+    [self.cache setObject:features forKey:oid];
+    return features;
+}
+
++ (void)featuresForFileAtPath:(NSString *)path oid:(NSString *)oid name:(NSString *)name completion:(void (^)(SeafMediaFeatures * _Nullable features))completion {
+    SeafMediaFeatures *features = [self featuresForOid:oid];
+    if (features || ![self mayBeMotionPhotoNamed:name]) {
+        completion(features ?: [self plainFeaturesWithOid:oid]);
+        return;
+    }
+    
+    dispatch_async(self.queue, ^{
+        SeafMediaFeatures *parsed;
+        @autoreleasepool {
+            parsed = [self featuresForFileAtPath:path oid:oid name:name];
+        }
+        dispatch_async(dispatch_get_main_queue(), ^{
+            completion(parsed);
+        });
+    });
+}
+
++ (void)indexFileAtPath:(NSString *)path oid:(NSString *)oid name:(NSString *)name {
+    if (oid.length == 0) {
+        return;
+    }
+    
+    dispatch_async(self.queue, ^{
+        @autoreleasepool {
+            [self featuresForFileAtPath:path oid:oid name:name];
+        }
+    });
+}
+
+// Motion Photos are typically HEIC or JPEG
++ (BOOL)mayBeMotionPhotoNamed:(NSString *)name {
+    NSString *ext = name.pathExtension.lowercaseString;
+    return [@[@"heic", @"heif", @"jpg", @"jpeg"] containsObject:ext];
+}
+
++ (SeafMediaFeatures *)plainFeaturesWithOid:(NSString *)oid {
+    SeafMediaFeatures *features = [[SeafMediaFeatures alloc] init];
+    features.oid = oid;
+    return features;
+}
+
+// Parses the file once, through a single parser that reads only what each check needs
++ (nullable SeafMediaFeatures *)parseFeaturesOfFileAtPath:(NSString *)path oid:(NSString *)oid name:(NSString *)name {
+    if (oid.length == 0) {
+        return nil;
+    }
+    
+    SeafMediaFeatures *features = [self plainFeaturesWithOid:oid];
+    
+    SeafISOBMFFParser *parser = [[SeafISOBMFFParser alloc] initWithPath:path];
+    if (!parser) {
+        return nil;
+    }
+    
+    if (![SeafMotionPhotoExtractor isMotionPhotoInParser:parser]) {
+        return features;
+    }
+    
+    uint64_t videoOffset = 0, videoLength = 0;
+    uint64_t imageLength = [SeafMotionPhotoExtractor imageLengthInParser:parser];
+    if (imageLength == 0 || ![SeafMotionPhotoExtractor getVideoRangeInParser:parser offset:&videoOffset length:&videoLength]) {
+        Debug(@"SeafMotionPhotoIndex: %@ has no separable video", name);
+        return features;
+    }
+    
+    features.isMotionPhoto = YES;
+    features.imageLength = (long long)imageLength;
+    features.videoOffset = (long long)videoOffset;
+    features.videoLength = (long long)videoLength;
+    
+    SeafMotionPhotoXMP *xmp = [SeafMotionPhotoExtractor getMotionPhotoInfoInParser:parser];
+    if (xmp) {
+        features.presentationTimestampUs = xmp.presentationTimestampUs;
+    }
+    
+    NSData *header = [parser dataAtOffset:videoOffset length:MIN((uint64_t)12, videoLength)];
+    features.containerBrand = [SeafMotionPhotoExtractor videoContainerBrandForHeader:header];
+    
+    Debug(@"SeafMotionPhotoIndex: %@ is a Motion Photo, video %lld+%lld (%@)", name, features.videoOffset, features.videoLength, features.containerBrand);
+    return features;
+}
+
++ (nullable NSData *)imageDataAtPath:(NSString *)path features:(SeafMediaFeatures *)features {
+    if (!features.isMotionPhoto || features.imageLength <= 0) {
+        return nil;
+    }
+    
+    SeafISOBMFFParser *parser = [[SeafISOBMFFParser alloc] initWithPath:path];
+    if (!parser || (uint64_t)features.imageLength > parser.length) {
+        return nil;
+    }
+    return [parser dataAtOffset:0 length:(uint64_t)features.imageLength];
+}
+
++ (nullable NSString *)extractVideoToTempFileAtPath:(NSString *)path features:(SeafMediaFeatures *)features {
+    if (!features.isMotionPhoto || features.videoLength <= 0) {
+        return nil;
+    }
+    
+    SeafISOBMFFParser *parser = [[SeafISOBMFFParser alloc] initWithPath:path];
+    if (!parser || (uint64_t)(features.videoOffset + features.videoLength) > parser.length) {
+        return nil;
+    }
+    return [SeafMotionPhotoExtractor extractVideoToTempFileFromParser:parser
+                                                               offset:(uint64_t)features.videoOffset
+                                                               length:(uint64_t)features.videoLength
+                                                       containerBrand:features.containerBrand];
+}
+
+@end
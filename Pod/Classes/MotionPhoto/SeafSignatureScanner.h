@@ -0,0 +1,43 @@
+//
+//  SeafSignatureScanner.h
+//  Seafile
+//
+//  Finds several byte signatures in one pass over the data.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class SeafISOBMFFParser;
+
+/// Called with each hit, in order of offset, and of pattern for hits at the same offset. Return NO to stop the scan.
+typedef BOOL (^SeafSignatureHitHandler)(NSUInteger patternIndex, uint64_t offset);
+
+/**
+ * Multi-pattern matcher for short signatures, such as the ftyp brands of an embedded video
+ * or the XMP packet markers. Candidates are found by the first byte of the patterns, with
+ * memchr when they all start with the same byte, and then compared with the patterns
+ * starting with that byte. Immutable, can be used from any thread.
+ */
+@interface SeafSignatureScanner : NSObject
+
+- (instancetype)initWithPatterns:(NSArray<NSData *> *)patterns;
+
+/// Convenience for patterns given as UTF-8 strings.
++ (instancetype)scannerWithStrings:(NSArray<NSString *> *)strings;
+
+@property (nonatomic, readonly) NSArray<NSData *> *patterns;
+
+/// Scan a range of data in memory. Offsets are from the start of data.
+- (void)scanData:(NSData *)data range:(NSRange)range handler:(SeafSignatureHitHandler)handler;
+
+/// Scan a range of a parsed file, read a chunk at a time. Offsets are from the start of the file.
+- (void)scanParser:(SeafISOBMFFParser *)parser
+        fromOffset:(uint64_t)offset
+            length:(uint64_t)length
+           handler:(SeafSignatureHitHandler)handler;
+
+@end
+
+NS_ASSUME_NONNULL_END
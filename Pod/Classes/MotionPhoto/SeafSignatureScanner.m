@@ -0,0 +1,141 @@
+//
+//  SeafSignatureScanner.m
+//  Seafile
+//
+//  Finds several byte signatures in one pass over the data.
+//
+
+#import "SeafSignatureScanner.h"
+#import "SeafISOBMFFParser.h"
+
+// Files are scanned through a buffer of this size.
+static const NSUInteger SeafSignatureScanChunk = 1024 * 1024;
+
+@implementation SeafSignatureScanner {
+    // Indexes of the patterns starting with each byte.
+    NSArray<NSNumber *> *_candidates[256];
+    // The first byte of all patterns, or -1 if they start with different bytes.
+    int _commonFirstByte;
+    NSUInteger _maxLength;
+}
+
+- (instancetype)initWithPatterns:(NSArray<NSData *> *)patterns {
+    self = [super init];
+    if (self) {
+        _patterns = [patterns copy];
+        int commonFirstByte = -1;
+        BOOL mixedFirstBytes = NO;
+        NSMutableArray<NSNumber *> *candidates[256] = {nil};
+        for (NSUInteger i = 0; i < patterns.count; i++) {
+            NSData *pattern = patterns[i];
+            if (pattern.length == 0) {
+                continue;
+            }
+            uint8_t first = ((const uint8_t *)pattern.bytes)[0];
+            if (!candidates[first]) {
+                candidates[first] = [NSMutableArray array];
+            }
+            [candidates[first] addObject:@(i)];
+            if (commonFirstByte < 0) {
+                commonFirstByte = first;
+            } else if (commonFirstByte != first) {
+                mixedFirstBytes = YES;
+            }
+            _maxLength = MAX(_maxLength, pattern.length);
+        }
+        _commonFirstByte = mixedFirstBytes ? -1 : commonFirstByte;
+        for (int b = 0; b < 256; b++) {
+            _candidates[b] = [candidates[b] copy];
+        }
+    }
+    return self;
+}
+
++ (instancetype)scannerWithStrings:(NSArray<NSString *> *)strings {
+    NSMutableArray<NSData *> *patterns = [NSMutableArray arrayWithCapacity:strings.count];
+    for (NSString *string in strings) {
+        [patterns addObject:[string dataUsingEncoding:NSUTF8StringEncoding]];
+    }
+    return [[self alloc] initWithPatterns:patterns];
+}
+
+// Reports the hits starting before startLimit, which must leave room for the longest pattern
+// unless the buffer ends the scanned range. Returns NO if the handler stopped the scan.
+- (BOOL)scanBytes:(const uint8_t *)bytes
+           length:(NSUInteger)length
+       startLimit:(NSUInteger)startLimit
+       baseOffset:(uint64_t)baseOffset
+          handler:(SeafSignatureHitHandler)handler {
+    const uint8_t *p = bytes;
+    const uint8_t *limit = bytes + startLimit;
+    while (p < limit) {
+        if (_commonFirstByte >= 0) {
+            p = memchr(p, _commonFirstByte, limit - p);
+            if (!p) {
+                break;
+            }
+        } else {
+            while (p < limit && !_candidates[*p]) {
+                p++;
+            }
+            if (p == limit) {
+                break;
+            }
+        }
+        NSUInteger at = p - bytes;
+        for (NSNumber *index in _candidates[*p]) {
+            NSData *pattern = _patterns[index.unsignedIntegerValue];
+            if (at + pattern.length <= length && memcmp(p, pattern.bytes, pattern.length) == 0) {
+                if (!handler(index.unsignedIntegerValue, baseOffset + at)) {
+                    return NO;
+                }
+            }
+        }
+        p++;
+    }
+    return YES;
+}
+
+- (void)scanData:(NSData *)data range:(NSRange)range handler:(SeafSignatureHitHandler)handler {
+    if (_maxLength == 0 || NSMaxRange(range) > data.length) {
+        return;
+    }
+    [self scanBytes:(const uint8_t *)data.bytes + range.location
+             length:range.length
+         startLimit:range.length
+         baseOffset:range.location
+            handler:handler];
+}
+
+- (void)scanParser:(SeafISOBMFFParser *)parser
+        fromOffset:(uint64_t)offset
+            length:(uint64_t)length
+           handler:(SeafSignatureHitHandler)handler {
+    if (_maxLength == 0 || offset > parser.length || length > parser.length - offset) {
+        return;
+    }
+    // The last bytes of a chunk are kept for the next one, so that hits across chunks are found.
+    NSUInteger overlap = _maxLength - 1;
+    NSMutableData *buffer = [NSMutableData dataWithLength:(NSUInteger)MIN((uint64_t)SeafSignatureScanChunk, length) + overlap];
+    uint8_t *bytes = buffer.mutableBytes;
+    NSUInteger kept = 0;
+    uint64_t bufferOffset = offset;
+    while (length > 0) {
+        NSUInteger chunk = (NSUInteger)MIN((uint64_t)(buffer.length - kept), length);
+        if (![parser readBytes:bytes + kept offset:offset length:chunk]) {
+            return;
+        }
+        offset += chunk;
+        length -= chunk;
+        NSUInteger filled = kept + chunk;
+        NSUInteger startLimit = length == 0 ? filled : (filled > overlap ? filled - overlap : 0);
+        if (![self scanBytes:bytes length:filled startLimit:startLimit baseOffset:bufferOffset handler:handler]) {
+            return;
+        }
+        kept = filled - startLimit;
+        memmove(bytes, bytes + startLimit, kept);
+        bufferOffset += startLimit;
+    }
+}
+
+@end
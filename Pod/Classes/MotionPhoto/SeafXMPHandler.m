@@ -8,6 +8,7 @@
 #import "SeafXMPHandler.h"
 #import "Debug.h"
 #import "SeafISOBMFFParser.h"
+#import "SeafSignatureScanner.h"
 
 #pragma mark - SeafMotionPhotoXMP Implementation
 
@@ -226,24 +227,32 @@
 }
 
 + (nullable NSData *)searchXMPInRawData:(NSData *)data {
-    // Search for XMP markers in raw data
-    NSData *xmpStartMarker = [@"<x:xmpmeta" dataUsingEncoding:NSUTF8StringEncoding];
-    NSData *xmpEndMarker = [@"</x:xmpmeta>" dataUsingEncoding:NSUTF8StringEncoding];
-    
-    NSRange startRange = [data rangeOfData:xmpStartMarker options:0 range:NSMakeRange(0, data.length)];
-    if (startRange.location == NSNotFound) {
-        return nil;
-    }
-    
-    NSRange searchRange = NSMakeRange(startRange.location, data.length - startRange.location);
-    NSRange endRange = [data rangeOfData:xmpEndMarker options:0 range:searchRange];
+    // Search for XMP markers in raw data, both in one pass
+    static SeafSignatureScanner *scanner = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        scanner = [SeafSignatureScanner scannerWithStrings:@[@"<x:xmpmeta", @"</x:xmpmeta>"]];
+    });
+    
+    __block NSUInteger xmpStart = NSNotFound;
+    __block NSUInteger xmpEnd = NSNotFound;
+    [scanner scanData:data range:NSMakeRange(0, data.length) handler:^BOOL(NSUInteger patternIndex, uint64_t offset) {
+        if (patternIndex == 0) {
+            if (xmpStart == NSNotFound) {
+                xmpStart = (NSUInteger)offset;
+            }
+        } else if (xmpStart != NSNotFound) {
+            xmpEnd = (NSUInteger)offset + scanner.patterns[1].length;
+            return NO;
+        }
+        return YES;
+    }];
     
-    if (endRange.location == NSNotFound) {
+    if (xmpStart == NSNotFound || xmpEnd == NSNotFound) {
         return nil;
     }
     
-    NSUInteger xmpEnd = endRange.location + endRange.length;
-    return [data subdataWithRange:NSMakeRange(startRange.location, xmpEnd - startRange.location)];
+    return [data subdataWithRange:NSMakeRange(xmpStart, xmpEnd - xmpStart)];
 }
 
 + (BOOL)hasMotionPhotoXMP:(NSData *)data {
@@ -7,6 +7,31 @@
 //
 
 #import <Foundation/Foundation.h>
+
+/**
+ * The AES key and IV derived from a repository password, so that the key derivation
+ * only runs once per repository instead of once per encrypted block.
+ */
+@interface SeafRepoKey : NSObject
+
+@property (readonly) int version;///< Encryption version the key was derived for.
+
+/**
+ * Derives the key and IV for an encrypted repository.
+ * @param password The repository password.
+ * @param encKey The encrypted random key of the repository, used by version 2.
+ * @param version The encryption version of the repository.
+ */
+- (instancetype)initWithPassword:(NSString *)password encKey:(NSString *)encKey version:(int)version;
+
+/**
+ * Overwrites the key material, the key cannot be used afterwards.
+ * Called when the key is deallocated, so it is wiped once its last user releases it.
+ */
+- (void)wipe;
+
+@end
+
 /**
     Category on NSData to add encryption and decryption functionalities, alongside other cryptographic utilities.
  */
@@ -30,6 +55,20 @@
  */
 - (NSData *)encrypt:(NSString *)password encKey:(NSString *)encKey version:(int)version;
 
+/**
+ * Decrypts data with an already derived repository key.
+ * @param repoKey The derived repository key.
+ * @return The decrypted version of the NSData, or nil if decryption fails.
+ */
+- (NSData *)decryptWithRepoKey:(SeafRepoKey *)repoKey;
+
+/**
+ * Encrypts data with an already derived repository key.
+ * @param repoKey The derived repository key.
+ * @return The encrypted version of the NSData, or nil if encryption fails.
+ */
+- (NSData *)encryptWithRepoKey:(SeafRepoKey *)repoKey;
+
 /**
  * Computes the SHA-1 hash of this data instance.
  * @return A string representing the SHA-1 hash of the data.
@@ -52,3 +91,25 @@
 - (NSString *)hexString;
 
 @end
+
+/**
+ * Decrypts seafile blocks from disk in fixed-size chunks through a single reused cipher context,
+ * so memory use does not depend on the block size.
+ */
+@interface SeafBlockDecryptor : NSObject
+
+/**
+ * Creates a decryptor for the blocks of a repository.
+ * @param repoKey The derived repository key.
+ */
+- (instancetype)initWithRepoKey:(SeafRepoKey *)repoKey;
+
+/**
+ * Decrypts an encrypted block file and appends the plaintext to the given file handle.
+ * @param path The path of the encrypted block.
+ * @param outfile The file handle the plaintext is written to.
+ * @return YES on success, NO if the block cannot be read or decrypted.
+ */
+- (BOOL)decryptBlockAtPath:(NSString *)path toFileHandle:(NSFileHandle *)outfile;
+
+@end
@@ -16,6 +16,7 @@
 #define DEC_SUCCESS 1
 #define DEC_FAILURE 0
 #define BLK_SIZE 16
+#define DECRYPT_CHUNK_SIZE (64 * 1024)
 
 
 void
@@ -58,6 +59,55 @@ hex_to_rawdata (const char *hex_str, char *rawdata, int n_bytes)
 }
 #include <openssl/evp.h>
 
+@interface NSData (EncryptionKey)
++ (void)generateKey:(NSString *)password version:(int)version encKey:(NSString *)encKey key:(uint8_t *)key iv:(uint8_t *)iv;
+@end
+
+@interface SeafRepoKey ()
+@property (readonly) uint8_t *key;
+@property (readonly) uint8_t *iv;
+@end
+
+@implementation SeafRepoKey
+{
+    uint8_t _key[kCCKeySizeAES256+1];
+    uint8_t _iv[kCCKeySizeAES128+1];
+}
+
+- (instancetype)initWithPassword:(NSString *)password encKey:(NSString *)encKey version:(int)version
+{
+    if (self = [super init]) {
+        _version = version;
+        memset(_key, 0, sizeof(_key));
+        memset(_iv, 0, sizeof(_iv));
+        [NSData generateKey:password version:version encKey:encKey key:_key iv:_iv];
+    }
+    return self;
+}
+
+- (uint8_t *)key
+{
+    return _key;
+}
+
+- (uint8_t *)iv
+{
+    return _iv;
+}
+
+- (void)wipe
+{
+    memset_s(_key, sizeof(_key), 0, sizeof(_key));
+    memset_s(_iv, sizeof(_iv), 0, sizeof(_iv));
+}
+
+- (void)dealloc
+{
+    [self wipe];
+}
+
+@end
+
 @implementation NSData (Encryption)
 
 
@@ -248,6 +298,30 @@ enc_error:
 {
     uint8_t key[kCCKeySizeAES256+1] = {0}, iv[kCCKeySizeAES128+1];
     [NSData generateKey:password version:version encKey:encKey key:key iv:iv];
+    return [self decryptWithKey:key iv:iv version:version];
+}
+
+- (NSData *)encrypt:(NSString *)password encKey:(NSString *)encKey version:(int)version
+{
+    uint8_t key[kCCKeySizeAES256+1] = {0}, iv[kCCKeySizeAES128+1];
+    [NSData generateKey:password version:version encKey:encKey key:key iv:iv];
+    return [self encryptWithKey:key iv:iv version:version];
+}
+
+- (NSData *)decryptWithRepoKey:(SeafRepoKey *)repoKey
+{
+    if (!repoKey) return nil;
+    return [self decryptWithKey:repoKey.key iv:repoKey.iv version:repoKey.version];
+}
+
+- (NSData *)encryptWithRepoKey:(SeafRepoKey *)repoKey
+{
+    if (!repoKey) return nil;
+    return [self encryptWithKey:repoKey.key iv:repoKey.iv version:repoKey.version];
+}
+
+- (NSData *)decryptWithKey:(uint8_t *)key iv:(uint8_t *)iv version:(int)version
+{
     char *data_out = malloc(self.length);
     int outlen;
     int ret = [NSData seafileDecrypt:data_out outlen:&outlen datain:self.bytes inlen:(int)self.length version:version key:key iv:iv];
@@ -258,10 +332,8 @@ enc_error:
     return [NSData dataWithBytesNoCopy:data_out length:outlen];
 }
 
-- (NSData *)encrypt:(NSString *)password encKey:(NSString *)encKey version:(int)version
+- (NSData *)encryptWithKey:(uint8_t *)key iv:(uint8_t *)iv version:(int)version
 {
-    uint8_t key[kCCKeySizeAES256+1] = {0}, iv[kCCKeySizeAES128+1];
-    [NSData generateKey:password version:version encKey:encKey key:key iv:iv];
     char *data_out;
     int outlen;
     int ret = [NSData seafileEncrypt:&data_out outlen:&outlen datain:self.bytes inlen:(int)self.length version:version key:key iv:iv];
@@ -310,3 +382,77 @@ enc_error:
 
 @end
 
+@implementation SeafBlockDecryptor
+{
+    EVP_CIPHER_CTX _ctx;
+    const EVP_CIPHER *_cipher;
+    SeafRepoKey *_repoKey;
+    unsigned char *_inbuf;
+    unsigned char *_outbuf;
+}
+
+- (instancetype)initWithRepoKey:(SeafRepoKey *)repoKey
+{
+    if (self = [super init]) {
+        _repoKey = repoKey;
+        int version = repoKey.version;
+        if (version == 2)
+            _cipher = EVP_aes_256_cbc();
+        else if (version == 1)
+            _cipher = EVP_aes_128_cbc();
+        else
+            _cipher = EVP_aes_128_ecb();
+        EVP_CIPHER_CTX_init (&_ctx);
+        _inbuf = malloc(DECRYPT_CHUNK_SIZE);
+        _outbuf = malloc(DECRYPT_CHUNK_SIZE + BLK_SIZE);
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    EVP_CIPHER_CTX_cleanup (&_ctx);
+    free(_inbuf);
+    free(_outbuf);
+}
+
+- (BOOL)writeBytes:(const void *)bytes length:(int)len toFileHandle:(NSFileHandle *)outfile
+{
+    if (len <= 0) return YES;
+    @try {
+        [outfile writeData:[NSData dataWithBytesNoCopy:(void *)bytes length:len freeWhenDone:NO]];
+    } @catch (NSException *exception) {
+        Warning("Failed to write decrypted data: %@", exception);
+        return NO;
+    }
+    return YES;
+}
+
+- (BOOL)decryptBlockAtPath:(NSString *)path toFileHandle:(NSFileHandle *)outfile
+{
+    if (!_repoKey || !_inbuf || !_outbuf) return NO;
+    FILE *fp = fopen(path.fileSystemRepresentation, "rb");
+    if (!fp) return NO;
+
+    // Every block is encrypted on its own, so the context is re-keyed per block but never reallocated.
+    BOOL ret = EVP_DecryptInit_ex (&_ctx, _cipher, NULL, _repoKey.key, _repoKey.iv) != DEC_FAILURE;
+    int outlen;
+    while (ret) {
+        size_t n = fread(_inbuf, 1, DECRYPT_CHUNK_SIZE, fp);
+        if (n == 0) {
+            ret = !ferror(fp);
+            break;
+        }
+        ret = EVP_DecryptUpdate (&_ctx, _outbuf, &outlen, _inbuf, (int)n) != DEC_FAILURE
+            && [self writeBytes:_outbuf length:outlen toFileHandle:outfile];
+    }
+    fclose(fp);
+    if (!ret) return NO;
+
+    /* Finish the possible partial block and strip the padding. */
+    if (EVP_DecryptFinal_ex (&_ctx, _outbuf, &outlen) == DEC_FAILURE)
+        return NO;
+    return [self writeBytes:_outbuf length:outlen toFileHandle:outfile];
+}
+
+@end
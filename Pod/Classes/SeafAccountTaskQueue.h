@@ -8,6 +8,8 @@
 #import "SeafFile.h"
 #import "SeafThumb.h"
 #import "SeafBaseOperation.h"
+#import "SeafTaskScheduler.h"
+#import "SeafTaskRegistry.h"
 
 @interface SeafAccountTaskQueue : NSObject
 
@@ -16,33 +18,25 @@
 @property (nonatomic, strong) NSOperationQueue * _Nonnull commentImageQueue;
 @property (nonatomic, strong) NSOperationQueue * _Nonnull uploadQueue;
 
-// Arrays for task status
-@property (nonatomic, strong) NSMutableArray<SeafUploadFile *> * _Nullable ongoingTasks;
-@property (nonatomic, strong) NSMutableArray<SeafUploadFile *> * _Nullable waitingTasks;
-@property (nonatomic, strong) NSMutableArray<SeafUploadFile *> * _Nullable cancelledTasks;
-@property (nonatomic, strong) NSMutableArray<SeafUploadFile *> * _Nullable completedSuccessfulTasks;
-@property (nonatomic, strong) NSMutableArray<SeafUploadFile *> * _Nullable completedFailedTasks;
-
-// Array of download task statuses
-@property (nonatomic, strong) NSMutableArray<SeafFile *> * _Nullable ongoingDownloadTasks;
-@property (nonatomic, strong) NSMutableArray<SeafFile *> * _Nullable waitingDownloadTasks;
-@property (nonatomic, strong) NSMutableArray<SeafFile *> * _Nullable cancelledDownloadTasks;
-@property (nonatomic, strong) NSMutableArray<SeafFile *> * _Nullable completedSuccessfulDownloadTasks;
-@property (nonatomic, strong) NSMutableArray<SeafFile *> * _Nullable completedFailedDownloadTasks;
+// Upload and download tasks by state, uploads are keyed by local path and asset identifier
+@property (nonatomic, strong, readonly) SeafTaskRegistry<SeafUploadFile *> * _Nonnull uploadTasks;
+@property (nonatomic, strong, readonly) SeafTaskRegistry<SeafFile *> * _Nonnull downloadTasks;
 
 // keep track of paused tasks
-@property (nonatomic, strong) NSMutableArray<SeafUploadFile *> * _Nullable pausedUploadTasks;
-@property (nonatomic, strong) NSMutableArray<SeafFile *> * _Nullable pausedDownloadTasks;
 @property (nonatomic, strong) NSMutableArray<SeafThumb *> * _Nullable pausedThumbTasks;
 
 @property (nonatomic, assign) BOOL isPaused;
 
 @property (nonatomic, strong) SeafConnection * _Nonnull conn;
 
+@property (nonatomic, strong, readonly) SeafTaskScheduler * _Nonnull scheduler;
+
 - (void)addFileDownloadTask:(SeafFile * _Nonnull)dfile;
 - (void)addFileDownloadTask:(SeafFile * _Nonnull)dfile priority:(NSOperationQueuePriority)priority;
 - (BOOL)addUploadTask:(SeafUploadFile * _Nonnull)ufile;
 - (BOOL)addUploadTask:(SeafUploadFile * _Nonnull)ufile priority:(NSOperationQueuePriority)priority;
+- (void)addFileDownloadTask:(SeafFile * _Nonnull)dfile taskClass:(SeafTaskClass)taskClass;
+- (BOOL)addUploadTask:(SeafUploadFile * _Nonnull)ufile taskClass:(SeafTaskClass)taskClass;
 
 - (void)addThumbTask:(SeafThumb * _Nonnull)thumb;
 
@@ -58,6 +52,8 @@
 
 - (NSArray<SeafUploadFile *> *_Nullable)getNeedUploadTasks;
 - (NSArray<SeafUploadFile *> *_Nullable)getOngoingTasks;
+// Waiting or ongoing upload of a file edited from the object `oid`
+- (SeafUploadFile *_Nullable)pendingEditedUploadForOid:(NSString *_Nullable)oid;
 - (NSArray<SeafUploadFile *> *_Nullable)getWaitingTasks;
 - (NSArray<SeafUploadFile *> *_Nullable)getCancelledTasks;
 - (NSArray<SeafUploadFile *> *_Nullable)getCompletedSuccessfulTasks;
@@ -70,6 +66,9 @@
 - (NSArray<SeafFile *> *_Nullable)getCompletedSuccessfulDownloadTasks;
 - (NSArray<SeafFile *> *_Nullable)getCompletedFailedDownloadTasks;
 
+// Ids of cached objects unfinished uploads and downloads depend on
+- (NSSet<NSString *> *_Nonnull)objectIdsWithPendingChanges;
+
 - (void)cancelAllTasks;
 - (void)cancelAllUploadTasks;
 - (void)cancelAllDownloadTasks;
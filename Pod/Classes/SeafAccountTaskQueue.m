@@ -12,15 +12,24 @@
 #import "SeafAccountTaskQueue.h"
 #import "SeafBase.h"
 #import "SeafDir.h"
+#import "SeafConcurrencyController.h"
 #import "Debug.h"
 
+// Upper bounds of the queue concurrency, SeafConcurrencyController tunes the actual counts.
 #define THUMB_MAX_COUNT 20
 #define UPLOAD_MAX_COUNT 5
 #define DOWNLOAD_MAX_COUNT 5
+#define COMMENT_IMAGE_MAX_COUNT 8
 #define QUEUE_MAX_COUNT 50
 
 
-@interface SeafAccountTaskQueue ()
+@interface SeafAccountTaskQueue () <SeafTaskSchedulerDelegate>
+
+@property (nonatomic, strong) SeafTaskScheduler *scheduler;
+@property (nonatomic, strong) SeafTaskRegistry<SeafUploadFile *> *uploadTasks;
+@property (nonatomic, strong) SeafTaskRegistry<SeafFile *> *downloadTasks;
+// Operations preempted by interactive work, their tasks are added again when the hold ends
+@property (nonatomic, strong) NSMutableArray<SeafBaseOperation *> *preemptedOperations;
 
 @property (nonatomic, strong) dispatch_source_t cleanupTimerSource;  // GCD timer object
 @property (nonatomic, assign) BOOL isCleanupTimerRunning;           // Timer status flag
@@ -33,6 +42,8 @@
 
 @end
 
+static NSString * const SeafEditedFileOidIndex = @"editedFileOid";
+
 @implementation SeafAccountTaskQueue
 
 - (instancetype)init {
@@ -49,31 +60,37 @@
 
         self.commentImageQueue = [[NSOperationQueue alloc] init];
         self.commentImageQueue.name = @"com.seafile.commentImageQueue";
-        self.commentImageQueue.maxConcurrentOperationCount = 8; // 专用评论图并发数
+        self.commentImageQueue.maxConcurrentOperationCount = COMMENT_IMAGE_MAX_COUNT;
         self.commentImageQueue.qualityOfService = NSQualityOfServiceUserInitiated;
         
         self.uploadQueue = [[NSOperationQueue alloc] init];
         self.uploadQueue.name = @"com.seafile.fileUploadQueue";
         self.uploadQueue.maxConcurrentOperationCount = UPLOAD_MAX_COUNT;
+
+        SeafConcurrencyController *controller = [SeafConcurrencyController sharedObject];
+        [controller registerQueue:self.downloadQueue minCount:1 maxCount:DOWNLOAD_MAX_COUNT];
+        [controller registerQueue:self.uploadQueue minCount:1 maxCount:UPLOAD_MAX_COUNT];
+        [controller registerQueue:self.thumbQueue minCount:2 maxCount:THUMB_MAX_COUNT];
         
-        self.ongoingTasks = [NSMutableArray array];
-        self.waitingTasks = [NSMutableArray array];
-        self.cancelledTasks = [NSMutableArray array];
-        self.completedSuccessfulTasks = [NSMutableArray array];
-        self.completedFailedTasks = [NSMutableArray array];
-        
-        // Initialize arrays for download task statuses
-        self.ongoingDownloadTasks = [NSMutableArray array];
-        self.waitingDownloadTasks = [NSMutableArray array];
-        self.cancelledDownloadTasks = [NSMutableArray array];
-        self.completedSuccessfulDownloadTasks = [NSMutableArray array];
-        self.completedFailedDownloadTasks = [NSMutableArray array];
+        // Uploads are keyed by local path, as that is what makes two uploads the same
+        self.uploadTasks = [[SeafTaskRegistry alloc] initWithKeyBlock:^NSString *(SeafUploadFile *ufile) {
+            return ufile.lpath;
+        } secondaryKeyBlock:^NSString *(SeafUploadFile *ufile) {
+            return ufile.assetIdentifier;
+        }];
+        [self.uploadTasks addIndex:SeafEditedFileOidIndex keyBlock:^NSString *(SeafUploadFile *ufile) {
+            return ufile.editedFileOid;
+        }];
+        self.downloadTasks = [[SeafTaskRegistry alloc] initWithKeyBlock:^NSString *(SeafFile *dfile) {
+            return dfile.uniqueKey;
+        } secondaryKeyBlock:nil];
         
-        // Initialize arrays for paused task states
-        self.pausedUploadTasks = [NSMutableArray array];
-        self.pausedDownloadTasks = [NSMutableArray array];
         self.pausedThumbTasks = [NSMutableArray array];
         
+        self.scheduler = [[SeafTaskScheduler alloc] init];
+        self.scheduler.delegate = self;
+        self.preemptedOperations = [NSMutableArray array];
+
         self.pendingUploadTasks = [NSMutableArray array];
         self.maxBatchSize = QUEUE_MAX_COUNT; // Maximum of 50 tasks per batch
         
@@ -92,60 +109,55 @@
 }
 
 - (void)addFileDownloadTask:(SeafFile * _Nonnull)dfile priority:(NSOperationQueuePriority)priority {
+    [self addFileDownloadTask:dfile taskClass:[SeafTaskScheduler downloadClassForPriority:priority]];
+}
+
+- (void)addFileDownloadTask:(SeafFile * _Nonnull)dfile taskClass:(SeafTaskClass)taskClass {
     dfile.state = SEAF_DENTRY_INIT;
-    // Check if the task already exists
-    for (SeafDownloadOperation *op in self.downloadQueue.operations) {
-        if ([op.file isEqual:dfile]) {
-            return;
-        }
-    }
     SeafDownloadOperation *operation = [[SeafDownloadOperation alloc] initWithFile:dfile];
+    // Initial state is waiting to execute, unless the task already exists
+    if (![self.downloadTasks activateTask:dfile operation:operation]) {
+        return;
+    }
     [operation addObserver:self forKeyPath:@"isExecuting" options:NSKeyValueObservingOptionNew context:NULL];
     [operation addObserver:self forKeyPath:@"isFinished" options:NSKeyValueObservingOptionNew context:NULL];
     [operation addObserver:self forKeyPath:@"isCancelled" options:NSKeyValueObservingOptionNew context:NULL];
     operation.observersAdded = YES; // Set to YES after adding observers
-    operation.queuePriority = priority;
-
-    // Initial state is waiting to execute, add to waitingDownloadTasks
-    @synchronized (self.waitingDownloadTasks) {
-        [self.waitingDownloadTasks addObject:dfile];
-    }
     
-    [self.downloadQueue addOperation:operation];
+    [self.scheduler scheduleOperation:operation taskClass:taskClass onQueue:self.downloadQueue];
 }
 
+
 - (BOOL)addUploadTask:(SeafUploadFile * _Nonnull)ufile {
     return [self addUploadTask:ufile priority:NSOperationQueuePriorityNormal];
 }
 
 - (BOOL)addUploadTask:(SeafUploadFile * _Nonnull)ufile priority:(NSOperationQueuePriority)priority {
-    // Check if the task already exists
-    for (SeafUploadOperation *op in self.uploadQueue.operations) {
-        if ([op.uploadFile.lpath isEqual:ufile.lpath]) {
-            return NO;
-        }
-    }
+    return [self addUploadTask:ufile taskClass:[SeafTaskScheduler uploadClassForPriority:priority autoSync:ufile.uploadFileAutoSync]];
+}
+
+- (BOOL)addUploadTask:(SeafUploadFile * _Nonnull)ufile taskClass:(SeafTaskClass)taskClass {
     SeafUploadOperation *operation = [[SeafUploadOperation alloc] initWithUploadFile:ufile];
+    // Initial state is waiting to execute, unless the task already exists
+    if (![self.uploadTasks activateTask:ufile operation:operation]) {
+        return NO;
+    }
     [operation addObserver:self forKeyPath:@"isExecuting" options:NSKeyValueObservingOptionNew context:NULL];
     [operation addObserver:self forKeyPath:@"isFinished" options:NSKeyValueObservingOptionNew context:NULL];
     [operation addObserver:self forKeyPath:@"isCancelled" options:NSKeyValueObservingOptionNew context:NULL];
     operation.observersAdded = YES; // Set to YES after adding observers
-    operation.queuePriority = priority;
-    // Initial state is waiting to execute, add to waitingTasks
-    @synchronized (self.waitingTasks) {
-        [self.waitingTasks addObject:ufile];
-    }
     
-    [self.uploadQueue addOperation:operation];
+    [self.scheduler scheduleOperation:operation taskClass:taskClass onQueue:self.uploadQueue];
     return YES;
 }
 
+
 - (void)addUploadTasksInBatch:(NSArray<SeafUploadFile *> *)tasks {
     @synchronized (self.pendingUploadTasks) {
         [self.pendingUploadTasks addObjectsFromArray:tasks];
     }
     // If there are no ongoing or waiting tasks in uploadQueue, start the next batch
-    if ([self getOngoingTasks].count == 0 && [self getWaitingTasks].count == 0) {
+    if ([self.uploadTasks countOfTasksInState:SeafTaskStateOngoing] == 0 && [self.uploadTasks countOfTasksInState:SeafTaskStateWaiting] == 0) {
         [self startNextBatchOfUploadTasks];
     }
 }
@@ -171,8 +183,8 @@
 }
 
 - (void)tryLoadNextBatchIfNeeded {
-    NSInteger ongoingCount = [self getOngoingTasks].count;
-    NSInteger waitingCount = [self getWaitingTasks].count;
+    NSInteger ongoingCount = [self.uploadTasks countOfTasksInState:SeafTaskStateOngoing];
+    NSInteger waitingCount = [self.uploadTasks countOfTasksInState:SeafTaskStateWaiting];
     
     // If the number of ongoing + waiting tasks is less than 5, load the next batch
     if ((ongoingCount + waitingCount) < 5) {
@@ -184,6 +196,13 @@
 
 - (void)addThumbTask:(SeafThumb * _Nonnull)thumb {
     SeafThumbOperation *operation = [[SeafThumbOperation alloc] initWithSeafFile:thumb.file];
+    __weak SeafThumbOperation *weakOperation = operation;
+    __weak NSOperationQueue *thumbQueue = self.thumbQueue;
+    operation.completionBlock = ^{
+        SeafThumbOperation *op = weakOperation;
+        if (!op || op.isCancelled || op.executionStartTime == 0) return;
+        [[SeafConcurrencyController sharedObject] recordTransferOnQueue:thumbQueue bytes:op.receivedBytes duration:[[NSDate date] timeIntervalSince1970] - op.executionStartTime failed:op.failed];
+    };
     [self.thumbQueue addOperation:operation];
 }
 - (void)cancelAllCommentImageTasks
@@ -217,43 +236,40 @@
         if ([keyPath isEqualToString:@"isExecuting"]) {
             BOOL isExecuting = [[change objectForKey:NSKeyValueChangeNewKey] boolValue];
             if (isExecuting) {
-                // Task started executing, move it from waitingTasks to ongoingTasks
-                [self moveTask:ufile fromArray:self.waitingTasks toArray:self.ongoingTasks];
+                [self.uploadTasks setTask:ufile state:SeafTaskStateOngoing];
             }
         } else if ([keyPath isEqualToString:@"isFinished"]) {
             BOOL isFinished = [[change objectForKey:NSKeyValueChangeNewKey] boolValue];
             if (isFinished) {
-                // Task finished, remove it from ongoingTasks
-                [self removeTask:ufile fromArray:self.ongoingTasks];
-                
-                // Add to success or failure array based on the upload result
+                [self recordTransferOfOperation:operation onQueue:self.uploadQueue bytes:ufile.filesize succeeded:ufile.uploaded];
+
+                // Mark it successful or failed based on the upload result
                 if (ufile.uploaded) {
-                    [self addTask:ufile toArray:self.completedSuccessfulTasks];
+                    [self.uploadTasks setTask:ufile state:SeafTaskStateCompletedSuccessful];
                     
                     // reset errorCode count
                     [self.errorCodeCountDict removeAllObjects];
                     [[SeafDataTaskManager sharedObject] removeUploadFileTaskInStorage:ufile];
 
                 } else {
-                    [self addTask:ufile toArray:self.completedFailedTasks];
+                    [self.uploadTasks setTask:ufile state:SeafTaskStateCompletedFailed];
                     
                     [self handleUploadErrorIfNeeded:ufile.uploadError];
                 }
 
                 // Remove observers
                 [self safelyRemoveObserversFromOperation:operation];
+                [self.scheduler operationDidFinish:operation onQueue:self.uploadQueue];
                 
             }
         } else if ([keyPath isEqualToString:@"isCancelled"]) {
             BOOL isCancelled = [[change objectForKey:NSKeyValueChangeNewKey] boolValue];
             if (isCancelled) {
-                // Task was canceled, remove it from waitingTasks or ongoingTasks and add to cancelledTasks
-                [self removeTask:ufile fromArray:self.waitingTasks];
-                [self removeTask:ufile fromArray:self.ongoingTasks];
-                [self addTask:ufile toArray:self.cancelledTasks];
+                [self.uploadTasks setTask:ufile state:SeafTaskStateCancelled];
 
                 // Remove observers
                 [self safelyRemoveObserversFromOperation:operation];
+                [self.scheduler operationDidFinish:operation onQueue:self.uploadQueue];
             }
         }
         [self postUploadTaskStatusChangedNotification];
@@ -265,49 +281,48 @@
             if ([keyPath isEqualToString:@"isExecuting"]) {
                 BOOL isExecuting = [[change objectForKey:NSKeyValueChangeNewKey] boolValue];
                 if (isExecuting) {
-                    // Task started executing, move it from waitingDownloadTasks to ongoingDownloadTasks
-                    [self moveDownloadTask:dfile fromArray:self.waitingDownloadTasks toArray:self.ongoingDownloadTasks];
+                    [self.downloadTasks setTask:dfile state:SeafTaskStateOngoing];
                 }
             } else if ([keyPath isEqualToString:@"isFinished"]) {
                 BOOL isFinished = [[change objectForKey:NSKeyValueChangeNewKey] boolValue];
                 if (isFinished) {
-                    // Task finished, remove it from ongoingDownloadTasks
-                    [self removeDownloadTask:dfile fromArray:self.ongoingDownloadTasks];
-                    
-                    // Add to success or failure array based on the download result
+                    [self recordTransferOfOperation:operation onQueue:self.downloadQueue bytes:dfile.filesize succeeded:dfile.downloaded];
+
+                    // Mark it successful or failed based on the download result
                     if (dfile.downloaded) {
                         dfile.retryCount = 0; // Reset retry count on success
-                        [self addDownloadTask:dfile toArray:self.completedSuccessfulDownloadTasks];
+                        [self.downloadTasks setTask:dfile state:SeafTaskStateCompletedSuccessful];
                     } else {
                         [self handleDownloadErrorIfNeeded:operation.error];
                         NSInteger fileMaxRetryCount = dfile.retryable ? DEFAULT_RETRYCOUNT : 0;
                         if (self.isPaused) { // If paused due to auth error, add to failed list directly
-                            [self addDownloadTask:dfile toArray:self.completedFailedDownloadTasks];
+                            [self.downloadTasks setTask:dfile state:SeafTaskStateCompletedFailed];
                         } else if (dfile.retryCount < fileMaxRetryCount) {
                             dfile.retryCount++;
+                            // Not tracked until it is added again
+                            [self.downloadTasks removeTask:dfile];
                             Debug(@"Download for %@ failed, will retry %ld/%ld", dfile.name, (long)dfile.retryCount, (long)fileMaxRetryCount);
                             dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(DEFAULT_RETRY_INTERVAL * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-                                [self addFileDownloadTask:dfile];
+                                [self addFileDownloadTask:dfile taskClass:operation.taskClass];
                             });
                         } else {
                             Debug(@"Download for %@ failed after all retries.", dfile.name);
-                            [self addDownloadTask:dfile toArray:self.completedFailedDownloadTasks];
+                            [self.downloadTasks setTask:dfile state:SeafTaskStateCompletedFailed];
                         }
                     }
 
                     // Remove observers
                     [self safelyRemoveObserversFromOperation:operation];
+                    [self.scheduler operationDidFinish:operation onQueue:self.downloadQueue];
                 }
             } else if ([keyPath isEqualToString:@"isCancelled"]) {
                 BOOL isCancelled = [[change objectForKey:NSKeyValueChangeNewKey] boolValue];
                 if (isCancelled) {
-                    // Task was canceled, remove it from waitingDownloadTasks or ongoingDownloadTasks and add to cancelledDownloadTasks
-                    [self removeDownloadTask:dfile fromArray:self.waitingDownloadTasks];
-                    [self removeDownloadTask:dfile fromArray:self.ongoingDownloadTasks];
-                    [self addDownloadTask:dfile toArray:self.cancelledDownloadTasks];
+                    [self.downloadTasks setTask:dfile state:SeafTaskStateCancelled];
                 
                     // Remove observers
                     [self safelyRemoveObserversFromOperation:operation];
+                    [self.scheduler operationDidFinish:operation onQueue:self.downloadQueue];
                 }
             }
             [self postDownloadTaskStatusChangedNotification];
@@ -317,67 +332,70 @@
     }
 }
 
-#pragma mark - Post Notifications
-
-- (void)postUploadTaskStatusChangedNotification {
-    dispatch_async(dispatch_get_main_queue(), ^{
-        [[NSNotificationCenter defaultCenter] postNotificationName:@"SeafUploadTaskStatusChanged" object:self];
-    });
-    [self tryLoadNextBatchIfNeeded];
-}
-
-- (void)postDownloadTaskStatusChangedNotification {
-    dispatch_async(dispatch_get_main_queue(), ^{
-        [[NSNotificationCenter defaultCenter] postNotificationName:@"SeafDownloadTaskStatusChanged" object:self];
-    });
+// Feed the concurrency controller, cancelled operations say nothing about the link.
+- (void)recordTransferOfOperation:(SeafBaseOperation *)operation onQueue:(NSOperationQueue *)queue bytes:(long long)bytes succeeded:(BOOL)succeeded {
+    if (operation.isCancelled || operation.executionStartTime == 0) return;
+    NSTimeInterval duration = [[NSDate date] timeIntervalSince1970] - operation.executionStartTime;
+    [[SeafConcurrencyController sharedObject] recordTransferOnQueue:queue bytes:succeeded ? bytes : 0 duration:duration failed:!succeeded];
 }
 
-#pragma mark - Upload Task Helper Methods
+#pragma mark - SeafTaskSchedulerDelegate
 
-// Remove a task from an array
-- (void)removeTask:(SeafUploadFile *)task fromArray:(NSMutableArray<SeafUploadFile *> *)array {
-    @synchronized (array) {
-        [array removeObject:task];
+- (void)taskScheduler:(SeafTaskScheduler *)scheduler preemptOperation:(SeafBaseOperation *)operation {
+    if (operation.isCancelled || operation.isFinished) return;
+    [self safelyRemoveObserversFromOperation:operation];
+    operation.preempted = YES;
+    [operation cancel];
+    @synchronized (self.preemptedOperations) {
+        [self.preemptedOperations addObject:operation];
+    }
+    if ([operation isKindOfClass:[SeafUploadOperation class]]) {
+        [self.uploadTasks setTask:((SeafUploadOperation *)operation).uploadFile state:SeafTaskStatePaused];
+        [self postUploadTaskStatusChangedNotification];
+    } else if ([operation isKindOfClass:[SeafDownloadOperation class]]) {
+        [self.downloadTasks setTask:((SeafDownloadOperation *)operation).file state:SeafTaskStatePaused];
+        [self postDownloadTaskStatusChangedNotification];
     }
 }
 
-// Move a task from one array to another
-- (void)moveTask:(SeafUploadFile *)task fromArray:(NSMutableArray<SeafUploadFile *> *)fromArray toArray:(NSMutableArray<SeafUploadFile *> *)toArray {
-    [self removeTask:task fromArray:fromArray];
-    [self addTask:task toArray:toArray];
-}
-
-// Add a task to an array
-- (void)addTask:(SeafUploadFile *)task toArray:(NSMutableArray<SeafUploadFile *> *)array {
-    @synchronized (array) {
-        if (![array containsObject:task]) {
-            [array addObject:task];
+- (void)taskSchedulerDidEndHold:(SeafTaskScheduler *)scheduler {
+    NSArray<SeafBaseOperation *> *operations;
+    @synchronized (self.preemptedOperations) {
+        operations = [self.preemptedOperations copy];
+        [self.preemptedOperations removeAllObjects];
+    }
+    for (SeafBaseOperation *operation in operations) {
+        if ([operation isKindOfClass:[SeafUploadOperation class]]) {
+            [self addUploadTask:((SeafUploadOperation *)operation).uploadFile taskClass:operation.taskClass];
+        } else if ([operation isKindOfClass:[SeafDownloadOperation class]]) {
+            [self addFileDownloadTask:((SeafDownloadOperation *)operation).file taskClass:operation.taskClass];
         }
     }
 }
 
-#pragma mark - Download Task Helper Methods
-
-// Remove a download task from an array
-- (void)removeDownloadTask:(SeafFile *)task fromArray:(NSMutableArray<SeafFile *> *)array {
-    @synchronized (array) {
-        [array removeObject:task];
+// Preempted tasks of a cancelled kind must not come back when the hold ends.
+- (void)dropPreemptedOperationsPassingTest:(BOOL (^)(SeafBaseOperation *operation))test {
+    @synchronized (self.preemptedOperations) {
+        NSIndexSet *indexes = [self.preemptedOperations indexesOfObjectsPassingTest:^BOOL(SeafBaseOperation *operation, NSUInteger idx, BOOL *stop) {
+            return test(operation);
+        }];
+        [self.preemptedOperations removeObjectsAtIndexes:indexes];
     }
 }
 
-// Move a download task from one array to another
-- (void)moveDownloadTask:(SeafFile *)task fromArray:(NSMutableArray<SeafFile *> *)fromArray toArray:(NSMutableArray<SeafFile *> *)toArray {
-    [self removeDownloadTask:task fromArray:fromArray];
-    [self addDownloadTask:task toArray:toArray];
+#pragma mark - Post Notifications
+
+- (void)postUploadTaskStatusChangedNotification {
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [[NSNotificationCenter defaultCenter] postNotificationName:@"SeafUploadTaskStatusChanged" object:self];
+    });
+    [self tryLoadNextBatchIfNeeded];
 }
 
-// Add a download task to an array
-- (void)addDownloadTask:(SeafFile *)task toArray:(NSMutableArray<SeafFile *> *)array {
-    @synchronized (array) {
-        if (![array containsObject:task]) {
-            [array addObject:task];
-        }
-    }
+- (void)postDownloadTaskStatusChangedNotification {
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [[NSNotificationCenter defaultCenter] postNotificationName:@"SeafDownloadTaskStatusChanged" object:self];
+    });
 }
 
 #pragma mark - Retrieve Upload Task Status Arrays
@@ -393,36 +411,38 @@
     return allNeedUpLoadTasks;
 }
 
+- (SeafUploadFile *)pendingEditedUploadForOid:(NSString *)oid {
+    if (!oid) return nil;
+    // A waiting upload carries the latest edit, the last one added is the most recent
+    SeafUploadFile *ufile = [self.uploadTasks tasksForKey:oid inIndex:SeafEditedFileOidIndex state:SeafTaskStateWaiting].lastObject;
+    return ufile ?: [self.uploadTasks tasksForKey:oid inIndex:SeafEditedFileOidIndex state:SeafTaskStateOngoing].lastObject;
+}
+
 - (NSArray<SeafUploadFile *> *)getOngoingTasks {
-    @synchronized (self.ongoingTasks) {
-        return [self.ongoingTasks copy];
-    }
+    return [self.uploadTasks tasksInState:SeafTaskStateOngoing];
 }
 
+
 - (NSArray<SeafUploadFile *> *)getWaitingTasks {
-    @synchronized (self.waitingTasks) {
-        return [self.waitingTasks copy];
-    }
+    return [self.uploadTasks tasksInState:SeafTaskStateWaiting];
 }
 
+
 - (NSArray<SeafUploadFile *> *)getCancelledTasks {
-    @synchronized (self.cancelledTasks) {
-        return [self.cancelledTasks copy];
-    }
+    return [self.uploadTasks tasksInState:SeafTaskStateCancelled];
 }
 
+
 - (NSArray<SeafUploadFile *> *)getCompletedSuccessfulTasks {
-    @synchronized (self.completedSuccessfulTasks) {
-        return [self.completedSuccessfulTasks copy];
-    }
+    return [self.uploadTasks tasksInState:SeafTaskStateCompletedSuccessful];
 }
 
+
 - (NSArray<SeafUploadFile *> *)getCompletedFailedTasks {
-    @synchronized (self.completedFailedTasks) {
-        return [self.completedFailedTasks copy];
-    }
+    return [self.uploadTasks tasksInState:SeafTaskStateCompletedFailed];
 }
 
+
 #pragma mark - Retrieve Download Task Status Arrays
 - (NSArray<SeafFile *> *_Nullable)getNeedDownloadTasks {
     NSArray *ongoingTasks = [self getOngoingDownloadTasks];
@@ -437,38 +457,57 @@
 }
 
 - (NSArray<SeafFile *> *)getOngoingDownloadTasks {
-    @synchronized (self.ongoingDownloadTasks) {
-        return [self.ongoingDownloadTasks copy];
-    }
+    return [self.downloadTasks tasksInState:SeafTaskStateOngoing];
 }
 
+
 - (NSArray<SeafFile *> *)getWaitingDownloadTasks {
-    @synchronized (self.waitingDownloadTasks) {
-        return [self.waitingDownloadTasks copy];
-    }
+    return [self.downloadTasks tasksInState:SeafTaskStateWaiting];
 }
 
+
 - (NSArray<SeafFile *> *)getCancelledDownloadTasks {
-    @synchronized (self.cancelledDownloadTasks) {
-        return [self.cancelledDownloadTasks copy];
-    }
+    return [self.downloadTasks tasksInState:SeafTaskStateCancelled];
 }
 
+
 - (NSArray<SeafFile *> *)getCompletedSuccessfulDownloadTasks {
-    @synchronized (self.completedSuccessfulDownloadTasks) {
-        return [self.completedSuccessfulDownloadTasks copy];
-    }
+    return [self.downloadTasks tasksInState:SeafTaskStateCompletedSuccessful];
 }
 
+
 - (NSArray<SeafFile *> *)getCompletedFailedDownloadTasks {
-    @synchronized (self.completedFailedDownloadTasks) {
-        return [self.completedFailedDownloadTasks copy];
-    }
+    return [self.downloadTasks tasksInState:SeafTaskStateCompletedFailed];
 }
 
+
 #pragma mark - Cancel Tasks
 
 // Cancel all tasks
+- (NSSet<NSString *> *)objectIdsWithPendingChanges {
+    NSMutableSet<NSString *> *oids = [NSMutableSet set];
+    NSMutableArray<SeafUploadFile *> *uploads = [NSMutableArray array];
+    for (SeafTaskState state = SeafTaskStateWaiting; state < SEAF_TASK_STATE_COUNT; state++) {
+        if (state != SeafTaskStateCompletedSuccessful && state != SeafTaskStateCancelled) {
+            [uploads addObjectsFromArray:[self.uploadTasks tasksInState:state]];
+        }
+    }
+    @synchronized (self.pendingUploadTasks) {
+        [uploads addObjectsFromArray:self.pendingUploadTasks];
+    }
+    for (SeafUploadFile *ufile in uploads) {
+        if (ufile.isEditedFile && ufile.editedFileOid.length > 0) {
+            [oids addObject:ufile.editedFileOid];
+        }
+    }
+    for (SeafFile *dfile in [self getNeedDownloadTasks]) {
+        if (dfile.ooid.length > 0) {
+            [oids addObject:dfile.ooid];
+        }
+    }
+    return oids;
+}
+
 - (void)cancelAllTasks {
     [self cancelAllUploadTasks];
     [self cancelAllDownloadTasks];
@@ -484,17 +523,14 @@
         [self safelyRemoveObserversFromOperation:op];
         [op cancel];
     }
-    // Clear ongoing and waiting upload task arrays, and move them to cancelledTasks
-    @synchronized (self.ongoingTasks) {
-        [self.cancelledTasks addObjectsFromArray:self.ongoingTasks];
-        [self.ongoingTasks removeAllObjects];
-    }
-    @synchronized (self.waitingTasks) {
-        [self.cancelledTasks addObjectsFromArray:self.waitingTasks];
-        [self.waitingTasks removeAllObjects];
-    }
+    // Move ongoing and waiting upload tasks to cancelled
+    [self.uploadTasks moveAllTasksInState:SeafTaskStateOngoing toState:SeafTaskStateCancelled];
+    [self.uploadTasks moveAllTasksInState:SeafTaskStateWaiting toState:SeafTaskStateCancelled];
     
     [self.pendingUploadTasks removeAllObjects];
+    [self dropPreemptedOperationsPassingTest:^BOOL(SeafBaseOperation *operation) {
+        return [operation isKindOfClass:[SeafUploadOperation class]];
+    }];
     
     [self.uploadQueue setSuspended:NO];
 
@@ -510,15 +546,12 @@
         [self safelyRemoveObserversFromOperation:op];
         [op cancel];
     }
-    // Clear ongoing and waiting download task arrays, and move them to cancelledDownloadTasks
-    @synchronized (self.ongoingDownloadTasks) {
-        [self.cancelledDownloadTasks addObjectsFromArray:self.ongoingDownloadTasks];
-        [self.ongoingDownloadTasks removeAllObjects];
-    }
-    @synchronized (self.waitingDownloadTasks) {
-        [self.cancelledDownloadTasks addObjectsFromArray:self.waitingDownloadTasks];
-        [self.waitingDownloadTasks removeAllObjects];
-    }
+    // Move ongoing and waiting download tasks to cancelled
+    [self.downloadTasks moveAllTasksInState:SeafTaskStateOngoing toState:SeafTaskStateCancelled];
+    [self.downloadTasks moveAllTasksInState:SeafTaskStateWaiting toState:SeafTaskStateCancelled];
+    [self dropPreemptedOperationsPassingTest:^BOOL(SeafBaseOperation *operation) {
+        return [operation isKindOfClass:[SeafDownloadOperation class]];
+    }];
     
     [self.downloadQueue setSuspended:NO];
 
@@ -530,42 +563,22 @@
     // Pause the upload queue to ensure no tasks execute during the operation
     [self.uploadQueue setSuspended:YES];
 
-    // Convert the localAssetIdentifiers array to a set for fast lookup
     NSSet *identifierSet = [NSSet setWithArray:localAssetIdentifiers];
 
-    // Prepare an array to collect tasks to be canceled
-    NSMutableArray<SeafUploadFile *> *tasksToCancel = [NSMutableArray array];
-    
-    // Iterate through all operations in the upload queue
-    for (SeafUploadOperation *op in self.uploadQueue.operations) {
-        SeafUploadFile *ufile = op.uploadFile;
-        // Check if the task's assetIdentifier exists in the specified set
-        if ([identifierSet containsObject:ufile.assetIdentifier]) {
-            // Remove observers and cancel the task
-            [self safelyRemoveObserversFromOperation:op];
-            [op cancel];
-            
-            [tasksToCancel addObject:ufile];
-        }
-    }
-
-    // Remove matching tasks from ongoingTasks and move to cancelledTasks
-    @synchronized (self.ongoingTasks) {
-        for (SeafUploadFile *ufile in tasksToCancel) {
-            if ([self.ongoingTasks containsObject:ufile]) {
-                [self.ongoingTasks removeObject:ufile];
-                [self.cancelledTasks addObject:ufile];
+    // Look up the tasks of each asset instead of scanning the queue
+    for (NSString *identifier in identifierSet) {
+        for (SeafUploadFile *ufile in [self.uploadTasks tasksForSecondaryKey:identifier]) {
+            SeafTaskState state;
+            if (![self.uploadTasks getState:&state ofTask:ufile] || (state != SeafTaskStateWaiting && state != SeafTaskStateOngoing)) {
+                continue;
             }
-        }
-    }
-
-    // Remove matching tasks from waitingTasks and move to cancelledTasks
-    @synchronized (self.waitingTasks) {
-        for (SeafUploadFile *ufile in tasksToCancel) {
-            if ([self.waitingTasks containsObject:ufile]) {
-                [self.waitingTasks removeObject:ufile];
-                [self.cancelledTasks addObject:ufile];
+            SeafUploadOperation *op = (SeafUploadOperation *)[self.uploadTasks operationForTask:ufile];
+            if (op) {
+                // Remove observers and cancel the task
+                [self safelyRemoveObserversFromOperation:op];
+                [op cancel];
             }
+            [self.uploadTasks setTask:ufile state:SeafTaskStateCancelled];
         }
     }
     
@@ -578,6 +591,9 @@
             }
         }
     }
+    [self dropPreemptedOperationsPassingTest:^BOOL(SeafBaseOperation *operation) {
+        return [operation isKindOfClass:[SeafUploadOperation class]] && [identifierSet containsObject:((SeafUploadOperation *)operation).uploadFile.assetIdentifier];
+    }];
     // Resume the upload queue
     [self.uploadQueue setSuspended:NO];
 
@@ -586,23 +602,15 @@
 }
 
 - (void)removeFileDownloadTask:(SeafFile * _Nonnull)dfile {
-    for (SeafDownloadOperation *op in self.downloadQueue.operations) {
-        if ([op.file isEqual:dfile]) {
-            [op cancel];
-            break;
-        }
-    }
+    [[self.downloadTasks operationForTask:dfile] cancel];
 }
 
+
 - (void)removeUploadTask:(SeafUploadFile * _Nonnull)ufile {
-    for (SeafUploadOperation *op in self.uploadQueue.operations) {
-        if ([op.uploadFile isEqual:ufile]) {
-            [op cancel];
-            break;
-        }
-    }
+    [[self.uploadTasks operationForTask:ufile] cancel];
 }
 
+
 - (void)removeThumbTask:(SeafThumb * _Nonnull)thumb {
     for (SeafThumbOperation *op in self.thumbQueue.operations) {
         if ([op.file.oid isEqual:thumb.file.oid]) {
@@ -621,36 +629,22 @@
 }
 
 - (void)cancelAutoSyncTasksWithoutSuspend {
-    NSMutableArray<SeafUploadFile *> *tasksToCancel = [NSMutableArray array];
-    
-    // Collect tasks that need to be canceled
-    NSArray *taskArrays = @[self.ongoingTasks, self.waitingTasks];
-    for (NSMutableArray<SeafUploadFile *> *taskArray in taskArrays) {
-        for (SeafUploadFile *ufile in taskArray) {
-            if (ufile.uploadFileAutoSync && ufile.udir.connection == self.conn) {
-                [tasksToCancel addObject:ufile];
+    NSArray<SeafUploadFile *> *activeTasks = [self getNeedUploadTasks];
+    for (SeafUploadFile *ufile in activeTasks) {
+        if (ufile.uploadFileAutoSync && ufile.udir.connection == self.conn) {
+            SeafUploadOperation *op = (SeafUploadOperation *)[self.uploadTasks operationForTask:ufile];
+            if (op) {
+                [self safelyRemoveObserversFromOperation:op];
+                [op cancel];
             }
+            [self.uploadTasks removeTask:ufile];
         }
     }
     
-    // Create a mapping table using ufile.lpath as the key
-    NSMutableDictionary<NSString *, SeafUploadOperation *> *operationMap = [NSMutableDictionary dictionary];
-    for (SeafUploadOperation *op in self.uploadQueue.operations) {
-        if (op.uploadFile && op.uploadFile.lpath) {
-            operationMap[op.uploadFile.lpath] = op;
-        }
-    }
-    
-    // Cancel tasks and update task arrays
-    for (SeafUploadFile *ufile in tasksToCancel) {
-        SeafUploadOperation *op = operationMap[ufile.lpath];
-        if (op) {
-            [self safelyRemoveObserversFromOperation:op];
-            [op cancel];
-        }
-        [self removeTask:ufile fromArray:self.ongoingTasks];
-        [self removeTask:ufile fromArray:self.waitingTasks];
-    }
+    [self dropPreemptedOperationsPassingTest:^BOOL(SeafBaseOperation *operation) {
+        SeafUploadFile *ufile = [operation isKindOfClass:[SeafUploadOperation class]] ? ((SeafUploadOperation *)operation).uploadFile : nil;
+        return ufile.uploadFileAutoSync && ufile.udir.connection == self.conn;
+    }];
     
     @synchronized(self.pendingUploadTasks) {
         for (NSInteger i = self.pendingUploadTasks.count - 1; i >= 0; i--) {
@@ -667,44 +661,23 @@
 - (void)cancelAutoSyncVideoTasks {
     [self.uploadQueue setSuspended:YES];
 
-    // Iterate through ongoingTasks
-    @synchronized (self.ongoingTasks) {
-        NSArray *ongoingTasksCopy = [self.ongoingTasks copy];
-        for (SeafUploadFile *ufile in ongoingTasksCopy) {
-            if (ufile.uploadFileAutoSync && ufile.udir.connection == self.conn && !ufile.isImageFile) {
-                // Find the corresponding SeafUploadOperation
-                for (SeafUploadOperation *op in self.uploadQueue.operations) {
-                    if (op.uploadFile == ufile) {
-                        [self safelyRemoveObserversFromOperation:op];
-                        [op cancel];
-                        break;
-                    }
-                }
-                // Remove from ongoingTasks and add to cancelledTasks
-                [self removeTask:ufile fromArray:self.ongoingTasks];
-            }
-        }
-    }
-
-    // Iterate through waitingTasks
-    @synchronized (self.waitingTasks) {
-        NSArray *waitingTasksCopy = [self.waitingTasks copy];
-        for (SeafUploadFile *ufile in waitingTasksCopy) {
-            if (ufile.uploadFileAutoSync && ufile.udir.connection == self.conn && !ufile.isImageFile) {
-                // Find the corresponding SeafUploadOperation
-                for (SeafUploadOperation *op in self.uploadQueue.operations) {
-                    if (op.uploadFile == ufile) {
-                        [self safelyRemoveObserversFromOperation:op];
-                        [op cancel];
-                        break;
-                    }
-                }
-                // Remove from waitingTasks and add to cancelledTasks
-                [self removeTask:ufile fromArray:self.waitingTasks];
+    NSArray<SeafUploadFile *> *activeTasks = [self getNeedUploadTasks];
+    for (SeafUploadFile *ufile in activeTasks) {
+        if (ufile.uploadFileAutoSync && ufile.udir.connection == self.conn && !ufile.isImageFile) {
+            SeafUploadOperation *op = (SeafUploadOperation *)[self.uploadTasks operationForTask:ufile];
+            if (op) {
+                [self safelyRemoveObserversFromOperation:op];
+                [op cancel];
             }
+            [self.uploadTasks removeTask:ufile];
         }
     }
     
+    [self dropPreemptedOperationsPassingTest:^BOOL(SeafBaseOperation *operation) {
+        SeafUploadFile *ufile = [operation isKindOfClass:[SeafUploadOperation class]] ? ((SeafUploadOperation *)operation).uploadFile : nil;
+        return ufile.uploadFileAutoSync && ufile.udir.connection == self.conn && !ufile.isImageFile;
+    }];
+    
     @synchronized(self.pendingUploadTasks) {
         for (NSInteger i = self.pendingUploadTasks.count - 1; i >= 0; i--) {
             SeafUploadFile *ufile = self.pendingUploadTasks[i];
@@ -794,19 +767,13 @@
             [op cancel];
             SeafUploadFile *ufile = op.uploadFile;
             if (ufile) { // Ensure ufile is not nil
-                @synchronized (self.pausedUploadTasks) {
-                    if (![self.pausedUploadTasks containsObject:ufile]) { // Avoid duplicates
-                        [self.pausedUploadTasks addObject:ufile];
-                    }
-                }
+                [self.uploadTasks setTask:ufile state:SeafTaskStatePaused];
             }
         }
     }
     
     // Clear ongoing tasks as they are now either cancelled (and moved to paused) or were not executing.
-    @synchronized (self.ongoingTasks) {
-        [self.ongoingTasks removeAllObjects];
-    }
+    [self.uploadTasks removeAllTasksInState:SeafTaskStateOngoing];
     [self postUploadTaskStatusChangedNotification];
 }
 
@@ -819,18 +786,12 @@
             [op cancel];
             SeafFile *dfile = op.file;
             if (dfile) {
-                @synchronized (self.pausedDownloadTasks) {
-                    if (![self.pausedDownloadTasks containsObject:dfile]) {
-                        [self.pausedDownloadTasks addObject:dfile];
-                    }
-                }
+                [self.downloadTasks setTask:dfile state:SeafTaskStatePaused];
             }
         }
     }
     
-    @synchronized (self.ongoingDownloadTasks) {
-        [self.ongoingDownloadTasks removeAllObjects];
-    }
+    [self.downloadTasks removeAllTasksInState:SeafTaskStateOngoing];
     
     [self postDownloadTaskStatusChangedNotification];
 }
@@ -864,17 +825,12 @@
         if (op.isExecuting) {
             [self safelyRemoveObserversFromOperation:op];
             [op cancel];
-            SeafUploadFile *ufile = op.uploadFile;
-            @synchronized (self.pausedUploadTasks) {
-                [self.pausedUploadTasks addObject:ufile];
-            }
+            [self.uploadTasks setTask:op.uploadFile state:SeafTaskStatePaused];
         }
     }
 
-    // Clear the ongoing tasks array (to avoid duplication with pausedUploadTasks)
-    @synchronized (self.ongoingTasks) {
-        [self.ongoingTasks removeAllObjects];
-    }
+    // Clear the remaining ongoing tasks
+    [self.uploadTasks removeAllTasksInState:SeafTaskStateOngoing];
     
     Debug(@"[pauseUploadTasks] All upload tasks has been paused。");
     
@@ -898,14 +854,13 @@
     }
     
     BOOL shouldResumeQueue = NO;
-    @synchronized (self.pausedUploadTasks) {
-        if (self.pausedUploadTasks.count > 0) {
-            for (SeafUploadFile *ufile in self.pausedUploadTasks) {
-                [self addUploadTask:ufile];
-            }
-            [self.pausedUploadTasks removeAllObjects];
-            shouldResumeQueue = YES; // Mark that we've processed paused tasks
+    NSArray<SeafUploadFile *> *pausedTasks = [self.uploadTasks tasksInState:SeafTaskStatePaused];
+    if (pausedTasks.count > 0) {
+        // Adding a task again moves it from paused to waiting
+        for (SeafUploadFile *ufile in pausedTasks) {
+            [self addUploadTask:ufile];
         }
+        shouldResumeQueue = YES; // Mark that we've processed paused tasks
     }
 
     // Resume the upload queue only if it was previously suspended by this specific logic
@@ -940,22 +895,16 @@
         return;
     }
 
-    @synchronized (self.pausedUploadTasks) {
-        for (SeafUploadFile *ufile in self.pausedUploadTasks) {
-            [self addUploadTask:ufile];
-        }
-        [self.pausedUploadTasks removeAllObjects];
+    for (SeafUploadFile *ufile in [self.uploadTasks tasksInState:SeafTaskStatePaused]) {
+        [self addUploadTask:ufile];
     }
 }
 
 /// Resumes all paused download tasks.
 - (void)resumePausedDownloadTasks {
     // No wifiOnly check here, downloads should resume if network is generally available.
-    @synchronized (self.pausedDownloadTasks) {
-        for (SeafFile *dfile in self.pausedDownloadTasks) {
-            [self addFileDownloadTask:dfile];
-        }
-        [self.pausedDownloadTasks removeAllObjects];
+    for (SeafFile *dfile in [self.downloadTasks tasksInState:SeafTaskStatePaused]) {
+        [self addFileDownloadTask:dfile];
     }
 }
 
@@ -1002,7 +951,7 @@
             return;
         }
         
-        if (self.conn && self.conn.photoBackup && self.conn.photoBackup.photosArray.count > 0 && self.ongoingTasks.count == 0 && self.waitingTasks.count == 0) {
+        if (self.conn && self.conn.photoBackup && self.conn.photoBackup.photosArray.count > 0 && [self.uploadTasks countOfTasksInState:SeafTaskStateOngoing] == 0 && [self.uploadTasks countOfTasksInState:SeafTaskStateWaiting] == 0) {
             NSNotification *note = [NSNotification notificationWithName:@"photosDidChange" object:nil userInfo:@{@"force" : @(YES)}];
             [self.conn photosDidChange:note];
         }
@@ -1010,45 +959,30 @@
 }
 
 - (void)removeOldCompletedTasks {
-    NSMutableArray *tempSuccessfulDownloadTasks = [NSMutableArray array];
-    NSMutableArray *tempSuccessfulTasks = [NSMutableArray array];
-
-    NSTimeInterval currentTimestamp = [[NSDate date] timeIntervalSince1970];
-
-    @synchronized (self.completedSuccessfulDownloadTasks) {
-        NSArray *copyArray = [NSArray arrayWithArray:self.completedSuccessfulDownloadTasks];
-        for (id<SeafTask> task in copyArray) {
-            if (currentTimestamp - task.lastFinishTimestamp > DEFAULT_COMPLELE_INTERVAL) {
-                [tempSuccessfulDownloadTasks addObject:task];
-                if ([task respondsToSelector:@selector(cleanup)]) {
-                    [task cleanup];
-                }
-            }
-        }
-        
-        if (tempSuccessfulDownloadTasks.count > 0) {
-            [self.completedSuccessfulDownloadTasks removeObjectsInArray:tempSuccessfulDownloadTasks];
-            [self postDownloadTaskStatusChangedNotification];
-        }
+    if ([self removeOldTasksInState:SeafTaskStateCompletedSuccessful ofRegistry:self.downloadTasks]) {
+        [self postDownloadTaskStatusChangedNotification];
+    }
+    if ([self removeOldTasksInState:SeafTaskStateCompletedSuccessful ofRegistry:self.uploadTasks]) {
+        [self postUploadTaskStatusChangedNotification];
     }
+}
 
-    @synchronized (self.completedSuccessfulTasks) {
-        NSArray *copyArray = [NSArray arrayWithArray:self.completedSuccessfulTasks];
-        for (id<SeafTask> task in copyArray) {
-            if (currentTimestamp - task.lastFinishTimestamp > DEFAULT_COMPLELE_INTERVAL) {
-                [tempSuccessfulTasks addObject:task];
-                if ([task respondsToSelector:@selector(cleanup)]) {
-                    [task cleanup];
-                }
+- (BOOL)removeOldTasksInState:(SeafTaskState)state ofRegistry:(SeafTaskRegistry *)registry {
+    NSTimeInterval currentTimestamp = [[NSDate date] timeIntervalSince1970];
+    BOOL removed = NO;
+    for (id<SeafTask> task in [registry tasksInState:state]) {
+        if (currentTimestamp - task.lastFinishTimestamp > DEFAULT_COMPLELE_INTERVAL) {
+            if ([task respondsToSelector:@selector(cleanup)]) {
+                [task cleanup];
             }
-        }
-        if (tempSuccessfulTasks.count > 0) {
-            [self.completedSuccessfulTasks removeObjectsInArray:tempSuccessfulTasks];
-            [self postUploadTaskStatusChangedNotification];
+            [registry removeTask:task];
+            removed = YES;
         }
     }
+    return removed;
 }
 
+
 #pragma mark - GCD Timer Control
 
 // Start the cleanup timer (GCD-based)
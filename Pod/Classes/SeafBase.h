@@ -28,6 +28,7 @@ typedef enum {
 
 @class SeafBase;
 @class SeafConnection;
+@class SeafCollationKey;
 @protocol SeafDentryDelegate <NSObject>
 - (void)download:(id _Nullable)entry complete:(BOOL)updated;
 - (void)download:(id _Nullable)entry failed:(NSError *_Nullable)error;
@@ -126,6 +127,7 @@ typedef void (^repo_password_set_block_t)(SeafBase * _Nullable entry, int ret);
 @property (nonatomic, copy) NSString * _Nullable repoName;//repo name
 @property (nonatomic, assign) BOOL isDeleted;//2.9.27 mark is deleted
 @property (copy) NSString * _Nullable name; //obj name
+@property (readonly) SeafCollationKey * _Nonnull collationKey; // sort key of the name
 @property (nonatomic, copy) NSString * _Nullable fullPath; // full path
 
 @end
@@ -10,6 +10,7 @@
 #import "SeafBaseModel.h"
 #import "SeafRepos.h"
 #import "SeafConnection.h"
+#import "SeafCollationKey.h"
 
 #import "ExtentedString.h"
 #import "UIImage+FileType.h"
@@ -54,6 +55,9 @@
  */
 @property (nonatomic, strong) SeafBaseModel *model;
 
+/// The sort key of the name the entry had when it was last compared.
+@property (strong) SeafCollationKey *cachedCollationKey;
+
 @end
 
 @implementation SeafBase
@@ -119,6 +123,13 @@
     self.model.name = name;
 }
 
+- (SeafCollationKey *)collationKey {
+    // Built once per name, the key is dropped when the name changes
+    SeafCollationKey *key = [SeafCollationKey keyWithName:self.name cachedKey:self.cachedCollationKey];
+    self.cachedCollationKey = key;
+    return key;
+}
+
 - (NSString * _Nullable)path {
     return self.model.path;
 }
@@ -7,6 +7,18 @@
 
 #import <Foundation/Foundation.h>
 
+/**
+ * Scheduling classes of transfer operations, see SeafTaskScheduler.
+ */
+typedef NS_ENUM(NSInteger, SeafTaskClass) {
+    SeafTaskClassInteractive = 0,   ///< A file the user is waiting for, e.g. opening or saving it.
+    SeafTaskClassTransfer,          ///< Uploads and downloads the user queued.
+    SeafTaskClassPrefetch,          ///< Downloads nobody is waiting for yet, e.g. caching a folder.
+    SeafTaskClassBackup,            ///< Photo backup uploads.
+};
+
+#define SEAF_TASK_CLASS_COUNT 4
+
 @interface SeafBaseOperation : NSOperation
 
 @property (nonatomic, strong) NSMutableArray<NSURLSessionTask *> *taskList;
@@ -17,6 +29,12 @@
 
 @property (nonatomic, assign) NSInteger maxRetryCount;
 
+@property (nonatomic, assign) NSTimeInterval executionStartTime;///< When the operation started executing, 0 before.
+
+@property (nonatomic, assign) SeafTaskClass taskClass;
+@property (nonatomic, assign) NSTimeInterval enqueueTime;///< When the operation was handed to the scheduler.
+@property (nonatomic, assign) BOOL preempted;///< Cancelled to make room for interactive work, it will be added again.
+
 
 - (void)cancelAllRequests;
 - (void)completeOperation;
@@ -18,6 +18,7 @@
         _taskList = [NSMutableArray array];
         _observersRemoved = NO;
         _operationCompleted = NO;
+        _taskClass = SeafTaskClassTransfer;
     }
     return self;
 }
@@ -44,6 +45,7 @@
         return;
     }
 
+    self.executionStartTime = [[NSDate date] timeIntervalSince1970];
     [self willChangeValueForKey:@"isExecuting"];
     _executing = YES;
     [self didChangeValueForKey:@"isExecuting"];
@@ -0,0 +1,68 @@
+//
+//  SeafCacheIndex.h
+//  Seafile
+//
+//  In-memory access index of the downloaded objects, used for cache accounting and eviction.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+typedef NS_ENUM(NSInteger, SeafCacheEvictionPolicy) {
+    SeafCacheEvictionPolicyLRU = 0, ///< Least recently accessed objects first.
+    SeafCacheEvictionPolicyLFU,     ///< Least frequently accessed objects first, least recently among equals.
+};
+
+@interface SeafCacheIndexRecord : NSObject
+
+@property (nonatomic, readonly, copy) NSString *oid;
+@property (nonatomic, readonly) long long size;
+@property (nonatomic, readonly) NSTimeInterval lastAccess;
+@property (nonatomic, readonly) NSInteger accessCount;
+
+@end
+
+/**
+ * Size and access statistics of the objects in the objects directory. Records are kept
+ * in access order, so size accounting, accesses and LRU eviction do not walk the directory
+ * or sort. Changes are collected for batched persistence with takeChanges:.
+ * Not thread safe, the owner serializes all calls.
+ */
+@interface SeafCacheIndex : NSObject
+
+@property (nonatomic, readonly) long long totalSize;
+@property (nonatomic, readonly) NSUInteger count;
+
+/// Adds an object or updates its size, counting it as accessed at `time`.
+- (void)addObject:(NSString *)oid size:(long long)size time:(NSTimeInterval)time;
+
+/// Loads a persisted record, does not mark it as changed.
+- (void)loadObject:(NSString *)oid size:(long long)size lastAccess:(NSTimeInterval)lastAccess accessCount:(NSInteger)accessCount;
+
+/// Records an access, returns NO if the object is not indexed.
+- (BOOL)touchObject:(NSString *)oid time:(NSTimeInterval)time;
+
+- (void)removeObject:(NSString *)oid;
+- (void)removeAllObjects;
+
+- (nullable SeafCacheIndexRecord *)recordForObject:(NSString *)oid;
+
+/**
+ * Records in eviction order.
+ * @param policy The eviction order.
+ * @param time Objects accessed at or after this time are left out.
+ * @param pinned Object ids which must not be evicted.
+ */
+- (NSArray<SeafCacheIndexRecord *> *)evictionCandidatesWithPolicy:(SeafCacheEvictionPolicy)policy
+                                                  accessedBefore:(NSTimeInterval)time
+                                                       excluding:(nullable NSSet<NSString *> *)pinned;
+
+/**
+ * Returns the records changed since the previous call, and the ids of the removed objects in `removed`.
+ */
+- (NSArray<SeafCacheIndexRecord *> *)takeChanges:(NSArray<NSString *> * _Nullable * _Nullable)removed;
+
+@end
+
+NS_ASSUME_NONNULL_END
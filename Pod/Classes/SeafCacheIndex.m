@@ -0,0 +1,240 @@
+//
+//  SeafCacheIndex.m
+//  Seafile
+//
+//  In-memory access index of the downloaded objects, used for cache accounting and eviction.
+//
+
+#import "SeafCacheIndex.h"
+
+@interface SeafCacheIndexRecord ()
+
+@property (nonatomic, copy) NSString *oid;
+@property (nonatomic) long long size;
+@property (nonatomic) NSTimeInterval lastAccess;
+@property (nonatomic) NSInteger accessCount;
+
+// Access order links, the forward link is retained by the index's record dictionary as well.
+@property (nonatomic, strong, nullable) SeafCacheIndexRecord *next;
+@property (nonatomic, unsafe_unretained, nullable) SeafCacheIndexRecord *prev;
+
+@end
+
+@implementation SeafCacheIndexRecord
+@end
+
+@interface SeafCacheIndex ()
+
+@property (nonatomic, strong) NSMutableDictionary<NSString *, SeafCacheIndexRecord *> *records;
+// Least recently accessed first.
+@property (nonatomic, strong, nullable) SeafCacheIndexRecord *head;
+@property (nonatomic, unsafe_unretained, nullable) SeafCacheIndexRecord *tail;
+@property (nonatomic, assign) long long totalSize;
+@property (nonatomic, strong) NSMutableSet<NSString *> *changedOids;
+@property (nonatomic, strong) NSMutableSet<NSString *> *removedOids;
+
+@end
+
+@implementation SeafCacheIndex
+
+- (instancetype)init
+{
+    if (self = [super init]) {
+        _records = [NSMutableDictionary dictionary];
+        _changedOids = [NSMutableSet set];
+        _removedOids = [NSMutableSet set];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    // Release the chain iteratively, releasing it from its head would recurse once per record.
+    SeafCacheIndexRecord *record = _head;
+    _head = nil;
+    while (record) {
+        SeafCacheIndexRecord *next = record.next;
+        record.next = nil;
+        record = next;
+    }
+}
+
+- (NSUInteger)count
+{
+    return self.records.count;
+}
+
+- (void)unlink:(SeafCacheIndexRecord *)record
+{
+    SeafCacheIndexRecord *next = record.next;
+    SeafCacheIndexRecord *prev = record.prev;
+    if (prev) {
+        prev.next = next;
+    } else {
+        self.head = next;
+    }
+    if (next) {
+        next.prev = prev;
+    } else {
+        self.tail = prev;
+    }
+    record.next = nil;
+    record.prev = nil;
+}
+
+- (void)append:(SeafCacheIndexRecord *)record
+{
+    record.prev = self.tail;
+    if (self.tail) {
+        self.tail.next = record;
+    } else {
+        self.head = record;
+    }
+    self.tail = record;
+}
+
+// Keeps the list sorted by lastAccess for records loaded out of order.
+- (void)insertByAccessTime:(SeafCacheIndexRecord *)record
+{
+    SeafCacheIndexRecord *after = self.tail;
+    while (after && after.lastAccess > record.lastAccess) {
+        after = after.prev;
+    }
+    if (!after) {
+        record.next = self.head;
+        if (self.head) {
+            self.head.prev = record;
+        } else {
+            self.tail = record;
+        }
+        self.head = record;
+    } else if (after == self.tail) {
+        [self append:record];
+    } else {
+        record.prev = after;
+        record.next = after.next;
+        after.next.prev = record;
+        after.next = record;
+    }
+}
+
+- (void)addObject:(NSString *)oid size:(long long)size time:(NSTimeInterval)time
+{
+    SeafCacheIndexRecord *record = [self.records objectForKey:oid];
+    if (record) {
+        self.totalSize += size - record.size;
+        record.size = size;
+        [self touchObject:oid time:time];
+        return;
+    }
+    record = [SeafCacheIndexRecord new];
+    record.oid = oid;
+    record.size = size;
+    record.lastAccess = time;
+    record.accessCount = 1;
+    [self.records setObject:record forKey:oid];
+    [self insertByAccessTime:record];
+    self.totalSize += size;
+    [self.removedOids removeObject:oid];
+    [self.changedOids addObject:oid];
+}
+
+- (void)loadObject:(NSString *)oid size:(long long)size lastAccess:(NSTimeInterval)lastAccess accessCount:(NSInteger)accessCount
+{
+    if ([self.records objectForKey:oid]) return;
+    SeafCacheIndexRecord *record = [SeafCacheIndexRecord new];
+    record.oid = oid;
+    record.size = size;
+    record.lastAccess = lastAccess;
+    record.accessCount = accessCount;
+    [self.records setObject:record forKey:oid];
+    [self insertByAccessTime:record];
+    self.totalSize += size;
+}
+
+- (BOOL)touchObject:(NSString *)oid time:(NSTimeInterval)time
+{
+    SeafCacheIndexRecord *record = [self.records objectForKey:oid];
+    if (!record) return NO;
+    record.accessCount++;
+    if (time > record.lastAccess) {
+        record.lastAccess = time;
+    }
+    if (record != self.tail) {
+        [self unlink:record];
+        [self insertByAccessTime:record];
+    }
+    [self.changedOids addObject:oid];
+    return YES;
+}
+
+- (void)removeObject:(NSString *)oid
+{
+    SeafCacheIndexRecord *record = [self.records objectForKey:oid];
+    if (!record) return;
+    [self unlink:record];
+    [self.records removeObjectForKey:oid];
+    self.totalSize -= record.size;
+    [self.changedOids removeObject:oid];
+    [self.removedOids addObject:oid];
+}
+
+- (void)removeAllObjects
+{
+    SeafCacheIndexRecord *record = self.head;
+    self.head = nil;
+    self.tail = nil;
+    while (record) {
+        SeafCacheIndexRecord *next = record.next;
+        record.next = nil;
+        record.prev = nil;
+        record = next;
+    }
+    [self.records removeAllObjects];
+    [self.changedOids removeAllObjects];
+    [self.removedOids removeAllObjects];
+    self.totalSize = 0;
+}
+
+- (SeafCacheIndexRecord *)recordForObject:(NSString *)oid
+{
+    return [self.records objectForKey:oid];
+}
+
+- (NSArray<SeafCacheIndexRecord *> *)evictionCandidatesWithPolicy:(SeafCacheEvictionPolicy)policy
+                                                  accessedBefore:(NSTimeInterval)time
+                                                       excluding:(NSSet<NSString *> *)pinned
+{
+    NSMutableArray<SeafCacheIndexRecord *> *candidates = [NSMutableArray array];
+    // The list is in access order, so it can stop at the first record accessed too recently.
+    for (SeafCacheIndexRecord *record = self.head; record && record.lastAccess < time; record = record.next) {
+        if (![pinned containsObject:record.oid]) {
+            [candidates addObject:record];
+        }
+    }
+    if (policy == SeafCacheEvictionPolicyLFU) {
+        // Stable, equally frequent records stay least recently accessed first.
+        [candidates sortWithOptions:NSSortStable usingComparator:^NSComparisonResult(SeafCacheIndexRecord *a, SeafCacheIndexRecord *b) {
+            if (a.accessCount == b.accessCount) return NSOrderedSame;
+            return a.accessCount < b.accessCount ? NSOrderedAscending : NSOrderedDescending;
+        }];
+    }
+    return candidates;
+}
+
+- (NSArray<SeafCacheIndexRecord *> *)takeChanges:(NSArray<NSString *> **)removed
+{
+    NSMutableArray<SeafCacheIndexRecord *> *changed = [NSMutableArray arrayWithCapacity:self.changedOids.count];
+    for (NSString *oid in self.changedOids) {
+        SeafCacheIndexRecord *record = [self.records objectForKey:oid];
+        if (record) [changed addObject:record];
+    }
+    if (removed) {
+        *removed = self.removedOids.allObjects;
+    }
+    [self.changedOids removeAllObjects];
+    [self.removedOids removeAllObjects];
+    return changed;
+}
+
+@end
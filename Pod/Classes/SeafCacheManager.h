@@ -6,6 +6,7 @@
 //
 
 #import <Foundation/Foundation.h>
+#import "SeafCacheIndex.h"
 @class SeafFile;
 @class SeafConnection;
 @class SeafBase;
@@ -33,6 +34,17 @@
 - (void)clearAllCache;
 - (void)trimCacheToSize:(unsigned long long)maxSize;
 
+// Downloaded objects are evicted in the background once they exceed the disk cache limit,
+// or when the free disk space drops below this. Objects with pending edits are kept.
+@property (nonatomic, assign) unsigned long long minimumFreeDiskSpace;
+@property (nonatomic, assign) SeafCacheEvictionPolicy evictionPolicy;
+
+// Access index of the objects directory, every object written or read there is recorded
+- (void)recordCachedObject:(NSString *)oid;
+- (void)recordAccessToObject:(NSString *)oid;
+- (void)removeCachedObject:(NSString *)oid;
+- (void)evictIfNeeded;
+
 // New interfaces to replace cache logic in SeafFile
 - (BOOL)fileHasCache:(SeafFile *)file;
 - (BOOL)loadFileCache:(SeafFile *)file;
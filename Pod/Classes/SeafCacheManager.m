@@ -9,11 +9,27 @@
 #import "SeafRealmManager.h"
 #import "SeafStorage.h"
 #import "SeafFile.h"
+#import "SeafDataTaskManager.h"
 #import <CommonCrypto/CommonDigest.h>
 
 #define DEFAULT_TotalCostLimit 20*1024*1024
 #define DEFAULT_CountLimit 100
 
+#define DEFAULT_DISK_CACHE_LIMIT (4LL*1024*1024*1024)
+#define DEFAULT_MIN_FREE_DISK_SPACE (1LL*1024*1024*1024)
+// Eviction frees this fraction of the limit beyond what is needed, so it does not run for every download.
+#define CACHE_EVICTION_SLACK 0.1
+// Objects accessed this recently are never evicted, they may be open (in seconds).
+#define CACHE_EVICTION_GRACE_INTERVAL 300
+// Index changes are written to the database in batches (in seconds).
+#define CACHE_INDEX_FLUSH_INTERVAL 5
+// Leftover blocks of abandoned downloads are removed after this (in seconds).
+#define CACHE_STALE_BLOCK_INTERVAL (24*60*60)
+
+#define KEY_DISK_CACHE_LIMIT @"DiskCacheLimit"
+#define KEY_MIN_FREE_DISK_SPACE @"MinFreeDiskSpace"
+#define KEY_CACHE_EVICTION_POLICY @"CacheEvictionPolicy"
+
 @interface SeafCacheManager ()
 
 @property (nonatomic, strong) NSCache *thumbMemoryCache;
@@ -23,6 +39,14 @@
 @property (nonatomic, copy) NSString *thumbDiskCachePath;
 @property (nonatomic, copy) NSString *imageDiskCachePath; // URL 图片磁盘缓存目录
 
+// Accessed on cacheQueue only
+@property (nonatomic, strong) SeafCacheIndex *cacheIndex;
+@property (nonatomic, assign) BOOL cacheIndexLoaded;
+@property (nonatomic, assign) BOOL flushScheduled;
+// Readable from any thread
+@property (atomic, assign) unsigned long long objectsSize;
+@property (atomic, assign) unsigned long long otherFilesSize;
+
 @end
 
 @implementation SeafCacheManager
@@ -44,6 +68,13 @@
         NSString *base = (paths.count > 0) ? paths.firstObject : NSTemporaryDirectory();
         _imageDiskCachePath = [base stringByAppendingPathComponent:@"SeafCommentImageCache"];
         [[NSFileManager defaultManager] createDirectoryAtPath:_imageDiskCachePath withIntermediateDirectories:YES attributes:nil error:nil];
+        _cacheIndex = [[SeafCacheIndex alloc] init];
+        // The index lives next to the file statuses, which only the main app maintains
+        if ([Utils isMainApp]) {
+            dispatch_async(_cacheQueue, ^{
+                [self loadCacheIndex];
+            });
+        }
     }
     return self;
 }
@@ -183,20 +214,211 @@ static NSString *sha1String(NSString *s)
 
 #pragma mark - Cache Management
 
+// Downloaded objects are accounted by the index, the other directories are measured in the background.
 - (unsigned long long)totalCacheSize {
-    __block unsigned long long size = 0;
-    dispatch_sync(self.cacheQueue, ^{
-        NSArray *paths = @[self.fileCachePath, self.thumbDiskCachePath];
-        for (NSString *path in paths) {
-            NSArray *files = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:path error:nil];
-            for (NSString *file in files) {
-                NSString *filePath = [path stringByAppendingPathComponent:file];
-                NSDictionary *attrs = [[NSFileManager defaultManager] attributesOfItemAtPath:filePath error:nil];
-                size += [attrs fileSize];
-            }
+    return self.objectsSize + self.otherFilesSize;
+}
+
+- (void)clearAllCache {
+    [SeafStorage.sharedObject clearCache];
+    self.objectsSize = 0;
+    self.otherFilesSize = 0;
+    dispatch_async(self.cacheQueue, ^{
+        [self.cacheIndex removeAllObjects];
+        if (self.cacheIndexLoaded) {
+            [[SeafRealmManager shared] clearAllCacheEntries];
         }
+        [self measureOtherFiles];
+    });
+}
+
+- (void)setDiskCacheLimit:(unsigned long long)maxSize {
+    [SeafStorage.sharedObject setObject:@(maxSize) forKey:KEY_DISK_CACHE_LIMIT];
+    [self evictIfNeeded];
+}
+
+- (unsigned long long)diskCacheLimit {
+    NSNumber *limit = [SeafStorage.sharedObject objectForKey:KEY_DISK_CACHE_LIMIT];
+    return limit ? limit.unsignedLongLongValue : DEFAULT_DISK_CACHE_LIMIT;
+}
+
+- (void)setMinimumFreeDiskSpace:(unsigned long long)minimumFreeDiskSpace {
+    [SeafStorage.sharedObject setObject:@(minimumFreeDiskSpace) forKey:KEY_MIN_FREE_DISK_SPACE];
+    [self evictIfNeeded];
+}
+
+- (unsigned long long)minimumFreeDiskSpace {
+    NSNumber *space = [SeafStorage.sharedObject objectForKey:KEY_MIN_FREE_DISK_SPACE];
+    return space ? space.unsignedLongLongValue : DEFAULT_MIN_FREE_DISK_SPACE;
+}
+
+- (void)setEvictionPolicy:(SeafCacheEvictionPolicy)evictionPolicy {
+    [SeafStorage.sharedObject setObject:@(evictionPolicy) forKey:KEY_CACHE_EVICTION_POLICY];
+}
+
+- (SeafCacheEvictionPolicy)evictionPolicy {
+    return [[SeafStorage.sharedObject objectForKey:KEY_CACHE_EVICTION_POLICY] integerValue];
+}
+
+- (void)trimCacheToSize:(unsigned long long)maxSize {
+    dispatch_async(self.cacheQueue, ^{
+        [self evictObjectsToSize:maxSize freeSpaceNeeded:0];
     });
-    return size;
+}
+
+#pragma mark - Cache Index
+
+// Called on cacheQueue.
+- (void)loadCacheIndex {
+    NSArray<SeafCacheEntry *> *entries = [[SeafRealmManager shared] getAllCacheEntries];
+    for (SeafCacheEntry *entry in entries) {
+        [self.cacheIndex loadObject:entry.oid size:entry.size lastAccess:entry.lastAccess accessCount:entry.accessCount];
+    }
+    if (entries.count == 0) {
+        // First launch with the index, or an empty cache: index what is already downloaded.
+        NSString *objectsDir = SeafStorage.sharedObject.objectsDir;
+        for (NSString *name in [[NSFileManager defaultManager] contentsOfDirectoryAtPath:objectsDir error:nil]) {
+            if (name.pathExtension.length > 0) continue; // .tmp and .part files of running downloads
+            NSDictionary *attrs = [[NSFileManager defaultManager] attributesOfItemAtPath:[objectsDir stringByAppendingPathComponent:name] error:nil];
+            if (![attrs.fileType isEqualToString:NSFileTypeRegular]) continue;
+            [self.cacheIndex addObject:name size:attrs.fileSize time:attrs.fileModificationDate.timeIntervalSince1970];
+        }
+        Debug(@"Indexed %lu cached objects, %lld bytes", (unsigned long)self.cacheIndex.count, self.cacheIndex.totalSize);
+    }
+    self.cacheIndexLoaded = YES;
+    self.objectsSize = self.cacheIndex.totalSize;
+    [self removeStaleBlocks];
+    [self measureOtherFiles];
+    [self flushCacheIndex];
+}
+
+// Called on cacheQueue.
+- (void)measureOtherFiles {
+    NSString *rootPath = SeafStorage.sharedObject.rootPath;
+    NSString *objectsDir = SeafStorage.sharedObject.objectsDir.lastPathComponent;
+    unsigned long long size = 0;
+    for (NSString *name in [[NSFileManager defaultManager] contentsOfDirectoryAtPath:rootPath error:nil]) {
+        if ([name isEqualToString:objectsDir]) continue;
+        size += [Utils folderSizeAtPath:[rootPath stringByAppendingPathComponent:name]];
+    }
+    self.otherFilesSize = size;
+}
+
+// Called on cacheQueue, blocks are removed once a download checks out, the rest belongs to abandoned downloads.
+- (void)removeStaleBlocks {
+    NSString *blocksDir = SeafStorage.sharedObject.blocksDir;
+    NSTimeInterval staleBefore = [[NSDate date] timeIntervalSince1970] - CACHE_STALE_BLOCK_INTERVAL;
+    for (NSString *name in [[NSFileManager defaultManager] contentsOfDirectoryAtPath:blocksDir error:nil]) {
+        NSString *path = [blocksDir stringByAppendingPathComponent:name];
+        NSDictionary *attrs = [[NSFileManager defaultManager] attributesOfItemAtPath:path error:nil];
+        if (attrs && attrs.fileModificationDate.timeIntervalSince1970 < staleBefore) {
+            [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+        }
+    }
+}
+
+// Called on cacheQueue.
+- (void)scheduleCacheIndexFlush {
+    self.objectsSize = self.cacheIndex.totalSize;
+    if (!self.cacheIndexLoaded || self.flushScheduled) return;
+    self.flushScheduled = YES;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(CACHE_INDEX_FLUSH_INTERVAL * NSEC_PER_SEC)), self.cacheQueue, ^{
+        self.flushScheduled = NO;
+        [self flushCacheIndex];
+    });
+}
+
+// Called on cacheQueue, writes the changed records in one transaction and evicts if needed.
+- (void)flushCacheIndex {
+    @autoreleasepool {
+        NSArray<NSString *> *removed = nil;
+        NSArray<SeafCacheIndexRecord *> *changed = [self.cacheIndex takeChanges:&removed];
+        NSMutableArray<SeafCacheEntry *> *entries = [NSMutableArray arrayWithCapacity:changed.count];
+        for (SeafCacheIndexRecord *record in changed) {
+            SeafCacheEntry *entry = [[SeafCacheEntry alloc] init];
+            entry.oid = record.oid;
+            entry.size = record.size;
+            entry.lastAccess = record.lastAccess;
+            entry.accessCount = record.accessCount;
+            [entries addObject:entry];
+        }
+        [[SeafRealmManager shared] updateCacheEntries:entries removingOids:removed];
+    }
+    [self evictObjectsToSize:self.diskCacheLimit freeSpaceNeeded:self.minimumFreeDiskSpace];
+}
+
+- (void)recordCachedObject:(NSString *)oid {
+    if (oid.length == 0 || ![Utils isMainApp]) return;
+    dispatch_async(self.cacheQueue, ^{
+        NSDictionary *attrs = [[NSFileManager defaultManager] attributesOfItemAtPath:[SeafStorage.sharedObject documentPath:oid] error:nil];
+        if (!attrs) return;
+        [self.cacheIndex addObject:oid size:attrs.fileSize time:[[NSDate date] timeIntervalSince1970]];
+        [self scheduleCacheIndexFlush];
+    });
+}
+
+- (void)recordAccessToObject:(NSString *)oid {
+    if (oid.length == 0 || ![Utils isMainApp]) return;
+    NSTimeInterval now = [[NSDate date] timeIntervalSince1970];
+    dispatch_async(self.cacheQueue, ^{
+        if ([self.cacheIndex touchObject:oid time:now]) {
+            [self scheduleCacheIndexFlush];
+        }
+    });
+}
+
+- (void)removeCachedObject:(NSString *)oid {
+    if (oid.length == 0 || ![Utils isMainApp]) return;
+    dispatch_async(self.cacheQueue, ^{
+        if ([self.cacheIndex recordForObject:oid]) {
+            [self.cacheIndex removeObject:oid];
+            [self scheduleCacheIndexFlush];
+        }
+    });
+}
+
+- (void)evictIfNeeded {
+    dispatch_async(self.cacheQueue, ^{
+        [self evictObjectsToSize:self.diskCacheLimit freeSpaceNeeded:self.minimumFreeDiskSpace];
+    });
+}
+
+- (long long)availableDiskSpace {
+    NSDictionary *values = [SeafStorage.sharedObject.rootURL resourceValuesForKeys:@[NSURLVolumeAvailableCapacityForImportantUsageKey] error:nil];
+    NSNumber *capacity = [values objectForKey:NSURLVolumeAvailableCapacityForImportantUsageKey];
+    return capacity ? capacity.longLongValue : LLONG_MAX;
+}
+
+// Called on cacheQueue.
+- (void)evictObjectsToSize:(unsigned long long)maxSize freeSpaceNeeded:(unsigned long long)minFreeSpace {
+    if (!self.cacheIndexLoaded) return;
+    long long excess = self.cacheIndex.totalSize - (long long)maxSize;
+    long long deficit = minFreeSpace > 0 ? (long long)minFreeSpace - [self availableDiskSpace] : 0;
+    long long needed = MAX(excess, deficit);
+    if (needed <= 0) return;
+    needed += (long long)(maxSize * CACHE_EVICTION_SLACK);
+
+    // Never evict the base of a pending edit, nor what is being uploaded or downloaded.
+    NSSet<NSString *> *pinned = [SeafDataTaskManager.sharedObject objectIdsWithPendingChanges];
+    NSTimeInterval accessedBefore = [[NSDate date] timeIntervalSince1970] - CACHE_EVICTION_GRACE_INTERVAL;
+    NSArray<SeafCacheIndexRecord *> *candidates = [self.cacheIndex evictionCandidatesWithPolicy:self.evictionPolicy accessedBefore:accessedBefore excluding:pinned];
+
+    long long freed = 0;
+    NSUInteger evicted = 0;
+    for (SeafCacheIndexRecord *record in candidates) {
+        if (freed >= needed) break;
+        NSString *oid = record.oid;
+        [[NSFileManager defaultManager] removeItemAtPath:[SeafStorage.sharedObject documentPath:oid] error:nil];
+        // Export and preview links of the object hold on to its data as well.
+        [[NSFileManager defaultManager] removeItemAtPath:[SeafStorage.sharedObject.tempDir stringByAppendingPathComponent:oid] error:nil];
+        freed += record.size;
+        evicted++;
+        [self.cacheIndex removeObject:oid];
+    }
+    Debug(@"Evicted %lu cached objects, %lld of %lld bytes needed", (unsigned long)evicted, freed, needed);
+    if (evicted > 0) {
+        [self scheduleCacheIndexFlush];
+    }
 }
 
 - (NSString *)getCachePathForFile:(SeafFile *)file {
@@ -298,6 +520,7 @@ static NSString *sha1String(NSString *s)
     if (file.ooid) {
         NSString *docPath = [SeafStorage.sharedObject documentPath:file.ooid];
         [[NSFileManager defaultManager] removeItemAtPath:docPath error:nil];
+        [self removeCachedObject:file.ooid];
         
         NSString *tempDir = [SeafStorage.sharedObject.tempDir stringByAppendingPathComponent:file.ooid];
         [[NSFileManager defaultManager] removeItemAtPath:tempDir error:nil];
@@ -351,6 +574,7 @@ static NSString *sha1String(NSString *s)
     fileStatus.fileName = sFile.name;
 
     [[SeafRealmManager shared] updateFileStatus:fileStatus];
+    [self recordCachedObject:oid];
 }
 
 - (NSString *)cachePathForFile:(SeafFile *)file {
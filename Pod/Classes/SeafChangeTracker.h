@@ -0,0 +1,55 @@
+//
+//  SeafChangeTracker.h
+//  Seafile
+//
+//  Polls the libraries of an account for changes to the directories on screen.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class SeafConnection;
+@class SeafDir;
+
+/// Posted on the main thread when a poll re-listed a directory; the object is the SeafChangeTracker.
+extern NSNotificationName const SeafChangeTrackerDidUpdateDirNotification;
+/// Keys of the userInfo of SeafChangeTrackerDidUpdateDirNotification.
+extern NSString * const SeafChangeTrackerRepoIdKey;
+extern NSString * const SeafChangeTrackerPathKey;
+
+/**
+ * Keeps the tracked directories of an account fresh without listing each of them on every poll.
+ *
+ * A poll fetches the head commits of all libraries in one request. Only in libraries whose head
+ * moved, the directory tree is walked from the root by dir_id: as the id of a directory changes
+ * whenever anything below it does, only the subdirectories whose id differs from their cached
+ * listing are listed again, and only those leading to a tracked directory or already cached.
+ *
+ * All views and File Provider enumerators of an account share the tracker, so their polls are
+ * coalesced into one. Polling pauses while the app is in the background.
+ */
+@interface SeafChangeTracker : NSObject
+
+- (instancetype)initWithConnection:(SeafConnection *)connection;
+- (instancetype)init NS_UNAVAILABLE;
+
+/// Seconds between polls while directories are tracked, 30 by default.
+@property (nonatomic, assign) NSTimeInterval pollInterval;
+
+/// Requests sent by polls so far.
+@property (nonatomic, readonly) NSUInteger requestCount;
+
+/**
+ * Keeps a directory fresh until untrackDir: is called as often.
+ * The directory object is updated in place, its delegate is told about changes.
+ */
+- (void)trackDir:(SeafDir *)dir;
+- (void)untrackDir:(SeafDir *)dir;
+
+/// Polls now, or once more after the poll in progress.
+- (void)pollNow;
+
+@end
+
+NS_ASSUME_NONNULL_END
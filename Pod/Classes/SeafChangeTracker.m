@@ -0,0 +1,390 @@
+//
+//  SeafChangeTracker.m
+//  Seafile
+//
+//  Polls the libraries of an account for changes to the directories on screen.
+//
+
+#import <UIKit/UIKit.h>
+#import "SeafChangeTracker.h"
+#import "SeafConnection.h"
+#import "SeafRepos.h"
+#import "SeafDir.h"
+#import "SeafDirentList.h"
+#import "Utils.h"
+#import "Debug.h"
+
+#define CHANGE_TRACKER_POLL_INTERVAL 30
+// Listing requests in flight at most while walking a library.
+#define CHANGE_TRACKER_MAX_CONCURRENT_LISTINGS 4
+
+NSNotificationName const SeafChangeTrackerDidUpdateDirNotification = @"SeafChangeTrackerDidUpdateDir";
+NSString * const SeafChangeTrackerRepoIdKey = @"repoId";
+NSString * const SeafChangeTrackerPathKey = @"path";
+
+/// The walk of one library for a poll.
+@interface SeafRepoWalk : NSObject
+
+@property (nonatomic, copy) NSString *repoId;
+@property (nonatomic, copy, nullable) NSString *head;  ///< nil if the server did not tell it
+@property (nonatomic, strong) NSSet<NSString *> *trackedPaths;
+@property (nonatomic, strong) NSMutableArray<NSString *> *pending;
+@property (nonatomic, assign) NSUInteger inFlightCount;
+@property (nonatomic, assign) BOOL failed;
+@property (nonatomic, copy) void (^completion)(SeafRepoWalk *walk);
+
+@end
+
+@implementation SeafRepoWalk
+@end
+
+@interface SeafChangeTracker ()
+
+@property (nonatomic, weak) SeafConnection *connection;
+@property (nonatomic, strong) dispatch_queue_t queue;
+@property (nonatomic, strong, nullable) dispatch_source_t timerSource;
+@property (nonatomic, strong) NSMutableDictionary<NSString *, NSCountedSet<NSString *> *> *trackedPaths; // repo id to paths
+@property (nonatomic, strong) NSMutableDictionary<NSString *, NSHashTable<SeafDir *> *> *trackedDirs; // repo id/path to objects
+@property (nonatomic, strong) NSMutableDictionary<NSString *, NSString *> *heads; // repo id to the head commit last walked
+@property (nonatomic, assign) BOOL polling;
+@property (nonatomic, assign) BOOL pollAgain;
+@property (nonatomic, assign) BOOL inBackground;
+@property (atomic, readwrite) NSUInteger requestCount;
+
+@end
+
+@implementation SeafChangeTracker
+
+- (instancetype)initWithConnection:(SeafConnection *)connection
+{
+    if (self = [super init]) {
+        _connection = connection;
+        _queue = dispatch_queue_create("com.seafile.changeTracker", DISPATCH_QUEUE_SERIAL);
+        _trackedPaths = [NSMutableDictionary dictionary];
+        _trackedDirs = [NSMutableDictionary dictionary];
+        _heads = [NSMutableDictionary dictionary];
+        _pollInterval = CHANGE_TRACKER_POLL_INTERVAL;
+        [[NSNotificationCenter defaultCenter] addObserver:self
+                                                 selector:@selector(appDidEnterBackground:)
+                                                     name:UIApplicationDidEnterBackgroundNotification
+                                                   object:nil];
+        [[NSNotificationCenter defaultCenter] addObserver:self
+                                                 selector:@selector(appWillEnterForeground:)
+                                                     name:UIApplicationWillEnterForegroundNotification
+                                                   object:nil];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+    if (_timerSource) dispatch_source_cancel(_timerSource);
+}
+
+#pragma mark - App State
+
+// Nothing is on screen, polls wait until the app comes back.
+- (void)appDidEnterBackground:(NSNotification *)notification
+{
+    dispatch_async(self.queue, ^{
+        self.inBackground = YES;
+        [self stopTimer];
+    });
+}
+
+- (void)appWillEnterForeground:(NSNotification *)notification
+{
+    dispatch_async(self.queue, ^{
+        self.inBackground = NO;
+        if (self.trackedPaths.count == 0) return;
+        [self startTimerIfNeeded];
+        [self poll];
+    });
+}
+
+static NSString *seafTrackKey(NSString *repoId, NSString *path)
+{
+    return [NSString stringWithFormat:@"%@/%@", repoId, path];
+}
+
+#pragma mark - Tracking
+
+- (void)trackDir:(SeafDir *)dir
+{
+    // The library list has no dir_id to check
+    if (!dir.repoId || !dir.path || [dir isKindOfClass:[SeafRepos class]]) return;
+    NSString *repoId = dir.repoId;
+    NSString *path = dir.path;
+    dispatch_async(self.queue, ^{
+        NSCountedSet *paths = [self.trackedPaths objectForKey:repoId];
+        if (!paths) {
+            paths = [NSCountedSet set];
+            [self.trackedPaths setObject:paths forKey:repoId];
+        }
+        [paths addObject:path];
+        NSString *key = seafTrackKey(repoId, path);
+        NSHashTable *dirs = [self.trackedDirs objectForKey:key];
+        if (!dirs) {
+            dirs = [NSHashTable weakObjectsHashTable];
+            [self.trackedDirs setObject:dirs forKey:key];
+        }
+        [dirs addObject:dir];
+        [self startTimerIfNeeded];
+    });
+}
+
+- (void)untrackDir:(SeafDir *)dir
+{
+    if (!dir.repoId || !dir.path) return;
+    NSString *repoId = dir.repoId;
+    NSString *path = dir.path;
+    dispatch_async(self.queue, ^{
+        NSCountedSet *paths = [self.trackedPaths objectForKey:repoId];
+        if (![paths containsObject:path]) return;
+        [paths removeObject:path];
+        if ([paths countForObject:path] == 0) {
+            [self.trackedDirs removeObjectForKey:seafTrackKey(repoId, path)];
+        }
+        if (paths.count == 0) {
+            [self.trackedPaths removeObjectForKey:repoId];
+        }
+        if (self.trackedPaths.count == 0) {
+            [self stopTimer];
+        }
+    });
+}
+
+- (void)pollNow
+{
+    dispatch_async(self.queue, ^{
+        [self poll];
+    });
+}
+
+- (void)startTimerIfNeeded
+{
+    if (self.timerSource || self.inBackground) return;
+    self.timerSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, self.queue);
+    uint64_t interval = (uint64_t)(self.pollInterval * NSEC_PER_SEC);
+    dispatch_source_set_timer(self.timerSource, dispatch_time(DISPATCH_TIME_NOW, interval), interval, 1 * NSEC_PER_SEC);
+    __weak typeof(self) weakSelf = self;
+    dispatch_source_set_event_handler(self.timerSource, ^{
+        [weakSelf poll];
+    });
+    dispatch_resume(self.timerSource);
+}
+
+- (void)stopTimer
+{
+    if (!self.timerSource) return;
+    dispatch_source_cancel(self.timerSource);
+    self.timerSource = nil;
+}
+
+#pragma mark - Polling
+
+- (void)poll
+{
+    if (self.polling) {
+        self.pollAgain = YES;
+        return;
+    }
+    SeafConnection *connection = self.connection;
+    if (self.trackedPaths.count == 0 || self.inBackground || !connection.authorized) return;
+    self.polling = YES;
+    self.requestCount++;
+    // The api2 library list carries the head commit of each library.
+    [connection sendRequest:API_URL"/repos/" success:^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
+        NSDictionary *heads = [self headsFromJSON:JSON];
+        dispatch_async(self.queue, ^{
+            [self walkReposWithHeads:heads];
+        });
+    } failure:^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON, NSError *error) {
+        Warning("Failed to poll libraries: %@", error);
+        dispatch_async(self.queue, ^{
+            [self pollDidFinish];
+        });
+    }];
+}
+
+// Repo id to head commit id, or to NSNull for a library listed without one.
+- (NSDictionary *)headsFromJSON:(id)JSON
+{
+    NSMutableDictionary *heads = [NSMutableDictionary dictionary];
+    if (![JSON isKindOfClass:[NSArray class]]) return heads;
+    for (NSDictionary *info in (NSArray *)JSON) {
+        if (![info isKindOfClass:[NSDictionary class]]) continue;
+        NSString *repoId = [info objectForKey:@"id"];
+        if (![repoId isKindOfClass:[NSString class]]) continue;
+        NSString *head = [info objectForKey:@"head_commit_id"];
+        [heads setObject:([head isKindOfClass:[NSString class]] && head.length > 0 ? head : [NSNull null]) forKey:repoId];
+    }
+    return heads;
+}
+
+- (void)walkReposWithHeads:(NSDictionary *)heads
+{
+    NSMutableArray<SeafRepoWalk *> *walks = [NSMutableArray array];
+    for (NSString *repoId in self.trackedPaths) {
+        id head = [heads objectForKey:repoId];
+        // Libraries no longer listed were deleted or unshared
+        if (!head) continue;
+        if ([head isKindOfClass:[NSString class]] && [head isEqualToString:[self.heads objectForKey:repoId]]) continue;
+        SeafRepoWalk *walk = [SeafRepoWalk new];
+        walk.repoId = repoId;
+        walk.head = [head isKindOfClass:[NSString class]] ? head : nil;
+        walk.trackedPaths = [NSSet setWithArray:[self.trackedPaths objectForKey:repoId].allObjects];
+        walk.pending = [NSMutableArray arrayWithObject:@"/"];
+        [walks addObject:walk];
+    }
+    if (walks.count == 0) {
+        [self pollDidFinish];
+        return;
+    }
+    __block NSUInteger remaining = walks.count;
+    for (SeafRepoWalk *walk in walks) {
+        walk.completion = ^(SeafRepoWalk *w) {
+            if (!w.failed && w.head) {
+                [self.heads setObject:w.head forKey:w.repoId];
+            }
+            if (--remaining == 0) {
+                [self pollDidFinish];
+            }
+        };
+        [self pumpWalk:walk];
+    }
+}
+
+- (void)pollDidFinish
+{
+    self.polling = NO;
+    if (self.pollAgain) {
+        self.pollAgain = NO;
+        [self poll];
+    }
+}
+
+#pragma mark - Walking
+
+- (void)pumpWalk:(SeafRepoWalk *)walk
+{
+    while (walk.inFlightCount < CHANGE_TRACKER_MAX_CONCURRENT_LISTINGS && walk.pending.count > 0) {
+        NSString *path = walk.pending.firstObject;
+        [walk.pending removeObjectAtIndex:0];
+        walk.inFlightCount++;
+        [self listPath:path ofWalk:walk];
+    }
+    if (walk.inFlightCount == 0 && walk.pending.count == 0) {
+        walk.completion(walk);
+    }
+}
+
+// A directory object of a path, its cached listing is not loaded.
+- (SeafDir *)dirOfRepo:(NSString *)repoId path:(NSString *)path
+{
+    SeafConnection *connection = self.connection;
+    NSString *name = [path isEqualToString:@"/"] ? ([connection getRepo:repoId].name ?: path) : path.lastPathComponent;
+    return [[SeafDir alloc] initWithConnection:connection oid:nil repoId:repoId perm:nil name:name path:path mtime:0];
+}
+
+// A directory object holding the cached listing of a path.
+- (SeafDir *)cachedDirOfRepo:(NSString *)repoId path:(NSString *)path
+{
+    SeafDir *dir = [self dirOfRepo:repoId path:path];
+    [dir loadCache];
+    return dir;
+}
+
+- (void)listPath:(NSString *)path ofWalk:(SeafRepoWalk *)walk
+{
+    SeafConnection *connection = self.connection;
+    if (!connection) {
+        walk.failed = YES;
+        walk.inFlightCount--;
+        return;
+    }
+    NSArray<SeafDir *> *trackedDirs = [[self.trackedDirs objectForKey:seafTrackKey(walk.repoId, path)] allObjects];
+    NSString *repoId = walk.repoId;
+    // Listed like a refresh on screen: streamed, parsed off the main thread and cached by the directory.
+    dispatch_async(dispatch_get_main_queue(), ^{
+        NSArray<SeafDir *> *targets = trackedDirs.count > 0 ? trackedDirs : @[[self cachedDirOfRepo:repoId path:path]];
+        dispatch_group_t group = dispatch_group_create();
+        __block NSDictionary<NSString *, NSString *> *subdirs = nil;
+        __block NSError *listError = nil;
+        for (SeafDir *target in targets) {
+            self.requestCount++;
+            dispatch_group_enter(group);
+            [target loadContentSuccess:^(SeafDir *dir) {
+                if (!subdirs) subdirs = [self subdirOidsOfItems:dir.items];
+                dispatch_group_leave(group);
+            } failure:^(SeafDir *dir, NSError *error) {
+                listError = error;
+                dispatch_group_leave(group);
+            }];
+        }
+        dispatch_group_notify(group, self.queue, ^{
+            walk.inFlightCount--;
+            if (subdirs) {
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    [[NSNotificationCenter defaultCenter] postNotificationName:SeafChangeTrackerDidUpdateDirNotification
+                                                                        object:self
+                                                                      userInfo:@{SeafChangeTrackerRepoIdKey: repoId, SeafChangeTrackerPathKey: path}];
+                });
+                [self addChangedSubdirs:subdirs ofPath:path toWalk:walk];
+            } else {
+                Warning("Failed to list %@ %@: %@", repoId, path, listError);
+                walk.failed = YES;
+            }
+            [self pumpWalk:walk];
+        });
+    });
+}
+
+// Name to dir id of the subdirectories in a listing, called on the main thread.
+- (NSDictionary<NSString *, NSString *> *)subdirOidsOfItems:(NSArray *)items
+{
+    NSMutableDictionary *subdirs = [NSMutableDictionary dictionary];
+    // The records of a cached listing are read without creating its objects.
+    if ([items isKindOfClass:[SeafDirentList class]]) {
+        SeafDirentList *list = (SeafDirentList *)items;
+        for (NSUInteger i = 0; i < list.count; i++) {
+            if ([list typeAtIndex:i] == SeafDirentTypeDir) {
+                [subdirs setObject:[list oidAtIndex:i] forKey:[list nameAtIndex:i]];
+            }
+        }
+        return subdirs;
+    }
+    for (SeafBase *item in items) {
+        if ([item isKindOfClass:[SeafDir class]] && item.name) {
+            [subdirs setObject:item.oid ?: @"" forKey:item.name];
+        }
+    }
+    return subdirs;
+}
+
+// Queues the subdirectories whose dir_id differs from their cached listing.
+- (void)addChangedSubdirs:(NSDictionary<NSString *, NSString *> *)subdirs ofPath:(NSString *)path toWalk:(SeafRepoWalk *)walk
+{
+    [subdirs enumerateKeysAndObjectsUsingBlock:^(NSString *name, NSString *oid, BOOL *stop) {
+        NSString *subPath = [path stringByAppendingPathComponent:name];
+
+        BOOL leadsToTracked = NO;
+        NSString *prefix = [subPath stringByAppendingString:@"/"];
+        for (NSString *tracked in walk.trackedPaths) {
+            if ([tracked isEqualToString:subPath] || [tracked hasPrefix:prefix]) {
+                leadsToTracked = YES;
+                break;
+            }
+        }
+        SeafDir *tracked = [[self.trackedDirs objectForKey:seafTrackKey(walk.repoId, subPath)] anyObject];
+        // Only the header of the cached listing is read, the listing itself is loaded if it changed.
+        NSString *cachedOid = tracked.ooid ?: [[self dirOfRepo:walk.repoId path:subPath] cachedOid];
+        // Subtrees never browsed are left to be listed when they are opened
+        if (!cachedOid && !leadsToTracked) return;
+        if (oid.length > 0 && [oid isEqualToString:cachedOid]) return;
+        [walk.pending addObject:subPath];
+    }];
+}
+
+@end
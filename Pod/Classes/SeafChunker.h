@@ -0,0 +1,64 @@
+//
+//  SeafChunker.h
+//  Seafile
+//
+//  Block boundary strategies used when a file is uploaded by blocks.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * Splits a file into upload blocks. The block ids stay the SHA1 of the (encrypted) block content,
+ * only the block boundaries depend on the strategy.
+ */
+@protocol SeafChunkingStrategy <NSObject>
+
+/// The largest block the strategy produces.
+@property (nonatomic, readonly) NSUInteger maxBlockSize;
+
+/**
+ * Returns the length of the block starting at `bytes`.
+ * @param bytes The remaining content of the file.
+ * @param length The number of remaining bytes.
+ * @return The block length, greater than 0 and at most MIN(length, maxBlockSize).
+ */
+- (NSUInteger)nextBlockLength:(const uint8_t *)bytes length:(NSUInteger)length;
+
+@end
+
+/**
+ * Cuts blocks at fixed offsets.
+ */
+@interface SeafFixedSizeChunker : NSObject <SeafChunkingStrategy>
+
+- (instancetype)initWithBlockSize:(NSUInteger)blockSize;
+
+@end
+
+/**
+ * Content-defined chunking (FastCDC): cuts blocks where a gear rolling hash matches a mask,
+ * so an insertion in a file only changes the blocks around it.
+ */
+@interface SeafContentDefinedChunker : NSObject <SeafChunkingStrategy>
+
+@property (nonatomic, readonly) NSUInteger minBlockSize;
+@property (nonatomic, readonly) NSUInteger averageBlockSize;
+
+/**
+ * @param minSize No cut point is searched before this offset.
+ * @param averageSize The expected block size, rounded down to a power of two.
+ * @param maxSize Blocks are cut at this size when no cut point is found.
+ */
+- (instancetype)initWithMinSize:(NSUInteger)minSize averageSize:(NSUInteger)averageSize maxSize:(NSUInteger)maxSize;
+
+@end
+
+/**
+ * Returns the length of the next content-defined block, the C kernel of SeafContentDefinedChunker.
+ * `mask_s` is used before `avg_size` and `mask_l` after it (normalized chunking).
+ */
+size_t seaf_fastcdc_cut(const uint8_t *src, size_t len, size_t min_size, size_t avg_size, size_t max_size, uint64_t mask_s, uint64_t mask_l);
+
+NS_ASSUME_NONNULL_END
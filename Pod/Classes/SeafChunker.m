@@ -0,0 +1,117 @@
+//
+//  SeafChunker.m
+//  Seafile
+//
+//  Block boundary strategies used when a file is uploaded by blocks.
+//
+
+#import "SeafChunker.h"
+
+// The gear table must never change: block boundaries, and therefore server-side dedup
+// against earlier uploads, depend on it. It is generated by splitmix64 from a fixed seed.
+static uint64_t seaf_gear[256];
+
+static void seaf_gear_init(void)
+{
+    uint64_t x = 0x5EAF11E5EAF11E00ULL;
+    for (int i = 0; i < 256; i++) {
+        uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        seaf_gear[i] = z ^ (z >> 31);
+    }
+}
+
+size_t seaf_fastcdc_cut(const uint8_t *src, size_t len, size_t min_size, size_t avg_size, size_t max_size, uint64_t mask_s, uint64_t mask_l)
+{
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        seaf_gear_init();
+    });
+
+    if (len <= min_size)
+        return len;
+    if (len > max_size)
+        len = max_size;
+    size_t normal = avg_size < len ? avg_size : len;
+
+    uint64_t fp = 0;
+    size_t i = min_size;
+    for (; i < normal; i++) {
+        fp = (fp << 1) + seaf_gear[src[i]];
+        if (!(fp & mask_s))
+            return i + 1;
+    }
+    for (; i < len; i++) {
+        fp = (fp << 1) + seaf_gear[src[i]];
+        if (!(fp & mask_l))
+            return i + 1;
+    }
+    return len;
+}
+
+@implementation SeafFixedSizeChunker
+{
+    NSUInteger _blockSize;
+}
+
+- (instancetype)initWithBlockSize:(NSUInteger)blockSize
+{
+    if (self = [super init]) {
+        _blockSize = MAX(blockSize, 1);
+    }
+    return self;
+}
+
+- (NSUInteger)maxBlockSize
+{
+    return _blockSize;
+}
+
+- (NSUInteger)nextBlockLength:(const uint8_t *)bytes length:(NSUInteger)length
+{
+    return MIN(length, _blockSize);
+}
+
+@end
+
+// Mask with `bits` ones in the most significant bits, the bits that have seen the most input bytes.
+static uint64_t seaf_cdc_mask(int bits)
+{
+    bits = MAX(1, MIN(bits, 63));
+    return ((1ULL << bits) - 1) << (64 - bits);
+}
+
+@implementation SeafContentDefinedChunker
+{
+    NSUInteger _maxBlockSize;
+    uint64_t _maskS;
+    uint64_t _maskL;
+}
+
+- (instancetype)initWithMinSize:(NSUInteger)minSize averageSize:(NSUInteger)averageSize maxSize:(NSUInteger)maxSize
+{
+    if (self = [super init]) {
+        int bits = 0;
+        while ((2ULL << bits) <= MAX(averageSize, 2)) bits++;
+        _averageBlockSize = (NSUInteger)1 << bits;
+        _minBlockSize = MIN(minSize, _averageBlockSize);
+        _maxBlockSize = MAX(maxSize, _averageBlockSize);
+        // Normalized chunking: harder to cut before the average size, easier after it.
+        _maskS = seaf_cdc_mask(bits + 1);
+        _maskL = seaf_cdc_mask(bits - 1);
+    }
+    return self;
+}
+
+- (NSUInteger)maxBlockSize
+{
+    return _maxBlockSize;
+}
+
+- (NSUInteger)nextBlockLength:(const uint8_t *)bytes length:(NSUInteger)length
+{
+    return seaf_fastcdc_cut(bytes, length, _minBlockSize, _averageBlockSize, _maxBlockSize, _maskS, _maskL);
+}
+
+@end
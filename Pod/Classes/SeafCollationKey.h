@@ -0,0 +1,38 @@
+//
+//  SeafCollationKey.h
+//  Seafile
+//
+//  Precomputed sort key of a file name for the web compatible natural order.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * Holds what the natural name comparison derives from a name, so that it is computed once
+ * per entry instead of on every comparison: the character classes, the split into digit runs
+ * and characters, and a byte form of ASCII letters and digit runs (case folded, digit runs
+ * compared by value) which orders with memcmp.
+ *
+ * The order is the one of the web frontend's compareTwoString(): non-Chinese before Chinese,
+ * numbers by numeric value, Chinese by pinyin. Where the byte form cannot decide, e.g. for
+ * names equal but for case or leading zeros, the locale aware comparison is used.
+ */
+@interface SeafCollationKey : NSObject
+
++ (instancetype)keyWithName:(NSString *)name;
+
+/// Returns cachedKey while it was built from name, a new key once the name changed.
++ (instancetype)keyWithName:(nullable NSString *)name cachedKey:(nullable SeafCollationKey *)cachedKey;
+
+@property (nonatomic, readonly, copy) NSString *name;
+
+- (NSComparisonResult)compare:(SeafCollationKey *)other;
+
+@end
+
+/// Compares two names in natural order without precomputed keys.
+FOUNDATION_EXPORT NSComparisonResult SeafNaturalCompare(NSString *a, NSString *b);
+
+NS_ASSUME_NONNULL_END
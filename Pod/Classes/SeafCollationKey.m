@@ -0,0 +1,308 @@
+//
+//  SeafCollationKey.m
+//  Seafile
+//
+//  Precomputed sort key of a file name for the web compatible natural order.
+//
+
+#import "SeafCollationKey.h"
+
+#define SEAF_COLLATION_DIGITS 0x01    // Marks a digit run, sorts before any letter
+#define SEAF_COLLATION_MAX_DIGITS 200 // Longer digit runs are left to the locale comparison
+
+#pragma mark - Natural Sort Helpers (matching web frontend logic)
+
+/// Check if the string contains only ASCII letters and digits.
+static BOOL seafIsLetterOrNumber(NSString *str) {
+    if (str.length == 0) return NO;
+    static NSCharacterSet *nonAlnum = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSMutableCharacterSet *alnum = [NSMutableCharacterSet alphanumericCharacterSet];
+        nonAlnum = [alnum invertedSet];
+    });
+    return [str rangeOfCharacterFromSet:nonAlnum].location == NSNotFound;
+}
+
+/// Check if every character falls in the CJK Unified Ideographs range (U+4E00–U+9FA5).
+/// NOTE: The upper bound 0x9FA5 intentionally matches the web frontend's isAllChineseStr()
+/// regex (/^[\u4E00-\u9FA5]+$/) to keep sorting behaviour consistent across platforms.
+static BOOL seafIsAllChinese(NSString *str) {
+    if (str.length == 0) return NO;
+    static NSCharacterSet *nonChinese = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSCharacterSet *chinese = [NSCharacterSet characterSetWithRange:NSMakeRange(0x4E00, 0x9FA5 - 0x4E00 + 1)];
+        nonChinese = [chinese invertedSet];
+    });
+    return [str rangeOfCharacterFromSet:nonChinese].location == NSNotFound;
+}
+
+/// Split a string into an array where consecutive digits are kept as one element
+/// and non-digit characters are split into individual characters.
+/// e.g. "file10中文" -> @[@"f", @"i", @"l", @"e", @"10", @"中", @"文"]
+static NSArray<NSString *> *seafSplitStringByNumber(NSString *str) {
+    NSMutableArray *result = [NSMutableArray array];
+    static NSRegularExpression *regex = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        regex = [NSRegularExpression regularExpressionWithPattern:@"\\d+|\\D+" options:0 error:nil];
+    });
+    NSArray *matches = [regex matchesInString:str options:0 range:NSMakeRange(0, str.length)];
+    for (NSTextCheckingResult *match in matches) {
+        NSString *part = [str substringWithRange:match.range];
+        unichar first = [part characterAtIndex:0];
+        if (first >= '0' && first <= '9') {
+            // Keep numeric segment as a whole for numeric comparison
+            [result addObject:part];
+        } else {
+            // Split non-numeric segment into individual characters
+            [part enumerateSubstringsInRange:NSMakeRange(0, part.length)
+                                    options:NSStringEnumerationByComposedCharacterSequences
+                                 usingBlock:^(NSString *substring, NSRange substringRange, NSRange enclosingRange, BOOL *stop) {
+                if (substring) [result addObject:substring];
+            }];
+        }
+    }
+    return result;
+}
+
+static NSLocale *seafZhLocale(void) {
+    static NSLocale *loc = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        loc = [NSLocale localeWithLocaleIdentifier:@"zh-Hans-CN"];
+    });
+    return loc;
+}
+
+static NSComparisonResult seafLocaleCompare(NSString *a, NSString *b, BOOL numeric) {
+    NSStringCompareOptions options = numeric ? NSCaseInsensitiveSearch | NSNumericSearch : NSCaseInsensitiveSearch;
+    return [a compare:b options:options range:NSMakeRange(0, a.length) locale:seafZhLocale()];
+}
+
+/// Compare two strings using the same logic as the web frontend's compareTwoString().
+/// Sort order: non-Chinese before Chinese; numbers compared by numeric value; Chinese by pinyin.
+NSComparisonResult SeafNaturalCompare(NSString *a, NSString *b) {
+    // Fast path: both are pure letters/numbers
+    if (seafIsLetterOrNumber(a) && seafIsLetterOrNumber(b)) {
+        return seafLocaleCompare(a, b, YES);
+    }
+
+    // Fast path: both are pure Chinese
+    if (seafIsAllChinese(a) && seafIsAllChinese(b)) {
+        return seafLocaleCompare(a, b, NO);
+    }
+
+    // Mixed content: split and compare element by element
+    NSArray *arrA = seafSplitStringByNumber(a);
+    NSArray *arrB = seafSplitStringByNumber(b);
+    NSUInteger len = MIN(arrA.count, arrB.count);
+
+    for (NSUInteger i = 0; i < len; i++) {
+        NSString *ca = arrA[i];
+        NSString *cb = arrB[i];
+
+        // Non-Chinese sorts before Chinese
+        BOOL caIsChinese = seafIsAllChinese(ca);
+        BOOL cbIsChinese = seafIsAllChinese(cb);
+        if (!caIsChinese && cbIsChinese) return NSOrderedAscending;
+        if (caIsChinese && !cbIsChinese) return NSOrderedDescending;
+
+        NSComparisonResult r = seafLocaleCompare(ca, cb, !caIsChinese);
+        if (r != NSOrderedSame) return r;
+    }
+
+    // All compared elements are equal; shorter string comes first
+    if (arrA.count > arrB.count) return NSOrderedDescending;
+    if (arrA.count < arrB.count) return NSOrderedAscending;
+    return NSOrderedSame;
+}
+
+#pragma mark - Byte Form
+
+static inline BOOL seafIsAsciiDigit(unichar c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline BOOL seafIsAsciiLetter(unichar c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+/**
+ * Appends the byte form of an ASCII letters and digits string: letters case folded,
+ * digit runs as a marker, the length without leading zeros and the remaining digits.
+ * Returns NO if the string has other characters or too long a digit run.
+ * Where two byte forms differ, memcmp orders them like the locale aware numeric and case
+ * insensitive comparison: digits before letters, letters alphabetically, numbers by value.
+ */
+static BOOL seafAppendByteForm(NSString *str, NSMutableData *bytes) {
+    NSUInteger length = str.length;
+    if (length == 0) return NO;
+    unichar stackBuf[64];
+    unichar *chars = length <= 64 ? stackBuf : malloc(length * sizeof(unichar));
+    [str getCharacters:chars range:NSMakeRange(0, length)];
+    BOOL valid = YES;
+    NSUInteger i = 0;
+    while (i < length && valid) {
+        unichar c = chars[i];
+        if (seafIsAsciiLetter(c)) {
+            uint8_t b = (uint8_t)(c | 0x20);
+            [bytes appendBytes:&b length:1];
+            i++;
+        } else if (seafIsAsciiDigit(c)) {
+            NSUInteger start = i;
+            while (i < length && seafIsAsciiDigit(chars[i])) i++;
+            NSUInteger significant = start;
+            while (significant < i && chars[significant] == '0') significant++;
+            NSUInteger digits = i - significant;
+            if (digits > SEAF_COLLATION_MAX_DIGITS) {
+                valid = NO;
+                break;
+            }
+            uint8_t header[2] = { SEAF_COLLATION_DIGITS, (uint8_t)digits };
+            [bytes appendBytes:header length:2];
+            for (NSUInteger j = significant; j < i; j++) {
+                uint8_t b = (uint8_t)chars[j];
+                [bytes appendBytes:&b length:1];
+            }
+        } else {
+            valid = NO;
+        }
+    }
+    if (chars != stackBuf) free(chars);
+    return valid;
+}
+
+// NSOrderedSame means undecided, equal byte forms may still differ in case or leading zeros.
+static inline NSComparisonResult seafCompareBytes(const uint8_t *a, NSUInteger aLength, const uint8_t *b, NSUInteger bLength) {
+    int r = memcmp(a, b, MIN(aLength, bLength));
+    if (r < 0) return NSOrderedAscending;
+    if (r > 0) return NSOrderedDescending;
+    if (aLength < bLength) return NSOrderedAscending;
+    if (aLength > bLength) return NSOrderedDescending;
+    return NSOrderedSame;
+}
+
+#pragma mark - SeafCollationKey
+
+typedef struct {
+    uint32_t offset;  // Of the byte form in the key's bytes
+    uint16_t length;  // Of the byte form, 0 if the segment has none
+    BOOL chinese;
+} seaf_collation_segment;
+
+@interface SeafCollationKey ()
+
+@property (nonatomic, readwrite, copy) NSString *name;
+@property (nonatomic, assign) BOOL letterOrNumber;
+@property (nonatomic, assign) BOOL allChinese;
+@property (nonatomic, strong) NSData *bytes;
+@property (nonatomic, assign) NSUInteger nameLength; // Of the whole name's byte form, 0 if it has none
+@property (nonatomic, strong) NSArray<NSString *> *segments;
+
+@end
+
+@implementation SeafCollationKey {
+    seaf_collation_segment *_segmentInfo;
+}
+
++ (instancetype)keyWithName:(NSString *)name
+{
+    return [[self alloc] initWithName:name ?: @""];
+}
+
++ (instancetype)keyWithName:(NSString *)name cachedKey:(SeafCollationKey *)cachedKey
+{
+    name = name ?: @"";
+    if (cachedKey && (cachedKey.name == name || [cachedKey.name isEqualToString:name])) {
+        return cachedKey;
+    }
+    return [self keyWithName:name];
+}
+
+- (instancetype)initWithName:(NSString *)name
+{
+    if (self = [super init]) {
+        _name = [name copy];
+        _letterOrNumber = seafIsLetterOrNumber(_name);
+        _allChinese = seafIsAllChinese(_name);
+        NSMutableData *bytes = [NSMutableData data];
+        if (_letterOrNumber && seafAppendByteForm(_name, bytes)) {
+            _nameLength = bytes.length;
+        } else {
+            bytes.length = 0;
+        }
+        _segments = seafSplitStringByNumber(_name);
+        _segmentInfo = calloc(MAX(_segments.count, 1), sizeof(seaf_collation_segment));
+        for (NSUInteger i = 0; i < _segments.count; i++) {
+            NSString *segment = [_segments objectAtIndex:i];
+            seaf_collation_segment *info = _segmentInfo + i;
+            info->chinese = seafIsAllChinese(segment);
+            if (info->chinese) continue;
+            NSUInteger offset = bytes.length;
+            if (seafAppendByteForm(segment, bytes)) {
+                info->offset = (uint32_t)offset;
+                info->length = (uint16_t)(bytes.length - offset);
+            } else {
+                bytes.length = offset;
+            }
+        }
+        _bytes = bytes;
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    free(_segmentInfo);
+}
+
+- (NSComparisonResult)compare:(SeafCollationKey *)other
+{
+    if (self == other || [self.name isEqualToString:other.name]) return NSOrderedSame;
+    const uint8_t *bytes = self.bytes.bytes;
+    const uint8_t *otherBytes = other.bytes.bytes;
+
+    // Same steps as SeafNaturalCompare(), which decides wherever the byte forms do not
+    if (self.letterOrNumber && other.letterOrNumber) {
+        if (self.nameLength > 0 && other.nameLength > 0) {
+            NSComparisonResult r = seafCompareBytes(bytes, self.nameLength, otherBytes, other.nameLength);
+            if (r != NSOrderedSame) return r;
+        }
+        return seafLocaleCompare(self.name, other.name, YES);
+    }
+
+    if (self.allChinese && other.allChinese) {
+        return seafLocaleCompare(self.name, other.name, NO);
+    }
+
+    NSArray<NSString *> *segments = self.segments;
+    NSArray<NSString *> *otherSegments = other.segments;
+    const seaf_collation_segment *otherInfo = other->_segmentInfo;
+    NSUInteger len = MIN(segments.count, otherSegments.count);
+    for (NSUInteger i = 0; i < len; i++) {
+        NSString *ca = [segments objectAtIndex:i];
+        NSString *cb = [otherSegments objectAtIndex:i];
+        BOOL caIsChinese = _segmentInfo[i].chinese;
+        BOOL cbIsChinese = otherInfo[i].chinese;
+        if (!caIsChinese && cbIsChinese) return NSOrderedAscending;
+        if (caIsChinese && !cbIsChinese) return NSOrderedDescending;
+
+        // Shared prefixes are common, identical segments compare equal under any options
+        if ([ca isEqualToString:cb]) continue;
+        if (!caIsChinese && _segmentInfo[i].length > 0 && otherInfo[i].length > 0) {
+            NSComparisonResult r = seafCompareBytes(bytes + _segmentInfo[i].offset, _segmentInfo[i].length,
+                                                    otherBytes + otherInfo[i].offset, otherInfo[i].length);
+            if (r != NSOrderedSame) return r;
+        }
+        NSComparisonResult r = seafLocaleCompare(ca, cb, !caIsChinese);
+        if (r != NSOrderedSame) return r;
+    }
+
+    if (segments.count > otherSegments.count) return NSOrderedDescending;
+    if (segments.count < otherSegments.count) return NSOrderedAscending;
+    return NSOrderedSame;
+}
+
+@end
@@ -0,0 +1,73 @@
+//
+//  SeafConcurrencyController.h
+//  Seafile
+//
+//  Adapts the concurrency of the transfer queues to the measured link quality.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * One retuning of a queue, kept so the controller's convergence can be inspected.
+ */
+@interface SeafConcurrencyDecision : NSObject
+
+@property (nonatomic, readonly) NSTimeInterval timestamp;
+@property (nonatomic, readonly, copy) NSString *queueName;
+@property (nonatomic, readonly) NSInteger oldCount;
+@property (nonatomic, readonly) NSInteger newCount;
+@property (nonatomic, readonly) double throughput;///< Bytes per second of the queue during the sample interval.
+@property (nonatomic, readonly) double totalThroughput;///< Bytes per second of all queues during the sample interval.
+@property (nonatomic, readonly) double errorRate;
+@property (nonatomic, readonly, copy) NSString *reason;
+
+@end
+
+/**
+ * Retunes maxConcurrentOperationCount of the registered queues AIMD-style:
+ * one more operation while it raises the total throughput, half as many on errors.
+ *
+ * The samples are evaluated by a timer which is suspended while all queues are idle,
+ * and resumed by the next recorded transfer.
+ */
+@interface SeafConcurrencyController : NSObject
+
++ (SeafConcurrencyController *)sharedObject;
+
+/// Seconds between two evaluations, each evaluation uses the samples recorded since the previous one.
+@property (nonatomic, assign) NSTimeInterval sampleInterval;
+
+/**
+ * Starts controlling a queue. The queue is not retained.
+ * @param queue The queue to retune.
+ * @param minCount The concurrency is never lowered below this.
+ * @param maxCount The concurrency is never raised above this, halved on cellular networks.
+ */
+- (void)registerQueue:(NSOperationQueue *)queue minCount:(NSInteger)minCount maxCount:(NSInteger)maxCount;
+- (void)unregisterQueue:(NSOperationQueue *)queue;
+
+/**
+ * Records a finished operation of a registered queue.
+ * @param bytes The bytes transferred by the operation.
+ * @param duration The time the operation was executing.
+ * @param failed Whether the operation failed, cancelled operations should not be recorded.
+ */
+- (void)recordTransferOnQueue:(NSOperationQueue *)queue bytes:(int64_t)bytes duration:(NSTimeInterval)duration failed:(BOOL)failed;
+
+/**
+ * Evaluates the samples recorded since the previous evaluation, called by the controller's timer.
+ * @param interval The length of the sample interval in seconds.
+ */
+- (void)evaluateWithInterval:(NSTimeInterval)interval;
+
+/// The most recent decisions, oldest first.
+- (NSArray<SeafConcurrencyDecision *> *)decisions;
+
+/// Queue name -> current concurrency, throughput, per task throughput and error rate of the last sample interval.
+- (NSDictionary<NSString *, NSDictionary<NSString *, NSNumber *> *> *)metrics;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,316 @@
+//
+//  SeafConcurrencyController.m
+//  Seafile
+//
+//  Adapts the concurrency of the transfer queues to the measured link quality.
+//
+
+#import "SeafConcurrencyController.h"
+#import "Debug.h"
+#import <AFNetworking/AFNetworkReachabilityManager.h>
+
+#define CONCURRENCY_SAMPLE_INTERVAL 2.0
+#define CONCURRENCY_MAX_DECISIONS 256
+
+// Error rate of a sample interval above which a queue's concurrency is halved.
+#define CONCURRENCY_ERROR_RATE_THRESHOLD 0.2
+// Relative gain of the total throughput an increase has to bring to be kept.
+#define CONCURRENCY_MIN_GAIN 0.05
+
+@interface SeafConcurrencyDecision ()
+
+@property (nonatomic, assign) NSTimeInterval timestamp;
+@property (nonatomic, copy) NSString *queueName;
+@property (nonatomic, assign) NSInteger oldCount;
+@property (nonatomic, assign) NSInteger newCount;
+@property (nonatomic, assign) double throughput;
+@property (nonatomic, assign) double totalThroughput;
+@property (nonatomic, assign) double errorRate;
+@property (nonatomic, copy) NSString *reason;
+
+@end
+
+@implementation SeafConcurrencyDecision
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"%@ %ld -> %ld (%@, %.0f/%.0f B/s, errors %.2f)", self.queueName, (long)self.oldCount, (long)self.newCount, self.reason, self.throughput, self.totalThroughput, self.errorRate];
+}
+
+@end
+
+// Per queue state, guarded by the controller.
+@interface SeafQueueConcurrencyState : NSObject
+
+@property (nonatomic, weak) NSOperationQueue *queue;
+@property (nonatomic, copy) NSString *name;
+@property (nonatomic, assign) NSInteger minCount;
+@property (nonatomic, assign) NSInteger maxCount;
+@property (nonatomic, assign) NSInteger count;
+
+@property (nonatomic, assign) int64_t bytes;
+@property (nonatomic, assign) NSTimeInterval busyTime;
+@property (nonatomic, assign) NSUInteger completions;
+@property (nonatomic, assign) NSUInteger failures;
+
+@property (nonatomic, assign) double throughput;
+@property (nonatomic, assign) double taskThroughput;
+@property (nonatomic, assign) double errorRate;
+
+@end
+
+@implementation SeafQueueConcurrencyState
+@end
+
+@interface SeafConcurrencyController ()
+
+@property (nonatomic, strong) NSMutableArray<SeafQueueConcurrencyState *> *states;
+@property (nonatomic, strong) NSMutableArray<SeafConcurrencyDecision *> *decisionLog;
+@property (nonatomic, strong) dispatch_queue_t timerQueue;
+@property (nonatomic, strong, nullable) dispatch_source_t timerSource;
+@property (nonatomic, assign) BOOL timerSuspended;
+
+// The queue raised by the previous evaluation and the total throughput before that increase.
+@property (nonatomic, weak, nullable) SeafQueueConcurrencyState *probingState;
+@property (nonatomic, assign) double throughputBeforeProbe;
+
+@end
+
+@implementation SeafConcurrencyController
+
++ (SeafConcurrencyController *)sharedObject
+{
+    static SeafConcurrencyController *object = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        object = [SeafConcurrencyController new];
+    });
+    return object;
+}
+
+- (id)init
+{
+    if (self = [super init]) {
+        _states = [NSMutableArray new];
+        _decisionLog = [NSMutableArray new];
+        _sampleInterval = CONCURRENCY_SAMPLE_INTERVAL;
+        _timerQueue = dispatch_queue_create("com.seafile.concurrencyController", DISPATCH_QUEUE_SERIAL);
+    }
+    return self;
+}
+
+#pragma mark - Registration
+
+- (void)registerQueue:(NSOperationQueue *)queue minCount:(NSInteger)minCount maxCount:(NSInteger)maxCount
+{
+    SeafQueueConcurrencyState *state = [SeafQueueConcurrencyState new];
+    state.queue = queue;
+    state.name = [NSString stringWithFormat:@"%@-%p", queue.name, queue];
+    state.minCount = MAX(minCount, 1);
+    state.maxCount = MAX(maxCount, state.minCount);
+    // Start halfway and let the samples decide.
+    state.count = MAX(state.minCount, MIN([self ceilingForState:state], (state.maxCount + 1) / 2));
+    queue.maxConcurrentOperationCount = state.count;
+
+    @synchronized (self) {
+        [self.states addObject:state];
+    }
+    [self startTimerIfNeeded];
+}
+
+- (void)unregisterQueue:(NSOperationQueue *)queue
+{
+    @synchronized (self) {
+        [self removeStatesPassingTest:^BOOL(SeafQueueConcurrencyState *state) {
+            return state.queue == queue;
+        }];
+    }
+}
+
+- (void)removeStatesPassingTest:(BOOL (^)(SeafQueueConcurrencyState *state))test
+{
+    NSIndexSet *indexes = [self.states indexesOfObjectsPassingTest:^BOOL(SeafQueueConcurrencyState *state, NSUInteger idx, BOOL *stop) {
+        return test(state);
+    }];
+    [self.states removeObjectsAtIndexes:indexes];
+}
+
+- (SeafQueueConcurrencyState *)stateForQueue:(NSOperationQueue *)queue
+{
+    for (SeafQueueConcurrencyState *state in self.states) {
+        if (state.queue == queue) return state;
+    }
+    return nil;
+}
+
+- (NSInteger)ceilingForState:(SeafQueueConcurrencyState *)state
+{
+    // A cellular link is saturated by far fewer streams.
+    if ([AFNetworkReachabilityManager sharedManager].isReachableViaWWAN) {
+        return MAX(state.minCount, state.maxCount / 2);
+    }
+    return state.maxCount;
+}
+
+#pragma mark - Sampling
+
+- (void)recordTransferOnQueue:(NSOperationQueue *)queue bytes:(int64_t)bytes duration:(NSTimeInterval)duration failed:(BOOL)failed
+{
+    @synchronized (self) {
+        SeafQueueConcurrencyState *state = [self stateForQueue:queue];
+        if (!state) return;
+        state.bytes += MAX(bytes, 0);
+        state.busyTime += MAX(duration, 0);
+        state.completions++;
+        if (failed) state.failures++;
+        [self resumeTimerIfSuspended];
+    }
+}
+
+- (void)startTimerIfNeeded
+{
+    @synchronized (self) {
+        if (self.timerSource) return;
+        self.timerSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, self.timerQueue);
+        NSTimeInterval interval = self.sampleInterval;
+        dispatch_source_set_timer(self.timerSource,
+                                  dispatch_time(DISPATCH_TIME_NOW, (int64_t)(interval * NSEC_PER_SEC)),
+                                  (uint64_t)(interval * NSEC_PER_SEC),
+                                  (uint64_t)(0.1 * interval * NSEC_PER_SEC));
+        __weak typeof(self) weakSelf = self;
+        dispatch_source_set_event_handler(self.timerSource, ^{
+            [weakSelf evaluateWithInterval:interval];
+        });
+        dispatch_resume(self.timerSource);
+    }
+}
+
+// Called with self locked, restarts the timer so the first interval after idling is a full one.
+- (void)resumeTimerIfSuspended
+{
+    if (!self.timerSource || !self.timerSuspended) return;
+    NSTimeInterval interval = self.sampleInterval;
+    dispatch_source_set_timer(self.timerSource,
+                              dispatch_time(DISPATCH_TIME_NOW, (int64_t)(interval * NSEC_PER_SEC)),
+                              (uint64_t)(interval * NSEC_PER_SEC),
+                              (uint64_t)(0.1 * interval * NSEC_PER_SEC));
+    self.timerSuspended = NO;
+    dispatch_resume(self.timerSource);
+}
+
+// Called with self locked, there is nothing to evaluate until a transfer is recorded again.
+- (void)suspendTimerIfIdle
+{
+    if (!self.timerSource || self.timerSuspended) return;
+    for (SeafQueueConcurrencyState *state in self.states) {
+        if (state.completions > 0 || state.queue.operationCount > 0) return;
+    }
+    self.timerSuspended = YES;
+    dispatch_suspend(self.timerSource);
+}
+
+#pragma mark - Evaluation
+
+- (void)evaluateWithInterval:(NSTimeInterval)interval
+{
+    if (interval <= 0) return;
+    NSMutableArray<SeafConcurrencyDecision *> *decisions = [NSMutableArray array];
+    @synchronized (self) {
+        // Queues of removed accounts are gone.
+        [self removeStatesPassingTest:^BOOL(SeafQueueConcurrencyState *state) {
+            return state.queue == nil;
+        }];
+        [self suspendTimerIfIdle];
+        double total = 0;
+        for (SeafQueueConcurrencyState *state in self.states) {
+            state.throughput = state.bytes / interval;
+            state.taskThroughput = state.busyTime > 0 ? state.bytes / state.busyTime : 0;
+            state.errorRate = state.completions > 0 ? (double)state.failures / state.completions : 0;
+            total += state.throughput;
+        }
+
+        SeafQueueConcurrencyState *probed = self.probingState;
+        self.probingState = nil;
+
+        for (SeafQueueConcurrencyState *state in self.states) {
+            NSInteger ceiling = [self ceilingForState:state];
+            NSInteger count = state.count;
+            NSString *reason = nil;
+            BOOL backlogged = state.queue.operationCount > state.count;
+
+            if (state.completions > 0 && state.errorRate > CONCURRENCY_ERROR_RATE_THRESHOLD) {
+                count = state.count / 2;
+                reason = @"errors";
+            } else if (state == probed && total < self.throughputBeforeProbe * (1 + CONCURRENCY_MIN_GAIN)) {
+                // The extra stream did not raise the total, the link is saturated.
+                count = state.count - 1;
+                reason = @"saturated";
+            } else if (state.count > ceiling) {
+                count = ceiling;
+                reason = @"ceiling";
+            } else if (!self.probingState && backlogged && state.count < ceiling && state.completions > 0) {
+                // Probe one queue per interval so the effect on the total can be attributed.
+                count = state.count + 1;
+                reason = @"probe";
+                self.probingState = state;
+                self.throughputBeforeProbe = total;
+            }
+            count = MAX(state.minCount, MIN(count, ceiling));
+
+            if (reason && count != state.count) {
+                SeafConcurrencyDecision *decision = [SeafConcurrencyDecision new];
+                decision.timestamp = [[NSDate date] timeIntervalSince1970];
+                decision.queueName = state.name;
+                decision.oldCount = state.count;
+                decision.newCount = count;
+                decision.throughput = state.throughput;
+                decision.totalThroughput = total;
+                decision.errorRate = state.errorRate;
+                decision.reason = reason;
+                [decisions addObject:decision];
+
+                state.count = count;
+                state.queue.maxConcurrentOperationCount = count;
+            }
+
+            state.bytes = 0;
+            state.busyTime = 0;
+            state.completions = 0;
+            state.failures = 0;
+        }
+
+        [self.decisionLog addObjectsFromArray:decisions];
+        if (self.decisionLog.count > CONCURRENCY_MAX_DECISIONS) {
+            [self.decisionLog removeObjectsInRange:NSMakeRange(0, self.decisionLog.count - CONCURRENCY_MAX_DECISIONS)];
+        }
+    }
+    for (SeafConcurrencyDecision *decision in decisions) {
+        Debug(@"[Concurrency] %@", decision);
+    }
+}
+
+#pragma mark - Metrics
+
+- (NSArray<SeafConcurrencyDecision *> *)decisions
+{
+    @synchronized (self) {
+        return [self.decisionLog copy];
+    }
+}
+
+- (NSDictionary<NSString *, NSDictionary<NSString *, NSNumber *> *> *)metrics
+{
+    NSMutableDictionary *metrics = [NSMutableDictionary dictionary];
+    @synchronized (self) {
+        for (SeafQueueConcurrencyState *state in self.states) {
+            [metrics setObject:@{@"count": @(state.count),
+                                 @"throughput": @(state.throughput),
+                                 @"taskThroughput": @(state.taskThroughput),
+                                 @"errorRate": @(state.errorRate)}
+                        forKey:state.name];
+        }
+    }
+    return metrics;
+}
+
+@end
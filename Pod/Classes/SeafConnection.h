@@ -43,6 +43,9 @@ enum MSG_TYPE{
 @class SeafRepo;
 @class SeafUploadFile;
 @class SeafDir;
+@class SeafRepoKey;
+@class SeafPrefetcher;
+@class SeafChangeTracker;
 
 typedef void (^CompletionBlock)(BOOL success, NSError * _Nullable error);
 
@@ -130,6 +133,8 @@ extern NSNotificationName const SeafServerInfoUpdatedNotification;
 @property (nonatomic) BOOL wikiSwitchEnabled;///< Client-side wiki toggle (persisted per account, default NO).
 @property (readonly) BOOL isNewActivitiesApiSupported;///< Indicates whether the new activities API is supported.
 @property (readonly) NSData* _Nullable clientIdentityKey;///< Client identity key for secure communications.
+@property (readonly, nonatomic) SeafPrefetcher * _Nonnull prefetcher;///< Prefetches directory trees for offline browsing.
+@property (readonly, nonatomic) SeafChangeTracker * _Nonnull changeTracker;///< Polls for changes to the directories on screen.
 
 @property (readwrite, nonatomic, getter=isWifiOnly) BOOL wifiOnly;///< Indicates whether syncing should occur over WiFi only.
 @property (readwrite, nonatomic, getter=isAutoSync) BOOL autoSync; ///< Indicates whether automatic syncing is enabled.
@@ -213,6 +218,16 @@ extern NSNotificationName const SeafServerInfoUpdatedNotification;
             success:(void (^ _Nullable)(NSURLRequest * _Nonnull request, NSHTTPURLResponse * _Nonnull response, id _Nonnull JSON))success
             failure:(void (^ _Nullable)(NSURLRequest * _Nonnull request, NSHTTPURLResponse * _Nullable response, id _Nullable JSON, NSError * _Nullable error))failure;
 
+/**
+ * Sends a GET request whose response body is handed over in chunks as it arrives, so that it can be parsed while it downloads.
+ * @param url The URL where the request is sent.
+ * @param receive A block that is called on a background queue with each chunk of a successful response, in order.
+ * @param completion A block that is called on the main queue when the request finished, with an error if it failed or was cancelled.
+ */
+- (NSURLSessionDataTask *_Nullable)sendStreamingRequest:(NSString * _Nonnull)url
+                                                receive:(void (^ _Nonnull)(NSHTTPURLResponse * _Nonnull response, NSData * _Nonnull data))receive
+                                             completion:(void (^ _Nonnull)(NSHTTPURLResponse * _Nullable response, NSError * _Nullable error))completion;
+
 /**
  * Sends a prepared NSURLRequest without modifying headers or injecting tokens.
  * Use this to call external services (e.g., Seadoc) with their own Authorization headers
@@ -406,6 +421,12 @@ extern NSNotificationName const SeafServerInfoUpdatedNotification;
  */
 - (void)clearCache:(NSString * _Nonnull)entity;
 
+/**
+ * The directory holding this account's cached directory listings.
+ * @return The path of the directory, which is created if needed.
+ */
+- (NSString * _Nonnull)direntCacheDir;
+
 /**
  * Retrieves JSON data from a cache, decoding it into an object.
  * @param key The key associated with the JSON data.
@@ -481,6 +502,15 @@ Checks the auto synchronization settings and updates the connection’s synchron
  */
 - (NSString * _Nullable)getRepoPassword:(NSString * _Nonnull)repoId;
 
+/**
+ * Returns the derived encryption key of a repository whose password is saved.
+ * The key is derived once and cached in memory by (repoId, encVersion, magic) until the passwords are cleared.
+ * Deriving is slow, so this should not be called on the main thread.
+ * @param repoId The repository identifier.
+ * @return The derived key, or nil if the repository is not encrypted or no password is saved.
+ */
+- (SeafRepoKey * _Nullable)repoKeyForRepo:(NSString * _Nonnull)repoId;
+
 /**
  * Retrieves the encryption information for a specific repository.
  * @param repoId The repository identifier for which the encryption information is being requested.
@@ -489,7 +519,7 @@ Checks the auto synchronization settings and updates the connection’s synchron
 - (NSDictionary *_Nullable)getRepoEncInfo:(NSString * _Nonnull)repoId;
 
 /**
- * Initiates the download of a directory and all its contents recursively.
+ * Initiates the download of a directory and all its contents recursively, through the prefetcher.
  * @param dir The directory object that needs to be downloaded.
  */
 - (void)downloadDir:(SeafDir * _Nonnull)dir;
@@ -25,8 +25,12 @@
 #import "SeafRealmManager.h"
 #import "SeafFile.h"
 #import "SeafRealmManager.h"
+#import "SeafCacheManager.h"
 #import "SeafFileOperationManager.h"
 #import "SeafUploadFileModel.h"
+#import "SeafDirentList.h"
+#import "SeafPrefetcher.h"
+#import "SeafChangeTracker.h"
 
 enum {
     FLAG_LOCAL_DECRYPT = 0x1,
@@ -106,11 +110,18 @@ static AFHTTPRequestSerializer <AFURLRequestSerialization> * _requestSerializer;
 @property BOOL inCheckCert;
 
 @property SeafDir *syncDir;
+@property (readwrite, nonatomic) SeafPrefetcher *prefetcher;
+@property (readwrite, nonatomic) SeafChangeTracker *changeTracker;
+@property (nonatomic) AFHTTPSessionManager *streamMgr;///< Session manager for responses parsed while they arrive.
+@property (nonatomic) NSMutableDictionary<NSNumber *, void (^)(NSHTTPURLResponse *, NSData *)> *streamReceivers;///< Chunk handlers keyed by task identifier.
 @property (readonly) id<SeafCacheProvider> cacheProvider;
 
 @property (readonly) NSString *platformVersion;
 @property (readonly) NSString *tagDataKey;
 
+@property (readonly) NSMutableDictionary<NSString *, SeafRepoKey *> *repoKeys;///< Derived repo keys keyed by repoId/encVersion/magic.
+@property (nonatomic) NSUInteger repoKeysGeneration;///< Bumped whenever keys are removed, so a key derived meanwhile is not cached.
+
 @end
 
 @implementation SeafConnection
@@ -156,6 +167,7 @@ static AFHTTPRequestSerializer <AFURLRequestSerialization> * _requestSerializer;
         _settings = [[NSMutableDictionary alloc] init];
         _inAutoSync = false;
         _cacheProvider = cacheProvider;
+        _repoKeys = [[NSMutableDictionary alloc] init];
         
         [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(updateKeyValuePairs:) name:NSUbiquitousKeyValueStoreDidChangeExternallyNotification object:[NSUbiquitousKeyValueStore defaultStore]];
     }
@@ -590,6 +602,14 @@ static AFHTTPRequestSerializer <AFURLRequestSerialization> * _requestSerializer;
     [Utils dict:repoLastUpdateTsMap setObject:@([[NSDate date] timeIntervalSince1970]) forKey:repoId];
     [Utils dict:_info setObject:repoLastUpdateTsMap forKey:REPO_LAST_UPDATE_PASSWORD_TIME];
     [self saveAccountInfo];
+
+    // Derive the repo key now so that later block encryption and decryption skip the key derivation.
+    [self removeRepoKeys:repoId];
+    if (password) {
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            [self repoKeyForRepo:repoId];
+        });
+    }
 }
 - (void)saveRepo:(NSString *_Nonnull)repoId encInfo:(NSDictionary *_Nonnull)encInfo
 {
@@ -628,6 +648,55 @@ static AFHTTPRequestSerializer <AFURLRequestSerialization> * _requestSerializer;
     return nil;
 }
 
+#pragma mark - Repo key cache
+- (SeafRepoKey *)repoKeyForRepo:(NSString *)repoId
+{
+    SeafRepo *repo = [self getRepo:repoId];
+    NSString *password = [self getRepoPassword:repoId];
+    if (!repo.encrypted || !password) return nil;
+
+    NSString *cacheKey = [NSString stringWithFormat:@"%@/%d/%@", repoId, repo.encVersion, repo.magic ?: @""];
+    NSUInteger generation;
+    @synchronized (_repoKeys) {
+        SeafRepoKey *repoKey = [_repoKeys objectForKey:cacheKey];
+        if (repoKey) return repoKey;
+        generation = self.repoKeysGeneration;
+    }
+
+    // The derivation is slow, run it outside the lock so lookups of other repos are not held up.
+    SeafRepoKey *derived = [[SeafRepoKey alloc] initWithPassword:password encKey:repo.encKey version:repo.encVersion];
+    @synchronized (_repoKeys) {
+        SeafRepoKey *repoKey = [_repoKeys objectForKey:cacheKey];
+        if (repoKey) return repoKey;
+        // The keys were cleared while deriving, the password may have changed or been removed.
+        if (generation != self.repoKeysGeneration) return nil;
+        [_repoKeys setObject:derived forKey:cacheKey];
+        return derived;
+    }
+}
+
+- (void)removeRepoKeys:(NSString *)repoId
+{
+    NSString *prefix = [repoId stringByAppendingString:@"/"];
+    @synchronized (_repoKeys) {
+        for (NSString *cacheKey in _repoKeys.allKeys) {
+            if ([cacheKey hasPrefix:prefix]) {
+                [_repoKeys removeObjectForKey:cacheKey];
+            }
+        }
+        self.repoKeysGeneration++;
+    }
+}
+
+// Keys still used by running encryptors and decryptors are wiped by SeafRepoKey when they release them.
+- (void)wipeRepoKeys
+{
+    @synchronized (_repoKeys) {
+        [_repoKeys removeAllObjects];
+        self.repoKeysGeneration++;
+    }
+}
+
 - (AFSecurityPolicy *)policyForHost:(NSString *)host
 {
     NSString *path = [self certPathForHost:host];
@@ -714,9 +783,20 @@ static AFHTTPRequestSerializer <AFURLRequestSerialization> * _requestSerializer;
 {
     _policy = policy;
     _sessionMgr.securityPolicy = _policy;
+    [self setAuthenticationChallengeBlockOf:_sessionMgr];
+    @synchronized(self) {
+        if (_streamMgr) {
+            _streamMgr.securityPolicy = _policy;
+            [self setAuthenticationChallengeBlockOf:_streamMgr];
+        }
+    }
+}
+
+- (void)setAuthenticationChallengeBlockOf:(AFHTTPSessionManager *)manager
+{
     __weak typeof(self) weakSelf = self;
 
-    [_sessionMgr setSessionDidReceiveAuthenticationChallengeBlock:^NSURLSessionAuthChallengeDisposition(NSURLSession *session, NSURLAuthenticationChallenge *challenge, NSURLCredential *__autoreleasing *credential) {
+    [manager setSessionDidReceiveAuthenticationChallengeBlock:^NSURLSessionAuthChallengeDisposition(NSURLSession *session, NSURLAuthenticationChallenge *challenge, NSURLCredential *__autoreleasing *credential) {
         if ([challenge.protectionSpace.authenticationMethod isEqualToString:NSURLAuthenticationMethodServerTrust]) {
             *credential = [NSURLCredential credentialForTrust:challenge.protectionSpace.serverTrust];
             if (SeafStorage.sharedObject.allowInvalidCert) return NSURLSessionAuthChallengeUseCredential;
@@ -771,6 +851,9 @@ static AFHTTPRequestSerializer <AFURLRequestSerialization> * _requestSerializer;
     [_info removeObjectForKey:@"password"];
     [_info removeObjectForKey:@"repopassword"];
     [_info removeObjectForKey:@"repoInfo"];
+    [self wipeRepoKeys];
+    // The crawl would go on with a dead token, and resume for a logged out account on the next launch.
+    [self.prefetcher cancelAll];
     
     [SeafStorage.sharedObject setObject:_info forKey:self.accountIdentifier];
 
@@ -784,6 +867,7 @@ static AFHTTPRequestSerializer <AFURLRequestSerialization> * _requestSerializer;
 - (void)clearAccount
 {
     [SeafDataTaskManager.sharedObject removeAccountQueue:self];
+    [self.prefetcher cancelAll];
     [SeafStorage.sharedObject removeObjectForKey:_address];
     [SeafStorage.sharedObject removeObjectForKey:self.accountIdentifier];
     [SeafStorage.sharedObject removeObjectForKey:[NSString stringWithFormat:@"%@/settings", self.accountIdentifier]];
@@ -971,6 +1055,22 @@ static AFHTTPRequestSerializer <AFURLRequestSerialization> * _requestSerializer;
     }
 }
 
+// Account-wide handling of a failed request, after its own failure handler has run.
+- (void)handleErrorResponse:(NSHTTPURLResponse *)resp JSON:(id)JSON
+{
+    if (resp.statusCode == HTTP_ERR_UNAUTHORIZED) {
+        [self handleUnauthorizedErrorResponse:resp];
+    } else if (resp.statusCode == HTTP_ERR_OPERATION_FAILED && [JSON isKindOfClass:[NSDictionary class]]) {
+        NSString *err_msg = [((NSDictionary *)JSON) objectForKey:@"error_msg"];
+        if (err_msg && [@"Above quota" isEqualToString:err_msg]) {
+            Warning("Out of quota.");
+            [self.delegate outOfQuota:self];
+        }
+    } else if (resp.statusCode == HTTP_ERR_REPO_DOWNLOAD_PASSWORD_EXPIRED) {
+        [self refreshRepoPasswords];
+    }
+}
+
 - (NSURLSessionDataTask *)sendRequestAsync:(NSString *)url method:(NSString *)method form:(NSString *)form
                  success:(void (^)(NSURLRequest *request, NSHTTPURLResponse *response, id JSON))success
                  failure:(void (^)(NSURLRequest *request, NSHTTPURLResponse *response, id JSON, NSError *error))failure
@@ -988,17 +1088,7 @@ static AFHTTPRequestSerializer <AFURLRequestSerialization> * _requestSerializer;
             [self showDeserializedError:error];
             Warning("token=%@, resp=%ld %@, delegate=%@, url=%@, Error: %@", self.token, (long)resp.statusCode, responseObject, self.delegate, url, error);
             failure (request, resp, responseObject, error);
-            if (resp.statusCode == HTTP_ERR_UNAUTHORIZED) {
-                [self handleUnauthorizedErrorResponse:resp];
-            } else if (resp.statusCode == HTTP_ERR_OPERATION_FAILED && [responseObject isKindOfClass:[NSDictionary class]]) {
-                NSString *err_msg = [((NSDictionary *)responseObject) objectForKey:@"error_msg"];
-                if (err_msg && [@"Above quota" isEqualToString:err_msg]) {
-                    Warning("Out of quota.");
-                    [self.delegate outOfQuota:self];
-                }
-            } else if (resp.statusCode == HTTP_ERR_REPO_DOWNLOAD_PASSWORD_EXPIRED) {
-                [self refreshRepoPasswords];
-            }
+            [self handleErrorResponse:resp JSON:responseObject];
         } else {
             success(request, resp, responseObject);
         }
@@ -1030,6 +1120,72 @@ static AFHTTPRequestSerializer <AFURLRequestSerialization> * _requestSerializer;
     return task;
 }
 
+- (AFHTTPSessionManager *)streamMgr
+{
+    @synchronized(self) {
+        if (!_streamMgr) {
+            // Raw bytes instead of a JSON tree, the receivers parse the body themselves.
+            _streamMgr = [[AFHTTPSessionManager alloc] initWithBaseURL:[NSURL URLWithString:self.address] sessionConfiguration:_sessionMgr.session.configuration];
+            _streamMgr.responseSerializer = [AFHTTPResponseSerializer serializer];
+            _streamMgr.responseSerializer.acceptableContentTypes = nil;
+            _streamMgr.securityPolicy = _policy;
+            [self setAuthenticationChallengeBlockOf:_streamMgr];
+            _streamReceivers = [[NSMutableDictionary alloc] init];
+
+            __weak typeof(self) weakSelf = self;
+            [_streamMgr setDataTaskDidReceiveDataBlock:^(NSURLSession *session, NSURLSessionDataTask *dataTask, NSData *data) {
+                __strong typeof(weakSelf) strongSelf = weakSelf;
+                if (!strongSelf) return;
+                void (^receive)(NSHTTPURLResponse *, NSData *);
+                @synchronized(strongSelf.streamReceivers) {
+                    receive = [strongSelf.streamReceivers objectForKey:@(dataTask.taskIdentifier)];
+                }
+                NSHTTPURLResponse *resp = (NSHTTPURLResponse *)dataTask.response;
+                if (receive && resp.statusCode >= 200 && resp.statusCode < 300) {
+                    receive(resp, data);
+                }
+            }];
+        }
+        return _streamMgr;
+    }
+}
+
+- (NSURLSessionDataTask *)sendStreamingRequest:(NSString *)url
+                                      receive:(void (^)(NSHTTPURLResponse *response, NSData *data))receive
+                                   completion:(void (^)(NSHTTPURLResponse *response, NSError *error))completion
+{
+    NSURLRequest *request = [self buildRequest:url method:@"GET" form:nil];
+    Debug("Streaming request: %@", request.URL);
+
+    AFHTTPSessionManager *manager = self.streamMgr;
+    __block NSNumber *taskId = nil;
+    NSURLSessionDataTask *task = [manager dataTaskWithRequest:request uploadProgress:nil downloadProgress:nil completionHandler:^(NSURLResponse * _Nonnull response, id  _Nullable responseObject, NSError * _Nullable error) {
+        @synchronized(self.streamReceivers) {
+            if (taskId) [self.streamReceivers removeObjectForKey:taskId];
+        }
+        NSHTTPURLResponse *resp = (NSHTTPURLResponse *)response;
+        // The body is not parsed by the stream manager, an error body is small JSON.
+        id JSON = nil;
+        if (error) {
+            [self showDeserializedError:error];
+            if ([responseObject isKindOfClass:[NSData class]] && [(NSData *)responseObject length] > 0) {
+                JSON = [NSJSONSerialization JSONObjectWithData:responseObject options:0 error:nil];
+            }
+            Warning("token=%@, resp=%ld %@, url=%@, Error: %@", self.token, (long)resp.statusCode, JSON, url, error);
+        }
+        completion(resp, error);
+        if (error) {
+            [self handleErrorResponse:resp JSON:JSON];
+        }
+    }];
+    taskId = @(task.taskIdentifier);
+    @synchronized(self.streamReceivers) {
+        [self.streamReceivers setObject:[receive copy] forKey:taskId];
+    }
+    [task resume];
+    return task;
+}
+
 - (NSURLSessionDataTask *)sendRequest:(NSString *)url
             success:(void (^)(NSURLRequest *request, NSHTTPURLResponse *response, id JSON))success
             failure:(void (^)(NSURLRequest *request, NSHTTPURLResponse *response, id JSON, NSError *error))failure
@@ -1571,25 +1727,29 @@ static AFHTTPRequestSerializer <AFURLRequestSerialization> * _requestSerializer;
     }
 }
 
+- (SeafPrefetcher *)prefetcher
+{
+    @synchronized(self) {
+        if (!_prefetcher) {
+            _prefetcher = [[SeafPrefetcher alloc] initWithConnection:self];
+        }
+        return _prefetcher;
+    }
+}
+
+- (SeafChangeTracker *)changeTracker
+{
+    @synchronized(self) {
+        if (!_changeTracker) {
+            _changeTracker = [[SeafChangeTracker alloc] initWithConnection:self];
+        }
+        return _changeTracker;
+    }
+}
+
 - (void)downloadDir:(SeafDir *)dir
 {
-    [dir loadContentSuccess:^(SeafDir *dir) {
-        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-            Debug("dir %@ items: %lu", dir.path, (unsigned long)dir.items.count);
-            for (SeafBase *item in dir.items) {
-                if ([item isKindOfClass:[SeafFile class]]) {
-                    SeafFile *file = (SeafFile *)item;
-                    Debug("download file: %@, %@", item.repoId, item.path);
-                    [SeafDataTaskManager.sharedObject addFileDownloadTask:file];
-                } else if ([item isKindOfClass:[SeafDir class]]) {
-                    Debug("download dir: %@, %@", item.repoId, item.path);
-                    [self performSelector:@selector(downloadDir:) withObject:(SeafDir *)item];
-                }
-            }
-        });
-    } failure:^(SeafDir *dir, NSError *error) {
-        Warning("Failed to download dir %@ %@:  %@", dir.repoId, dir.path, error);
-    }];
+    [self.prefetcher prefetchDir:dir options:[SeafPrefetchOptions new]];
 }
 
 - (void)refreshRepoPasswords {
@@ -1616,6 +1776,7 @@ static AFHTTPRequestSerializer <AFURLRequestSerialization> * _requestSerializer;
 
 - (void)clearRepoPasswords
 {
+    [self wipeRepoKeys];
     NSDictionary *repopasswds = [_info objectForKey:@"repopassword"];
     if (repopasswds == nil)
         return;
@@ -1678,8 +1839,9 @@ static AFHTTPRequestSerializer <AFURLRequestSerialization> * _requestSerializer;
 
 - (void)clearAccountCache
 {
-    [SeafStorage.sharedObject clearCache];
+    [[SeafCacheManager sharedManager] clearAllCache];
     [_cacheProvider clearAllCacheInAccount:self.accountIdentifier];
+    [Utils clearAllFiles:[self direntCacheDir]];
     [SeafAvatar clearCache];
     [self clearUploadCache];
     // CLear old versiond data
@@ -1749,9 +1911,24 @@ static AFHTTPRequestSerializer <AFURLRequestSerialization> * _requestSerializer;
     [[NSNotificationCenter defaultCenter] removeObserver:self name:NSUbiquitousKeyValueStoreDidChangeExternallyNotification object:[NSUbiquitousKeyValueStore defaultStore]];
 }
 
+- (NSString *)direntCacheDir
+{
+    NSString *dir = [SeafStorage.sharedObject.direntsDir stringByAppendingPathComponent:[[(self.accountIdentifier ?: @"") dataUsingEncoding:NSUTF8StringEncoding] SHA1]];
+    [Utils checkMakeDir:dir];
+    return dir;
+}
+
 - (NSSet *)getAllCachedDirectoryOids
 {
     NSMutableSet *oids = [NSMutableSet new];
+    NSString *dir = [self direntCacheDir];
+    for (NSString *name in [[NSFileManager defaultManager] contentsOfDirectoryAtPath:dir error:nil]) {
+        SeafDirentList *list = [SeafDirentList listWithContentsOfFile:[dir stringByAppendingPathComponent:name]];
+        if (list.oid) {
+            [oids addObject:list.oid];
+        }
+    }
+    // Listings cached by earlier versions, until their directories are loaded again
     NSArray *values = [_cacheProvider getAllValuesForEntity:ENTITY_DIRECTORY inAccount:self.accountIdentifier];
     
     for (NSString *value in values) {
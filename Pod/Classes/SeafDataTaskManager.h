@@ -49,6 +49,9 @@ typedef void(^DownLoadFinshBlock)(id<SeafTask>  _Nonnull task);
 
 - (void)removeThumbTaskFromAccountQueue:(SeafThumb * _Nonnull)thumb;
 
+// Ids of cached objects the unfinished tasks of all accounts depend on, e.g. the base of an edited file
+- (NSSet<NSString *> * _Nonnull)objectIdsWithPendingChanges;
+
 - (NSArray *_Nullable)getOngoingUploadTasks: (SeafConnection *_Nullable)connection;
 
 - (NSMutableDictionary*_Nullable)convertTaskToDict:(id _Nullable )task;
@@ -62,6 +65,11 @@ typedef void(^DownLoadFinshBlock)(id<SeafTask>  _Nonnull task);
 
 - (void)removeUploadFileTaskInStorage:(SeafUploadFile *)ufile;
 
+// Block upload manifests, kept next to the upload task storage so that a block upload resumes after a restart
+- (NSDictionary * _Nullable)uploadManifestForFile:(SeafUploadFile * _Nonnull)ufile;
+- (void)saveUploadManifest:(NSDictionary * _Nonnull)manifest forFile:(SeafUploadFile * _Nonnull)ufile;
+- (void)removeUploadManifestForFile:(SeafUploadFile * _Nonnull)ufile;
+
 // Comment image downloads via thumb queue
 - (NSOperation * _Nonnull)addCommentImageDownload:(NSString * _Nonnull)url
                                        connection:(SeafConnection * _Nonnull)conn
@@ -11,6 +11,7 @@
 #import "SeafDownloadOperation.h"
 #import "SeafThumbOperation.h"
 #import "SeafDir.h"
+#import "SeafPrefetcher.h"
 #import "Debug.h"
 #import "SeafStorage.h"
 #import <AFNetworking/AFNetworking.h>
@@ -18,6 +19,9 @@
 #import "SeafFile.h"
 #import "SeafThumb.h"
 #import "Version.h"
+#import "NSData+Encryption.h"
+
+#define UPLOAD_MANIFESTS_DIR @"manifests"
 
 @interface SeafDataTaskManager()
 
@@ -218,6 +222,19 @@
     }
 }
 
+- (NSSet<NSString *> *)objectIdsWithPendingChanges
+{
+    NSArray<SeafAccountTaskQueue *> *queues;
+    @synchronized(self.accountQueueDict) {
+        queues = self.accountQueueDict.allValues;
+    }
+    NSMutableSet<NSString *> *oids = [NSMutableSet set];
+    for (SeafAccountTaskQueue *queue in queues) {
+        [oids unionSet:[queue objectIdsWithPendingChanges]];
+    }
+    return oids;
+}
+
 #pragma mark - Task Persistence
 
 - (void)saveUploadFileToTaskStorage:(SeafUploadFile *)ufile {
@@ -247,6 +264,43 @@
         [taskStorage removeObjectForKey:ufile.lpath];
         [SeafStorage.sharedObject setObject:taskStorage forKey:key];
     }
+    [self removeUploadManifestForFile:ufile];
+}
+
+#pragma mark - Upload Manifests
+
+- (NSString *)uploadManifestDir:(NSString *)accountIdentifier {
+    NSString *accountDir = [[accountIdentifier ?: @"" dataUsingEncoding:NSUTF8StringEncoding] SHA1];
+    return [[SeafStorage.sharedObject.uploadsDir stringByAppendingPathComponent:UPLOAD_MANIFESTS_DIR] stringByAppendingPathComponent:accountDir];
+}
+
+- (NSString *)uploadManifestPath:(SeafUploadFile *)ufile {
+    NSString *name = [[[ufile.lpath dataUsingEncoding:NSUTF8StringEncoding] SHA1] stringByAppendingPathExtension:@"plist"];
+    return [[self uploadManifestDir:ufile.accountIdentifier] stringByAppendingPathComponent:name];
+}
+
+- (NSDictionary *)uploadManifestForFile:(SeafUploadFile *)ufile {
+    if (!ufile.lpath) return nil;
+    @synchronized(self) {
+        return [NSDictionary dictionaryWithContentsOfFile:[self uploadManifestPath:ufile]];
+    }
+}
+
+- (void)saveUploadManifest:(NSDictionary *)manifest forFile:(SeafUploadFile *)ufile {
+    if (!ufile.lpath) return;
+    @synchronized(self) {
+        [Utils checkMakeDir:[self uploadManifestDir:ufile.accountIdentifier]];
+        if (![manifest writeToFile:[self uploadManifestPath:ufile] atomically:YES]) {
+            Warning("Failed to save upload manifest of %@", ufile.lpath);
+        }
+    }
+}
+
+- (void)removeUploadManifestForFile:(SeafUploadFile *)ufile {
+    if (!ufile.lpath) return;
+    @synchronized(self) {
+        [Utils removeFile:[self uploadManifestPath:ufile]];
+    }
 }
 
 
@@ -301,6 +355,8 @@
 }
 
 - (void)p_startLastTimeUnfinshTaskWithConnection:(SeafConnection *)conn {
+    [conn.prefetcher resumeFromCheckpoint];
+
     NSString *downloadKey = [self downloadStorageKey:conn.accountIdentifier];
     NSDictionary *downloadTasks = [SeafStorage.sharedObject objectForKey:downloadKey];
     if (downloadTasks.allValues.count > 0) {
@@ -383,6 +439,9 @@
 - (void)removeAccountUploadTaskFromStorage:(NSString *)accountIdentifier {
     NSString *key = [self uploadStorageKey:accountIdentifier];
     [SeafStorage.sharedObject removeObjectForKey:key];
+    @synchronized(self) {
+        [[NSFileManager defaultManager] removeItemAtPath:[self uploadManifestDir:accountIdentifier] error:nil];
+    }
 }
 
 - (NSArray * _Nullable)getUploadTasksInDir:(SeafDir *)dir connection:(SeafConnection * _Nonnull)connection {
@@ -46,6 +46,7 @@
 
 @property (readonly, copy) NSArray *allItems;//All items displayed in the current directory
 @property (nonatomic, copy) NSArray *items;//All items from server,after modified by - (void)updateItems:(NSMutableArray *)items
+@property (readonly, nullable) NSSet<SeafBase *> *changedItems;//Items kept by the last refresh but updated in place
 @property (readonly) NSArray *uploadFiles;// equal to uploadItems
 @property (readonly) BOOL editable;
 @property (nonatomic, copy) NSString *perm;
@@ -97,6 +98,12 @@
  */
 - (void)sortItems:(NSMutableArray *)items;
 
+/**
+ * Returns the comparator items are sorted with for a sort key, leaving the configured sort key alone.
+ * @param sortKey @"MTIME" for the newest first, otherwise by name.
+ */
++ (NSComparator)comparatorForSortKey:(NSString *)sortKey;
+
 /**
  * Initiates loading of the directory content from the server.
  * @param success A block called on successful loading of the directory.
@@ -105,7 +112,8 @@
 - (void)loadContentSuccess:(void (^)(SeafDir *dir)) success failure:(void (^)(SeafDir *dir, NSError *error))failure;
 
 /**
- * Checks if a given name already exists in the directory's items.
+ * Checks if a given name already exists in the directory's items or upload items,
+ * ignoring case and Unicode normalization.
  * @param name The name of the item to check for existence.
  * @return A boolean indicating whether the name exists in the directory's items.
  */
@@ -124,6 +132,9 @@
 
 - (void)handleResponse:(NSHTTPURLResponse *)response json:(id)JSON;
 
+/// The object id of the cached listing, read without loading it; nil if the directory is not cached.
+- (NSString * _Nullable)cachedOid;
+
 /**
  * Returns a string representation of the directory's modification time for display.
  * @return A formatted string with the modification time, or an empty string if mtime is not available.
@@ -21,122 +21,28 @@
 #import "SeafUploadOperation.h"
 #import "SeafRealmManager.h"
 #import "SeafDateFormatter.h"
+#import "SeafDirentList.h"
+#import "SeafDirentDiff.h"
+#import "SeafCollationKey.h"
+#import "SeafJSONStream.h"
+#import "NSData+Encryption.h"
 
 typedef NSComparisonResult (^SeafSortableCmp)(id<SeafSortable> obj1, id<SeafSortable> obj2);
 
 typedef NSComparisonResult (^SeafCmpFunc)(id obj1, id obj2, SeafSortableCmp comparator);
 
-#pragma mark - Natural Sort Helpers (matching web frontend logic)
-
-/// Check if the string contains only ASCII letters and digits.
-static BOOL seafIsLetterOrNumber(NSString *str) {
-    if (str.length == 0) return NO;
-    static NSCharacterSet *nonAlnum = nil;
-    static dispatch_once_t onceToken;
-    dispatch_once(&onceToken, ^{
-        NSMutableCharacterSet *alnum = [NSMutableCharacterSet alphanumericCharacterSet];
-        nonAlnum = [alnum invertedSet];
-    });
-    return [str rangeOfCharacterFromSet:nonAlnum].location == NSNotFound;
-}
-
-/// Check if every character falls in the CJK Unified Ideographs range (U+4E00–U+9FA5).
-/// NOTE: The upper bound 0x9FA5 intentionally matches the web frontend's isAllChineseStr()
-/// regex (/^[\u4E00-\u9FA5]+$/) to keep sorting behaviour consistent across platforms.
-static BOOL seafIsAllChinese(NSString *str) {
-    if (str.length == 0) return NO;
-    static NSCharacterSet *nonChinese = nil;
-    static dispatch_once_t onceToken;
-    dispatch_once(&onceToken, ^{
-        NSCharacterSet *chinese = [NSCharacterSet characterSetWithRange:NSMakeRange(0x4E00, 0x9FA5 - 0x4E00 + 1)];
-        nonChinese = [chinese invertedSet];
-    });
-    return [str rangeOfCharacterFromSet:nonChinese].location == NSNotFound;
-}
-
-/// Split a string into an array where consecutive digits are kept as one element
-/// and non-digit characters are split into individual characters.
-/// e.g. "file10中文" -> @[@"f", @"i", @"l", @"e", @"10", @"中", @"文"]
-static NSArray<NSString *> *seafSplitStringByNumber(NSString *str) {
-    NSMutableArray *result = [NSMutableArray array];
-    static NSRegularExpression *regex = nil;
-    static dispatch_once_t onceToken;
-    dispatch_once(&onceToken, ^{
-        regex = [NSRegularExpression regularExpressionWithPattern:@"\\d+|\\D+" options:0 error:nil];
-    });
-    NSArray *matches = [regex matchesInString:str options:0 range:NSMakeRange(0, str.length)];
-    for (NSTextCheckingResult *match in matches) {
-        NSString *part = [str substringWithRange:match.range];
-        unichar first = [part characterAtIndex:0];
-        if (first >= '0' && first <= '9') {
-            // Keep numeric segment as a whole for numeric comparison
-            [result addObject:part];
-        } else {
-            // Split non-numeric segment into individual characters
-            [part enumerateSubstringsInRange:NSMakeRange(0, part.length)
-                                    options:NSStringEnumerationByComposedCharacterSequences
-                                 usingBlock:^(NSString *substring, NSRange substringRange, NSRange enclosingRange, BOOL *stop) {
-                if (substring) [result addObject:substring];
-            }];
-        }
-    }
-    return result;
-}
-
-static NSLocale *seafZhLocale(void) {
-    static NSLocale *loc = nil;
-    static dispatch_once_t onceToken;
-    dispatch_once(&onceToken, ^{
-        loc = [NSLocale localeWithLocaleIdentifier:@"zh-Hans-CN"];
-    });
-    return loc;
+/// The form names are compared in for collisions: precomposed and case folded, like a
+/// case insensitive comparison of the precomposed names.
+static NSString *seafFoldedName(NSString *name) {
+    return [[name precomposedStringWithCanonicalMapping] stringByFoldingWithOptions:NSCaseInsensitiveSearch locale:nil];
 }
 
-/// Compare two strings using the same logic as the web frontend's compareTwoString().
-/// Sort order: non-Chinese before Chinese; numbers compared by numeric value; Chinese by pinyin.
-static NSComparisonResult seafNaturalCompare(NSString *a, NSString *b) {
-    // Fast path: both are pure letters/numbers
-    if (seafIsLetterOrNumber(a) && seafIsLetterOrNumber(b)) {
-        return [a compare:b options:NSCaseInsensitiveSearch | NSNumericSearch
-                    range:NSMakeRange(0, a.length) locale:seafZhLocale()];
-    }
-
-    // Fast path: both are pure Chinese
-    if (seafIsAllChinese(a) && seafIsAllChinese(b)) {
-        return [a compare:b options:NSCaseInsensitiveSearch
-                    range:NSMakeRange(0, a.length) locale:seafZhLocale()];
-    }
-
-    // Mixed content: split and compare element by element
-    NSArray *arrA = seafSplitStringByNumber(a);
-    NSArray *arrB = seafSplitStringByNumber(b);
-    NSUInteger len = MIN(arrA.count, arrB.count);
-
-    for (NSUInteger i = 0; i < len; i++) {
-        NSString *ca = arrA[i];
-        NSString *cb = arrB[i];
-
-        // Non-Chinese sorts before Chinese
-        BOOL caIsChinese = seafIsAllChinese(ca);
-        BOOL cbIsChinese = seafIsAllChinese(cb);
-        if (!caIsChinese && cbIsChinese) return NSOrderedAscending;
-        if (caIsChinese && !cbIsChinese) return NSOrderedDescending;
-
-        NSComparisonResult r;
-        if (caIsChinese && cbIsChinese) {
-            r = [ca compare:cb options:NSCaseInsensitiveSearch
-                      range:NSMakeRange(0, ca.length) locale:seafZhLocale()];
-        } else {
-            r = [ca compare:cb options:NSCaseInsensitiveSearch | NSNumericSearch
-                      range:NSMakeRange(0, ca.length) locale:seafZhLocale()];
-        }
-        if (r != NSOrderedSame) return r;
+/// The collation key of an item, kept by the item when it can hold one.
+static SeafCollationKey *seafCollationKeyOf(id<SeafSortable> obj) {
+    if ([obj respondsToSelector:@selector(collationKey)]) {
+        return [obj collationKey];
     }
-
-    // All compared elements are equal; shorter string comes first
-    if (arrA.count > arrB.count) return NSOrderedDescending;
-    if (arrA.count < arrB.count) return NSOrderedAscending;
-    return NSOrderedSame;
+    return [SeafCollationKey keyWithName:obj.name];
 }
 
 #pragma mark - Sort Comparators
@@ -145,7 +51,7 @@ static SeafCmpFunc seafCmpFunc = ^(id obj1, id obj2, SeafSortableCmp comparator)
     if ([obj1 conformsToProtocol:@protocol(SeafSortable)] && [obj2 conformsToProtocol:@protocol(SeafSortable)]) {
         return comparator((id<SeafSortable>)obj1, (id<SeafSortable>)obj2);
     } else if ([obj1 isKindOfClass:[SeafDir class]] && [obj2 isKindOfClass:[SeafDir class]]) {
-        return seafNaturalCompare([(SeafDir *)obj1 name], [(SeafDir *)obj2 name]);
+        return [seafCollationKeyOf(obj1) compare:seafCollationKeyOf(obj2)];
     } else if ([obj1 isKindOfClass:[SeafDir class]] || [obj2 isKindOfClass:[SeafDir class]]) {
         if ([obj1 isKindOfClass:[SeafDir class]]) {
             return NSOrderedAscending;
@@ -159,16 +65,55 @@ static SeafCmpFunc seafCmpFunc = ^(id obj1, id obj2, SeafSortableCmp comparator)
 
 static NSComparator seafSortByName = ^(id a, id b) {
     return seafCmpFunc(a, b, ^(id<SeafSortable> obj1, id<SeafSortable> obj2) {
-        return seafNaturalCompare(obj1.name, obj2.name);
+        return [seafCollationKeyOf(obj1) compare:seafCollationKeyOf(obj2)];
     });
 };
 
 static NSComparator seafSortByMtime = ^(id a, id b) {
     return seafCmpFunc(a, b, ^(id<SeafSortable> obj1, id<SeafSortable> obj2) {
-        return [[NSNumber numberWithLongLong:obj2.mtime] compare:[NSNumber numberWithLongLong:obj1.mtime]];
+        long long mtime1 = obj1.mtime, mtime2 = obj2.mtime;
+        if (mtime1 == mtime2) return NSOrderedSame;
+        return mtime2 < mtime1 ? NSOrderedAscending : NSOrderedDescending;
     });
 };
 
+/// Listings are parsed off the main thread, one at a time.
+static dispatch_queue_t seafDirParseQueue(void) {
+    static dispatch_queue_t queue;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        dispatch_queue_attr_t attr = dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_USER_INITIATED, 0);
+        queue = dispatch_queue_create("com.seafile.dirParse", attr);
+    });
+    return queue;
+}
+
+/// A streamed listing is shown after this many entries, if nothing was shown before.
+static const NSUInteger SeafDirPreviewCount = 100;
+
+/// A listing being parsed, with the changes to the loaded objects which wait to be published.
+@interface SeafDirentParse : NSObject
+
+/// The items and their listing id when the parse began.
+@property (nonatomic, strong) NSArray *oldItems;
+@property (nonatomic, copy) NSString *previousOid;
+@property (nonatomic, strong) SeafDirentDiff *diff;
+@property (nonatomic, strong) SeafAccountTaskQueue *uploadQueue;
+@property (nonatomic, copy) NSString *fullPath;
+/// Sync statuses of the new and changed files, their dirId is set when the parse is finished.
+@property (nonatomic, strong) NSMutableArray<SeafFileStatus *> *statuses;
+
+@property (nonatomic, strong) NSMutableArray<SeafBase *> *items;
+@property (nonatomic, strong) NSMutableSet<SeafBase *> *changedItems;
+/// Pairs of (loaded object, object holding its new entry).
+@property (nonatomic, strong) NSMutableArray<NSArray<SeafBase *> *> *updates;
+/// Pairs of (loaded file, upload of its edit).
+@property (nonatomic, strong) NSMutableArray<NSArray *> *editedFiles;
+
+@end
+
+@implementation SeafDirentParse
+@end
 
 @interface SeafDir ()
 @property NSObject *uploadLock;
@@ -178,6 +123,15 @@ static NSComparator seafSortByMtime = ^(id a, id b) {
 @property (nonatomic, strong, readwrite) NSDictionary<NSString *, NSNumber *> *serverFileIndex;
 @property (nonatomic, strong, readwrite) NSDictionary<NSString *, NSString *> *serverFileLowercaseIndex;
 @property (nonatomic, strong, readwrite) NSDictionary<NSString *, NSString *> *serverFileBaseNameIndex;
+@property (strong, nullable) NSSet<SeafBase *> *changedItems;
+// A cached listing whose file index has not been built yet
+@property (nonatomic, strong) SeafDirentList *pendingIndexList;
+
+// Folded names of the items to their actual names, valid while nameIndexItems is the current items
+@property (nonatomic, strong) NSDictionary<NSString *, NSString *> *nameIndex;
+@property (nonatomic, weak) NSArray *nameIndexItems;
+// Folded names of the upload items, guarded by uploadLock
+@property (nonatomic, strong) NSCountedSet<NSString *> *uploadNameIndex;
 
 @end
 
@@ -263,91 +217,260 @@ static NSComparator seafSortByMtime = ^(id a, id b) {
 
 - (BOOL)handleData:(NSString *)oid data:(id)JSON
 {
-    @synchronized(self) {
-        if (oid) {
+    SeafDirentParse *parse = [self parseData:oid data:JSON];
+    if (!parse) return NO;
+    [self publishParse:parse];
+    return YES;
+}
+
+// Builds the new items, and writes the sync statuses of the changed files.
+// Safe to call off the main thread, the loaded objects are left as they are.
+- (SeafDirentParse *)parseData:(NSString *)oid data:(id)JSON
+{
+    if (oid) {
+        @synchronized(self) {
             if ([oid isEqualToString:self.ooid])
-                return NO;
-            self.ooid = oid;
-        } else {
-            if ([@"uptodate" isEqual:JSON])
-                return NO;
+                return nil;
         }
+    } else if ([@"uptodate" isEqual:JSON]) {
+        return nil;
     }
-    
+
     // v2.1: the server returns a dictionary { "dirent_list": [...] }
     NSArray *dirArray = nil;
     if ([JSON isKindOfClass:[NSDictionary class]]) {
         dirArray = JSON[@"dirent_list"];
         if (![dirArray isKindOfClass:[NSArray class]]) {
             Warning("Invalid response type: %@, %@", NSStringFromClass([JSON class]), JSON);
-            return false;
+            return nil;
         }
     } else if ([JSON isKindOfClass:[NSArray class]]) { // backward compatibility
         dirArray = (NSArray *)JSON;
     } else {
         Warning("Invalid response type: %@, %@", NSStringFromClass([JSON class]), JSON);
-        return NO;
+        return nil;
     }
-    
-    //check if has edited file not uploaded before.
-    SeafAccountTaskQueue *accountQueue = [SeafDataTaskManager.sharedObject accountQueueForConnection:self.connection];
-    NSArray *allUpLoadTasks = [accountQueue getNeedUploadTasks];
-    
-    NSMutableArray *newItems = [NSMutableArray array];
-    NSMutableArray<SeafFileStatus *> *statusArray = [NSMutableArray array]; // useFor sync status
 
+    SeafDirentParse *parse = [self beginParse];
     for (NSDictionary *itemInfo in dirArray) {
-        if ([itemInfo objectForKey:@"name"] == [NSNull null])
-            continue;
-        SeafBase *newItem = nil;
-        NSString *type = [itemInfo objectForKey:@"type"];
-        NSString *name = [itemInfo objectForKey:@"name"];
-        NSString *path = [self.path isEqualToString:@"/"] ? [NSString stringWithFormat:@"/%@", name]:[NSString stringWithFormat:@"%@/%@", self.path, name];
-
-        if ([type isEqual:@"file"]) {
-            newItem = [[SeafFile alloc] initWithConnection:self.connection oid:[itemInfo objectForKey:@"id"] repoId:self.repoId name:name path:path mtime:[[itemInfo objectForKey:@"mtime"] integerValue:0] size:[[itemInfo objectForKey:@"size"] integerValue:0]];
-            SeafRepo *repo = [self.connection getRepo:self.repoId];
-            if ([self.name isEqualToString:repo.name]) {
-                newItem.fullPath = [NSString stringWithFormat:@"/%@", self.name];
-            } else {
-                newItem.fullPath = [NSString stringWithFormat:@"/%@/%@",repo.name,self.name];
-            }
-            
-            NSNumber *mtimeNumber = [itemInfo objectForKey:@"mtime"];
-
-            NSString *fOid = [itemInfo objectForKey:@"id"];
-            
-            if (allUpLoadTasks.count > 0) {//if have uploadTask
-                for (SeafUploadFile *file in allUpLoadTasks) {
-                    //check and set uploadFile to SeafFile
-                    if ((file.editedFileOid != nil) && [file.editedFileOid isEqualToString:fOid]) {
-                        SeafFile *fileItem = (SeafFile *)newItem;
-                        fileItem.ufile = file;
-                        [fileItem setMpath:file.lpath];
-                        fileItem.ufile.delegate = fileItem;
-                        newItem = fileItem;
-                    }
-                }
+        [self parse:parse addEntry:itemInfo];
+    }
+    return [self finishParse:parse oid:oid] ? parse : nil;
+}
+
+// Starts parsing a listing against the current items, its entries are added one by one.
+- (SeafDirentParse *)beginParse
+{
+    SeafDirentParse *parse = [SeafDirentParse new];
+    @synchronized(self) {
+        parse.previousOid = self.ooid;
+        parse.oldItems = _items;
+    }
+    // Entries which did not change keep their objects, and their sync status rows
+    parse.diff = [[SeafDirentDiff alloc] initWithItems:parse.oldItems];
+    //check if has edited file not uploaded before.
+    parse.uploadQueue = [self uploadQueue];
+    parse.fullPath = [self fullPathForItems];
+    parse.items = [NSMutableArray array];
+    parse.changedItems = [NSMutableSet set];
+    parse.updates = [NSMutableArray array];
+    parse.editedFiles = [NSMutableArray array];
+    parse.statuses = [NSMutableArray array]; // useFor sync status
+    return parse;
+}
+
+- (void)parse:(SeafDirentParse *)parse addEntry:(NSDictionary *)itemInfo
+{
+    if (![itemInfo isKindOfClass:[NSDictionary class]] || [itemInfo objectForKey:@"name"] == [NSNull null])
+        return;
+    NSString *type = [itemInfo objectForKey:@"type"];
+    SeafDirentType direntType;
+    if ([type isEqual:@"file"]) {
+        direntType = SeafDirentTypeFile;
+    } else if ([type isEqual:@"dir"]) {
+        direntType = SeafDirentTypeDir;
+    } else {
+        return;
+    }
+    NSString *name = [itemInfo objectForKey:@"name"];
+    NSString *itemOid = [itemInfo objectForKey:@"id"];
+    long long mtime = [[itemInfo objectForKey:@"mtime"] integerValue:0];
+    NSUInteger oldIndex = NSNotFound;
+    SeafDirentChange change = [parse.diff compareEntry:name type:direntType oid:itemOid mtime:mtime oldIndex:&oldIndex];
+
+    SeafBase *newItem = nil;
+    if (change == SeafDirentChangeNone) {
+        newItem = [parse.oldItems objectAtIndex:oldIndex];
+        SeafUploadFile *ufile = direntType == SeafDirentTypeFile ? [parse.uploadQueue pendingEditedUploadForOid:itemOid] : nil;
+        if (ufile && ((SeafFile *)newItem).ufile != ufile) {
+            [parse.editedFiles addObject:@[newItem, ufile]];
+        }
+    } else {
+        newItem = [self itemWithType:direntType
+                                name:name
+                                 oid:itemOid
+                                perm:[itemInfo objectForKey:@"permission"]
+                               mtime:mtime
+                                size:[[itemInfo objectForKey:@"size"] integerValue:0]
+                         uploadQueue:parse.uploadQueue
+                            fullPath:parse.fullPath];
+        if (change == SeafDirentChangeUpdated) {
+            SeafBase *oldObj = [parse.oldItems objectAtIndex:oldIndex];
+            if ([oldObj class] == [newItem class]) {
+                [parse.updates addObject:@[oldObj, newItem]];
+                newItem = oldObj;
+                [parse.changedItems addObject:oldObj];
             }
-            
+        }
+        if (direntType == SeafDirentTypeFile) {
             SeafFileStatus *fStatus = [self parseFileStatus:itemInfo];
-            fStatus.dirId = oid;
             if (fStatus) {
-                [statusArray addObject:fStatus];
+                [parse.statuses addObject:fStatus];
             }
-            
-        } else if ([type isEqual:@"dir"]) {
-            newItem = [[SeafDir alloc] initWithConnection:self.connection oid:[itemInfo objectForKey:@"id"] repoId:self.repoId perm:[itemInfo objectForKey:@"permission"] name:name path:path mtime:[[itemInfo objectForKey:@"mtime"] integerValue:0]];
         }
-        [newItems addObject:newItem];
     }
-    
+    [parse.items addObject:newItem];
+}
+
+// Takes the listing with id oid, unless it is the current one, and writes the sync statuses.
+- (BOOL)finishParse:(SeafDirentParse *)parse oid:(NSString *)oid
+{
+    @synchronized(self) {
+        if (oid) {
+            if ([oid isEqualToString:self.ooid])
+                return NO;
+            self.ooid = oid;
+        }
+    }
+
     if ([Utils isMainApp]) {
-        [[SeafRealmManager shared] updateFileStatuses:statusArray];
+        NSArray *oldItems = parse.oldItems;
+        NSMutableArray<NSString *> *removedPaths = [NSMutableArray array];
+        [parse.diff.deletedIndexes enumerateIndexesUsingBlock:^(NSUInteger idx, BOOL *stop) {
+            if ([oldItems isKindOfClass:[SeafDirentList class]]) {
+                SeafDirentList *list = (SeafDirentList *)oldItems;
+                if ([list typeAtIndex:idx] == SeafDirentTypeFile) {
+                    [removedPaths addObject:[Utils uniquePathWithUniKey:self.uniqueKey fileName:[list nameAtIndex:idx]]];
+                }
+            } else {
+                SeafBase *obj = [oldItems objectAtIndex:idx];
+                if ([obj isKindOfClass:[SeafFile class]]) {
+                    [removedPaths addObject:[Utils uniquePathWithUniKey:self.uniqueKey fileName:obj.name]];
+                }
+            }
+        }];
+        for (SeafFileStatus *fStatus in parse.statuses) {
+            fStatus.dirId = oid;
+        }
+        [[SeafRealmManager shared] updateFileStatuses:parse.statuses
+                                        removingPaths:removedPaths
+                                            fromDirId:oldItems ? parse.previousOid : nil
+                                              toDirId:oid
+                                           forAccount:self.connection.accountIdentifier];
     }
+    Debug("%@: %lu entries, %lu changed", self.path, (unsigned long)parse.items.count, (unsigned long)parse.diff.changeCount);
+    return YES;
+}
 
-    [self buildFileIndexFromItems:newItems];
-    [self loadedItems:newItems];
+// Applies a parsed listing to the loaded objects and makes it the current one.
+- (void)publishParse:(SeafDirentParse *)parse
+{
+    for (NSArray<SeafBase *> *update in parse.updates) {
+        [update.firstObject updateWithEntry:update.lastObject];
+    }
+    for (NSArray *edit in parse.editedFiles) {
+        [self attachEditedFile:edit.lastObject toFile:edit.firstObject];
+    }
+    [self buildFileIndexFromItems:parse.items];
+    @synchronized(self) {
+        self.changedItems = parse.changedItems;
+        _items = parse.items;
+        _allItems = nil;
+    }
+}
+
+- (SeafAccountTaskQueue *)uploadQueue
+{
+    return [SeafDataTaskManager.sharedObject accountQueueForConnection:self.connection];
+}
+
+- (NSString *)fullPathForItems
+{
+    SeafRepo *repo = [self.connection getRepo:self.repoId];
+    if ([self.name isEqualToString:repo.name]) {
+        return [NSString stringWithFormat:@"/%@", self.name];
+    }
+    return [NSString stringWithFormat:@"/%@/%@", repo.name, self.name];
+}
+
+- (SeafBase *)itemWithType:(SeafDirentType)type
+                      name:(NSString *)name
+                       oid:(NSString *)oid
+                      perm:(NSString *)perm
+                     mtime:(long long)mtime
+                      size:(long long)size
+               uploadQueue:(SeafAccountTaskQueue *)uploadQueue
+                  fullPath:(NSString *)fullPath
+{
+    NSString *path = [self.path isEqualToString:@"/"] ? [NSString stringWithFormat:@"/%@", name]:[NSString stringWithFormat:@"%@/%@", self.path, name];
+    if (type == SeafDirentTypeDir) {
+        return [[SeafDir alloc] initWithConnection:self.connection oid:oid repoId:self.repoId perm:perm name:name path:path mtime:mtime];
+    }
+    SeafFile *fileItem = [[SeafFile alloc] initWithConnection:self.connection oid:oid repoId:self.repoId name:name path:path mtime:mtime size:size];
+    fileItem.fullPath = fullPath;
+    [self attachEditedFile:[uploadQueue pendingEditedUploadForOid:oid] toFile:fileItem];
+    return fileItem;
+}
+
+//check and set uploadFile to SeafFile
+- (void)attachEditedFile:(SeafUploadFile *)file toFile:(SeafFile *)fileItem
+{
+    if (!file || fileItem.ufile == file)
+        return;
+    fileItem.ufile = file;
+    [fileItem setMpath:file.lpath];
+    fileItem.ufile.delegate = fileItem;
+}
+
+// Uses a cached listing, its entries are created as they are accessed.
+- (BOOL)loadDirentList:(SeafDirentList *)list
+{
+    @synchronized(self) {
+        if ([list.oid isEqualToString:self.ooid])
+            return NO;
+        self.ooid = list.oid;
+    }
+    SeafAccountTaskQueue *accountQueue = [self uploadQueue];
+    NSString *fullPath = [self fullPathForItems];
+    // Keep the objects already handed out for entries which did not change, as they are accessed.
+    NSDictionary *existingItems = [self existingItemsByKey];
+    __weak typeof(self) weakSelf = self;
+    list.materializer = ^SeafBase *(SeafDirentList *l, NSUInteger index) {
+        __strong typeof(weakSelf) strongSelf = weakSelf;
+        if (!strongSelf) return nil;
+        SeafBase *obj = [strongSelf itemWithType:[l typeAtIndex:index]
+                                            name:[l nameAtIndex:index]
+                                             oid:[l oidAtIndex:index]
+                                            perm:[l permAtIndex:index]
+                                           mtime:[l mtimeAtIndex:index]
+                                            size:[l sizeAtIndex:index]
+                                     uploadQueue:accountQueue
+                                        fullPath:fullPath];
+        SeafBase *oldObj = [existingItems objectForKey:[obj key]];
+        if (oldObj && [obj class] == [oldObj class]) {
+            [oldObj updateWithEntry:obj];
+            return oldObj;
+        }
+        return obj;
+    };
+    // The file index is built from the records when it is first needed.
+    self.serverFileIndex = nil;
+    self.serverFileLowercaseIndex = nil;
+    self.serverFileBaseNameIndex = nil;
+    self.pendingIndexList = list;
+
+    _items = list;
+    _allItems = nil;
     return YES;
 }
 
@@ -401,6 +524,48 @@ static NSComparator seafSortByMtime = ^(id a, id b) {
     }
 }
 
+// Publishes a listing parsed in the background, or tells the delegate that it did not change if
+// parse is nil. The new listing is cached on the parse queue.
+- (void)publishListing:(SeafDirentParse *)parse oid:(NSString *)curId perm:(NSString *)dirPerm
+{
+    NSArray *cacheItems = nil;
+    @synchronized(self) {
+        self.state = SEAF_DENTRY_UPTODATE;
+        if (parse) {
+            [self publishParse:parse];
+            self.ooid = curId;
+            if (dirPerm) {
+                self.perm = dirPerm;
+            }
+            cacheItems = _items;
+            [self.delegate download:self complete:true];
+        } else {
+            Debug("Already uptodate oid=%@, path=%@\n", self.ooid, self.path);
+            [self.delegate download:self complete:false];
+        }
+        if (curId && ![self.oid isEqualToString:curId]) {
+            self.oid = curId;
+        }
+    }
+    if (cacheItems) {
+        dispatch_async(seafDirParseQueue(), ^{
+            [self writeCacheItems:cacheItems cacheOid:curId perm:dirPerm];
+        });
+    }
+}
+
+// Shows the first entries of a listing which is still arriving, if no listing was shown yet.
+- (void)publishPreview:(NSArray *)items
+{
+    @synchronized(self) {
+        if (_items || self.state != SEAF_DENTRY_LOADING)
+            return;
+        _items = items;
+        _allItems = nil;
+    }
+    [self.delegate download:self complete:true];
+}
+
 - (NSString *)url
 {
     NSString *requestStr = [NSString stringWithFormat:API_URL_V21"/repos/%@/dir/?p=%@", self.repoId, [self.path escapedUrl]];
@@ -412,20 +577,85 @@ static NSComparator seafSortByMtime = ^(id a, id b) {
 
  [{"id": "0d6a4cc4e084fec6cde0f50d628cf4f502ced622", "type": "file", "name": "shin_SSD.pdf", "size": 1092236}, {"id": "2ac5dfb7126bea3a2038069688337bd3f64e80e2", "type": "file", "name": "FTL design exploration in reconfigurable high-performance SSD for server applications.pdf", "size": 675464}, {"id": "eee56009908153baf5cf21615cea00cba657cb0a", "type": "file", "name": "DFTL.pdf", "size": 1232088}, {"id": "97eb7fd4f9ad45c821ed3ddd662c5d2b27ab7e45", "type": "file", "name": "BPLRU a buffer management scheme for improving random writes in flash storage.pdf", "size": 1113100}, {"id": "1578adbc33c143f68c5a79b421f1d9d7f0d52bc8", "type": "file", "name": "Algorithms and Data Structures for Flash Memories.pdf", "size": 689915}, {"id": "8dd0a3be9289aea6795c1203351691fcc1373fbb", "type": "file", "name": "2006-Intel TR-Understanding the flash translation layer (FTL)specification.pdf", "size": 84054}]
  */
+// The listing is parsed while it downloads, entries are built without decoding the whole response first.
 - (void)loadContentSuccess:(void (^)(SeafDir *dir)) success failure:(void (^)(SeafDir *dir, NSError *error))failure
 {
-    [self.connection sendRequest:self.url
-                    success:^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
-                        // Force reload uplaodItems from task queue.
-                        self->_uploadItems = nil;
-                        [self handleResponse:response json:JSON];
-                        if (success)  success(self);
-                    }
-                    failure:^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON, NSError *error) {
-                        self.state = SEAF_DENTRY_INIT;
-                        if (failure) failure(self, error);
-                        [self.delegate download:self failed:error];
-                    }];
+    // Touched on the parse queue only
+    SeafJSONStreamReader *reader = [[SeafJSONStreamReader alloc] initWithArrayKey:@"dirent_list"];
+    __block SeafDirentParse *parse = nil;
+    __block NSString *dirId = nil;
+    __block NSString *dirPerm = nil;
+    __block BOOL uptodate = NO;
+    __block BOOL previewed = NO;
+    __block NSURLSessionDataTask *task = nil;
+
+    reader.memberHandler = ^(NSString *key, id value) {
+        if (![value isKindOfClass:[NSString class]])
+            return;
+        if ([key isEqualToString:@"user_perm"]) {
+            dirPerm = value;
+        } else if ([key isEqualToString:@"dir_id"]) {
+            dirId = value;
+            @synchronized(self) {
+                uptodate = [dirId isEqualToString:self.ooid];
+            }
+            // The rest of an unchanged listing is not needed.
+            if (uptodate) [task cancel];
+        }
+    };
+    reader.elementHandler = ^(id element) {
+        if (!parse) parse = [self beginParse];
+        [self parse:parse addEntry:element];
+        if (!previewed && !parse.oldItems && parse.items.count == SeafDirPreviewCount) {
+            previewed = YES;
+            NSArray *preview = [parse.items copy];
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [self publishPreview:preview];
+            });
+        }
+    };
+
+    void (^fail)(NSError *) = ^(NSError *error) {
+        self.state = SEAF_DENTRY_INIT;
+        if (failure) failure(self, error);
+        [self.delegate download:self failed:error];
+    };
+    task = [self.connection sendStreamingRequest:self.url receive:^(NSHTTPURLResponse *response, NSData *data) {
+        dispatch_async(seafDirParseQueue(), ^{
+            if (uptodate || reader.error)
+                return;
+            if (![reader appendData:data]) {
+                Warning("Invalid listing of %@: %@", self.path, reader.error);
+                [task cancel];
+            }
+        });
+    } completion:^(NSHTTPURLResponse *response, NSError *error) {
+        dispatch_async(seafDirParseQueue(), ^{
+            NSString *curId = dirId ?: self.oid;
+            SeafDirentParse *result = nil;
+            if (!uptodate) {
+                NSError *parseError = error;
+                if (!parseError && (![reader finish] || !reader.foundArray)) {
+                    parseError = reader.error ?: [Utils defaultError];
+                    Warning("Invalid listing of %@: %@", self.path, parseError);
+                }
+                if (parseError) {
+                    dispatch_async(dispatch_get_main_queue(), ^{
+                        fail(parseError);
+                    });
+                    return;
+                }
+                if (!parse) parse = [self beginParse];
+                result = [self finishParse:parse oid:curId] ? parse : nil;
+            }
+            dispatch_async(dispatch_get_main_queue(), ^{
+                // Force reload uplaodItems from task queue.
+                self->_uploadItems = nil;
+                [self publishListing:result oid:curId perm:dirPerm];
+                if (success) success(self);
+            });
+        });
+    }];
 }
 
 - (void)realLoadContent
@@ -433,16 +663,34 @@ static NSComparator seafSortByMtime = ^(id a, id b) {
     [self loadContentSuccess:nil failure:nil];
 }
 
+// The objects of the current items by key
+- (NSDictionary *)existingItemsByKey
+{
+    NSMutableDictionary *dict = [[NSMutableDictionary alloc] init];
+    if ([_items isKindOfClass:[SeafDirentList class]]) {
+        // Entries of a cached listing which were never accessed have no objects to keep
+        SeafDirentList *list = (SeafDirentList *)_items;
+        for (NSUInteger j = 0; j < list.count; ++j) {
+            if ([list isMaterializedAtIndex:j]) {
+                SeafBase *obj = [list objectAtIndex:j];
+                [dict setObject:obj forKey:[obj key]];
+            }
+        }
+    } else {
+        for (SeafBase *obj in _items) {
+            [dict setObject:obj forKey:[obj key]];
+        }
+    }
+    return dict;
+}
+
 - (void)updateItems:(NSMutableArray *)items
 {
     int i = 0;
     if (!_items)
         _items = items;
     else {
-        NSMutableDictionary *dict = [[NSMutableDictionary alloc] init];
-        for (SeafBase *obj in _items) {
-            [dict setObject:obj forKey:[obj key]];
-        }
+        NSDictionary *dict = [self existingItemsByKey];
         for (i = 0; i < [items count]; ++i) {
             SeafBase *obj = (SeafBase*)[items objectAtIndex:i];
             SeafBase *oldObj = [dict objectForKey:[obj key]];
@@ -513,6 +761,14 @@ static NSComparator seafSortByMtime = ^(id a, id b) {
      _allItems = nil;
 }
 
++ (NSComparator)comparatorForSortKey:(NSString *)sortKey
+{
+    if ([@"MTIME" caseInsensitiveCompare:sortKey] == NSOrderedSame) {
+        return seafSortByMtime;
+    }
+    return seafSortByName;
+}
+
 - (NSComparator)getCmpFunc
 {
     NSString *confKey = [self configKeyForSort];
@@ -533,22 +789,52 @@ static NSComparator seafSortByMtime = ^(id a, id b) {
     self.state = SEAF_DENTRY_INIT;
     _items = nil;
     _allItems = nil;
+    [Utils removeFile:[self direntCachePath]];
     [self.connection removeKey:self.cacheKey entityName:ENTITY_DIRECTORY];
 }
 
+- (NSString *)direntCachePath
+{
+    return [self.connection.direntCacheDir stringByAppendingPathComponent:[[self.cacheKey dataUsingEncoding:NSUTF8StringEncoding] SHA1]];
+}
+
+- (NSString *)cachedOid
+{
+    return [SeafDirentList oidOfListAtPath:[self direntCachePath]];
+}
+
+- (NSString *)sortKey
+{
+    NSString *key = [SeafStorage.sharedObject objectForKey:[self configKeyForSort]];
+    return [@"MTIME" caseInsensitiveCompare:key] == NSOrderedSame ? @"MTIME" : @"NAME";
+}
+
 - (BOOL)savetoCache:(id)JSON cacheOid:(NSString *)cacheOid perm:(NSString *)permStr
 {
-    NSMutableDictionary *dict = [NSMutableDictionary new];
-    [dict setObject:JSON forKey:@"data"];
-    [dict setObject:cacheOid forKey:@"oid"];
-    [dict setObject:permStr forKey:@"perm"];
+    return [self writeCacheItems:_items cacheOid:cacheOid perm:permStr];
+}
 
-    NSString *value = [[NSString alloc] initWithData:[Utils JSONEncode:dict] encoding:NSUTF8StringEncoding];
-    return [self.connection setValue:value forKey:self.cacheKey entityName:ENTITY_DIRECTORY];
+- (BOOL)writeCacheItems:(NSArray *)cacheItems cacheOid:(NSString *)cacheOid perm:(NSString *)permStr
+{
+    // Written in display order, so that the cached listing is shown without sorting it
+    NSMutableArray *items = [NSMutableArray arrayWithArray:cacheItems];
+    [self sortItems:items];
+    return [SeafDirentList writeItems:items oid:cacheOid perm:permStr sortKey:[self sortKey] toFile:[self direntCachePath]];
 }
 
 - (BOOL)realLoadCache
 {
+    SeafDirentList *list = [SeafDirentList listWithContentsOfFile:[self direntCachePath]];
+    if (list) {
+        if (list.perm) {
+            self.perm = list.perm;
+        }
+        BOOL updated = [self loadDirentList:list];
+        [self.delegate download:self complete:updated];
+        return YES;
+    }
+
+    // Listings cached as JSON by earlier versions are converted once
     NSDictionary *dict = [self.connection getCachedJson:self.cacheKey entityName:ENTITY_DIRECTORY];
     if (!dict) {
         return NO;
@@ -557,6 +843,9 @@ static NSComparator seafSortByMtime = ^(id a, id b) {
     NSString *perm = [dict objectForKey:@"perm"];
     self.perm = perm;
     BOOL updated = [self handleData:oid data:[dict objectForKey:@"data"]];
+    if (updated && [self savetoCache:nil cacheOid:oid perm:perm]) {
+        [self.connection removeKey:self.cacheKey entityName:ENTITY_DIRECTORY];
+    }
     [self.delegate download:self complete:updated];
     return YES;
 }
@@ -566,6 +855,18 @@ static NSComparator seafSortByMtime = ^(id a, id b) {
     if (_allItems)
         return _allItems;
 
+    // A cached listing is already in display order, unless uploads have to be merged into it
+    if ([_items isKindOfClass:[SeafDirentList class]] && [((SeafDirentList *)_items).sortKey isEqualToString:[self sortKey]]) {
+        NSUInteger uploadCount;
+        @synchronized(_uploadLock) {
+            uploadCount = self.uploadItems.count;
+        }
+        if (uploadCount == 0) {
+            _allItems = _items;
+            return _allItems;
+        }
+    }
+
     NSMutableArray *arr = [[NSMutableArray alloc] init];
     [arr addObjectsFromArray:_items];
      @synchronized(_uploadLock) {
@@ -576,23 +877,69 @@ static NSComparator seafSortByMtime = ^(id a, id b) {
     return _allItems;
 }
 
-- (BOOL)nameExist:(NSString *)name
+// Built on the first lookup after the items change.
+- (NSDictionary<NSString *, NSString *> *)currentNameIndex
 {
-    for (SeafBase *entry in _items) {
-        if ([[name precomposedStringWithCanonicalMapping] caseInsensitiveCompare:[entry.name precomposedStringWithCanonicalMapping]] == NSOrderedSame)
-            return true;
+    @synchronized(self) {
+        NSArray *items = _items;
+        if (self.nameIndex && self.nameIndexItems == items)
+            return self.nameIndex;
+
+        NSMutableDictionary<NSString *, NSString *> *index = [NSMutableDictionary dictionaryWithCapacity:items.count];
+        void (^addName)(NSString *) = ^(NSString *name) {
+            if (!name) return;
+            NSString *key = seafFoldedName(name);
+            // The first match wins, as it did for a scan of the items
+            if (![index objectForKey:key]) {
+                [index setObject:name forKey:key];
+            }
+        };
+        if ([items isKindOfClass:[SeafDirentList class]]) {
+            SeafDirentList *list = (SeafDirentList *)items;
+            for (NSUInteger i = 0; i < list.count; i++) {
+                addName([list nameAtIndex:i]);
+            }
+        } else {
+            for (SeafBase *entry in items) {
+                addName(entry.name);
+            }
+        }
+        self.nameIndex = index;
+        self.nameIndexItems = items;
+        return index;
     }
-    return false;
 }
 
-- (NSString *)actualNameForCaseInsensitiveMatch:(NSString *)name
+// Called with uploadLock held.
+- (NSCountedSet<NSString *> *)currentUploadNameIndex
 {
-    for (SeafBase *entry in _items) {
-        if ([[name precomposedStringWithCanonicalMapping] caseInsensitiveCompare:[entry.name precomposedStringWithCanonicalMapping]] == NSOrderedSame) {
-            return entry.name;
+    NSMutableArray *uploadItems = self.uploadItems;
+    if (!self.uploadNameIndex) {
+        NSCountedSet *index = [[NSCountedSet alloc] initWithCapacity:uploadItems.count];
+        for (SeafUploadFile *file in uploadItems) {
+            if (file.name) [index addObject:seafFoldedName(file.name)];
         }
+        self.uploadNameIndex = index;
     }
-    return nil;
+    return self.uploadNameIndex;
+}
+
+- (BOOL)nameExist:(NSString *)name
+{
+    if (!name) return false;
+    NSString *key = seafFoldedName(name);
+    if ([[self currentNameIndex] objectForKey:key])
+        return true;
+    // A file waiting to be uploaded here takes its name as well
+    @synchronized(_uploadLock) {
+        return [[self currentUploadNameIndex] countForObject:key] > 0;
+    }
+}
+
+- (NSString *)actualNameForCaseInsensitiveMatch:(NSString *)name
+{
+    if (!name) return nil;
+    return [[self currentNameIndex] objectForKey:seafFoldedName(name)];
 }
 
 - (void)loadContent:(BOOL)force;
@@ -608,8 +955,10 @@ static NSComparator seafSortByMtime = ^(id a, id b) {
 
 - (NSMutableArray *)uploadItems
 {
-    if (self.path && !_uploadItems)
+    if (self.path && !_uploadItems) {
         _uploadItems = [NSMutableArray arrayWithArray:[[SeafDataTaskManager sharedObject] getUploadTasksInDir:self connection:self.connection]];
+        _uploadNameIndex = nil;
+    }
     
     return _uploadItems;
 }
@@ -629,6 +978,7 @@ static NSComparator seafSortByMtime = ^(id a, id b) {
     file.udir = self;
     @synchronized(_uploadLock) {
         [self.uploadItems addObject:file];
+        if (file.name) [self.uploadNameIndex addObject:seafFoldedName(file.name)];
     }
     _allItems = nil;
     if (!file.uploadFileAutoSync) [self.delegate download:self complete:true];
@@ -637,15 +987,28 @@ static NSComparator seafSortByMtime = ^(id a, id b) {
 - (void)removeUploadItem:(SeafUploadFile *)ufile
 {
     @synchronized(_uploadLock) {
-        [self.uploadItems removeObject:ufile];
+        if ([self.uploadItems containsObject:ufile]) {
+            [self.uploadItems removeObject:ufile];
+            if (ufile.name) [self.uploadNameIndex removeObject:seafFoldedName(ufile.name)];
+        }
     }
     _allItems = nil;
 }
 
 - (NSArray *)subDirs
 {
+    NSArray *items = self.items;
     NSMutableArray *arr = [[NSMutableArray alloc] init];
-    for (SeafBase *entry in self.items) {
+    if ([items isKindOfClass:[SeafDirentList class]]) {
+        // Only the directories need to be created
+        SeafDirentList *list = (SeafDirentList *)items;
+        for (NSUInteger i = 0; i < list.count; i++) {
+            if ([list typeAtIndex:i] == SeafDirentTypeDir)
+                [arr addObject:[list objectAtIndex:i]];
+        }
+        return arr;
+    }
+    for (SeafBase *entry in items) {
         if ([entry isKindOfClass:[SeafDir class]])
             [arr addObject:entry];
     }
@@ -685,11 +1048,53 @@ static NSComparator seafSortByMtime = ^(id a, id b) {
         }
     }
     
+    self.pendingIndexList = nil;
     self.serverFileIndex = [fileIndex copy];
     self.serverFileLowercaseIndex = [lowercaseIndex copy];
     self.serverFileBaseNameIndex = [baseNameIndex copy];
 }
 
+- (void)buildPendingFileIndex {
+    SeafDirentList *list;
+    @synchronized(self) {
+        list = self.pendingIndexList;
+        self.pendingIndexList = nil;
+    }
+    if (!list) return;
+
+    NSMutableDictionary<NSString *, NSNumber *> *fileIndex = [NSMutableDictionary dictionary];
+    NSMutableDictionary<NSString *, NSString *> *lowercaseIndex = [NSMutableDictionary dictionary];
+    NSMutableDictionary<NSString *, NSString *> *baseNameIndex = [NSMutableDictionary dictionary];
+    for (NSUInteger i = 0; i < list.count; i++) {
+        if ([list typeAtIndex:i] != SeafDirentTypeFile) continue;
+        NSString *name = [list nameAtIndex:i];
+        fileIndex[name] = @([list sizeAtIndex:i]);
+        lowercaseIndex[name.lowercaseString] = name;
+        NSString *lowerBaseName = [name stringByDeletingPathExtension].lowercaseString;
+        if (!baseNameIndex[lowerBaseName]) {
+            baseNameIndex[lowerBaseName] = name;
+        }
+    }
+    _serverFileIndex = [fileIndex copy];
+    _serverFileLowercaseIndex = [lowercaseIndex copy];
+    _serverFileBaseNameIndex = [baseNameIndex copy];
+}
+
+- (NSDictionary<NSString *, NSNumber *> *)serverFileIndex {
+    [self buildPendingFileIndex];
+    return _serverFileIndex;
+}
+
+- (NSDictionary<NSString *, NSString *> *)serverFileLowercaseIndex {
+    [self buildPendingFileIndex];
+    return _serverFileLowercaseIndex;
+}
+
+- (NSDictionary<NSString *, NSString *> *)serverFileBaseNameIndex {
+    [self buildPendingFileIndex];
+    return _serverFileBaseNameIndex;
+}
+
 - (NSNumber *)fileSizeForName:(NSString *)name {
     if (!name || !self.serverFileLowercaseIndex || !self.serverFileIndex) {
         return nil;
@@ -0,0 +1,75 @@
+//
+//  SeafDirentDiff.h
+//  Seafile
+//
+//  Compares directory listings, so that a refresh only touches the entries which changed.
+//
+
+#import <Foundation/Foundation.h>
+#import "SeafDirentList.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class SeafBase;
+
+typedef NS_ENUM(NSInteger, SeafDirentChange) {
+    SeafDirentChangeNone = 0,   ///< Same name, type, object id and mtime.
+    SeafDirentChangeInserted,   ///< No entry of the same name and type.
+    SeafDirentChangeUpdated,    ///< Same name and type, different object id or mtime.
+};
+
+/**
+ * Compares the entries of a new listing with the loaded items by (name, id, mtime).
+ * Entries are passed one at a time while the new listing is parsed; the entries of the
+ * loaded items are read from a `SeafDirentList` without creating their objects.
+ */
+@interface SeafDirentDiff : NSObject
+
+/// @param items The loaded items, nil if there are none.
+- (instancetype)initWithItems:(nullable NSArray<SeafBase *> *)items;
+
+/**
+ * Compares an entry of the new listing.
+ * @param oldIndex Set to the index of the loaded item of the same name and type, unless inserted.
+ */
+- (SeafDirentChange)compareEntry:(NSString *)name
+                            type:(SeafDirentType)type
+                             oid:(nullable NSString *)oid
+                           mtime:(long long)mtime
+                        oldIndex:(NSUInteger *)oldIndex;
+
+/// Indexes of the loaded items missing from the entries compared so far.
+@property (nonatomic, readonly) NSIndexSet *deletedIndexes;
+
+/// Number of inserted, updated and deleted entries.
+@property (nonatomic, readonly) NSUInteger changeCount;
+
+@end
+
+/**
+ * Row changes between two displayed arrays of the same objects, in the form
+ * UITableView batch updates take: deletions, reloads and move sources index the old
+ * array, insertions and move targets index the new one.
+ */
+@interface SeafRowChanges : NSObject
+
+/**
+ * Matches objects by identity.
+ * @param updated Objects present in both arrays whose rows must be reloaded.
+ * @param limit Returns nil if there are more changes, a full reload is cheaper then.
+ */
++ (nullable instancetype)changesFromItems:(NSArray *)oldItems
+                                  toItems:(NSArray *)newItems
+                                  updated:(nullable NSSet *)updated
+                                    limit:(NSUInteger)limit;
+
+@property (nonatomic, readonly) NSIndexSet *deletedIndexes;
+@property (nonatomic, readonly) NSIndexSet *insertedIndexes;
+@property (nonatomic, readonly) NSIndexSet *reloadedIndexes;
+/// Pairs of (old index, new index).
+@property (nonatomic, readonly) NSArray<NSArray<NSNumber *> *> *moves;
+@property (nonatomic, readonly) BOOL isEmpty;
+
+@end
+
+NS_ASSUME_NONNULL_END
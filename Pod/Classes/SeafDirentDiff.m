@@ -0,0 +1,214 @@
+//
+//  SeafDirentDiff.m
+//  Seafile
+//
+//  Compares directory listings, so that a refresh only touches the entries which changed.
+//
+
+#import "SeafDirentDiff.h"
+#import "SeafFile.h"
+#import "SeafDir.h"
+
+@interface SeafDirentDiff ()
+
+@property (nonatomic, strong) NSArray<SeafBase *> *items;
+@property (nonatomic, strong, nullable) SeafDirentList *list;
+@property (nonatomic, strong) NSMutableDictionary<NSString *, NSNumber *> *indexByName;
+@property (nonatomic, strong) NSMutableIndexSet *unmatched;
+@property (nonatomic, assign) NSUInteger insertedCount;
+@property (nonatomic, assign) NSUInteger updatedCount;
+
+@end
+
+@implementation SeafDirentDiff
+
+- (instancetype)initWithItems:(NSArray<SeafBase *> *)items
+{
+    if (self = [super init]) {
+        _items = items ?: @[];
+        _indexByName = [NSMutableDictionary dictionaryWithCapacity:_items.count];
+        _unmatched = [NSMutableIndexSet indexSet];
+        if ([_items isKindOfClass:[SeafDirentList class]]) {
+            _list = (SeafDirentList *)_items;
+            for (NSUInteger i = 0; i < _list.count; i++) {
+                [_indexByName setObject:@(i) forKey:[_list nameAtIndex:i]];
+                [_unmatched addIndex:i];
+            }
+        } else {
+            [_items enumerateObjectsUsingBlock:^(SeafBase *obj, NSUInteger i, BOOL *stop) {
+                if (obj.name && ([obj isKindOfClass:[SeafFile class]] || [obj isKindOfClass:[SeafDir class]])) {
+                    [self->_indexByName setObject:@(i) forKey:obj.name];
+                    [self->_unmatched addIndex:i];
+                }
+            }];
+        }
+    }
+    return self;
+}
+
+- (SeafDirentType)typeAtIndex:(NSUInteger)index
+{
+    if (self.list) return [self.list typeAtIndex:index];
+    return [[self.items objectAtIndex:index] isKindOfClass:[SeafDir class]] ? SeafDirentTypeDir : SeafDirentTypeFile;
+}
+
+- (NSString *)oidAtIndex:(NSUInteger)index
+{
+    if (self.list) return [self.list oidAtIndex:index];
+    return [self.items objectAtIndex:index].oid;
+}
+
+- (long long)mtimeAtIndex:(NSUInteger)index
+{
+    if (self.list) return [self.list mtimeAtIndex:index];
+    id obj = [self.items objectAtIndex:index];
+    return [obj isKindOfClass:[SeafDir class]] ? ((SeafDir *)obj).mtime : ((SeafFile *)obj).mtime;
+}
+
+- (SeafDirentChange)compareEntry:(NSString *)name
+                            type:(SeafDirentType)type
+                             oid:(NSString *)oid
+                           mtime:(long long)mtime
+                        oldIndex:(NSUInteger *)oldIndex
+{
+    NSNumber *index = [self.indexByName objectForKey:name];
+    // A name changing between file and directory is a deletion and an insertion.
+    if (!index || ![self.unmatched containsIndex:index.unsignedIntegerValue]
+        || [self typeAtIndex:index.unsignedIntegerValue] != type) {
+        self.insertedCount++;
+        return SeafDirentChangeInserted;
+    }
+    NSUInteger i = index.unsignedIntegerValue;
+    [self.unmatched removeIndex:i];
+    if (oldIndex) *oldIndex = i;
+    NSString *oldOid = [self oidAtIndex:i];
+    if ((oid == oldOid || [oid isEqualToString:oldOid]) && mtime == [self mtimeAtIndex:i]) {
+        return SeafDirentChangeNone;
+    }
+    self.updatedCount++;
+    return SeafDirentChangeUpdated;
+}
+
+- (NSIndexSet *)deletedIndexes
+{
+    return [self.unmatched copy];
+}
+
+- (NSUInteger)changeCount
+{
+    return self.insertedCount + self.updatedCount + self.unmatched.count;
+}
+
+@end
+
+@interface SeafRowChanges ()
+
+@property (nonatomic, strong) NSIndexSet *deletedIndexes;
+@property (nonatomic, strong) NSIndexSet *insertedIndexes;
+@property (nonatomic, strong) NSIndexSet *reloadedIndexes;
+@property (nonatomic, strong) NSArray<NSArray<NSNumber *> *> *moves;
+
+@end
+
+@implementation SeafRowChanges
+
+// Marks the elements of a longest increasing subsequence of values, in O(n log n).
+static void seafMarkLongestIncreasing(const NSUInteger *values, NSUInteger count, BOOL *marks)
+{
+    if (count == 0) return;
+    NSUInteger *tails = malloc(count * sizeof(NSUInteger)); // position of the smallest tail of each length
+    NSUInteger *prev = malloc(count * sizeof(NSUInteger));
+    NSUInteger length = 0;
+    for (NSUInteger i = 0; i < count; i++) {
+        NSUInteger lo = 0, hi = length;
+        while (lo < hi) {
+            NSUInteger mid = (lo + hi) / 2;
+            if (values[tails[mid]] < values[i]) lo = mid + 1; else hi = mid;
+        }
+        prev[i] = lo > 0 ? tails[lo - 1] : NSNotFound;
+        tails[lo] = i;
+        if (lo == length) length++;
+    }
+    for (NSUInteger i = tails[length - 1]; i != NSNotFound; i = prev[i]) {
+        marks[i] = YES;
+    }
+    free(tails);
+    free(prev);
+}
+
++ (instancetype)changesFromItems:(NSArray *)oldItems
+                         toItems:(NSArray *)newItems
+                         updated:(NSSet *)updated
+                           limit:(NSUInteger)limit
+{
+    NSMapTable *oldIndexes = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsObjectPointerPersonality
+                                                   valueOptions:NSPointerFunctionsStrongMemory];
+    [oldItems enumerateObjectsUsingBlock:^(id obj, NSUInteger i, BOOL *stop) {
+        [oldIndexes setObject:@(i) forKey:obj];
+    }];
+
+    NSMutableIndexSet *deleted = [NSMutableIndexSet indexSet];
+    NSMutableIndexSet *inserted = [NSMutableIndexSet indexSet];
+    NSMutableIndexSet *reloaded = [NSMutableIndexSet indexSet];
+    NSMutableArray *moves = [NSMutableArray array];
+
+    // Objects in both arrays, in new order.
+    NSUInteger commonCount = 0;
+    NSUInteger *commonOld = malloc(MAX(newItems.count, 1) * sizeof(NSUInteger));
+    NSUInteger *commonNew = malloc(MAX(newItems.count, 1) * sizeof(NSUInteger));
+    NSHashTable *kept = [NSHashTable hashTableWithOptions:NSPointerFunctionsObjectPointerPersonality];
+    for (NSUInteger i = 0; i < newItems.count; i++) {
+        id obj = [newItems objectAtIndex:i];
+        NSNumber *oldIndex = [oldIndexes objectForKey:obj];
+        if (oldIndex && ![kept containsObject:obj]) {
+            [kept addObject:obj];
+            commonOld[commonCount] = oldIndex.unsignedIntegerValue;
+            commonNew[commonCount] = i;
+            commonCount++;
+        } else {
+            [inserted addIndex:i];
+        }
+    }
+    for (NSUInteger i = 0; i < oldItems.count; i++) {
+        if (![kept containsObject:[oldItems objectAtIndex:i]]) {
+            [deleted addIndex:i];
+        }
+    }
+
+    // Objects off the longest run which kept its relative order have moved.
+    BOOL *inPlace = calloc(MAX(commonCount, 1), sizeof(BOOL));
+    seafMarkLongestIncreasing(commonOld, commonCount, inPlace);
+    for (NSUInteger i = 0; i < commonCount; i++) {
+        BOOL isUpdated = [updated containsObject:[newItems objectAtIndex:commonNew[i]]];
+        if (inPlace[i]) {
+            if (isUpdated) [reloaded addIndex:commonOld[i]];
+        } else if (isUpdated) {
+            // A moved row is not reloaded by the table view
+            [deleted addIndex:commonOld[i]];
+            [inserted addIndex:commonNew[i]];
+        } else {
+            [moves addObject:@[@(commonOld[i]), @(commonNew[i])]];
+        }
+    }
+    free(inPlace);
+    free(commonOld);
+    free(commonNew);
+
+    if (deleted.count + inserted.count + reloaded.count + moves.count > limit) {
+        return nil;
+    }
+    SeafRowChanges *changes = [SeafRowChanges new];
+    changes.deletedIndexes = deleted;
+    changes.insertedIndexes = inserted;
+    changes.reloadedIndexes = reloaded;
+    changes.moves = moves;
+    return changes;
+}
+
+- (BOOL)isEmpty
+{
+    return self.deletedIndexes.count == 0 && self.insertedIndexes.count == 0
+        && self.reloadedIndexes.count == 0 && self.moves.count == 0;
+}
+
+@end
@@ -0,0 +1,69 @@
+//
+//  SeafDirentList.h
+//  Seafile
+//
+//  Directory listing cache in a compact binary format, read from a memory-mapped file.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class SeafBase;
+@class SeafDirentList;
+
+typedef NS_ENUM(uint8_t, SeafDirentType) {
+    SeafDirentTypeFile = 0,
+    SeafDirentTypeDir = 1,
+};
+
+/// Creates the object of an entry, called at most once per entry.
+typedef SeafBase * _Nullable (^SeafDirentMaterializer)(SeafDirentList *list, NSUInteger index);
+
+/**
+ * The entries of a directory listing as an immutable array. The fields of the entries are
+ * read from the mapped file on demand, and the `SeafFile`/`SeafDir` objects are only created
+ * by the materializer when an element is accessed, e.g. when its cell scrolls into view.
+ *
+ * File layout: a header, a table of fixed-width entry records (mtime, size, and indexes into
+ * the string table), and a table of interned UTF-8 strings holding names, object ids and
+ * permissions.
+ */
+@interface SeafDirentList : NSArray
+
+/// Maps a listing written by writeItems:toFile:, nil if it is missing or invalid.
++ (nullable instancetype)listWithContentsOfFile:(NSString *)path;
+
+/// The directory's object id of a listing, read from its header without checking the entries.
++ (nullable NSString *)oidOfListAtPath:(NSString *)path;
+
+/**
+ * Writes a listing.
+ * @param items `SeafFile` and `SeafDir` objects, in the order they should be listed.
+ * @param oid The directory's object id.
+ * @param perm The directory's permission.
+ * @param sortKey The sort order of `items`, see -[SeafDir configKeyForSort].
+ */
++ (BOOL)writeItems:(NSArray<SeafBase *> *)items oid:(NSString *)oid perm:(nullable NSString *)perm sortKey:(nullable NSString *)sortKey toFile:(NSString *)path;
+
+@property (nonatomic, readonly, copy) NSString *oid;
+@property (nonatomic, readonly, copy, nullable) NSString *perm;
+/// The sort order the entries were written in, nil if unknown.
+@property (nonatomic, readonly, copy, nullable) NSString *sortKey;
+
+/// Must be set before elements are accessed.
+@property (nonatomic, copy, nullable) SeafDirentMaterializer materializer;
+
+- (SeafDirentType)typeAtIndex:(NSUInteger)index;
+- (NSString *)nameAtIndex:(NSUInteger)index;
+- (NSString *)oidAtIndex:(NSUInteger)index;
+- (nullable NSString *)permAtIndex:(NSUInteger)index;
+- (long long)mtimeAtIndex:(NSUInteger)index;
+- (long long)sizeAtIndex:(NSUInteger)index;
+
+/// Whether the element at index has been created.
+- (BOOL)isMaterializedAtIndex:(NSUInteger)index;
+
+@end
+
+NS_ASSUME_NONNULL_END
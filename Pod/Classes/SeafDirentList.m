@@ -0,0 +1,288 @@
+//
+//  SeafDirentList.m
+//  Seafile
+//
+//  Directory listing cache in a compact binary format, read from a memory-mapped file.
+//
+
+#import "SeafDirentList.h"
+#import "SeafFile.h"
+#import "SeafDir.h"
+#import "Debug.h"
+
+#define SEAF_DIRENT_MAGIC 0x31434453 // "SDC1"
+#define SEAF_DIRENT_VERSION 1
+#define SEAF_DIRENT_NO_STRING UINT32_MAX
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t sortKey;
+    uint8_t reserved;
+    uint32_t count;         // Number of entry records, they follow the header
+    uint32_t stringCount;
+    uint32_t oid;           // String index of the directory's object id
+    uint32_t perm;          // String index of the directory's permission
+    uint64_t stringsOffset; // Offset of the string table, stringCount {offset, length} pairs
+    uint64_t bytesOffset;   // Offset of the string bytes, string offsets are relative to it
+} seaf_dirent_header;
+
+typedef struct {
+    int64_t mtime;
+    int64_t size;
+    uint32_t name;
+    uint32_t oid;
+    uint32_t perm;
+    uint8_t type;
+    uint8_t reserved[3];
+} seaf_dirent_record;
+
+typedef struct {
+    uint32_t offset;
+    uint32_t length;
+} seaf_dirent_string;
+
+enum {
+    SeafDirentSortNone = 0,
+    SeafDirentSortName,
+    SeafDirentSortMtime,
+};
+
+@interface SeafDirentList ()
+
+@property (nonatomic, strong) NSData *data;
+@property (nonatomic, assign) const seaf_dirent_header *header;
+@property (nonatomic, assign) const seaf_dirent_record *records;
+@property (nonatomic, assign) const seaf_dirent_string *strings;
+@property (nonatomic, assign) const char *bytes;
+@property (nonatomic, strong) NSPointerArray *objects;
+
+@property (nonatomic, readwrite, copy) NSString *oid;
+@property (nonatomic, readwrite, copy) NSString *perm;
+@property (nonatomic, readwrite, copy) NSString *sortKey;
+
+@end
+
+@implementation SeafDirentList
+
++ (instancetype)listWithContentsOfFile:(NSString *)path
+{
+    NSData *data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedAlways error:nil];
+    if (!data) return nil;
+    return [[self alloc] initWithData:data];
+}
+
++ (NSString *)oidOfListAtPath:(NSString *)path
+{
+    // Mapped, only the pages of the header and the string are read.
+    NSData *data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedAlways error:nil];
+    if (data.length < sizeof(seaf_dirent_header)) return nil;
+    const seaf_dirent_header *header = data.bytes;
+    if (header->magic != SEAF_DIRENT_MAGIC || header->version != SEAF_DIRENT_VERSION) return nil;
+
+    uint64_t length = data.length;
+    if (header->oid >= header->stringCount || header->bytesOffset > length
+        || header->stringsOffset + ((uint64_t)header->oid + 1) * sizeof(seaf_dirent_string) > length) {
+        return nil;
+    }
+    const seaf_dirent_string *s = (const seaf_dirent_string *)((const char *)data.bytes + header->stringsOffset) + header->oid;
+    if (header->bytesOffset + s->offset + s->length > length) return nil;
+    return [[NSString alloc] initWithBytes:(const char *)data.bytes + header->bytesOffset + s->offset length:s->length encoding:NSUTF8StringEncoding];
+}
+
+- (instancetype)initWithData:(NSData *)data
+{
+    if (!(self = [super init])) return nil;
+    if (data.length < sizeof(seaf_dirent_header)) return nil;
+    const seaf_dirent_header *header = data.bytes;
+    if (header->magic != SEAF_DIRENT_MAGIC || header->version != SEAF_DIRENT_VERSION) return nil;
+
+    uint64_t length = data.length;
+    uint64_t recordsEnd = sizeof(seaf_dirent_header) + (uint64_t)header->count * sizeof(seaf_dirent_record);
+    if (recordsEnd > header->stringsOffset || header->stringsOffset > length
+        || header->stringsOffset + (uint64_t)header->stringCount * sizeof(seaf_dirent_string) != header->bytesOffset
+        || header->bytesOffset > length) {
+        Warning("Invalid dirent cache header");
+        return nil;
+    }
+    const seaf_dirent_record *records = (const seaf_dirent_record *)((const char *)data.bytes + sizeof(seaf_dirent_header));
+    const seaf_dirent_string *strings = (const seaf_dirent_string *)((const char *)data.bytes + header->stringsOffset);
+
+    // Check all indexes once, so that the accessors need no bounds checks.
+    uint64_t bytesLength = length - header->bytesOffset;
+    for (uint32_t i = 0; i < header->stringCount; i++) {
+        if ((uint64_t)strings[i].offset + strings[i].length > bytesLength) return nil;
+    }
+    uint32_t stringCount = header->stringCount;
+    if (header->oid >= stringCount || (header->perm != SEAF_DIRENT_NO_STRING && header->perm >= stringCount)) return nil;
+    for (uint32_t i = 0; i < header->count; i++) {
+        const seaf_dirent_record *r = records + i;
+        if (r->name >= stringCount || r->oid >= stringCount || (r->perm != SEAF_DIRENT_NO_STRING && r->perm >= stringCount)) return nil;
+        if (r->type != SeafDirentTypeFile && r->type != SeafDirentTypeDir) return nil;
+    }
+
+    _data = data;
+    _header = header;
+    _records = records;
+    _strings = strings;
+    _bytes = (const char *)data.bytes + header->bytesOffset;
+    _objects = [NSPointerArray strongObjectsPointerArray];
+    _objects.count = header->count;
+    _oid = [self stringAtIndex:header->oid];
+    _perm = header->perm != SEAF_DIRENT_NO_STRING ? [self stringAtIndex:header->perm] : nil;
+    if (header->sortKey == SeafDirentSortName) {
+        _sortKey = @"NAME";
+    } else if (header->sortKey == SeafDirentSortMtime) {
+        _sortKey = @"MTIME";
+    }
+    return self;
+}
+
+- (NSString *)stringAtIndex:(uint32_t)index
+{
+    const seaf_dirent_string *s = self.strings + index;
+    NSString *str = [[NSString alloc] initWithBytes:self.bytes + s->offset length:s->length encoding:NSUTF8StringEncoding];
+    return str ?: @"";
+}
+
+#pragma mark - Entry Fields
+
+- (SeafDirentType)typeAtIndex:(NSUInteger)index
+{
+    return self.records[index].type;
+}
+
+- (NSString *)nameAtIndex:(NSUInteger)index
+{
+    return [self stringAtIndex:self.records[index].name];
+}
+
+- (NSString *)oidAtIndex:(NSUInteger)index
+{
+    return [self stringAtIndex:self.records[index].oid];
+}
+
+- (NSString *)permAtIndex:(NSUInteger)index
+{
+    uint32_t perm = self.records[index].perm;
+    return perm != SEAF_DIRENT_NO_STRING ? [self stringAtIndex:perm] : nil;
+}
+
+- (long long)mtimeAtIndex:(NSUInteger)index
+{
+    return self.records[index].mtime;
+}
+
+- (long long)sizeAtIndex:(NSUInteger)index
+{
+    return self.records[index].size;
+}
+
+#pragma mark - NSArray
+
+- (NSUInteger)count
+{
+    return self.header->count;
+}
+
+- (id)objectAtIndex:(NSUInteger)index
+{
+    if (index >= self.header->count) {
+        [NSException raise:NSRangeException format:@"index %lu beyond bounds [0 .. %lu]", (unsigned long)index, (unsigned long)self.header->count];
+    }
+    @synchronized (self) {
+        id obj = (__bridge id)[self.objects pointerAtIndex:index];
+        if (!obj) {
+            obj = self.materializer ? self.materializer(self, index) : nil;
+            if (!obj) obj = [NSNull null];
+            [self.objects replacePointerAtIndex:index withPointer:(__bridge void *)obj];
+        }
+        return obj;
+    }
+}
+
+- (BOOL)isMaterializedAtIndex:(NSUInteger)index
+{
+    @synchronized (self) {
+        return [self.objects pointerAtIndex:index] != NULL;
+    }
+}
+
+// Immutable, a copy would materialize every element.
+- (id)copyWithZone:(NSZone *)zone
+{
+    return self;
+}
+
+#pragma mark - Writing
+
++ (BOOL)writeItems:(NSArray<SeafBase *> *)items oid:(NSString *)oid perm:(NSString *)perm sortKey:(NSString *)sortKey toFile:(NSString *)path
+{
+    NSMutableDictionary<NSString *, NSNumber *> *stringIndexes = [NSMutableDictionary dictionary];
+    NSMutableArray<NSString *> *strings = [NSMutableArray array];
+    uint32_t (^intern)(NSString *) = ^uint32_t(NSString *str) {
+        if (!str) return SEAF_DIRENT_NO_STRING;
+        NSNumber *index = [stringIndexes objectForKey:str];
+        if (!index) {
+            index = @(strings.count);
+            [stringIndexes setObject:index forKey:str];
+            [strings addObject:str];
+        }
+        return index.unsignedIntValue;
+    };
+
+    seaf_dirent_header header = {0};
+    header.magic = SEAF_DIRENT_MAGIC;
+    header.version = SEAF_DIRENT_VERSION;
+    if ([@"MTIME" caseInsensitiveCompare:sortKey] == NSOrderedSame) {
+        header.sortKey = SeafDirentSortMtime;
+    } else if ([@"NAME" caseInsensitiveCompare:sortKey] == NSOrderedSame) {
+        header.sortKey = SeafDirentSortName;
+    }
+    header.oid = intern(oid ?: @"");
+    header.perm = intern(perm);
+
+    NSMutableData *recordData = [NSMutableData dataWithCapacity:items.count * sizeof(seaf_dirent_record)];
+    for (SeafBase *item in items) {
+        seaf_dirent_record r = {0};
+        if ([item isKindOfClass:[SeafDir class]]) {
+            SeafDir *dir = (SeafDir *)item;
+            r.type = SeafDirentTypeDir;
+            r.mtime = dir.mtime;
+            r.perm = intern(dir.perm);
+        } else if ([item isKindOfClass:[SeafFile class]]) {
+            SeafFile *file = (SeafFile *)item;
+            r.type = SeafDirentTypeFile;
+            r.mtime = file.mtime;
+            r.size = file.filesize;
+            r.perm = SEAF_DIRENT_NO_STRING;
+        } else {
+            continue;
+        }
+        r.name = intern(item.name ?: @"");
+        r.oid = intern(item.oid ?: @"");
+        [recordData appendBytes:&r length:sizeof(r)];
+    }
+    header.count = (uint32_t)(recordData.length / sizeof(seaf_dirent_record));
+    header.stringCount = (uint32_t)strings.count;
+    header.stringsOffset = sizeof(header) + recordData.length;
+    header.bytesOffset = header.stringsOffset + strings.count * sizeof(seaf_dirent_string);
+
+    NSMutableData *stringTable = [NSMutableData dataWithCapacity:strings.count * sizeof(seaf_dirent_string)];
+    NSMutableData *bytes = [NSMutableData data];
+    for (NSString *str in strings) {
+        NSData *utf8 = [str dataUsingEncoding:NSUTF8StringEncoding];
+        seaf_dirent_string s = { (uint32_t)bytes.length, (uint32_t)utf8.length };
+        [stringTable appendBytes:&s length:sizeof(s)];
+        [bytes appendData:utf8];
+    }
+
+    NSMutableData *data = [NSMutableData dataWithCapacity:header.bytesOffset + bytes.length];
+    [data appendBytes:&header length:sizeof(header)];
+    [data appendData:recordData];
+    [data appendData:stringTable];
+    [data appendData:bytes];
+    return [data writeToFile:path atomically:YES];
+}
+
+@end
@@ -9,6 +9,10 @@
 #import "SeafAccountTaskQueue.h"
 #import "SeafBaseOperation.h"
 
+// Bounds for the number of blocks fetched concurrently for a locally decrypted file.
+#define BLOCK_DOWNLOAD_MIN_WINDOW 2
+#define BLOCK_DOWNLOAD_MAX_WINDOW 8
+
 @class SeafFile;
 
 /**
@@ -19,7 +23,7 @@
 @property (nonatomic, weak) SeafFile *file;
 @property (nonatomic, strong) NSArray *blkids;
 @property (nonatomic, strong) NSString *downloadingFileOid;
-@property (nonatomic, assign) int currentBlockIndex;
+@property (nonatomic, assign) int currentBlockIndex;///< Number of distinct blocks already downloaded.
 @property (nonatomic) float progress;
 @property (nonatomic, strong) NSError * _Nullable error;
 
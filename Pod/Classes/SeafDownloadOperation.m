@@ -20,6 +20,8 @@
 #import "SeafAccountTaskQueue.h"
 #import <CommonCrypto/CommonDigest.h>
 
+#define CHECKOUT_CHUNK_SIZE (64 * 1024)
+
 extern NSString * const AFNetworkingOperationFailingURLResponseErrorKey;
 
 // Generate a deterministic identifier from repoId + path when server oid is unavailable.
@@ -35,6 +37,31 @@ static NSString *syntheticOid(NSString *repoId, NSString *path, long long mtime)
     return out;
 }
 
+// Exponentially weighted moving average used for the link measurements.
+static inline double ewma(double average, double sample) {
+    return average * 0.75 + sample * 0.25;
+}
+
+@interface SeafDownloadOperation ()
+
+@property (nonatomic, strong) NSArray<NSString *> *uniqueBlocks;
+@property (nonatomic, assign) NSUInteger nextBlockIndex;
+@property (nonatomic, strong) NSMutableDictionary<NSString *, NSNumber *> *inflightBlocks;///< blkId -> fraction downloaded
+@property (nonatomic, assign) BOOL blocksFinished;///< Set once all blocks arrived or one of them failed.
+
+@property (nonatomic, assign) NSTimeInterval smoothedRtt;
+@property (nonatomic, assign) double smoothedThroughput;///< Bytes per second of a single block stream.
+@property (nonatomic, assign) double smoothedBlockSize;
+
+// Streaming checkout state, only touched on checkoutQueue.
+@property (nonatomic, strong) dispatch_queue_t checkoutQueue;
+@property (nonatomic, strong) NSFileHandle *checkoutHandle;
+@property (nonatomic, strong) SeafBlockDecryptor *blockDecryptor;
+@property (nonatomic, assign) NSUInteger checkoutIndex;///< Index into blkids of the next block to append.
+@property (nonatomic, assign) BOOL checkoutFailed;
+
+@end
+
 @implementation SeafDownloadOperation
 
 - (instancetype)initWithFile:(SeafFile *)file
@@ -62,6 +89,12 @@ static NSString *syntheticOid(NSString *repoId, NSString *path, long long mtime)
     @synchronized (self) {
         [super cancel];
 
+        if (self.preempted) {
+            if (self.isExecuting && !self.operationCompleted) {
+                [self finishPreempted];
+            }
+            return;
+        }
         self.file.state = SEAF_DENTRY_FAILURE;
 
         if (self.isExecuting && !self.operationCompleted) {
@@ -152,7 +185,7 @@ static NSString *syntheticOid(NSString *repoId, NSString *path, long long mtime)
 {
     float percent = 0;
     if (self.blkids) {
-        percent = self.currentBlockIndex * 1.0f / self.blkids.count;
+        percent = [self blocksProgress];
     } else {
         percent = progress;
     }
@@ -269,29 +302,107 @@ static NSString *syntheticOid(NSString *repoId, NSString *path, long long mtime)
 
 - (void)downloadBlocks
 {
-    if (self.isCancelled) return;
-    
-    NSString *blk_id = [self.blkids objectAtIndex:self.currentBlockIndex];
-    if ([[NSFileManager defaultManager] fileExistsAtPath:[SeafStorage.sharedObject blockPath:blk_id]]) {
-        return [self finishBlock:blk_id];
+    @synchronized (self) {
+        // A file may reference the same block more than once; fetch each distinct block only once.
+        self.uniqueBlocks = [NSOrderedSet orderedSetWithArray:self.blkids].array;
+        self.nextBlockIndex = 0;
+        self.currentBlockIndex = 0;
+        self.inflightBlocks = [NSMutableDictionary dictionary];
+        self.blocksFinished = NO;
+    }
+    if (![self prepareCheckout]) {
+        NSError *error = [NSError errorWithDomain:@"SeafDownloadOperation"
+                                             code:-1
+                                         userInfo:@{NSLocalizedDescriptionKey: @"Failed to checkout file"}];
+        [self finishDownload:NO error:error ooid:nil];
+        return;
     }
+    [self scheduleBlocks];
+}
 
+// Fill the download window with link-resolve requests for the next pending blocks.
+- (void)scheduleBlocks
+{
+    NSMutableArray *blocksToFetch = [NSMutableArray array];
+    BOOL allDone = NO;
+    @synchronized (self) {
+        if (self.isCancelled || self.blocksFinished) return;
+
+        NSUInteger window = [self blockWindowSize];
+        while (self.nextBlockIndex < self.uniqueBlocks.count && self.inflightBlocks.count < window) {
+            NSString *blk_id = [self.uniqueBlocks objectAtIndex:self.nextBlockIndex];
+            self.nextBlockIndex++;
+            if ([[NSFileManager defaultManager] fileExistsAtPath:[SeafStorage.sharedObject blockPath:blk_id]]) {
+                self.currentBlockIndex++;
+                continue;
+            }
+            [self.inflightBlocks setObject:@(0) forKey:blk_id];
+            [blocksToFetch addObject:blk_id];
+        }
+        allDone = self.currentBlockIndex >= self.uniqueBlocks.count;
+        if (allDone) self.blocksFinished = YES;
+    }
+
+    if (allDone) {
+        [self checkoutBlocks];
+        return;
+    }
+    [self assembleReadyBlocks];
+    for (NSString *blk_id in blocksToFetch) {
+        [self requestBlockLink:blk_id];
+    }
+}
+
+// Number of blocks kept in flight, derived from the measured round trip time and per-stream throughput.
+- (NSUInteger)blockWindowSize
+{
+    if (self.smoothedRtt <= 0 || self.smoothedThroughput <= 0 || self.smoothedBlockSize <= 0) {
+        return BLOCK_DOWNLOAD_MIN_WINDOW;
+    }
+    // Each block pays a link-resolve round trip and a fetch round trip on top of its transfer time,
+    // keep enough blocks in flight so that transfers cover those idle gaps.
+    NSTimeInterval transferTime = MAX(self.smoothedBlockSize / self.smoothedThroughput, 0.001);
+    NSUInteger window = (NSUInteger)ceil((2 * self.smoothedRtt + transferTime) / transferTime);
+    return MIN(MAX(window, BLOCK_DOWNLOAD_MIN_WINDOW), BLOCK_DOWNLOAD_MAX_WINDOW);
+}
+
+- (void)recordRtt:(NSTimeInterval)rtt
+{
+    @synchronized (self) {
+        self.smoothedRtt = self.smoothedRtt > 0 ? ewma(self.smoothedRtt, rtt) : rtt;
+    }
+}
+
+- (void)recordBlockSize:(long long)size duration:(NSTimeInterval)duration
+{
+    if (size <= 0 || duration <= 0) return;
+    double throughput = size / duration;
+    @synchronized (self) {
+        self.smoothedThroughput = self.smoothedThroughput > 0 ? ewma(self.smoothedThroughput, throughput) : throughput;
+        self.smoothedBlockSize = self.smoothedBlockSize > 0 ? ewma(self.smoothedBlockSize, size) : size;
+    }
+}
+
+- (void)requestBlockLink:(NSString *)blk_id
+{
     NSString *link = [NSString stringWithFormat:API_URL"/repos/%@/files/%@/blks/%@/download-link/",
                      self.file.repoId,
                      self.downloadingFileOid,
                      blk_id];
-    
+
+    NSDate *requestStart = [NSDate date];
     __weak typeof(self) weakSelf = self;
     NSURLSessionDataTask *task = [self.file.connection sendRequest:link 
         success:^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
             __strong typeof(weakSelf) strongSelf = weakSelf;
             if (!strongSelf || strongSelf.isCancelled) return;
+            [strongSelf recordRtt:-[requestStart timeIntervalSinceNow]];
             NSString *url = JSON;
             [strongSelf downloadBlock:blk_id fromUrl:url];
         } 
         failure:^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON, NSError *error) {
             __strong typeof(weakSelf) strongSelf = weakSelf;
-            if (!strongSelf) return;
+            if (!strongSelf || strongSelf.isCancelled) return;
             Warning("error=%@", error);
             NSError *newError = error;
             if (response && [response isKindOfClass:[NSHTTPURLResponse class]]) {
@@ -299,7 +410,7 @@ static NSString *syntheticOid(NSString *repoId, NSString *path, long long mtime)
                 [userInfo setObject:response forKey:AFNetworkingOperationFailingURLResponseErrorKey];
                 newError = [NSError errorWithDomain:error.domain code:error.code userInfo:userInfo];
             }
-            [strongSelf finishDownload:NO error:newError ooid:nil];
+            [strongSelf failBlocksWithError:newError];
         }];
     [self addTaskToList:task];
 }
@@ -313,23 +424,21 @@ static NSString *syntheticOid(NSString *repoId, NSString *path, long long mtime)
     NSString *target = [SeafStorage.sharedObject blockPath:blkId];
     Debug("Download block %@ from %@", blkId, url);
     
+    NSDate *downloadStart = [NSDate date];
     __weak typeof(self) weakSelf = self;
     NSURLSessionDownloadTask *downloadTask = [self.file.connection.sessionMgr
                                               downloadTaskWithRequest:downloadRequest
                                               progress:^(NSProgress * _Nonnull downloadProgress) {
         __strong typeof(weakSelf) strongSelf = weakSelf;
         if (!strongSelf || strongSelf.isCancelled) return;
-        //            float blockProgress = downloadProgress.fractionCompleted;
-        float overallProgress = strongSelf.currentBlockIndex * 1.0f / strongSelf.blkids.count;
-        strongSelf.progress = overallProgress;
-        [strongSelf updateProgress:overallProgress];
+        [strongSelf updateBlock:blkId progress:downloadProgress.fractionCompleted];
     }
                                               destination:^NSURL *(NSURL *targetPath, NSURLResponse *response) {
         return [NSURL fileURLWithPath:[target stringByAppendingPathExtension:@"tmp"]];
     }
                                               completionHandler:^(NSURLResponse *response, NSURL *filePath, NSError *error) {
         __strong typeof(weakSelf) strongSelf = weakSelf;
-        if (!strongSelf) return;
+        if (!strongSelf || strongSelf.isCancelled) return;
         
         if (error) {
             Debug("Failed to download block %@: %@", blkId, error);
@@ -340,13 +449,13 @@ static NSString *syntheticOid(NSString *repoId, NSString *path, long long mtime)
                 [userInfo setObject:response forKey:AFNetworkingOperationFailingURLResponseErrorKey];
                 newError = [NSError errorWithDomain:error.domain code:error.code userInfo:userInfo];
             }
-            [strongSelf finishDownload:NO error:newError ooid:nil];
+            [strongSelf failBlocksWithError:newError];
         } else {
             if (![filePath.path isEqualToString:target]) {
                 [Utils removeFile:target];
                 [[NSFileManager defaultManager] moveItemAtPath:filePath.path toPath:target error:nil];
             }
-            
+            [strongSelf recordBlockSize:[Utils fileSizeAtPath1:target] duration:-[downloadStart timeIntervalSinceNow]];
             [strongSelf finishBlock:blkId];
         }
     }];
@@ -355,32 +464,74 @@ static NSString *syntheticOid(NSString *repoId, NSString *path, long long mtime)
     [self addTaskToList:downloadTask];
 }
 
+- (void)updateBlock:(NSString *)blkId progress:(float)fraction
+{
+    @synchronized (self) {
+        if (![self.inflightBlocks objectForKey:blkId]) return;
+        [self.inflightBlocks setObject:@(fraction) forKey:blkId];
+    }
+    [self updateProgress:0];
+}
+
+- (float)blocksProgress
+{
+    @synchronized (self) {
+        if (self.uniqueBlocks.count == 0) return 0;
+        double done = self.currentBlockIndex;
+        for (NSNumber *fraction in self.inflightBlocks.allValues) {
+            done += fraction.doubleValue;
+        }
+        return (float)(done / self.uniqueBlocks.count);
+    }
+}
+
 - (void)finishBlock:(NSString *)blkId
 {
     if (self.isCancelled) {
         [self removeBlock:blkId];
         return;
     }
-    
-    self.currentBlockIndex++;
-    if (self.currentBlockIndex >= self.blkids.count) {
-        if ([self checkoutFile] < 0) {
-            Debug("Failed to checkout file %@", self.downloadingFileOid);
-            self.currentBlockIndex = 0;
-            for (NSString *blk_id in self.blkids) {
-                [self removeBlock:blk_id];
-            }
-            NSError *error = [NSError errorWithDomain:@"SeafDownloadOperation" 
-                                               code:-1 
-                                           userInfo:@{NSLocalizedDescriptionKey: @"Failed to checkout file"}];
-            [self finishDownload:NO error:error ooid:nil];
-            return;
-        }
-        [self finishDownload:YES error:nil ooid:self.downloadingFileOid];
-        return;
+
+    @synchronized (self) {
+        if (self.blocksFinished) return;
+        [self.inflightBlocks removeObjectForKey:blkId];
+        self.currentBlockIndex++;
     }
-    
-    [self performSelector:@selector(downloadBlocks) withObject:nil afterDelay:0.0];
+    [self updateProgress:0];
+    [self scheduleBlocks];
+}
+
+- (void)failBlocksWithError:(NSError *)error
+{
+    @synchronized (self) {
+        if (self.blocksFinished || self.operationCompleted) return;
+        self.blocksFinished = YES;
+    }
+    // Stop the remaining blocks of the window, their completions are ignored from now on.
+    [self cancelAllRequests];
+    [self finishDownload:NO error:error ooid:nil];
+}
+
+- (void)checkoutBlocks
+{
+    dispatch_async(self.checkoutQueue, ^{
+        int ret = [self checkoutFile];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (ret < 0) {
+                Debug("Failed to checkout file %@", self.downloadingFileOid);
+                self.currentBlockIndex = 0;
+                for (NSString *blk_id in self.blkids) {
+                    [self removeBlock:blk_id];
+                }
+                NSError *error = [NSError errorWithDomain:@"SeafDownloadOperation"
+                                                   code:-1
+                                               userInfo:@{NSLocalizedDescriptionKey: @"Failed to checkout file"}];
+                [self finishDownload:NO error:error ooid:nil];
+                return;
+            }
+            [self finishDownload:YES error:nil ooid:self.downloadingFileOid];
+        });
+    });
 }
 
 - (void)removeBlock:(NSString *)blkId
@@ -388,44 +539,189 @@ static NSString *syntheticOid(NSString *repoId, NSString *path, long long mtime)
     [[NSFileManager defaultManager] removeItemAtPath:[SeafStorage.sharedObject blockPath:blkId] error:nil];
 }
 
+- (NSString *)checkoutPartPath
+{
+    return [[SeafStorage.sharedObject documentPath:self.downloadingFileOid] stringByAppendingPathExtension:@"part"];
+}
+
+// Open the partial target file that blocks are appended to as they arrive in order.
+- (BOOL)prepareCheckout
+{
+    NSString *partPath = [self checkoutPartPath];
+    [Utils removeFile:partPath];
+    if (![[NSFileManager defaultManager] createFileAtPath:partPath contents:nil attributes:nil]) {
+        return NO;
+    }
+    NSFileHandle *outfile = [NSFileHandle fileHandleForWritingAtPath:partPath];
+    if (!outfile) return NO;
+
+    if (!self.checkoutQueue) {
+        self.checkoutQueue = dispatch_queue_create("com.seafile.downloadCheckout", DISPATCH_QUEUE_SERIAL);
+    }
+    dispatch_sync(self.checkoutQueue, ^{
+        self.checkoutHandle = outfile;
+        self.blockDecryptor = nil;
+        self.checkoutIndex = 0;
+        self.checkoutFailed = NO;
+    });
+    // Deriving the repo key is slow, do it on the checkout queue, ahead of the first block appended there.
+    SeafConnection *connection = self.file.connection;
+    NSString *repoId = self.file.repoId;
+    dispatch_async(self.checkoutQueue, ^{
+        if (self.checkoutHandle != outfile) return;
+        SeafRepoKey *repoKey = [connection repoKeyForRepo:repoId];
+        if (repoKey) {
+            self.blockDecryptor = [[SeafBlockDecryptor alloc] initWithRepoKey:repoKey];
+        } else if ([connection isEncrypted:repoId]) {
+            // The password was removed or never saved, the blocks cannot be decrypted.
+            Warning("No key to decrypt %@ of encrypted repo %@", self.file.name, repoId);
+            self.checkoutFailed = YES;
+            dispatch_async(dispatch_get_main_queue(), ^{
+                NSError *error = [NSError errorWithDomain:@"SeafDownloadOperation"
+                                                     code:-1
+                                                 userInfo:@{NSLocalizedDescriptionKey: @"Failed to decrypt file"}];
+                [self failBlocksWithError:error];
+            });
+        }
+    });
+    return YES;
+}
+
+// Append every block whose predecessors are already in the target file, called on checkoutQueue.
+- (void)appendReadyBlocks
+{
+    NSArray *blkids = self.blkids;
+    NSFileManager *fm = [NSFileManager defaultManager];
+    while (self.checkoutHandle && !self.checkoutFailed && !self.isCancelled && self.checkoutIndex < blkids.count) {
+        NSString *blkPath = [SeafStorage.sharedObject blockPath:[blkids objectAtIndex:self.checkoutIndex]];
+        if (![fm fileExistsAtPath:blkPath]) break;
+
+        BOOL ret;
+        @autoreleasepool {
+            if (self.blockDecryptor) {
+                ret = [self.blockDecryptor decryptBlockAtPath:blkPath toFileHandle:self.checkoutHandle];
+            } else {
+                ret = [self copyBlockAtPath:blkPath toFileHandle:self.checkoutHandle];
+            }
+        }
+        if (!ret) {
+            Warning("Failed to checkout block %@ of %@", [blkids objectAtIndex:self.checkoutIndex], self.file.name);
+            self.checkoutFailed = YES;
+            break;
+        }
+        self.checkoutIndex++;
+    }
+}
+
+- (void)assembleReadyBlocks
+{
+    if (!self.checkoutQueue) return;
+    dispatch_async(self.checkoutQueue, ^{
+        [self appendReadyBlocks];
+    });
+}
+
+- (BOOL)copyBlockAtPath:(NSString *)path toFileHandle:(NSFileHandle *)outfile
+{
+    NSFileHandle *infile = [NSFileHandle fileHandleForReadingAtPath:path];
+    if (!infile) return NO;
+    BOOL ret = YES;
+    @try {
+        while (YES) {
+            @autoreleasepool {
+                NSData *data = [infile readDataOfLength:CHECKOUT_CHUNK_SIZE];
+                if (data.length == 0) break;
+                [outfile writeData:data];
+            }
+        }
+    } @catch (NSException *exception) {
+        Warning("Failed to copy block %@: %@", path, exception);
+        ret = NO;
+    }
+    [infile closeFile];
+    return ret;
+}
+
+// Called on checkoutQueue once all blocks are downloaded.
 - (int)checkoutFile
 {
-    // Implement file block merging logic
     NSString *path = [SeafStorage.sharedObject documentPath:self.downloadingFileOid];
+    NSString *partPath = [self checkoutPartPath];
     NSFileManager *fm = [NSFileManager defaultManager];
+
+    [self appendReadyBlocks];
+    [self.checkoutHandle closeFile];
+    self.checkoutHandle = nil;
+    self.blockDecryptor = nil;
+
     if ([fm fileExistsAtPath:path]) {
+        [Utils removeFile:partPath];
         return 0;
     }
-    
-    NSFileHandle *outfile = [NSFileHandle fileHandleForWritingAtPath:path];
-    if (!outfile) {
-        [@"" writeToFile:path atomically:YES encoding:NSUTF8StringEncoding error:nil];
-        outfile = [NSFileHandle fileHandleForWritingAtPath:path];
-        if (!outfile) return -1;
+    if (self.checkoutFailed || self.checkoutIndex < self.blkids.count) {
+        [Utils removeFile:partPath];
+        return -1;
     }
-    
-    for (NSString *blkId in self.blkids) {
-        NSString *blkPath = [SeafStorage.sharedObject blockPath:blkId];
-        NSData *data = [NSData dataWithContentsOfFile:blkPath];
-        if (!data) return -1;
-        [outfile writeData:data];
+    if (![fm moveItemAtPath:partPath toPath:path error:nil]) {
+        [Utils removeFile:partPath];
+        return -1;
     }
-    
-    [outfile closeFile];
     return 0;
 }
 
 - (void)clearDownloadContext
 {
+    NSString *partPath = self.downloadingFileOid ? [self checkoutPartPath] : nil;
     self.downloadingFileOid = nil;
     self.currentBlockIndex = 0;
     for (int i = 0; i < self.blkids.count; ++i) {
         [self removeBlock:[self.blkids objectAtIndex:i]];
     }
     self.blkids = nil;
+    if (self.checkoutQueue) {
+        dispatch_async(self.checkoutQueue, ^{
+            [self.checkoutHandle closeFile];
+            self.checkoutHandle = nil;
+            self.blockDecryptor = nil;
+            if (partPath) [Utils removeFile:partPath];
+        });
+    }
+    @synchronized (self) {
+        self.uniqueBlocks = nil;
+        self.nextBlockIndex = 0;
+        [self.inflightBlocks removeAllObjects];
+    }
+}
+
+// Stop a download which will be added again. The downloaded blocks are kept, they are not fetched again.
+- (void)finishPreempted
+{
+    @synchronized (self.file) {
+        self.file.isDownloading = NO;
+        self.file.state = SEAF_DENTRY_INIT;
+    }
+    NSString *partPath = self.downloadingFileOid ? [self checkoutPartPath] : nil;
+    if (self.checkoutQueue) {
+        dispatch_async(self.checkoutQueue, ^{
+            [self.checkoutHandle closeFile];
+            self.checkoutHandle = nil;
+            self.blockDecryptor = nil;
+            if (partPath) [Utils removeFile:partPath];
+        });
+    }
+    @synchronized (self) {
+        self.blocksFinished = YES;
+        [self.inflightBlocks removeAllObjects];
+    }
+    [self completeOperation];
 }
 
 - (void)finishDownload:(BOOL)success error:(NSError *)error ooid:(NSString *)ooid {
+    if (!success && self.preempted) {
+        // The requests failed because they were cancelled.
+        [self finishPreempted];
+        return;
+    }
     @synchronized (self.file) {
         self.file.isDownloading = NO;
         
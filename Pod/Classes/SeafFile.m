@@ -23,6 +23,7 @@
 #import "SeafFilePreviewHandler.h"
 #import "SeafCacheManager+Thumb.h"
 #import "SeafUploadFileModel.h"
+#import "SeafMotionPhotoIndex.h"
 
 @interface SeafFile()
 
@@ -197,6 +198,8 @@
 {
     if ([Utils isMainApp]) {
         [[SeafCacheManager sharedManager] saveOidToLocalDB:ooid seafFile:self connection:self.connection];
+        // Parsed once here, so that viewers only look up where the parts of a Motion Photo are
+        [SeafMotionPhotoIndex indexFileAtPath:[SeafStorage.sharedObject documentPath:ooid] oid:ooid name:self.name];
     }
     Debug("%@ ooid=%@, self.ooid=%@, oid=%@", self.name, ooid, self.ooid, self.oid);
     BOOL updated = ![ooid isEqualToString:self.ooid];
@@ -344,6 +347,7 @@
 {
     if (!self.ooid)
         return nil;
+    [[SeafCacheManager sharedManager] recordAccessToObject:self.ooid];
     NSString *path = [SeafStorage.sharedObject documentPath:self.ooid];
     NSString *name = [@"cacheimage-preview-" stringByAppendingString:self.name];
     NSString *cachePath = [[[SeafStorage.sharedObject tempDir] stringByAppendingPathComponent:self.ooid] stringByAppendingPathComponent:name];
@@ -354,6 +358,7 @@
     if (!self.ooid) {
         return completion(nil);
     }
+    [[SeafCacheManager sharedManager] recordAccessToObject:self.ooid];
     NSString *path = [SeafStorage.sharedObject documentPath:self.ooid];
     NSString *name = [@"cacheimage-preview-" stringByAppendingString:self.name];
     NSString *cachePath = [[[SeafStorage.sharedObject tempDir] stringByAppendingPathComponent:self.ooid] stringByAppendingPathComponent:name];
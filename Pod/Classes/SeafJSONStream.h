@@ -0,0 +1,80 @@
+//
+//  SeafJSONStream.h
+//  Seafile
+//
+//  Incremental JSON parsing, for large responses read while they arrive.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+typedef NS_ENUM(NSInteger, SeafJSONToken) {
+    SeafJSONTokenNeedMore = 0,  ///< The buffered bytes end inside a token, append more.
+    SeafJSONTokenEnd,           ///< The document is complete.
+    SeafJSONTokenError,
+    SeafJSONTokenObjectStart,
+    SeafJSONTokenObjectEnd,
+    SeafJSONTokenArrayStart,
+    SeafJSONTokenArrayEnd,
+    SeafJSONTokenKey,           ///< A member name, in stringValue.
+    SeafJSONTokenString,        ///< In stringValue.
+    SeafJSONTokenNumber,        ///< In numberValue.
+    SeafJSONTokenTrue,
+    SeafJSONTokenFalse,
+    SeafJSONTokenNull,
+};
+
+/**
+ * Pull tokenizer over a UTF-8 JSON byte stream. Bytes are appended as they arrive and tokens
+ * are pulled until SeafJSONTokenNeedMore; bytes of returned tokens are dropped from the buffer.
+ * Checks the grammar, so that a key is told from a string value.
+ */
+@interface SeafJSONTokenizer : NSObject
+
+- (void)appendData:(NSData *)data;
+
+/// No more bytes will come, a number at the end of the buffer is complete.
+- (void)finish;
+
+- (SeafJSONToken)nextToken;
+
+@property (nonatomic, readonly, nullable) NSString *stringValue;
+@property (nonatomic, readonly, nullable) NSNumber *numberValue;
+
+/// Number of objects and arrays the last token is in, or starts.
+@property (nonatomic, readonly) NSUInteger depth;
+
+@property (nonatomic, readonly, nullable) NSError *error;
+
+@end
+
+/**
+ * Reads a document holding a large array without building the whole tree: the elements of the
+ * array are built and handed over one at a time. The document is either the array itself, or an
+ * object with the array as the member `arrayKey`; the other members are handed over as they are read.
+ */
+@interface SeafJSONStreamReader : NSObject
+
+- (instancetype)initWithArrayKey:(nullable NSString *)arrayKey;
+
+/// Called with each element of the array, in an autorelease pool of its own.
+@property (nonatomic, copy, nullable) void (^elementHandler)(id element);
+
+/// Called with the other members of the top level object.
+@property (nonatomic, copy, nullable) void (^memberHandler)(NSString *key, id value);
+
+/// Whether the array was found, it may still be empty.
+@property (nonatomic, readonly) BOOL foundArray;
+
+/// Returns NO if the bytes read so far are no valid document.
+- (BOOL)appendData:(NSData *)data;
+
+/// Returns YES if the document was complete and valid.
+- (BOOL)finish;
+
+@property (nonatomic, readonly, nullable) NSError *error;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,542 @@
+//
+//  SeafJSONStream.m
+//  Seafile
+//
+//  Incremental JSON parsing, for large responses read while they arrive.
+//
+
+#import "SeafJSONStream.h"
+
+// Buffered bytes of returned tokens are dropped once this many have piled up.
+static const NSUInteger SeafJSONCompactThreshold = 64 * 1024;
+
+typedef NS_ENUM(NSInteger, SeafJSONState) {
+    SeafJSONStateExpectValue = 0,
+    SeafJSONStateExpectValueOrEnd,  // after '['
+    SeafJSONStateExpectKeyOrEnd,    // after '{'
+    SeafJSONStateExpectKey,         // after ',' in an object
+    SeafJSONStateExpectColon,
+    SeafJSONStateExpectCommaOrEnd,
+    SeafJSONStateDone,
+};
+
+@interface SeafJSONTokenizer ()
+@property (nonatomic, readwrite, nullable) NSString *stringValue;
+@property (nonatomic, readwrite, nullable) NSNumber *numberValue;
+@property (nonatomic, readwrite) NSUInteger depth;
+@property (nonatomic, readwrite, nullable) NSError *error;
+@end
+
+@implementation SeafJSONTokenizer {
+    NSMutableData *_buffer;
+    NSUInteger _pos;
+    NSUInteger _dropped;    // bytes removed from the front of the buffer so far, for error offsets
+    NSMutableData *_containers; // '{' or '[' per open container
+    SeafJSONState _state;
+    BOOL _finished;
+}
+
+- (instancetype)init
+{
+    if (self = [super init]) {
+        _buffer = [NSMutableData data];
+        _containers = [NSMutableData data];
+        _state = SeafJSONStateExpectValue;
+    }
+    return self;
+}
+
+- (void)appendData:(NSData *)data
+{
+    if (_pos >= SeafJSONCompactThreshold && _pos * 2 >= _buffer.length) {
+        [_buffer replaceBytesInRange:NSMakeRange(0, _pos) withBytes:NULL length:0];
+        _dropped += _pos;
+        _pos = 0;
+    }
+    [_buffer appendData:data];
+}
+
+- (void)finish
+{
+    _finished = YES;
+}
+
+- (SeafJSONToken)failWithReason:(NSString *)reason
+{
+    if (!self.error) {
+        NSString *desc = [NSString stringWithFormat:@"%@ around character %lu.", reason, (unsigned long)(_dropped + _pos)];
+        self.error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSPropertyListReadCorruptError userInfo:@{NSDebugDescriptionKey: desc}];
+    }
+    return SeafJSONTokenError;
+}
+
+- (char)topContainer
+{
+    NSUInteger count = _containers.length;
+    return count > 0 ? ((const char *)_containers.bytes)[count - 1] : 0;
+}
+
+- (SeafJSONToken)openContainer:(char)kind
+{
+    [_containers appendBytes:&kind length:1];
+    _pos++;
+    self.depth = _containers.length;
+    if (kind == '{') {
+        _state = SeafJSONStateExpectKeyOrEnd;
+        return SeafJSONTokenObjectStart;
+    }
+    _state = SeafJSONStateExpectValueOrEnd;
+    return SeafJSONTokenArrayStart;
+}
+
+- (SeafJSONToken)closeContainer:(char)c
+{
+    char top = [self topContainer];
+    if ((c == '}' && top != '{') || (c == ']' && top != '[')) {
+        return [self failWithReason:@"Unbalanced closing bracket"];
+    }
+    self.depth = _containers.length;
+    _containers.length = _containers.length - 1;
+    _pos++;
+    [self valueDone];
+    return c == '}' ? SeafJSONTokenObjectEnd : SeafJSONTokenArrayEnd;
+}
+
+- (void)valueDone
+{
+    _state = _containers.length == 0 ? SeafJSONStateDone : SeafJSONStateExpectCommaOrEnd;
+}
+
+static void seafAppendUTF8(NSMutableData *data, uint32_t cp)
+{
+    uint8_t out[4];
+    NSUInteger len;
+    if (cp < 0x80) {
+        out[0] = (uint8_t)cp;
+        len = 1;
+    } else if (cp < 0x800) {
+        out[0] = 0xC0 | (cp >> 6);
+        out[1] = 0x80 | (cp & 0x3F);
+        len = 2;
+    } else if (cp < 0x10000) {
+        out[0] = 0xE0 | (cp >> 12);
+        out[1] = 0x80 | ((cp >> 6) & 0x3F);
+        out[2] = 0x80 | (cp & 0x3F);
+        len = 3;
+    } else {
+        out[0] = 0xF0 | (cp >> 18);
+        out[1] = 0x80 | ((cp >> 12) & 0x3F);
+        out[2] = 0x80 | ((cp >> 6) & 0x3F);
+        out[3] = 0x80 | (cp & 0x3F);
+        len = 4;
+    }
+    [data appendBytes:out length:len];
+}
+
+static BOOL seafReadHex4(const uint8_t *p, uint32_t *value)
+{
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) {
+        uint8_t c = p[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9') v |= c - '0';
+        else if (c >= 'a' && c <= 'f') v |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') v |= c - 'A' + 10;
+        else return NO;
+    }
+    *value = v;
+    return YES;
+}
+
+// Reads the string starting at the quote at _pos into stringValue.
+- (SeafJSONToken)readString:(SeafJSONToken)token
+{
+    const uint8_t *bytes = _buffer.bytes;
+    NSUInteger length = _buffer.length;
+    NSUInteger start = _pos + 1;
+    NSUInteger i = start;
+
+    // Most names and values have no escapes, they are decoded in place.
+    while (i < length && bytes[i] != '"' && bytes[i] != '\\') {
+        if (bytes[i] < 0x20) return [self failWithReason:@"Control character in string"];
+        i++;
+    }
+    if (i >= length) {
+        return _finished ? [self failWithReason:@"Unterminated string"] : SeafJSONTokenNeedMore;
+    }
+    if (bytes[i] == '"') {
+        NSString *s = [[NSString alloc] initWithBytes:bytes + start length:i - start encoding:NSUTF8StringEncoding];
+        if (!s) return [self failWithReason:@"Invalid UTF-8 in string"];
+        self.stringValue = s;
+        _pos = i + 1;
+        return token;
+    }
+
+    NSMutableData *decoded = [NSMutableData dataWithBytes:bytes + start length:i - start];
+    while (YES) {
+        if (i >= length) {
+            return _finished ? [self failWithReason:@"Unterminated string"] : SeafJSONTokenNeedMore;
+        }
+        uint8_t c = bytes[i];
+        if (c == '"') break;
+        if (c < 0x20) return [self failWithReason:@"Control character in string"];
+        if (c != '\\') {
+            NSUInteger run = i;
+            while (run < length && bytes[run] != '"' && bytes[run] != '\\' && bytes[run] >= 0x20) run++;
+            [decoded appendBytes:bytes + i length:run - i];
+            i = run;
+            continue;
+        }
+        if (i + 1 >= length) {
+            return _finished ? [self failWithReason:@"Unterminated string"] : SeafJSONTokenNeedMore;
+        }
+        uint8_t e = bytes[i + 1];
+        char simple = 0;
+        switch (e) {
+            case '"': simple = '"'; break;
+            case '\\': simple = '\\'; break;
+            case '/': simple = '/'; break;
+            case 'b': simple = '\b'; break;
+            case 'f': simple = '\f'; break;
+            case 'n': simple = '\n'; break;
+            case 'r': simple = '\r'; break;
+            case 't': simple = '\t'; break;
+            case 'u': break;
+            default: return [self failWithReason:@"Invalid escape in string"];
+        }
+        if (simple) {
+            [decoded appendBytes:&simple length:1];
+            i += 2;
+            continue;
+        }
+        if (i + 6 > length) {
+            return _finished ? [self failWithReason:@"Unterminated string"] : SeafJSONTokenNeedMore;
+        }
+        uint32_t cp;
+        if (!seafReadHex4(bytes + i + 2, &cp)) return [self failWithReason:@"Invalid \\u escape in string"];
+        i += 6;
+        if (cp >= 0xD800 && cp < 0xDC00) {
+            // A high surrogate must be followed by the escaped low one.
+            if (i + 6 > length) {
+                return _finished ? [self failWithReason:@"Unterminated string"] : SeafJSONTokenNeedMore;
+            }
+            uint32_t low;
+            if (bytes[i] != '\\' || bytes[i + 1] != 'u' || !seafReadHex4(bytes + i + 2, &low) || low < 0xDC00 || low > 0xDFFF) {
+                return [self failWithReason:@"Unpaired surrogate in string"];
+            }
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+            i += 6;
+        } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+            return [self failWithReason:@"Unpaired surrogate in string"];
+        }
+        seafAppendUTF8(decoded, cp);
+    }
+    NSString *s = [[NSString alloc] initWithData:decoded encoding:NSUTF8StringEncoding];
+    if (!s) return [self failWithReason:@"Invalid UTF-8 in string"];
+    self.stringValue = s;
+    _pos = i + 1;
+    return token;
+}
+
+- (SeafJSONToken)readLiteral:(const char *)literal token:(SeafJSONToken)token
+{
+    NSUInteger len = strlen(literal);
+    if (_pos + len > _buffer.length) {
+        return _finished ? [self failWithReason:@"Unexpected end of data"] : SeafJSONTokenNeedMore;
+    }
+    if (memcmp((const uint8_t *)_buffer.bytes + _pos, literal, len) != 0) {
+        return [self failWithReason:@"Invalid literal"];
+    }
+    _pos += len;
+    [self valueDone];
+    return token;
+}
+
+- (SeafJSONToken)readNumber
+{
+    const uint8_t *bytes = _buffer.bytes;
+    NSUInteger length = _buffer.length;
+    NSUInteger i = _pos;
+    BOOL integral = YES;
+    while (i < length) {
+        uint8_t c = bytes[i];
+        if (c >= '0' && c <= '9') {
+        } else if (c == '-' || c == '+') {
+        } else if (c == '.' || c == 'e' || c == 'E') {
+            integral = NO;
+        } else {
+            break;
+        }
+        i++;
+    }
+    // Without a delimiter after it, the number may go on in the next chunk.
+    if (i >= length && !_finished) return SeafJSONTokenNeedMore;
+
+    NSUInteger len = i - _pos;
+    char text[64];
+    if (len == 0 || len >= sizeof(text)) return [self failWithReason:@"Invalid number"];
+    memcpy(text, bytes + _pos, len);
+    text[len] = '\0';
+
+    char *end = NULL;
+    NSNumber *number = nil;
+    if (integral) {
+        errno = 0;
+        long long v = strtoll(text, &end, 10);
+        if (errno != ERANGE) number = @(v);
+    }
+    if (!number) {
+        double v = strtod(text, &end);
+        number = @(v);
+    }
+    if (end != text + len) return [self failWithReason:@"Invalid number"];
+    self.numberValue = number;
+    _pos = i;
+    [self valueDone];
+    return SeafJSONTokenNumber;
+}
+
+- (SeafJSONToken)readValue:(uint8_t)c
+{
+    switch (c) {
+        case '{':
+            return [self openContainer:'{'];
+        case '[':
+            return [self openContainer:'['];
+        case '"': {
+            SeafJSONToken token = [self readString:SeafJSONTokenString];
+            if (token == SeafJSONTokenString) [self valueDone];
+            return token;
+        }
+        case 't':
+            return [self readLiteral:"true" token:SeafJSONTokenTrue];
+        case 'f':
+            return [self readLiteral:"false" token:SeafJSONTokenFalse];
+        case 'n':
+            return [self readLiteral:"null" token:SeafJSONTokenNull];
+        default:
+            if (c == '-' || (c >= '0' && c <= '9')) return [self readNumber];
+            return [self failWithReason:@"Unexpected character"];
+    }
+}
+
+- (SeafJSONToken)nextToken
+{
+    if (self.error) return SeafJSONTokenError;
+    self.stringValue = nil;
+    self.numberValue = nil;
+
+    const uint8_t *bytes = _buffer.bytes;
+    NSUInteger length = _buffer.length;
+    while (YES) {
+        while (_pos < length && (bytes[_pos] == ' ' || bytes[_pos] == '\n' || bytes[_pos] == '\r' || bytes[_pos] == '\t')) {
+            _pos++;
+        }
+        if (_pos >= length) {
+            if (_state == SeafJSONStateDone) return SeafJSONTokenEnd;
+            return _finished ? [self failWithReason:@"Unexpected end of data"] : SeafJSONTokenNeedMore;
+        }
+        uint8_t c = bytes[_pos];
+        self.depth = _containers.length;
+        switch (_state) {
+            case SeafJSONStateDone:
+                return [self failWithReason:@"Garbage at end"];
+            case SeafJSONStateExpectColon:
+                if (c != ':') return [self failWithReason:@"Expected ':'"];
+                _pos++;
+                _state = SeafJSONStateExpectValue;
+                continue;
+            case SeafJSONStateExpectCommaOrEnd:
+                if (c == ',') {
+                    _pos++;
+                    _state = [self topContainer] == '{' ? SeafJSONStateExpectKey : SeafJSONStateExpectValue;
+                    continue;
+                }
+                if (c == '}' || c == ']') return [self closeContainer:c];
+                return [self failWithReason:@"Expected ',' or closing bracket"];
+            case SeafJSONStateExpectKeyOrEnd:
+                if (c == '}') return [self closeContainer:c];
+                // fall through
+            case SeafJSONStateExpectKey: {
+                if (c != '"') return [self failWithReason:@"Expected a member name"];
+                SeafJSONToken token = [self readString:SeafJSONTokenKey];
+                if (token == SeafJSONTokenKey) _state = SeafJSONStateExpectColon;
+                return token;
+            }
+            case SeafJSONStateExpectValueOrEnd:
+                if (c == ']') return [self closeContainer:c];
+                return [self readValue:c];
+            case SeafJSONStateExpectValue:
+                return [self readValue:c];
+        }
+    }
+}
+
+@end
+
+@interface SeafJSONStreamReader ()
+@property (nonatomic, readwrite) BOOL foundArray;
+@property (nonatomic, readwrite, nullable) NSError *error;
+@end
+
+@implementation SeafJSONStreamReader {
+    SeafJSONTokenizer *_tokenizer;
+    NSString *_arrayKey;
+    BOOL _started;
+    BOOL _inArray;          // reading the elements of the streamed array
+    BOOL _complete;
+    NSString *_key;         // member of the top level object being read
+    NSMutableArray *_containers;    // value being built
+    NSMutableArray *_pendingKeys;   // per container of _containers, the key of its next member
+}
+
+- (instancetype)initWithArrayKey:(NSString *)arrayKey
+{
+    if (self = [super init]) {
+        _tokenizer = [[SeafJSONTokenizer alloc] init];
+        _arrayKey = arrayKey;
+        _containers = [NSMutableArray array];
+        _pendingKeys = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (void)deliverValue:(id)value
+{
+    if (_inArray) {
+        if (self.elementHandler) {
+            @autoreleasepool {
+                self.elementHandler(value);
+            }
+        }
+    } else {
+        if (_key && self.memberHandler) self.memberHandler(_key, value);
+        _key = nil;
+    }
+}
+
+// Adds a complete value to the container being built, or hands it over.
+- (void)addValue:(id)value
+{
+    if (_containers.count == 0) {
+        [self deliverValue:value];
+        return;
+    }
+    id container = _containers.lastObject;
+    if ([container isKindOfClass:[NSMutableDictionary class]]) {
+        id key = _pendingKeys.lastObject;
+        if ([key isKindOfClass:[NSString class]]) {
+            [(NSMutableDictionary *)container setObject:value forKey:key];
+        }
+    } else {
+        [(NSMutableArray *)container addObject:value];
+    }
+}
+
+- (void)buildToken:(SeafJSONToken)token
+{
+    switch (token) {
+        case SeafJSONTokenObjectStart:
+            [_containers addObject:[NSMutableDictionary dictionary]];
+            [_pendingKeys addObject:[NSNull null]];
+            break;
+        case SeafJSONTokenArrayStart:
+            [_containers addObject:[NSMutableArray array]];
+            [_pendingKeys addObject:[NSNull null]];
+            break;
+        case SeafJSONTokenObjectEnd:
+        case SeafJSONTokenArrayEnd: {
+            id container = _containers.lastObject;
+            [_containers removeLastObject];
+            [_pendingKeys removeLastObject];
+            [self addValue:container];
+            break;
+        }
+        case SeafJSONTokenKey:
+            _pendingKeys[_pendingKeys.count - 1] = _tokenizer.stringValue;
+            break;
+        case SeafJSONTokenString:
+            [self addValue:_tokenizer.stringValue];
+            break;
+        case SeafJSONTokenNumber:
+            [self addValue:_tokenizer.numberValue];
+            break;
+        case SeafJSONTokenTrue:
+            [self addValue:@YES];
+            break;
+        case SeafJSONTokenFalse:
+            [self addValue:@NO];
+            break;
+        case SeafJSONTokenNull:
+            [self addValue:[NSNull null]];
+            break;
+        default:
+            break;
+    }
+}
+
+- (BOOL)pump
+{
+    while (YES) {
+        SeafJSONToken token = [_tokenizer nextToken];
+        switch (token) {
+            case SeafJSONTokenNeedMore:
+                return YES;
+            case SeafJSONTokenEnd:
+                _complete = YES;
+                return YES;
+            case SeafJSONTokenError:
+                self.error = _tokenizer.error;
+                return NO;
+            default:
+                break;
+        }
+        if (_containers.count > 0) {
+            [self buildToken:token];
+            continue;
+        }
+        if (!_started) {
+            // The document is the array itself, or an object holding it.
+            _started = YES;
+            if (token == SeafJSONTokenArrayStart) _inArray = self.foundArray = YES;
+            continue;
+        }
+        if (_inArray) {
+            if (token == SeafJSONTokenArrayEnd) {
+                _inArray = NO;
+                _key = nil;
+            } else {
+                [self buildToken:token];
+            }
+            continue;
+        }
+        if (token == SeafJSONTokenKey) {
+            _key = _tokenizer.stringValue;
+        } else if (token == SeafJSONTokenArrayStart && _arrayKey && [_key isEqualToString:_arrayKey]) {
+            _inArray = self.foundArray = YES;
+        } else if (token != SeafJSONTokenObjectEnd) {
+            [self buildToken:token];
+        }
+    }
+}
+
+- (BOOL)appendData:(NSData *)data
+{
+    if (self.error) return NO;
+    [_tokenizer appendData:data];
+    @autoreleasepool {
+        return [self pump];
+    }
+}
+
+- (BOOL)finish
+{
+    if (self.error) return NO;
+    [_tokenizer finish];
+    @autoreleasepool {
+        if (![self pump]) return NO;
+    }
+    return _complete;
+}
+
+@end
@@ -10,6 +10,7 @@
 #import <QuickLook/QuickLook.h>
 
 @class SeafBase;
+@class SeafCollationKey;
 
 /**
  Enumerates the possible return values for setting a repository's password.
@@ -47,6 +48,8 @@ enum SET_REPO_PASSWORD_RET {
 @protocol SeafSortable <NSObject>
 - (NSString *)name;///< Returns the name of the object.
 - (long long)mtime; ///< Returns the modification time of the object.
+@optional
+- (SeafCollationKey *)collationKey; ///< Returns the sort key of the name, kept until the name changes.
 @end
 
 /**
@@ -0,0 +1,61 @@
+//
+//  SeafPrefetcher.h
+//  Seafile
+//
+//  Crawls directory trees in the background so that they can be browsed offline.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class SeafConnection;
+@class SeafDir;
+
+/// What a prefetch crawls and downloads.
+@interface SeafPrefetchOptions : NSObject <NSCopying>
+
+@property (nonatomic, assign) NSUInteger maxDepth;          ///< Levels below the root to crawl, 0 for no limit.
+@property (nonatomic, assign) long long maxFileSize;        ///< Larger files are not downloaded, 0 for no limit.
+@property (nonatomic, copy, nullable) NSSet<NSString *> *fileExtensions; ///< Lowercase extensions of the files to download, nil for all.
+@property (nonatomic, assign) long long byteBudget;         ///< Total size of the files to download, 0 for no limit.
+
+@end
+
+/**
+ * Prefetches directory trees of an account. Listings are crawled breadth first, with at most
+ * maxConcurrentListings requests in flight, and stored in the listing cache; the files passing
+ * the filters are queued as prefetch downloads until the byte budget is spent.
+ *
+ * Listings wait while the task scheduler holds back background work for interactive transfers.
+ * The remaining directories of each prefetch are checkpointed, so that it resumes after a restart.
+ */
+@interface SeafPrefetcher : NSObject
+
+- (instancetype)initWithConnection:(SeafConnection *)connection;
+- (instancetype)init NS_UNAVAILABLE;
+
+/// Number of listing requests in flight at most, 3 by default.
+@property (nonatomic, assign) NSUInteger maxConcurrentListings;
+
+/// Number of directories still to be listed, over all prefetches.
+@property (nonatomic, readonly) NSUInteger pendingDirCount;
+
+/**
+ * Starts prefetching a directory tree.
+ * A prefetch of the same directory which is still running is replaced.
+ */
+- (void)prefetchDir:(SeafDir *)dir options:(SeafPrefetchOptions *)options;
+
+/// Stops the prefetch of a directory tree, downloads already queued are left alone.
+- (void)cancelPrefetchOfDir:(SeafDir *)dir;
+
+/// Stops all prefetches and removes their checkpoint, e.g. when the account logs out.
+- (void)cancelAll;
+
+/// Continues the prefetches checkpointed by an earlier run.
+- (void)resumeFromCheckpoint;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,523 @@
+//
+//  SeafPrefetcher.m
+//  Seafile
+//
+//  Crawls directory trees in the background so that they can be browsed offline.
+//
+
+#import "SeafPrefetcher.h"
+#import "SeafConnection.h"
+#import "SeafRepos.h"
+#import "SeafDir.h"
+#import "SeafFile.h"
+#import "SeafDirentList.h"
+#import "SeafStorage.h"
+#import "SeafDataTaskManager.h"
+#import "SeafAccountTaskQueue.h"
+#import "SeafTaskScheduler.h"
+#import "Utils.h"
+#import "Debug.h"
+
+#define KEY_PREFETCH @"PREFETCH"
+#define PREFETCH_MAX_CONCURRENT_LISTINGS 3
+#define PREFETCH_MAX_RETRIES 3
+// A burst of listings is checkpointed once, this long after the first of them (in seconds).
+#define PREFETCH_CHECKPOINT_DELAY 2
+// How often to check again while the tasks of the account are paused (in seconds).
+#define PREFETCH_PAUSED_RETRY_INTERVAL 30
+
+@implementation SeafPrefetchOptions
+
+- (id)copyWithZone:(NSZone *)zone
+{
+    SeafPrefetchOptions *options = [SeafPrefetchOptions new];
+    options.maxDepth = self.maxDepth;
+    options.maxFileSize = self.maxFileSize;
+    options.fileExtensions = self.fileExtensions;
+    options.byteBudget = self.byteBudget;
+    return options;
+}
+
+- (NSDictionary *)toDict
+{
+    NSMutableDictionary *dict = [NSMutableDictionary dictionary];
+    [dict setObject:@(self.maxDepth) forKey:@"maxDepth"];
+    [dict setObject:@(self.maxFileSize) forKey:@"maxFileSize"];
+    [dict setObject:@(self.byteBudget) forKey:@"byteBudget"];
+    if (self.fileExtensions) {
+        [dict setObject:self.fileExtensions.allObjects forKey:@"fileExtensions"];
+    }
+    return dict;
+}
+
++ (instancetype)optionsFromDict:(NSDictionary *)dict
+{
+    SeafPrefetchOptions *options = [SeafPrefetchOptions new];
+    options.maxDepth = [[dict objectForKey:@"maxDepth"] unsignedIntegerValue];
+    options.maxFileSize = [[dict objectForKey:@"maxFileSize"] longLongValue];
+    options.byteBudget = [[dict objectForKey:@"byteBudget"] longLongValue];
+    NSArray *extensions = [dict objectForKey:@"fileExtensions"];
+    if ([extensions isKindOfClass:[NSArray class]]) {
+        options.fileExtensions = [NSSet setWithArray:extensions];
+    }
+    return options;
+}
+
+@end
+
+/// One directory tree being prefetched. Directories to list are entries of
+/// {path, oid, perm, depth, retries}, so that they can be checkpointed as they are.
+@interface SeafPrefetchJob : NSObject
+
+@property (nonatomic, copy) NSString *repoId;
+@property (nonatomic, copy) NSString *path;
+@property (nonatomic, strong) SeafPrefetchOptions *options;
+@property (nonatomic, strong, nullable) SeafDir *rootDir;
+@property (nonatomic, strong) NSMutableArray<NSDictionary *> *frontier;
+@property (nonatomic, strong) NSMutableArray<NSDictionary *> *listing;
+@property (nonatomic, assign) long long queuedBytes;
+@property (nonatomic, assign) NSUInteger listedCount;
+@property (nonatomic, assign) BOOL cancelled;
+
+@end
+
+@implementation SeafPrefetchJob
+
+- (BOOL)isForRepo:(NSString *)repoId path:(NSString *)path
+{
+    return [self.repoId isEqualToString:repoId] && [self.path isEqualToString:path];
+}
+
+- (NSDictionary *)toDict
+{
+    return @{
+        @"repoId": self.repoId,
+        @"path": self.path,
+        @"options": [self.options toDict],
+        // Listings in flight are listed again after a restart
+        @"frontier": [self.listing arrayByAddingObjectsFromArray:self.frontier],
+        @"queuedBytes": @(self.queuedBytes),
+        @"listedCount": @(self.listedCount),
+    };
+}
+
+@end
+
+@interface SeafPrefetcher ()
+
+@property (nonatomic, weak) SeafConnection *connection;
+@property (nonatomic, strong) dispatch_queue_t queue;
+@property (nonatomic, strong) NSMutableArray<SeafPrefetchJob *> *jobs;
+@property (nonatomic, assign) NSUInteger inFlightCount;
+@property (nonatomic, assign) BOOL checkpointScheduled;
+@property (nonatomic, assign) BOOL retryScheduled;
+
+@end
+
+@implementation SeafPrefetcher
+
+- (instancetype)initWithConnection:(SeafConnection *)connection
+{
+    if (self = [super init]) {
+        _connection = connection;
+        _queue = dispatch_queue_create("com.seafile.prefetch", DISPATCH_QUEUE_SERIAL);
+        _jobs = [NSMutableArray array];
+        _maxConcurrentListings = PREFETCH_MAX_CONCURRENT_LISTINGS;
+        [[NSNotificationCenter defaultCenter] addObserver:self
+                                                 selector:@selector(schedulerDidEndHold:)
+                                                     name:SeafTaskSchedulerDidEndHoldNotification
+                                                   object:nil];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
+- (NSString *)checkpointKey
+{
+    return [NSString stringWithFormat:@"%@/%@", KEY_PREFETCH, self.connection.accountIdentifier];
+}
+
+- (SeafAccountTaskQueue *)accountQueue
+{
+    SeafConnection *connection = self.connection;
+    return connection ? [SeafDataTaskManager.sharedObject accountQueueForConnection:connection] : nil;
+}
+
+#pragma mark - Public
+
+- (void)prefetchDir:(SeafDir *)dir options:(SeafPrefetchOptions *)options
+{
+    SeafPrefetchJob *job = [SeafPrefetchJob new];
+    job.repoId = dir.repoId;
+    job.path = dir.path;
+    job.options = [options copy];
+    job.rootDir = dir;
+    job.frontier = [NSMutableArray arrayWithObject:[self entryWithPath:dir.path oid:nil perm:dir.perm depth:0]];
+    job.listing = [NSMutableArray array];
+    dispatch_async(self.queue, ^{
+        [self removeJobForRepo:job.repoId path:job.path];
+        [self.jobs addObject:job];
+        Debug("Prefetch %@ %@", job.repoId, job.path);
+        [self scheduleCheckpoint];
+        [self pump];
+    });
+}
+
+- (void)cancelPrefetchOfDir:(SeafDir *)dir
+{
+    NSString *repoId = dir.repoId;
+    NSString *path = dir.path;
+    dispatch_async(self.queue, ^{
+        [self removeJobForRepo:repoId path:path];
+        [self scheduleCheckpoint];
+    });
+}
+
+- (void)cancelAll
+{
+    // Taken now, the connection may be gone once the account is removed.
+    NSString *checkpointKey = [self checkpointKey];
+    dispatch_async(self.queue, ^{
+        for (SeafPrefetchJob *job in self.jobs) {
+            job.cancelled = YES;
+        }
+        [self.jobs removeAllObjects];
+        [self removeCheckpointForKey:checkpointKey];
+    });
+}
+
+- (NSUInteger)pendingDirCount
+{
+    __block NSUInteger count = 0;
+    dispatch_sync(self.queue, ^{
+        for (SeafPrefetchJob *job in self.jobs) {
+            count += job.frontier.count + job.listing.count;
+        }
+    });
+    return count;
+}
+
+// The checkpoint file of the account, named by the pointer kept in the storage defaults.
+- (NSString *)checkpointPathForKey:(NSString *)checkpointKey
+{
+    NSString *name = [SeafStorage.sharedObject objectForKey:checkpointKey];
+    if (![name isKindOfClass:[NSString class]]) return nil;
+    return [SeafStorage.sharedObject.prefetchDir stringByAppendingPathComponent:name];
+}
+
+- (NSString *)checkpointPath
+{
+    return [self checkpointPathForKey:[self checkpointKey]];
+}
+
+- (void)removeCheckpointForKey:(NSString *)checkpointKey
+{
+    NSString *path = [self checkpointPathForKey:checkpointKey];
+    if (path) [Utils removeFile:path];
+    [SeafStorage.sharedObject removeObjectForKey:checkpointKey];
+}
+
+- (NSArray *)loadCheckpoint
+{
+    id saved = [SeafStorage.sharedObject objectForKey:[self checkpointKey]];
+    // Checkpoints used to be kept in the defaults themselves.
+    if ([saved isKindOfClass:[NSArray class]]) return saved;
+    NSString *path = [self checkpointPath];
+    NSData *data = path ? [NSData dataWithContentsOfFile:path] : nil;
+    if (!data) return nil;
+    NSError *error = nil;
+    saved = [NSPropertyListSerialization propertyListWithData:data options:NSPropertyListImmutable format:nil error:&error];
+    if (![saved isKindOfClass:[NSArray class]]) {
+        Warning("Failed to read prefetch checkpoint %@: %@", path, error);
+        return nil;
+    }
+    return saved;
+}
+
+- (void)resumeFromCheckpoint
+{
+    dispatch_async(self.queue, ^{
+        NSArray *saved = [self loadCheckpoint];
+        if (!saved) return;
+        for (NSDictionary *dict in saved) {
+            NSString *repoId = [dict objectForKey:@"repoId"];
+            NSString *path = [dict objectForKey:@"path"];
+            NSArray *frontier = [dict objectForKey:@"frontier"];
+            if (!repoId || !path || ![frontier isKindOfClass:[NSArray class]] || [self jobForRepo:repoId path:path]) {
+                continue;
+            }
+            SeafPrefetchJob *job = [SeafPrefetchJob new];
+            job.repoId = repoId;
+            job.path = path;
+            job.options = [SeafPrefetchOptions optionsFromDict:[dict objectForKey:@"options"]];
+            job.frontier = [NSMutableArray arrayWithArray:frontier];
+            job.listing = [NSMutableArray array];
+            job.queuedBytes = [[dict objectForKey:@"queuedBytes"] longLongValue];
+            job.listedCount = [[dict objectForKey:@"listedCount"] unsignedIntegerValue];
+            [self.jobs addObject:job];
+            Debug("Resume prefetch %@ %@, %lu directories left", repoId, path, (unsigned long)job.frontier.count);
+        }
+        [self pump];
+    });
+}
+
+#pragma mark - Crawling
+
+- (NSDictionary *)entryWithPath:(NSString *)path oid:(NSString *)oid perm:(NSString *)perm depth:(NSUInteger)depth
+{
+    NSMutableDictionary *entry = [NSMutableDictionary dictionary];
+    [Utils dict:entry setObject:path forKey:@"path"];
+    [Utils dict:entry setObject:oid forKey:@"oid"];
+    [Utils dict:entry setObject:perm forKey:@"perm"];
+    [entry setObject:@(depth) forKey:@"depth"];
+    return entry;
+}
+
+- (SeafPrefetchJob *)jobForRepo:(NSString *)repoId path:(NSString *)path
+{
+    for (SeafPrefetchJob *job in self.jobs) {
+        if ([job isForRepo:repoId path:path]) return job;
+    }
+    return nil;
+}
+
+- (void)removeJobForRepo:(NSString *)repoId path:(NSString *)path
+{
+    SeafPrefetchJob *job = [self jobForRepo:repoId path:path];
+    if (job) {
+        job.cancelled = YES;
+        [self.jobs removeObject:job];
+    }
+}
+
+// Whether listings have to wait, for interactive transfers or for the account's tasks to resume.
+- (BOOL)shouldWait
+{
+    SeafAccountTaskQueue *accountQueue = [self accountQueue];
+    if (!accountQueue) return YES;
+    if (accountQueue.scheduler.holding) return YES;
+    if (accountQueue.isPaused) {
+        if (!self.retryScheduled) {
+            self.retryScheduled = YES;
+            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(PREFETCH_PAUSED_RETRY_INTERVAL * NSEC_PER_SEC)), self.queue, ^{
+                self.retryScheduled = NO;
+                [self pump];
+            });
+        }
+        return YES;
+    }
+    return NO;
+}
+
+- (void)schedulerDidEndHold:(NSNotification *)note
+{
+    if (note.object != [self accountQueue].scheduler) return;
+    dispatch_async(self.queue, ^{
+        [self pump];
+    });
+}
+
+// Starts listings until maxConcurrentListings are in flight, taking the jobs in turn.
+- (void)pump
+{
+    if (self.jobs.count == 0) return;
+    if (self.inFlightCount >= self.maxConcurrentListings || [self shouldWait]) return;
+
+    NSUInteger idle = 0;
+    while (self.inFlightCount < self.maxConcurrentListings && idle < self.jobs.count) {
+        // Move the job to the end, so that the next listing is of another job.
+        SeafPrefetchJob *job = self.jobs.firstObject;
+        [self.jobs removeObjectAtIndex:0];
+        [self.jobs addObject:job];
+        if (job.frontier.count == 0) {
+            idle++;
+            continue;
+        }
+        idle = 0;
+        NSDictionary *entry = job.frontier.firstObject;
+        [job.frontier removeObjectAtIndex:0];
+        [job.listing addObject:entry];
+        self.inFlightCount++;
+        [self listEntry:entry ofJob:job];
+    }
+}
+
+- (SeafDir *)dirForEntry:(NSDictionary *)entry ofJob:(SeafPrefetchJob *)job
+{
+    NSString *path = [entry objectForKey:@"path"];
+    if (job.rootDir && [path isEqualToString:job.path]) {
+        return job.rootDir;
+    }
+    if ([path isEqualToString:@"/"]) {
+        SeafRepo *repo = [self.connection getRepo:job.repoId];
+        if (repo) return repo;
+    }
+    return [[SeafDir alloc] initWithConnection:self.connection
+                                           oid:[entry objectForKey:@"oid"]
+                                        repoId:job.repoId
+                                          perm:[entry objectForKey:@"perm"]
+                                          name:path.lastPathComponent
+                                          path:path
+                                         mtime:0];
+}
+
+- (void)listEntry:(NSDictionary *)entry ofJob:(SeafPrefetchJob *)job
+{
+    SeafConnection *connection = self.connection;
+    if (!connection) return;
+    SeafDir *dir = [self dirForEntry:entry ofJob:job];
+    dispatch_async(dispatch_get_main_queue(), ^{
+        // A directory whose cached listing is still current is not requested again.
+        [dir loadCache];
+        NSString *oid = [entry objectForKey:@"oid"];
+        if (oid && [oid isEqualToString:dir.ooid]) {
+            [self didListEntry:entry ofJob:job items:dir.items dir:dir];
+            return;
+        }
+        [dir loadContentSuccess:^(SeafDir *d) {
+            [self didListEntry:entry ofJob:job items:d.items dir:d];
+        } failure:^(SeafDir *d, NSError *error) {
+            [self didFailEntry:entry ofJob:job error:error];
+        }];
+    });
+}
+
+- (void)didListEntry:(NSDictionary *)entry ofJob:(SeafPrefetchJob *)job items:(NSArray *)items dir:(SeafDir *)dir
+{
+    dispatch_async(self.queue, ^{
+        self.inFlightCount--;
+        [job.listing removeObjectIdenticalTo:entry];
+        if (!job.cancelled) {
+            job.listedCount++;
+            [self addChildrenOf:dir items:items depth:[[entry objectForKey:@"depth"] unsignedIntegerValue] toJob:job];
+            [self finishJobIfDone:job];
+            [self scheduleCheckpoint];
+        }
+        [self pump];
+    });
+}
+
+- (void)didFailEntry:(NSDictionary *)entry ofJob:(SeafPrefetchJob *)job error:(NSError *)error
+{
+    dispatch_async(self.queue, ^{
+        self.inFlightCount--;
+        [job.listing removeObjectIdenticalTo:entry];
+        if (!job.cancelled) {
+            NSUInteger retries = [[entry objectForKey:@"retries"] unsignedIntegerValue] + 1;
+            if (retries < PREFETCH_MAX_RETRIES) {
+                NSMutableDictionary *retry = [entry mutableCopy];
+                [retry setObject:@(retries) forKey:@"retries"];
+                [job.frontier addObject:retry];
+            } else {
+                Warning("Failed to prefetch dir %@ %@: %@", job.repoId, [entry objectForKey:@"path"], error);
+            }
+            [self finishJobIfDone:job];
+            [self scheduleCheckpoint];
+        }
+        [self pump];
+    });
+}
+
+- (void)addChildrenOf:(SeafDir *)dir items:(NSArray *)items depth:(NSUInteger)depth toJob:(SeafPrefetchJob *)job
+{
+    SeafPrefetchOptions *options = job.options;
+    BOOL descend = options.maxDepth == 0 || depth < options.maxDepth;
+
+    // The entries of a cached listing are read from its records, only the files to download are created.
+    if ([items isKindOfClass:[SeafDirentList class]]) {
+        SeafDirentList *list = (SeafDirentList *)items;
+        for (NSUInteger i = 0; i < list.count; i++) {
+            if ([list typeAtIndex:i] == SeafDirentTypeDir) {
+                if (descend) {
+                    NSString *path = [dir.path stringByAppendingPathComponent:[list nameAtIndex:i]];
+                    [job.frontier addObject:[self entryWithPath:path oid:[list oidAtIndex:i] perm:[list permAtIndex:i] depth:depth + 1]];
+                }
+            } else {
+                [self prefetchFile:[list objectAtIndex:i] ofJob:job];
+            }
+        }
+        return;
+    }
+    for (SeafBase *item in items) {
+        if ([item isKindOfClass:[SeafDir class]]) {
+            if (descend) {
+                [job.frontier addObject:[self entryWithPath:item.path oid:item.oid perm:((SeafDir *)item).perm depth:depth + 1]];
+            }
+        } else if ([item isKindOfClass:[SeafFile class]]) {
+            [self prefetchFile:item ofJob:job];
+        }
+    }
+}
+
+- (void)prefetchFile:(id)item ofJob:(SeafPrefetchJob *)job
+{
+    if (![item isKindOfClass:[SeafFile class]]) return;
+    SeafFile *file = (SeafFile *)item;
+    SeafPrefetchOptions *options = job.options;
+    if (options.maxFileSize > 0 && file.filesize > options.maxFileSize) return;
+    if (options.fileExtensions && ![options.fileExtensions containsObject:file.name.pathExtension.lowercaseString]) return;
+    if (options.byteBudget > 0 && job.queuedBytes + file.filesize > options.byteBudget) return;
+    if ([file hasCache]) return;
+
+    job.queuedBytes += file.filesize;
+    Debug("prefetch file: %@, %@", file.repoId, file.path);
+    // Caching a folder, nobody is waiting for these files yet.
+    [SeafDataTaskManager.sharedObject addFileDownloadTask:file priority:NSOperationQueuePriorityLow];
+}
+
+- (void)finishJobIfDone:(SeafPrefetchJob *)job
+{
+    if (job.frontier.count > 0 || job.listing.count > 0) return;
+    Debug("Prefetched %@ %@: %lu directories, %lld bytes queued", job.repoId, job.path, (unsigned long)job.listedCount, job.queuedBytes);
+    [self.jobs removeObject:job];
+}
+
+#pragma mark - Checkpoint
+
+- (void)scheduleCheckpoint
+{
+    if (self.checkpointScheduled) return;
+    self.checkpointScheduled = YES;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(PREFETCH_CHECKPOINT_DELAY * NSEC_PER_SEC)), self.queue, ^{
+        self.checkpointScheduled = NO;
+        [self saveCheckpoint];
+    });
+}
+
+- (void)saveCheckpoint
+{
+    if (!self.connection) return;
+    NSString *path = [self checkpointPath];
+    if (self.jobs.count == 0) {
+        [self removeCheckpointForKey:[self checkpointKey]];
+        return;
+    }
+    NSMutableArray *saved = [NSMutableArray arrayWithCapacity:self.jobs.count];
+    for (SeafPrefetchJob *job in self.jobs) {
+        [saved addObject:[job toDict]];
+    }
+    // The frontier can be large, it goes to a file and the shared defaults only keep its name.
+    NSError *error = nil;
+    NSData *data = [NSPropertyListSerialization dataWithPropertyList:saved format:NSPropertyListBinaryFormat_v1_0 options:0 error:&error];
+    if (!data) {
+        Warning("Failed to serialize prefetch checkpoint: %@", error);
+        return;
+    }
+    if (!path) {
+        NSString *name = [[[NSUUID UUID] UUIDString] stringByAppendingPathExtension:@"plist"];
+        path = [SeafStorage.sharedObject.prefetchDir stringByAppendingPathComponent:name];
+        if (![data writeToFile:path atomically:YES]) {
+            Warning("Failed to write prefetch checkpoint %@", path);
+            return;
+        }
+        [SeafStorage.sharedObject setObject:name forKey:[self checkpointKey]];
+    } else if (![data writeToFile:path atomically:YES]) {
+        Warning("Failed to write prefetch checkpoint %@", path);
+    }
+}
+
+@end
@@ -48,6 +48,10 @@
 - (NSString *)objectsDir;
 /// Returns the path to the blocks directory.
 - (NSString *)blocksDir;
+/// Returns the path to the directory listing cache.
+- (NSString *)direntsDir;
+/// Returns the path to the directory of the prefetch checkpoints.
+- (NSString *)prefetchDir;
 
 /**
  * Returns the path for a specific document.
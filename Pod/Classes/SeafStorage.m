@@ -20,6 +20,8 @@
 #define EDIT_DIR @"edit"
 #define THUMB_DIR @"thumb"
 #define TEMP_DIR @"temp"
+#define DIRENTS_DIR @"dirents"
+#define PREFETCH_DIR @"prefetch"
 
 static SeafStorage *object = nil;
 
@@ -86,6 +88,8 @@ static SeafStorage *object = nil;
     [Utils checkMakeDir:self.editDir];
     [Utils checkMakeDir:self.thumbsDir];
     [Utils checkMakeDir:self.tempDir];
+    [Utils checkMakeDir:self.direntsDir];
+    [Utils checkMakeDir:self.prefetchDir];
 }
 
 - (NSURL *)rootURL
@@ -128,6 +132,14 @@ static SeafStorage *object = nil;
 {
     return [self.rootPath stringByAppendingPathComponent:BLOCKS_DIR];
 }
+- (NSString *)direntsDir
+{
+    return [self.rootPath stringByAppendingPathComponent:DIRENTS_DIR];
+}
+- (NSString *)prefetchDir
+{
+    return [self.rootPath stringByAppendingPathComponent:PREFETCH_DIR];
+}
 - (NSString *)tempDir
 {
     return [[self rootPath] stringByAppendingPathComponent:TEMP_DIR];
@@ -156,6 +168,7 @@ static SeafStorage *object = nil;
     [Utils clearAllFiles:self.editDir];
     [Utils clearAllFiles:self.thumbsDir];
     [Utils clearAllFiles:self.tempDir];
+    [Utils clearAllFiles:self.direntsDir];
 }
 
 + (NSString *)uniqueDirUnder:(NSString *)dir identify:(NSString *)identify
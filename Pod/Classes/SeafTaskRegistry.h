@@ -0,0 +1,80 @@
+//
+//  SeafTaskRegistry.h
+//  Seafile
+//
+//  Indexed bookkeeping of the tasks of an account queue.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+typedef NS_ENUM(NSInteger, SeafTaskState) {
+    SeafTaskStateWaiting = 0,
+    SeafTaskStateOngoing,
+    SeafTaskStatePaused,
+    SeafTaskStateCancelled,
+    SeafTaskStateCompletedSuccessful,
+    SeafTaskStateCompletedFailed,
+};
+
+#define SEAF_TASK_STATE_COUNT 6
+
+/**
+ * Tasks indexed by a unique key and an optional secondary key, each in exactly one state.
+ * Every state keeps its tasks in the order they entered it, in an intrusive list, so that
+ * lookups and state transitions are O(1). Thread safe.
+ */
+@interface SeafTaskRegistry<TaskType> : NSObject
+
+/**
+ * @param keyBlock Returns the unique key of a task, e.g. its local path.
+ * @param secondaryKeyBlock Returns a key several tasks may share, e.g. a photo asset identifier, or nil.
+ */
+- (instancetype)initWithKeyBlock:(NSString * _Nullable (^)(TaskType task))keyBlock
+               secondaryKeyBlock:(NSString * _Nullable (^ _Nullable)(TaskType task))secondaryKeyBlock;
+
+/// Adds a task, or moves it to the end of `state`. A task with the same key is replaced.
+- (void)setTask:(TaskType)task state:(SeafTaskState)state;
+
+/// Adds a task as waiting unless a task with the same key is waiting or ongoing, returns whether it was added.
+- (BOOL)activateTask:(TaskType)task operation:(NSOperation *)operation;
+
+/// Removes a task, a different task with the same key is left alone.
+- (void)removeTask:(TaskType)task;
+
+/// Whether the task is registered, and its state.
+- (BOOL)getState:(SeafTaskState * _Nullable)state ofTask:(TaskType)task;
+
+/// Whether the task with the key of `task` is waiting or ongoing.
+- (BOOL)isActiveTask:(TaskType)task;
+
+- (nullable TaskType)taskForKey:(NSString *)key;
+- (NSArray<TaskType> *)tasksForSecondaryKey:(NSString *)key;
+
+/**
+ * Adds an index of the tasks by another key, which must not change while a task is registered.
+ * Must be added before tasks are.
+ * @param keyBlock Returns the key of a task in the index, or nil to leave the task out.
+ */
+- (void)addIndex:(NSString *)name keyBlock:(NSString * _Nullable (^)(TaskType task))keyBlock;
+
+/// The tasks with `key` in the index `name`, restricted to `state`, in the order they were added.
+- (NSArray<TaskType> *)tasksForKey:(NSString *)key inIndex:(NSString *)name state:(SeafTaskState)state;
+
+/// The operation executing a task, not retained.
+- (void)setOperation:(nullable NSOperation *)operation forTask:(TaskType)task;
+- (nullable NSOperation *)operationForTask:(TaskType)task;
+
+- (NSArray<TaskType> *)tasksInState:(SeafTaskState)state;
+- (NSUInteger)countOfTasksInState:(SeafTaskState)state;
+
+/// Appends all tasks of `fromState` to `state`, keeping their order.
+- (void)moveAllTasksInState:(SeafTaskState)fromState toState:(SeafTaskState)state;
+
+/// Removes all tasks of `state` and returns them.
+- (NSArray<TaskType> *)removeAllTasksInState:(SeafTaskState)state;
+
+@end
+
+NS_ASSUME_NONNULL_END
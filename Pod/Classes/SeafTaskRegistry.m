@@ -0,0 +1,341 @@
+//
+//  SeafTaskRegistry.m
+//  Seafile
+//
+//  Indexed bookkeeping of the tasks of an account queue.
+//
+
+#import "SeafTaskRegistry.h"
+
+@interface SeafTaskRegistryEntry : NSObject
+
+@property (nonatomic, copy) NSString *key;
+@property (nonatomic, copy, nullable) NSString *secondaryKey;
+@property (nonatomic, strong, nullable) NSDictionary<NSString *, NSString *> *indexKeys; // index name to key
+@property (nonatomic, strong) id task;
+@property (nonatomic, assign) SeafTaskState state;
+@property (nonatomic, weak, nullable) NSOperation *operation;
+
+// Linked entries are retained by the registry's key index, the back links need no reference count.
+@property (nonatomic, strong, nullable) SeafTaskRegistryEntry *next;
+@property (nonatomic, unsafe_unretained, nullable) SeafTaskRegistryEntry *prev;
+
+@end
+
+@implementation SeafTaskRegistryEntry
+@end
+
+// Doubly linked list of the entries in one state.
+@interface SeafTaskRegistryList : NSObject
+
+@property (nonatomic, strong, nullable) SeafTaskRegistryEntry *head;
+@property (nonatomic, unsafe_unretained, nullable) SeafTaskRegistryEntry *tail;
+@property (nonatomic, assign) NSUInteger count;
+
+@end
+
+@implementation SeafTaskRegistryList
+
+- (void)append:(SeafTaskRegistryEntry *)entry
+{
+    entry.next = nil;
+    entry.prev = self.tail;
+    if (self.tail) {
+        self.tail.next = entry;
+    } else {
+        self.head = entry;
+    }
+    self.tail = entry;
+    self.count++;
+}
+
+- (void)remove:(SeafTaskRegistryEntry *)entry
+{
+    SeafTaskRegistryEntry *next = entry.next;
+    SeafTaskRegistryEntry *prev = entry.prev;
+    if (prev) {
+        prev.next = next;
+    } else {
+        self.head = next;
+    }
+    if (next) {
+        next.prev = prev;
+    } else {
+        self.tail = prev;
+    }
+    entry.next = nil;
+    entry.prev = nil;
+    self.count--;
+}
+
+@end
+
+@interface SeafTaskRegistry ()
+
+@property (nonatomic, copy) NSString * _Nullable (^keyBlock)(id task);
+@property (nonatomic, copy, nullable) NSString * _Nullable (^secondaryKeyBlock)(id task);
+@property (nonatomic, strong) NSMutableDictionary<NSString *, SeafTaskRegistryEntry *> *entries;
+@property (nonatomic, strong) NSMutableDictionary<NSString *, NSMutableOrderedSet<NSString *> *> *secondaryIndex;
+@property (nonatomic, strong) NSMutableDictionary<NSString *, NSString * _Nullable (^)(id)> *indexKeyBlocks;
+// index name to (key to primary keys, in the order the tasks were added)
+@property (nonatomic, strong) NSMutableDictionary<NSString *, NSMutableDictionary<NSString *, NSMutableOrderedSet<NSString *> *> *> *indexes;
+@property (nonatomic, strong) NSArray<SeafTaskRegistryList *> *lists;
+
+@end
+
+@implementation SeafTaskRegistry
+
+- (instancetype)initWithKeyBlock:(NSString * _Nullable (^)(id task))keyBlock
+               secondaryKeyBlock:(NSString * _Nullable (^ _Nullable)(id task))secondaryKeyBlock
+{
+    if (self = [super init]) {
+        _keyBlock = keyBlock;
+        _secondaryKeyBlock = secondaryKeyBlock;
+        _entries = [NSMutableDictionary dictionary];
+        _secondaryIndex = [NSMutableDictionary dictionary];
+        _indexKeyBlocks = [NSMutableDictionary dictionary];
+        _indexes = [NSMutableDictionary dictionary];
+        NSMutableArray *lists = [NSMutableArray arrayWithCapacity:SEAF_TASK_STATE_COUNT];
+        for (int i = 0; i < SEAF_TASK_STATE_COUNT; i++) {
+            [lists addObject:[SeafTaskRegistryList new]];
+        }
+        _lists = lists;
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    // Break the chains iteratively, releasing a long list from its head would recurse once per entry.
+    for (SeafTaskRegistryList *list in _lists) {
+        SeafTaskRegistryEntry *entry = list.head;
+        list.head = nil;
+        while (entry) {
+            SeafTaskRegistryEntry *next = entry.next;
+            entry.next = nil;
+            entry = next;
+        }
+    }
+}
+
+// Called with self locked.
+- (SeafTaskRegistryEntry *)entryForTask:(id)task
+{
+    NSString *key = self.keyBlock(task);
+    if (!key) return nil;
+    SeafTaskRegistryEntry *entry = [self.entries objectForKey:key];
+    return entry.task == task ? entry : nil;
+}
+
+static void seafIndexAdd(NSMutableDictionary<NSString *, NSMutableOrderedSet<NSString *> *> *index, NSString *key, NSString *primaryKey)
+{
+    NSMutableOrderedSet *keys = [index objectForKey:key];
+    if (!keys) {
+        keys = [NSMutableOrderedSet orderedSet];
+        [index setObject:keys forKey:key];
+    }
+    [keys addObject:primaryKey];
+}
+
+static void seafIndexRemove(NSMutableDictionary<NSString *, NSMutableOrderedSet<NSString *> *> *index, NSString *key, NSString *primaryKey)
+{
+    NSMutableOrderedSet *keys = [index objectForKey:key];
+    [keys removeObject:primaryKey];
+    if (keys.count == 0) [index removeObjectForKey:key];
+}
+
+- (void)unlinkEntry:(SeafTaskRegistryEntry *)entry
+{
+    [[self.lists objectAtIndex:entry.state] remove:entry];
+    [self.entries removeObjectForKey:entry.key];
+    if (entry.secondaryKey) {
+        seafIndexRemove(self.secondaryIndex, entry.secondaryKey, entry.key);
+    }
+    [entry.indexKeys enumerateKeysAndObjectsUsingBlock:^(NSString *name, NSString *key, BOOL *stop) {
+        seafIndexRemove([self.indexes objectForKey:name], key, entry.key);
+    }];
+}
+
+- (void)setTask:(id)task state:(SeafTaskState)state
+{
+    NSString *key = self.keyBlock(task);
+    if (!key) return;
+    @synchronized (self) {
+        SeafTaskRegistryEntry *entry = [self.entries objectForKey:key];
+        if (entry && entry.task != task) {
+            [self unlinkEntry:entry];
+            entry = nil;
+        }
+        if (entry) {
+            [[self.lists objectAtIndex:entry.state] remove:entry];
+        } else {
+            entry = [SeafTaskRegistryEntry new];
+            entry.key = key;
+            entry.task = task;
+            entry.secondaryKey = self.secondaryKeyBlock ? self.secondaryKeyBlock(task) : nil;
+            [self.entries setObject:entry forKey:key];
+            if (entry.secondaryKey) {
+                seafIndexAdd(self.secondaryIndex, entry.secondaryKey, key);
+            }
+            if (self.indexKeyBlocks.count > 0) {
+                NSMutableDictionary *indexKeys = [NSMutableDictionary dictionary];
+                [self.indexKeyBlocks enumerateKeysAndObjectsUsingBlock:^(NSString *name, NSString * _Nullable (^keyBlock)(id), BOOL *stop) {
+                    NSString *indexKey = keyBlock(task);
+                    if (indexKey) {
+                        [indexKeys setObject:indexKey forKey:name];
+                        seafIndexAdd([self.indexes objectForKey:name], indexKey, key);
+                    }
+                }];
+                entry.indexKeys = indexKeys;
+            }
+        }
+        entry.state = state;
+        [[self.lists objectAtIndex:state] append:entry];
+    }
+}
+
+- (BOOL)activateTask:(id)task operation:(NSOperation *)operation
+{
+    NSString *key = self.keyBlock(task);
+    if (!key) return NO;
+    @synchronized (self) {
+        SeafTaskRegistryEntry *entry = [self.entries objectForKey:key];
+        if (entry && (entry.state == SeafTaskStateWaiting || entry.state == SeafTaskStateOngoing)) return NO;
+        [self setTask:task state:SeafTaskStateWaiting];
+        [self.entries objectForKey:key].operation = operation;
+        return YES;
+    }
+}
+
+- (void)removeTask:(id)task
+{
+    @synchronized (self) {
+        SeafTaskRegistryEntry *entry = [self entryForTask:task];
+        if (entry) [self unlinkEntry:entry];
+    }
+}
+
+- (BOOL)getState:(SeafTaskState *)state ofTask:(id)task
+{
+    @synchronized (self) {
+        SeafTaskRegistryEntry *entry = [self entryForTask:task];
+        if (!entry) return NO;
+        if (state) *state = entry.state;
+        return YES;
+    }
+}
+
+- (BOOL)isActiveTask:(id)task
+{
+    NSString *key = self.keyBlock(task);
+    if (!key) return NO;
+    @synchronized (self) {
+        SeafTaskRegistryEntry *entry = [self.entries objectForKey:key];
+        return entry && (entry.state == SeafTaskStateWaiting || entry.state == SeafTaskStateOngoing);
+    }
+}
+
+- (id)taskForKey:(NSString *)key
+{
+    @synchronized (self) {
+        return [self.entries objectForKey:key].task;
+    }
+}
+
+- (NSArray *)tasksForSecondaryKey:(NSString *)key
+{
+    NSMutableArray *tasks = [NSMutableArray array];
+    @synchronized (self) {
+        for (NSString *primaryKey in [self.secondaryIndex objectForKey:key]) {
+            SeafTaskRegistryEntry *entry = [self.entries objectForKey:primaryKey];
+            if (entry) [tasks addObject:entry.task];
+        }
+    }
+    return tasks;
+}
+
+- (void)addIndex:(NSString *)name keyBlock:(NSString * _Nullable (^)(id task))keyBlock
+{
+    @synchronized (self) {
+        [self.indexKeyBlocks setObject:[keyBlock copy] forKey:name];
+        [self.indexes setObject:[NSMutableDictionary dictionary] forKey:name];
+    }
+}
+
+- (NSArray *)tasksForKey:(NSString *)key inIndex:(NSString *)name state:(SeafTaskState)state
+{
+    NSMutableArray *tasks = [NSMutableArray array];
+    @synchronized (self) {
+        for (NSString *primaryKey in [[self.indexes objectForKey:name] objectForKey:key]) {
+            SeafTaskRegistryEntry *entry = [self.entries objectForKey:primaryKey];
+            if (entry && entry.state == state) [tasks addObject:entry.task];
+        }
+    }
+    return tasks;
+}
+
+- (void)setOperation:(NSOperation *)operation forTask:(id)task
+{
+    @synchronized (self) {
+        [self entryForTask:task].operation = operation;
+    }
+}
+
+- (NSOperation *)operationForTask:(id)task
+{
+    @synchronized (self) {
+        return [self entryForTask:task].operation;
+    }
+}
+
+- (NSArray *)tasksInState:(SeafTaskState)state
+{
+    @synchronized (self) {
+        SeafTaskRegistryList *list = [self.lists objectAtIndex:state];
+        NSMutableArray *tasks = [NSMutableArray arrayWithCapacity:list.count];
+        for (SeafTaskRegistryEntry *entry = list.head; entry; entry = entry.next) {
+            [tasks addObject:entry.task];
+        }
+        return tasks;
+    }
+}
+
+- (NSUInteger)countOfTasksInState:(SeafTaskState)state
+{
+    @synchronized (self) {
+        return [self.lists objectAtIndex:state].count;
+    }
+}
+
+- (void)moveAllTasksInState:(SeafTaskState)fromState toState:(SeafTaskState)state
+{
+    if (fromState == state) return;
+    @synchronized (self) {
+        SeafTaskRegistryList *from = [self.lists objectAtIndex:fromState];
+        SeafTaskRegistryList *to = [self.lists objectAtIndex:state];
+        SeafTaskRegistryEntry *entry = from.head;
+        while (entry) {
+            SeafTaskRegistryEntry *next = entry.next;
+            [from remove:entry];
+            entry.state = state;
+            [to append:entry];
+            entry = next;
+        }
+    }
+}
+
+- (NSArray *)removeAllTasksInState:(SeafTaskState)state
+{
+    NSMutableArray *tasks = [NSMutableArray array];
+    @synchronized (self) {
+        SeafTaskRegistryList *list = [self.lists objectAtIndex:state];
+        while (list.head) {
+            SeafTaskRegistryEntry *entry = list.head;
+            [tasks addObject:entry.task];
+            [self unlinkEntry:entry];
+        }
+    }
+    return tasks;
+}
+
+@end
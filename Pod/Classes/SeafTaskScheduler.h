@@ -0,0 +1,69 @@
+//
+//  SeafTaskScheduler.h
+//  Seafile
+//
+//  Orders the transfer operations of an account by scheduling class.
+//
+
+#import <Foundation/Foundation.h>
+#import "SeafBaseOperation.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class SeafTaskScheduler;
+
+/// Posted when prefetch and backup work may go on again; the object is the SeafTaskScheduler.
+extern NSNotificationName const SeafTaskSchedulerDidEndHoldNotification;
+
+@protocol SeafTaskSchedulerDelegate <NSObject>
+
+/**
+ * Stop an executing operation to make room for interactive work. The operation's task
+ * has to be scheduled again once taskSchedulerDidEndHold: is called.
+ */
+- (void)taskScheduler:(SeafTaskScheduler *)scheduler preemptOperation:(SeafBaseOperation *)operation;
+
+/// Interactive work is done, or has held the background classes for too long.
+- (void)taskSchedulerDidEndHold:(SeafTaskScheduler *)scheduler;
+
+@end
+
+/**
+ * Shares the slots of the transfer queues between scheduling classes by weight,
+ * interactive first and backup last. The shares are applied through the queuePriority
+ * of the waiting operations, which is raised for operations waiting too long.
+ *
+ * While interactive operations run, prefetch and backup operations are held back:
+ * executing ones are preempted and waiting ones depend on a gate that opens once
+ * the interactive operations finish, or after SCHEDULER_MAX_HOLD_INTERVAL.
+ */
+@interface SeafTaskScheduler : NSObject
+
+@property (nonatomic, weak, nullable) id<SeafTaskSchedulerDelegate> delegate;
+
+/// Whether prefetch and backup operations are currently held back.
+@property (nonatomic, readonly) BOOL holding;
+
+/**
+ * Adds an operation to its queue.
+ * @param operation The operation, not yet added to a queue.
+ * @param taskClass The scheduling class of the operation.
+ * @param queue The queue executing the operation.
+ */
+- (void)scheduleOperation:(SeafBaseOperation *)operation taskClass:(SeafTaskClass)taskClass onQueue:(NSOperationQueue *)queue;
+
+/// Called when an operation of the queue finished or was cancelled.
+- (void)operationDidFinish:(SeafBaseOperation *)operation onQueue:(NSOperationQueue *)queue;
+
+/// Recompute the queuePriority of the waiting operations of the queue.
+- (void)rebalanceQueue:(NSOperationQueue *)queue;
+
+/// The class of a download added with a NSOperationQueuePriority.
++ (SeafTaskClass)downloadClassForPriority:(NSOperationQueuePriority)priority;
+
+/// The class of an upload added with a NSOperationQueuePriority.
++ (SeafTaskClass)uploadClassForPriority:(NSOperationQueuePriority)priority autoSync:(BOOL)autoSync;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,252 @@
+//
+//  SeafTaskScheduler.m
+//  Seafile
+//
+//  Orders the transfer operations of an account by scheduling class.
+//
+
+#import "SeafTaskScheduler.h"
+#import "Debug.h"
+
+// Longest time interactive work holds back prefetch and backup operations (in seconds).
+#define SCHEDULER_MAX_HOLD_INTERVAL 60
+// After a hold timed out, no new hold starts for this long so backups make progress (in seconds).
+#define SCHEDULER_HOLD_COOLDOWN_INTERVAL 30
+// Waiting operations older than this get their priority raised (in seconds).
+#define SCHEDULER_STARVATION_INTERVAL 30
+
+NSNotificationName const SeafTaskSchedulerDidEndHoldNotification = @"SeafTaskSchedulerDidEndHold";
+
+static const double SeafTaskClassWeights[SEAF_TASK_CLASS_COUNT] = {
+    16, // SeafTaskClassInteractive
+    4,  // SeafTaskClassTransfer
+    2,  // SeafTaskClassPrefetch
+    1,  // SeafTaskClassBackup
+};
+
+@interface SeafTaskScheduler ()
+
+@property (nonatomic, strong) NSHashTable<SeafBaseOperation *> *interactiveOperations;
+@property (nonatomic, strong) NSHashTable<NSOperationQueue *> *queues;
+@property (nonatomic, strong, nullable) NSBlockOperation *gate;
+@property (nonatomic, strong) NSOperationQueue *gateQueue;
+@property (nonatomic, assign) NSUInteger holdGeneration;
+@property (nonatomic, assign) NSTimeInterval holdAllowedAfter;
+
+@end
+
+@implementation SeafTaskScheduler
+
+- (instancetype)init
+{
+    if (self = [super init]) {
+        _interactiveOperations = [NSHashTable weakObjectsHashTable];
+        _queues = [NSHashTable weakObjectsHashTable];
+        _gateQueue = [[NSOperationQueue alloc] init];
+        _gateQueue.name = @"com.seafile.schedulerGate";
+    }
+    return self;
+}
+
++ (SeafTaskClass)downloadClassForPriority:(NSOperationQueuePriority)priority
+{
+    if (priority >= NSOperationQueuePriorityHigh) return SeafTaskClassInteractive;
+    if (priority <= NSOperationQueuePriorityLow) return SeafTaskClassPrefetch;
+    return SeafTaskClassTransfer;
+}
+
++ (SeafTaskClass)uploadClassForPriority:(NSOperationQueuePriority)priority autoSync:(BOOL)autoSync
+{
+    if (autoSync) return SeafTaskClassBackup;
+    if (priority >= NSOperationQueuePriorityHigh) return SeafTaskClassInteractive;
+    return SeafTaskClassTransfer;
+}
+
+- (BOOL)isHeldClass:(SeafTaskClass)taskClass
+{
+    return taskClass == SeafTaskClassPrefetch || taskClass == SeafTaskClassBackup;
+}
+
+- (BOOL)holding
+{
+    @synchronized (self) {
+        return self.gate != nil;
+    }
+}
+
+#pragma mark - Scheduling
+
+- (void)scheduleOperation:(SeafBaseOperation *)operation taskClass:(SeafTaskClass)taskClass onQueue:(NSOperationQueue *)queue
+{
+    operation.taskClass = taskClass;
+    operation.enqueueTime = [[NSDate date] timeIntervalSince1970];
+    operation.queuePriority = taskClass == SeafTaskClassInteractive ? NSOperationQueuePriorityVeryHigh : NSOperationQueuePriorityNormal;
+
+    NSArray<SeafBaseOperation *> *preempted = nil;
+    @synchronized (self) {
+        [self.queues addObject:queue];
+        if (taskClass == SeafTaskClassInteractive) {
+            [self.interactiveOperations addObject:operation];
+            if (!self.gate && operation.enqueueTime >= self.holdAllowedAfter) {
+                preempted = [self beginHold];
+            }
+        } else if (self.gate && [self isHeldClass:taskClass]) {
+            [operation addDependency:self.gate];
+        }
+    }
+    [queue addOperation:operation];
+
+    for (SeafBaseOperation *op in preempted) {
+        Debug(@"[Scheduler] Preempt %@ for interactive work", op);
+        [self.delegate taskScheduler:self preemptOperation:op];
+    }
+    [self rebalanceQueue:queue];
+}
+
+// Called with self locked, returns the executing operations to preempt.
+- (NSArray<SeafBaseOperation *> *)beginHold
+{
+    NSBlockOperation *gate = [NSBlockOperation blockOperationWithBlock:^{}];
+    self.gate = gate;
+    NSUInteger generation = ++self.holdGeneration;
+
+    NSMutableArray<SeafBaseOperation *> *preempted = [NSMutableArray array];
+    for (NSOperationQueue *queue in self.queues.allObjects) {
+        for (NSOperation *op in queue.operations) {
+            if (![op isKindOfClass:[SeafBaseOperation class]]) continue;
+            SeafBaseOperation *baseOp = (SeafBaseOperation *)op;
+            if (![self isHeldClass:baseOp.taskClass] || baseOp.isCancelled || baseOp.isFinished) continue;
+            if (baseOp.isExecuting) {
+                [preempted addObject:baseOp];
+            } else {
+                [baseOp addDependency:gate];
+            }
+        }
+    }
+
+    __weak typeof(self) weakSelf = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(SCHEDULER_MAX_HOLD_INTERVAL * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        __strong typeof(weakSelf) strongSelf = weakSelf;
+        BOOL expired;
+        @synchronized (strongSelf) {
+            expired = strongSelf.holdGeneration == generation && strongSelf.gate;
+            if (expired) {
+                strongSelf.holdAllowedAfter = [[NSDate date] timeIntervalSince1970] + SCHEDULER_HOLD_COOLDOWN_INTERVAL;
+            }
+        }
+        if (expired) {
+            Debug(@"[Scheduler] Interactive hold expired");
+            [strongSelf endHold];
+        }
+    });
+    return preempted;
+}
+
+- (void)endHold
+{
+    NSBlockOperation *gate;
+    NSArray<NSOperationQueue *> *queues;
+    @synchronized (self) {
+        gate = self.gate;
+        self.gate = nil;
+        self.holdGeneration++;
+        queues = self.queues.allObjects;
+    }
+    if (!gate) return;
+
+    // Running the gate makes the operations depending on it ready.
+    [self.gateQueue addOperation:gate];
+    [self.delegate taskSchedulerDidEndHold:self];
+    [[NSNotificationCenter defaultCenter] postNotificationName:SeafTaskSchedulerDidEndHoldNotification object:self];
+    for (NSOperationQueue *queue in queues) {
+        [self rebalanceQueue:queue];
+    }
+}
+
+- (void)operationDidFinish:(SeafBaseOperation *)operation onQueue:(NSOperationQueue *)queue
+{
+    BOOL shouldEndHold = NO;
+    @synchronized (self) {
+        [self.interactiveOperations removeObject:operation];
+        if (self.gate) {
+            shouldEndHold = YES;
+            for (SeafBaseOperation *op in self.interactiveOperations.allObjects) {
+                if (!op.isFinished && !op.isCancelled) {
+                    shouldEndHold = NO;
+                    break;
+                }
+            }
+        }
+    }
+    if (shouldEndHold) {
+        [self endHold];
+    } else {
+        [self rebalanceQueue:queue];
+    }
+}
+
+#pragma mark - Weighted Sharing
+
+// Classes below their weighted share of the queue's slots are served first.
+- (void)rebalanceQueue:(NSOperationQueue *)queue
+{
+    NSArray<NSOperation *> *operations = queue.operations;
+    NSUInteger running[SEAF_TASK_CLASS_COUNT] = {0};
+    NSUInteger waiting[SEAF_TASK_CLASS_COUNT] = {0};
+    for (NSOperation *op in operations) {
+        if (![op isKindOfClass:[SeafBaseOperation class]] || op.isCancelled || op.isFinished) continue;
+        SeafTaskClass taskClass = ((SeafBaseOperation *)op).taskClass;
+        if (op.isExecuting) {
+            running[taskClass]++;
+        } else {
+            waiting[taskClass]++;
+        }
+    }
+
+    double activeWeight = 0;
+    for (int c = 0; c < SEAF_TASK_CLASS_COUNT; c++) {
+        if (running[c] + waiting[c] > 0) activeWeight += SeafTaskClassWeights[c];
+    }
+    if (activeWeight == 0) return;
+    NSInteger slots = MAX(queue.maxConcurrentOperationCount, 1);
+
+    // Rank the non interactive classes with waiting operations by how far they are below their share.
+    double deficit[SEAF_TASK_CLASS_COUNT];
+    NSMutableArray<NSNumber *> *ranked = [NSMutableArray array];
+    for (int c = SeafTaskClassTransfer; c < SEAF_TASK_CLASS_COUNT; c++) {
+        deficit[c] = slots * SeafTaskClassWeights[c] / activeWeight - running[c];
+        if (waiting[c] > 0) [ranked addObject:@(c)];
+    }
+    [ranked sortUsingComparator:^NSComparisonResult(NSNumber *a, NSNumber *b) {
+        double da = deficit[a.intValue], db = deficit[b.intValue];
+        if (da != db) return da > db ? NSOrderedAscending : NSOrderedDescending;
+        return [a compare:b];
+    }];
+    static const NSOperationQueuePriority rankPriorities[] = {
+        NSOperationQueuePriorityHigh,
+        NSOperationQueuePriorityNormal,
+        NSOperationQueuePriorityLow,
+        NSOperationQueuePriorityVeryLow,
+    };
+    NSOperationQueuePriority classPriorities[SEAF_TASK_CLASS_COUNT];
+    classPriorities[SeafTaskClassInteractive] = NSOperationQueuePriorityVeryHigh;
+    for (NSUInteger rank = 0; rank < ranked.count; rank++) {
+        classPriorities[ranked[rank].intValue] = rankPriorities[MIN(rank, 3)];
+    }
+
+    NSTimeInterval now = [[NSDate date] timeIntervalSince1970];
+    for (NSOperation *op in operations) {
+        if (![op isKindOfClass:[SeafBaseOperation class]] || op.isExecuting || op.isCancelled || op.isFinished) continue;
+        SeafBaseOperation *baseOp = (SeafBaseOperation *)op;
+        NSOperationQueuePriority priority = classPriorities[baseOp.taskClass];
+        if (baseOp.taskClass != SeafTaskClassInteractive && now - baseOp.enqueueTime > SCHEDULER_STARVATION_INTERVAL) {
+            // Starvation protection, one level up but never above interactive work.
+            priority = MIN(priority + 4, NSOperationQueuePriorityHigh);
+        }
+        if (baseOp.queuePriority != priority) {
+            baseOp.queuePriority = priority;
+        }
+    }
+}
+
+@end
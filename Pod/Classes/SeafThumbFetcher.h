@@ -0,0 +1,39 @@
+//
+//  SeafThumbFetcher.h
+//  Seafile
+//
+//  Fetches the encoded thumbnails of many files at once, for the File Provider.
+//
+
+#import <Foundation/Foundation.h>
+#import <CoreGraphics/CoreGraphics.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class SeafFile;
+
+typedef void (^SeafThumbDataCompletion)(NSData *_Nullable data, NSError *_Nullable error);
+
+/**
+ * Hands out thumbnails as the bytes stored on disk, without decoding and encoding them again.
+ *
+ * Thumbnails are kept per size bucket: the one the app displays, and larger ones for larger
+ * requested sizes. Misses are queued and downloaded a few at a time; requests for a thumbnail
+ * which is already being downloaded wait for that download.
+ */
+@interface SeafThumbFetcher : NSObject
+
++ (instancetype)sharedFetcher;
+
+/// Number of thumbnails downloaded at once at most, 4 by default.
+@property (nonatomic, assign) NSUInteger maxConcurrentDownloads;
+
+/**
+ * Fetches the thumbnail of a file which is at least pixelSize wide and high, as far as the server has it.
+ * @param completion Called on a background queue with the image data, or an error.
+ */
+- (void)fetchThumbDataForFile:(SeafFile *)file pixelSize:(CGFloat)pixelSize completion:(SeafThumbDataCompletion)completion;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,178 @@
+//
+//  SeafThumbFetcher.m
+//  Seafile
+//
+//  Fetches the encoded thumbnails of many files at once, for the File Provider.
+//
+
+#import <UIKit/UIKit.h>
+#import <AFNetworking/AFHTTPSessionManager.h>
+
+#import "SeafThumbFetcher.h"
+#import "SeafFile.h"
+#import "SeafConnection.h"
+#import "SeafStorage.h"
+#import "ExtentedString.h"
+#import "Utils.h"
+#import "Debug.h"
+
+// Larger thumbnails are not asked for, the server scales them from the whole image.
+static const int SeafThumbMaxPixelSize = 1024;
+
+/// A thumbnail to download, and the requests waiting for it.
+@interface SeafThumbFetch : NSObject
+@property (nonatomic, strong) SeafFile *file;
+@property (nonatomic, assign) int pixelSize;
+@property (nonatomic, copy) NSString *target;
+@property (nonatomic, strong) NSMutableArray<SeafThumbDataCompletion> *completions;
+@end
+
+@implementation SeafThumbFetch
+@end
+
+@interface SeafThumbFetcher ()
+@property (nonatomic, strong) dispatch_queue_t queue;
+/// Fetches by target path, queued or downloading.
+@property (nonatomic, strong) NSMutableDictionary<NSString *, SeafThumbFetch *> *fetches;
+@property (nonatomic, strong) NSMutableArray<SeafThumbFetch *> *waiting;
+@property (nonatomic, assign) NSUInteger downloading;
+@end
+
+@implementation SeafThumbFetcher
+
++ (instancetype)sharedFetcher
+{
+    static SeafThumbFetcher *fetcher;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        fetcher = [[SeafThumbFetcher alloc] init];
+    });
+    return fetcher;
+}
+
+- (instancetype)init
+{
+    if (self = [super init]) {
+        _queue = dispatch_queue_create("com.seafile.thumbFetcher", DISPATCH_QUEUE_SERIAL);
+        _fetches = [NSMutableDictionary dictionary];
+        _waiting = [NSMutableArray array];
+        _maxConcurrentDownloads = 4;
+    }
+    return self;
+}
+
+// The size of the thumbnails the app displays, their files are shared with it.
+- (int)defaultPixelSize
+{
+    return THUMB_SIZE * (int)[[UIScreen mainScreen] scale];
+}
+
+// Sizes are rounded up to powers of two, so that close sizes share a thumbnail.
+- (int)bucketForPixelSize:(CGFloat)pixelSize
+{
+    int bucket = [self defaultPixelSize];
+    if (pixelSize <= bucket) return bucket;
+    int pow2 = 128;
+    while (pow2 < pixelSize && pow2 < SeafThumbMaxPixelSize) pow2 *= 2;
+    return MAX(bucket, pow2);
+}
+
+- (NSString *)pathForFile:(SeafFile *)file pixelSize:(int)pixelSize
+{
+    if (!file.oid) return nil;
+    return [SeafStorage.sharedObject.thumbsDir stringByAppendingPathComponent:[NSString stringWithFormat:@"/%@-%d", file.oid, pixelSize]];
+}
+
+- (NSData *)cachedDataAtPath:(NSString *)path
+{
+    if (!path || ![Utils fileExistsAtPath:path]) return nil;
+    NSData *data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:nil];
+    return data.length > 0 ? data : nil;
+}
+
+- (void)fetchThumbDataForFile:(SeafFile *)file pixelSize:(CGFloat)pixelSize completion:(SeafThumbDataCompletion)completion
+{
+    dispatch_async(self.queue, ^{
+        int bucket = [self bucketForPixelSize:pixelSize];
+        NSString *target = [self pathForFile:file pixelSize:bucket];
+        NSData *data = [self cachedDataAtPath:target];
+        if (!data && bucket == [self defaultPixelSize]) {
+            // Thumbnails of encrypted libraries are made locally and named by mtime.
+            data = [self cachedDataAtPath:[SeafStorage.sharedObject.thumbsDir stringByAppendingPathComponent:[NSString stringWithFormat:@"/%@-%lld", file.name, file.mtime]]];
+        }
+        if (data) {
+            completion(data, nil);
+            return;
+        }
+        if (!target || [file.connection isEncrypted:file.repoId]) {
+            completion(nil, [Utils defaultError]);
+            return;
+        }
+
+        SeafThumbFetch *fetch = [self.fetches objectForKey:target];
+        if (fetch) {
+            [fetch.completions addObject:[completion copy]];
+            return;
+        }
+        fetch = [SeafThumbFetch new];
+        fetch.file = file;
+        fetch.pixelSize = bucket;
+        fetch.target = target;
+        fetch.completions = [NSMutableArray arrayWithObject:[completion copy]];
+        [self.fetches setObject:fetch forKey:target];
+        [self.waiting addObject:fetch];
+        [self startDownloads];
+    });
+}
+
+// Called on the queue.
+- (void)startDownloads
+{
+    while (self.downloading < self.maxConcurrentDownloads && self.waiting.count > 0) {
+        SeafThumbFetch *fetch = self.waiting.firstObject;
+        [self.waiting removeObjectAtIndex:0];
+        self.downloading += 1;
+        [self download:fetch];
+    }
+}
+
+- (void)download:(SeafThumbFetch *)fetch
+{
+    SeafFile *file = fetch.file;
+    SeafConnection *connection = file.connection;
+    NSString *thumburl = [NSString stringWithFormat:API_URL"/repos/%@/thumbnail/?size=%d&p=%@", file.repoId, fetch.pixelSize, file.path.escapedUrl];
+    NSMutableURLRequest *request = [[connection buildRequest:thumburl method:@"GET" form:nil] mutableCopy];
+    request.timeoutInterval = 10.0;
+    Debug("Request: %@", request.URL);
+
+    NSString *target = fetch.target;
+    NSURLSessionDownloadTask *task = [connection.sessionMgr downloadTaskWithRequest:request progress:nil destination:^NSURL *(NSURL *targetPath, NSURLResponse *response) {
+        return [NSURL fileURLWithPath:target];
+    } completionHandler:^(NSURLResponse *response, NSURL *filePath, NSError *error) {
+        NSInteger status = [response isKindOfClass:[NSHTTPURLResponse class]] ? ((NSHTTPURLResponse *)response).statusCode : 0;
+        if (!error && status != 200) {
+            // An error page is no thumbnail.
+            [Utils removeFile:filePath.path];
+            error = [Utils defaultError];
+        }
+        if (!error && filePath && ![filePath.path isEqualToString:target]) {
+            [Utils removeFile:target];
+            [[NSFileManager defaultManager] moveItemAtPath:filePath.path toPath:target error:nil];
+        }
+        dispatch_async(self.queue, ^{
+            self.downloading -= 1;
+            [self.fetches removeObjectForKey:target];
+            NSData *data = error ? nil : [self cachedDataAtPath:target];
+            if (!data) {
+                Warning("Failed to fetch thumb of %@: %@", file.name, error);
+            }
+            for (SeafThumbDataCompletion completion in fetch.completions) {
+                completion(data, data ? nil : (error ?: [Utils defaultError]));
+            }
+            [self startDownloads];
+        });
+    }];
+    [task resume];
+}
+
+@end
@@ -14,6 +14,10 @@ NS_ASSUME_NONNULL_BEGIN
 
 @property (nonatomic, strong) SeafFile *file;
 
+@property (nonatomic, readonly) NSTimeInterval executionStartTime;///< When the operation started executing, 0 before.
+@property (nonatomic, readonly) long long receivedBytes;///< Size of the downloaded thumbnail.
+@property (nonatomic, readonly) BOOL failed;
+
 - (instancetype)initWithSeafFile:(SeafFile *)file;
 
 @end
@@ -30,6 +30,10 @@
 
 @property (nonatomic, assign) NSInteger retryCount; // Tracks the current number of retry attempts
 
+@property (nonatomic, assign) NSTimeInterval executionStartTime;
+@property (nonatomic, assign) long long receivedBytes;
+@property (nonatomic, assign) BOOL failed;
+
 @end
 
 @implementation SeafThumbOperation
@@ -85,6 +89,7 @@
         return;
     }
 
+    self.executionStartTime = [[NSDate date] timeIntervalSince1970];
     [self willChangeValueForKey:@"isExecuting"];
     _executing = YES;
     [self didChangeValueForKey:@"isExecuting"];
@@ -164,6 +169,7 @@
                     });
                 } else {
                     Debug(@"Max retry count reached for %@. Failing download.", self.file.name);
+                    strongSelf.failed = YES;
                     [strongSelf finishDownloadThumbOperation:NO];
                 }
             }
@@ -173,6 +179,7 @@
                 [Utils removeFile:target];
                 [[NSFileManager defaultManager] moveItemAtPath:filePath.path toPath:target error:nil];
             }
+            strongSelf.receivedBytes = [Utils fileSizeAtPath1:target];
             [strongSelf finishDownloadThumbOperation:YES];
         }
     }];
@@ -0,0 +1,65 @@
+//
+//  SeafTiledImageView.h
+//  Seafile
+//
+//  Draws large photos in tiles, decoding only the visible part at the current zoom.
+//
+
+#import <UIKit/UIKit.h>
+#import <ImageIO/ImageIO.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * Reads regions of an image file at reduced resolutions, without decoding the whole image.
+ *
+ * The file is read by Image I/O as regions are needed. Each level of the pyramid is the image
+ * subsampled by a power of two, decoded by the codec itself where it supports it (JPEG, HEIF);
+ * a region is decoded from the smallest level which still has enough detail for it.
+ */
+@interface SeafImageTileSource : NSObject
+
+- (nullable instancetype)initWithPath:(NSString *)path;
+
+/// Size of the image in pixels, as stored, before orientation.
+@property (nonatomic, readonly) CGSize pixelSize;
+
+@property (nonatomic, readonly) CGImagePropertyOrientation orientation;
+
+/**
+ * Decodes a region of the image.
+ *
+ * @param rect Region in stored pixel coordinates
+ * @param scale Output pixels per source pixel, the region is decoded at no more than this detail
+ * @return A decoded image of the region, or NULL on failure
+ */
+- (nullable CGImageRef)copyImageForRect:(CGRect)rect scale:(CGFloat)scale CF_RETURNS_RETAINED;
+
+@end
+
+/**
+ * Shows an image file in tiles over a preview of it, for zooming into photos too large to decode whole.
+ *
+ * Tiles are drawn by a CATiledLayer for the visible rect at the current zoom only, on its
+ * background threads, with at most two tiles decoding at once; decoded tiles are kept in a
+ * least recently used cache of bounded size shared by all views. Tiles which would not show
+ * more detail than the preview are not drawn, the view is transparent there.
+ */
+@interface SeafTiledImageView : UIView
+
+- (instancetype)initWithFrame:(CGRect)frame tileSource:(SeafImageTileSource *)tileSource;
+
+@property (nonatomic, strong, readonly) SeafImageTileSource *tileSource;
+
+/// Size of the image in pixels, in display orientation.
+@property (nonatomic, readonly) CGSize imageSize;
+
+/// Size in pixels of the preview shown under the view, in display orientation.
+@property (nonatomic, assign) CGSize previewPixelSize;
+
+/// The largest zoom scale the view is shown at, tiles are prepared for up to this scale.
+@property (nonatomic, assign) CGFloat maximumZoomScale;
+
+@end
+
+NS_ASSUME_NONNULL_END
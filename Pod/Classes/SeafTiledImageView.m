@@ -0,0 +1,384 @@
+//
+//  SeafTiledImageView.m
+//  Seafile
+//
+//  Draws large photos in tiles, decoding only the visible part at the current zoom.
+//
+
+#import "SeafTiledImageView.h"
+#import "Debug.h"
+
+// Tile edge in pixels, 1MB per decoded tile.
+static const CGFloat SeafTileSize = 512;
+// Bytes of decoded tiles kept for all images together.
+static const NSUInteger SeafTileCacheCostLimit = 48 * 1024 * 1024;
+// Tiles decoded at once; decoding a region may need a large buffer for some codecs.
+static const long SeafMaxConcurrentTileDecodes = 2;
+// Coarsest level of the pyramid, codecs subsample by 2, 4 or 8.
+static const int SeafMaxSubsampleFactor = 8;
+
+static BOOL SeafOrientationSwapsAxes(CGImagePropertyOrientation orientation)
+{
+    return orientation >= kCGImagePropertyOrientationLeftMirrored;
+}
+
+// Maps the stored image to its display orientation, about its center.
+static CGAffineTransform SeafTransformForOrientation(CGImagePropertyOrientation orientation)
+{
+    switch (orientation) {
+        case kCGImagePropertyOrientationUpMirrored:
+            return CGAffineTransformMakeScale(-1, 1);
+        case kCGImagePropertyOrientationDown:
+            return CGAffineTransformMakeRotation(M_PI);
+        case kCGImagePropertyOrientationDownMirrored:
+            return CGAffineTransformMakeScale(1, -1);
+        case kCGImagePropertyOrientationLeftMirrored:
+            return CGAffineTransformMake(0, 1, 1, 0, 0, 0);
+        case kCGImagePropertyOrientationRight:
+            return CGAffineTransformMakeRotation(M_PI_2);
+        case kCGImagePropertyOrientationRightMirrored:
+            return CGAffineTransformMake(0, -1, -1, 0, 0, 0);
+        case kCGImagePropertyOrientationLeft:
+            return CGAffineTransformMakeRotation(-M_PI_2);
+        default:
+            return CGAffineTransformIdentity;
+    }
+}
+
+#pragma mark - SeafTileCache
+
+static NSUInteger SeafTileCost(CGImageRef image)
+{
+    return CGImageGetBytesPerRow(image) * CGImageGetHeight(image);
+}
+
+/// Decoded tiles, least recently used evicted first once over the cost limit.
+@interface SeafTileCache : NSObject
++ (instancetype)sharedCache;
+- (nullable CGImageRef)copyImageForKey:(NSString *)key CF_RETURNS_RETAINED;
+- (void)setImage:(CGImageRef)image forKey:(NSString *)key;
+- (void)removeAllImages;
+@end
+
+@implementation SeafTileCache {
+    NSMutableDictionary<NSString *, id> *_images;
+    // Keys from least to most recently used
+    NSMutableArray<NSString *> *_order;
+    NSUInteger _totalCost;
+}
+
++ (instancetype)sharedCache
+{
+    static SeafTileCache *cache;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        cache = [[SeafTileCache alloc] init];
+    });
+    return cache;
+}
+
+- (instancetype)init
+{
+    if (self = [super init]) {
+        _images = [NSMutableDictionary dictionary];
+        _order = [NSMutableArray array];
+        [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(removeAllImages) name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
+    }
+    return self;
+}
+
+- (CGImageRef)copyImageForKey:(NSString *)key
+{
+    @synchronized (self) {
+        id image = [_images objectForKey:key];
+        if (!image) return NULL;
+        [_order removeObject:key];
+        [_order addObject:key];
+        return CGImageRetain((__bridge CGImageRef)image);
+    }
+}
+
+- (void)setImage:(CGImageRef)image forKey:(NSString *)key
+{
+    @synchronized (self) {
+        id old = [_images objectForKey:key];
+        if (old) {
+            _totalCost -= SeafTileCost((__bridge CGImageRef)old);
+            [_order removeObject:key];
+        }
+        [_images setObject:(__bridge id)image forKey:key];
+        [_order addObject:key];
+        _totalCost += SeafTileCost(image);
+
+        while (_totalCost > SeafTileCacheCostLimit && _order.count > 1) {
+            NSString *oldest = _order.firstObject;
+            _totalCost -= SeafTileCost((__bridge CGImageRef)[_images objectForKey:oldest]);
+            [_images removeObjectForKey:oldest];
+            [_order removeObjectAtIndex:0];
+        }
+    }
+}
+
+- (void)removeAllImages
+{
+    @synchronized (self) {
+        [_images removeAllObjects];
+        [_order removeAllObjects];
+        _totalCost = 0;
+    }
+}
+
+@end
+
+#pragma mark - SeafImageTileSource
+
+@interface SeafImageTileSource ()
+@property (nonatomic, copy) NSString *path;
+@end
+
+@implementation SeafImageTileSource {
+    CGImageSourceRef _source;
+    // Lazily decoded images by subsample factor, they hold no pixels of their own
+    NSMutableDictionary<NSNumber *, id> *_levels;
+}
+
+- (nullable instancetype)initWithPath:(NSString *)path
+{
+    if (self = [super init]) {
+        _path = path;
+        _levels = [NSMutableDictionary dictionary];
+        // Backed by the file, Image I/O reads the parts it decodes
+        NSDictionary *options = @{(id)kCGImageSourceShouldCache: @NO};
+        _source = CGImageSourceCreateWithURL((__bridge CFURLRef)[NSURL fileURLWithPath:path], (__bridge CFDictionaryRef)options);
+        if (!_source) return nil;
+
+        NSDictionary *properties = CFBridgingRelease(CGImageSourceCopyPropertiesAtIndex(_source, 0, (__bridge CFDictionaryRef)options));
+        CGFloat width = [[properties objectForKey:(id)kCGImagePropertyPixelWidth] doubleValue];
+        CGFloat height = [[properties objectForKey:(id)kCGImagePropertyPixelHeight] doubleValue];
+        if (width <= 0 || height <= 0) return nil;
+        _pixelSize = CGSizeMake(width, height);
+
+        NSNumber *orientation = [properties objectForKey:(id)kCGImagePropertyOrientation];
+        _orientation = orientation ? (CGImagePropertyOrientation)orientation.intValue : kCGImagePropertyOrientationUp;
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    if (_source) CFRelease(_source);
+}
+
++ (dispatch_semaphore_t)decodeSemaphore
+{
+    static dispatch_semaphore_t semaphore;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        semaphore = dispatch_semaphore_create(SeafMaxConcurrentTileDecodes);
+    });
+    return semaphore;
+}
+
+// The returned image is kept by the source.
+- (CGImageRef)levelImageWithSubsampleFactor:(int)factor
+{
+    @synchronized (self) {
+        id image = [_levels objectForKey:@(factor)];
+        if (!image) {
+            NSMutableDictionary *options = [NSMutableDictionary dictionaryWithObject:@NO forKey:(id)kCGImageSourceShouldCache];
+            if (factor > 1) {
+                [options setObject:@(factor) forKey:(id)kCGImageSourceSubsampleFactor];
+            }
+            image = CFBridgingRelease(CGImageSourceCreateImageAtIndex(_source, 0, (__bridge CFDictionaryRef)options));
+            if (!image) return NULL;
+            [_levels setObject:image forKey:@(factor)];
+        }
+        return (__bridge CGImageRef)image;
+    }
+}
+
+- (CGImageRef)copyImageForRect:(CGRect)rect scale:(CGFloat)scale
+{
+    rect = CGRectIntersection(rect, (CGRect){CGPointZero, _pixelSize});
+    if (CGRectIsEmpty(rect) || scale <= 0) {
+        return NULL;
+    }
+    scale = MIN(scale, 1.0);
+    size_t width = MAX(1, (size_t)ceil(rect.size.width * scale));
+    size_t height = MAX(1, (size_t)ceil(rect.size.height * scale));
+
+    NSString *key = [NSString stringWithFormat:@"%@|%.0f,%.0f,%.0f,%.0f|%zu", _path, rect.origin.x, rect.origin.y, rect.size.width, rect.size.height, width];
+    CGImageRef tile = [[SeafTileCache sharedCache] copyImageForKey:key];
+    if (tile) {
+        return tile;
+    }
+
+    // The coarsest level which still has the detail asked for
+    int factor = 1;
+    while (factor < SeafMaxSubsampleFactor && scale * factor * 2 <= 1.0) {
+        factor *= 2;
+    }
+
+    dispatch_semaphore_wait([SeafImageTileSource decodeSemaphore], DISPATCH_TIME_FOREVER);
+    CGImageRef level = [self levelImageWithSubsampleFactor:factor];
+    if (level) {
+        // The codec may subsample less than asked, or not at all
+        CGFloat levelScale = CGImageGetWidth(level) / _pixelSize.width;
+        CGRect levelRect = CGRectIntegral(CGRectMake(rect.origin.x * levelScale, rect.origin.y * levelScale, rect.size.width * levelScale, rect.size.height * levelScale));
+        CGImageRef region = CGImageCreateWithImageInRect(level, levelRect);
+        if (region) {
+            tile = [self newDecodedImageFromImage:region width:width height:height];
+            CGImageRelease(region);
+        }
+    }
+    dispatch_semaphore_signal([SeafImageTileSource decodeSemaphore]);
+
+    if (tile) {
+        [[SeafTileCache sharedCache] setImage:tile forKey:key];
+    } else {
+        Warning("Failed to decode tile %@ of %@", NSStringFromCGRect(rect), _path.lastPathComponent);
+    }
+    return tile;
+}
+
+// Decodes the image into a bitmap of the given size, reading only the part of the file it covers.
+- (CGImageRef)newDecodedImageFromImage:(CGImageRef)image width:(size_t)width height:(size_t)height
+{
+    CGColorSpaceRef colorSpace = CGImageGetColorSpace(image);
+    BOOL rgb = colorSpace && CGColorSpaceGetModel(colorSpace) == kCGColorSpaceModelRGB;
+    colorSpace = rgb ? CGColorSpaceRetain(colorSpace) : CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+
+    CGImageAlphaInfo alpha = CGImageGetAlphaInfo(image);
+    BOOL opaque = alpha == kCGImageAlphaNone || alpha == kCGImageAlphaNoneSkipFirst || alpha == kCGImageAlphaNoneSkipLast;
+    CGBitmapInfo bitmapInfo = kCGBitmapByteOrder32Host | (opaque ? kCGImageAlphaNoneSkipFirst : kCGImageAlphaPremultipliedFirst);
+
+    CGContextRef context = CGBitmapContextCreate(NULL, width, height, 8, 0, colorSpace, bitmapInfo);
+    CGColorSpaceRelease(colorSpace);
+    if (!context) {
+        return NULL;
+    }
+    CGContextSetInterpolationQuality(context, kCGInterpolationHigh);
+    CGContextDrawImage(context, CGRectMake(0, 0, width, height), image);
+    CGImageRef decoded = CGBitmapContextCreateImage(context);
+    CGContextRelease(context);
+    return decoded;
+}
+
+@end
+
+#pragma mark - SeafTiledImageView
+
+/// Draws the stored image, unrotated, in tiles.
+@interface SeafImageTileView : UIView
+@property (atomic, strong) SeafImageTileSource *tileSource;
+/// Source pixels per point.
+@property (atomic, assign) CGFloat pixelsPerPoint;
+/// Output pixels per source pixel which the preview already has.
+@property (atomic, assign) CGFloat minimumDetail;
+@end
+
+@implementation SeafImageTileView
+
++ (Class)layerClass
+{
+    return [CATiledLayer class];
+}
+
+// Called on the background threads of the tiled layer, for each visible tile.
+- (void)drawRect:(CGRect)rect
+{
+    SeafImageTileSource *source = self.tileSource;
+    CGFloat pixelsPerPoint = self.pixelsPerPoint;
+    CGFloat scale = fabs(CGContextGetCTM(UIGraphicsGetCurrentContext()).a);
+    if (!source || pixelsPerPoint <= 0 || scale <= 0) {
+        return;
+    }
+
+    CGFloat detail = scale / pixelsPerPoint;
+    if (detail <= self.minimumDetail) {
+        return;
+    }
+
+    CGRect pixelRect = CGRectIntegral(CGRectMake(rect.origin.x * pixelsPerPoint, rect.origin.y * pixelsPerPoint, rect.size.width * pixelsPerPoint, rect.size.height * pixelsPerPoint));
+    pixelRect = CGRectIntersection(pixelRect, (CGRect){CGPointZero, source.pixelSize});
+    CGImageRef tile = [source copyImageForRect:pixelRect scale:detail];
+    if (!tile) {
+        return;
+    }
+    CGRect drawRect = CGRectMake(pixelRect.origin.x / pixelsPerPoint, pixelRect.origin.y / pixelsPerPoint, pixelRect.size.width / pixelsPerPoint, pixelRect.size.height / pixelsPerPoint);
+    [[UIImage imageWithCGImage:tile] drawInRect:drawRect];
+    CGImageRelease(tile);
+}
+
+@end
+
+@interface SeafTiledImageView ()
+@property (nonatomic, strong) SeafImageTileView *tileView;
+@end
+
+@implementation SeafTiledImageView
+
+- (instancetype)initWithFrame:(CGRect)frame tileSource:(SeafImageTileSource *)tileSource
+{
+    if (self = [super initWithFrame:frame]) {
+        _tileSource = tileSource;
+        self.opaque = NO;
+        self.backgroundColor = [UIColor clearColor];
+        self.userInteractionEnabled = NO;
+
+        _tileView = [[SeafImageTileView alloc] initWithFrame:CGRectZero];
+        _tileView.tileSource = tileSource;
+        _tileView.opaque = NO;
+        _tileView.backgroundColor = [UIColor clearColor];
+        ((CATiledLayer *)_tileView.layer).tileSize = CGSizeMake(SeafTileSize, SeafTileSize);
+        [self addSubview:_tileView];
+        self.maximumZoomScale = 1.0;
+    }
+    return self;
+}
+
+- (CGSize)imageSize
+{
+    CGSize size = _tileSource.pixelSize;
+    return SeafOrientationSwapsAxes(_tileSource.orientation) ? CGSizeMake(size.height, size.width) : size;
+}
+
+- (void)setMaximumZoomScale:(CGFloat)maximumZoomScale
+{
+    _maximumZoomScale = maximumZoomScale;
+    // Each magnified level of detail doubles the resolution of the tiles
+    size_t bias = (size_t)ceil(log2(MAX(maximumZoomScale, 2.0)));
+    CATiledLayer *layer = (CATiledLayer *)_tileView.layer;
+    layer.levelsOfDetail = bias + 1;
+    layer.levelsOfDetailBias = bias;
+}
+
+- (void)setPreviewPixelSize:(CGSize)previewPixelSize
+{
+    _previewPixelSize = previewPixelSize;
+    [self setNeedsLayout];
+}
+
+- (void)layoutSubviews
+{
+    [super layoutSubviews];
+
+    CGSize size = self.bounds.size;
+    CGImagePropertyOrientation orientation = _tileSource.orientation;
+    CGSize contentSize = SeafOrientationSwapsAxes(orientation) ? CGSizeMake(size.height, size.width) : size;
+    BOOL resized = !CGSizeEqualToSize(_tileView.bounds.size, contentSize);
+
+    // Bounds and center, the frame is undefined under a transform
+    _tileView.transform = SeafTransformForOrientation(orientation);
+    _tileView.bounds = (CGRect){CGPointZero, contentSize};
+    _tileView.center = CGPointMake(CGRectGetMidX(self.bounds), CGRectGetMidY(self.bounds));
+    _tileView.pixelsPerPoint = contentSize.width > 0 ? _tileSource.pixelSize.width / contentSize.width : 0;
+    CGSize imageSize = self.imageSize;
+    _tileView.minimumDetail = imageSize.width > 0 ? _previewPixelSize.width / imageSize.width : 0;
+
+    if (resized) {
+        [_tileView setNeedsDisplay];
+    }
+}
+
+@end
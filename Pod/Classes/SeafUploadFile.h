@@ -114,6 +114,9 @@ typedef void (^SeafUploadCompletionBlock)(SeafUploadFile *file, NSString *oid, N
 
 - (void)finishUpload:(BOOL)result oid:(NSString *_Nonnull)oid error:(NSError *_Nonnull)error;
 
+// Stop an upload which will be added again, the delegates are not told about it
+- (void)pauseUpload;
+
 // Update progress bar
 - (void)uploadProgress:(float)progress;
 
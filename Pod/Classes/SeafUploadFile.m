@@ -18,6 +18,8 @@
 #import "SeafDataTaskManager.h"
 #import "SeafStorage.h"
 #import "SeafRealmManager.h"
+#import "SeafCacheManager.h"
+#import "SeafCollationKey.h"
 #import <MobileCoreServices/MobileCoreServices.h>
 
 #ifndef kUTTypeHEIC
@@ -32,6 +34,7 @@
 @property (readonly) NSString *mime;
 @property (strong, nonatomic) NSURL *preViewURL;
 @property (nonatomic, strong) PHImageRequestOptions *requestOptions;
+@property (strong) SeafCollationKey *cachedCollationKey;
 @end
 
 @implementation SeafUploadFile
@@ -64,6 +67,12 @@
     return [self.lpath lastPathComponent];
 }
 
+- (SeafCollationKey *)collationKey {
+    SeafCollationKey *key = [SeafCollationKey keyWithName:self.name cachedKey:self.cachedCollationKey];
+    self.cachedCollationKey = key;
+    return key;
+}
+
 - (NSString *)lpath {
     return self.model.lpath;
 }
@@ -318,6 +327,13 @@
     });
 }
 
+- (void)pauseUpload {
+    @synchronized(self) {
+        self.model.uploading = NO;
+        self.task = nil;
+    }
+}
+
 - (void)finishUpload:(BOOL)result oid:(NSString *)oid error:(NSError *)error {
     @synchronized(self) {
         if (!self.model.uploading) return;
@@ -341,6 +357,7 @@
 
             if (self.editedFileOid) {
                 [Utils removeFile:[SeafStorage.sharedObject documentPath:self.editedFileOid]];
+                [[SeafCacheManager sharedManager] removeCachedObject:self.editedFileOid];
             }
         }
         
@@ -352,6 +369,7 @@
         if (!self.uploadFileAutoSync) {
             [Utils linkFileAtPath:self.lpath to:[SeafStorage.sharedObject documentPath:fOid] error:nil];
             [self updateSeafFileStatusWithOid:fOid];
+            [[SeafCacheManager sharedManager] recordCachedObject:fOid];
         } else {
             // For auto sync photos, release local cache files immediately.
             [self cleanup];
@@ -10,7 +10,11 @@
 
 #define UPLOAD_RETRY_DELAY 5.0
 
+// Number of raw blocks uploaded concurrently in block upload mode.
+#define BLOCK_UPLOAD_CONCURRENCY 3
+
 @class SeafUploadFile;
+@protocol SeafChunkingStrategy;
 
 /**
  * SeafUploadOperation handles the network operations for uploading files.
@@ -26,6 +30,8 @@
  */
 @property (nonatomic, strong, nullable) NSArray<NSString *> *missingBlocks;
 @property (nonatomic, strong, nullable) NSArray<NSString *> *allBlocks;
+@property (nonatomic, strong, nullable) NSDictionary<NSString *, NSValue *> *blockRanges;///< blockid -> range of the plaintext in the file
+@property (nonatomic, strong, null_resettable) id<SeafChunkingStrategy> chunker;///< Block boundaries, content-defined by default
 @property (nonatomic, copy, nullable) NSString *rawBlksUrl;
 @property (nonatomic, copy, nullable) NSString *commitUrl;
 @property (strong) NSString * _Nullable uploadpath;
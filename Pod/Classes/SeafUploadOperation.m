@@ -17,10 +17,38 @@
 #import "NSData+Encryption.h"
 #import "SeafStorage.h"
 #import "SeafUploadFileModel.h"
+#import "SeafDataTaskManager.h"
+#import "SeafChunker.h"
 
 // Time interval (in seconds) after which encrypted repo password should be refreshed on server
 #define REPO_PASSWORD_REFRESH_INTERVAL 300
 
+// Content-defined block sizes, the average matches the former fixed block size.
+#define CDC_MIN_BLOCK_SIZE (512*1024)
+#define CDC_AVG_BLOCK_SIZE (2*1024*1024)
+#define CDC_MAX_BLOCK_SIZE (8*1024*1024)
+
+// Upload links returned by upload-blks-link are only reused from a manifest for this long (in seconds).
+#define UPLOAD_LINK_VALID_INTERVAL 1800
+
+// The manifest is written again after this many finished blocks or seconds, whichever comes first.
+#define MANIFEST_SAVE_BLOCK_INTERVAL 16
+#define MANIFEST_SAVE_TIME_INTERVAL 10
+
+@interface SeafUploadOperation ()
+
+@property (nonatomic, strong) dispatch_queue_t chunkQueue;///< Serial queue reading and encrypting blocks off the main thread.
+@property (nonatomic, strong) NSMutableDictionary<NSString *, NSNumber *> *inflightBlocks;///< blockid -> fraction uploaded
+@property (nonatomic, assign) NSUInteger uploadedBlockCount;
+@property (nonatomic, assign) BOOL blocksFinished;///< Set once all missing blocks are sent or one of them failed.
+@property (nonatomic, assign) NSUInteger blockRound;///< Increased by every round of block uploads, work of an earlier round is dropped.
+@property (nonatomic, strong) NSMutableSet<NSString *> *uploadedBlocks;///< Blocks sent to the server, persisted in the upload manifest.
+@property (nonatomic, assign) NSTimeInterval linkTimestamp;///< When rawBlksUrl and commitUrl were obtained.
+@property (nonatomic, assign) NSUInteger blocksSinceManifestSave;
+@property (nonatomic, assign) NSTimeInterval manifestSaveTime;
+
+@end
+
 @implementation SeafUploadOperation
 
 - (instancetype)initWithUploadFile:(SeafUploadFile *)uploadFile
@@ -140,8 +168,13 @@
 // Actual upload logic after password validation
 - (void)doUpload:(SeafConnection *)connection repo:(NSString *)repoId path:(NSString *)uploadpath
 {
-    // Force non-chunked upload path regardless of file size or local decryption setting
-    Debug("Chunked upload disabled. Uploading file %@ as single request (size=%lld)", self.uploadFile.name, self.uploadFile.filesize);
+    SeafRepo *repo = [connection getRepo:repoId];
+    if ([self shouldUploadByBlocks:repo]) {
+        Debug("Uploading file %@ by blocks (size=%lld)", self.uploadFile.name, self.uploadFile.filesize);
+        [self uploadLargeFileByBlocks:repo path:uploadpath];
+        return;
+    }
+    Debug("Uploading file %@ as single request (size=%lld)", self.uploadFile.name, self.uploadFile.filesize);
     
     NSString *uploadURL = [NSString stringWithFormat:API_URL"/repos/%@/upload-link/?p=%@", repoId, uploadpath.escapedUrl];
     
@@ -160,80 +193,328 @@
     }
 }
 
+// Block upload sends only the blocks the server is missing, so a failed upload resumes instead of restarting.
+- (BOOL)shouldUploadByBlocks:(SeafRepo *)repo
+{
+    SeafConnection *connection = repo.connection;
+    if (repo.encrypted) {
+        // Blocks of an encrypted repo have to be encrypted locally, which needs the repo password.
+        // The key itself is derived later, off the main thread, when the first block is encrypted.
+        if (![connection getRepoPassword:repo.repoId]) return NO;
+        if ([connection shouldLocalDecrypt:repo.repoId]) return YES;
+    }
+    // Large files, edited ones included: those mostly share their blocks with the version on the server,
+    // and only the blocks it is missing are sent. Small files are cheaper to send whole.
+    return self.uploadFile.filesize >= LARGE_FILE_SIZE;
+}
+
 - (void)uploadLargeFileByBlocks:(SeafRepo *)repo path:(NSString *)uploadpath
 {
-    NSMutableArray *blockids = [[NSMutableArray alloc] init];
-    NSMutableArray *paths = [[NSMutableArray alloc] init];
     self.uploadpath = uploadpath;
-    if (![self chunkFile:self.uploadFile.lpath repo:repo blockids:blockids paths:paths]) {
-        Debug("Failed to chunk file");
-        [self finishUpload:NO oid:nil error:[Utils defaultError]];
+    if (!self.allBlocks && [self restoreManifest:repo]) {
+        if (self.rawBlksUrl && self.commitUrl && self.missingBlocks
+            && [[NSDate date] timeIntervalSince1970] - self.linkTimestamp < UPLOAD_LINK_VALID_INTERVAL) {
+            Debug("Resume block upload of %@, %lu blocks already uploaded", self.uploadFile.name, (unsigned long)self.uploadedBlocks.count);
+            [self uploadRawBlocks:repo];
+            return;
+        }
+    }
+    if (self.allBlocks && self.blockRanges) {
+        // Retrying, the block ids computed by the previous attempt are still valid.
+        [self sendBlockList:repo];
         return;
     }
-    self.allBlocks = blockids;
-    NSString* upload_url = [NSString stringWithFormat:API_URL"/repos/%@/upload-blks-link/?p=%@", repo.repoId, uploadpath.escapedUrl];
-    NSString *form = [NSString stringWithFormat: @"blklist=%@", [blockids componentsJoinedByString:@","]];
+
+    NSString *lpath = self.uploadFile.lpath;
+    dispatch_async(self.chunkQueue, ^{
+        NSMutableArray *blockids = [[NSMutableArray alloc] init];
+        NSMutableDictionary *ranges = [[NSMutableDictionary alloc] init];
+        BOOL ret = [self chunkFile:lpath repo:repo blockids:blockids ranges:ranges];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (self.isCancelled) return;
+            if (!ret) {
+                Debug("Failed to chunk file");
+                [self finishUpload:NO oid:nil error:[Utils defaultError]];
+                return;
+            }
+            self.allBlocks = blockids;
+            self.blockRanges = ranges;
+            [self sendBlockList:repo];
+        });
+    });
+}
+
+- (void)sendBlockList:(SeafRepo *)repo
+{
+    NSString* upload_url = [NSString stringWithFormat:API_URL"/repos/%@/upload-blks-link/?p=%@", repo.repoId, self.uploadpath.escapedUrl];
+    NSString *form = [NSString stringWithFormat: @"blklist=%@", [self.allBlocks componentsJoinedByString:@","]];
+    __weak __typeof__ (self) wself = self;
     NSURLSessionDataTask *sendBlockInfoTask = [repo.connection sendPost:upload_url form:form success:^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
-        Debug("upload largefile by blocks, JSON: %@", JSON);
-        self.rawBlksUrl = [JSON objectForKey:@"rawblksurl"];
-        self.commitUrl = [JSON objectForKey:@"commiturl"];
-        self.missingBlocks = [JSON objectForKey:@"blklist"];
-        self.blkidx = 0;
-        [self uploadRawBlocks:repo.connection];
+        __strong __typeof (wself) sself = wself;
+        if (!sself || sself.isCancelled) return;
+        Debug("upload largefile by blocks, missing %lu of %lu blocks", (unsigned long)[[JSON objectForKey:@"blklist"] count], (unsigned long)sself.allBlocks.count);
+        sself.rawBlksUrl = [JSON objectForKey:@"rawblksurl"];
+        sself.commitUrl = [JSON objectForKey:@"commiturl"];
+        sself.missingBlocks = [[NSOrderedSet orderedSetWithArray:[JSON objectForKey:@"blklist"]] array];
+        sself.linkTimestamp = [[NSDate date] timeIntervalSince1970];
+        [sself saveManifest:repo];
+        [sself uploadRawBlocks:repo];
     } failure:^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON, NSError *error) {
         Debug("Failed to upload: %@", error);
-        [self finishUpload:NO oid:nil error:error];
+        [wself finishUpload:NO oid:nil error:error];
     }];
-    
+
     @synchronized (self.taskList) {
         [self.taskList addObject:sendBlockInfoTask];
     }
 }
 
-- (void)uploadRawBlocks:(SeafConnection *)connection
+- (void)uploadRawBlocks:(SeafRepo *)repo
 {
-    long count = MIN(3, (self.missingBlocks.count - self.blkidx));
-    Debug("upload idx %ld, total: %ld, %ld", self.blkidx, (long)self.missingBlocks.count, count);
-    if (count == 0) {
-        [self uploadBlocksCommit:connection];
+    @synchronized (self) {
+        if (!self.uploadedBlocks) {
+            self.uploadedBlocks = [NSMutableSet set];
+        }
+        // Skip the blocks a previous attempt already sent.
+        NSMutableArray *missingBlocks = [NSMutableArray arrayWithCapacity:self.missingBlocks.count];
+        for (NSString *blockid in self.missingBlocks) {
+            if (![self.uploadedBlocks containsObject:blockid]) {
+                [missingBlocks addObject:blockid];
+            }
+        }
+        self.missingBlocks = missingBlocks;
+        self.blkidx = 0;
+        self.uploadedBlockCount = 0;
+        self.inflightBlocks = [NSMutableDictionary dictionary];
+        self.blocksFinished = NO;
+        self.blockRound++;
+    }
+    [self scheduleRawBlocks:repo round:self.blockRound];
+}
+
+// Whether work of a round may still go on: the round is the current one and has neither finished nor failed.
+- (BOOL)isActiveRound:(NSUInteger)round
+{
+    @synchronized (self) {
+        return !self.isCancelled && !self.blocksFinished && round == self.blockRound;
+    }
+}
+
+// Keep BLOCK_UPLOAD_CONCURRENCY block streams busy, each block is read and encrypted on chunkQueue right before it is sent.
+- (void)scheduleRawBlocks:(SeafRepo *)repo round:(NSUInteger)round
+{
+    NSMutableArray *blocksToSend = [NSMutableArray array];
+    BOOL allDone = NO;
+    @synchronized (self) {
+        if (![self isActiveRound:round]) return;
+        while (self.blkidx < self.missingBlocks.count && self.inflightBlocks.count < BLOCK_UPLOAD_CONCURRENCY) {
+            NSString *blockid = [self.missingBlocks objectAtIndex:self.blkidx];
+            self.blkidx++;
+            [self.inflightBlocks setObject:@(0) forKey:blockid];
+            [blocksToSend addObject:blockid];
+        }
+        allDone = self.uploadedBlockCount >= self.missingBlocks.count;
+        if (allDone) self.blocksFinished = YES;
+    }
+
+    if (allDone) {
+        [self uploadBlocksCommit:repo.connection];
         return;
     }
-    
-    NSArray *arr = [self.missingBlocks subarrayWithRange:NSMakeRange(self.blkidx, count)];
+    for (NSString *blockid in blocksToSend) {
+        dispatch_async(self.chunkQueue, ^{
+            if (![self isActiveRound:round]) return;
+            BOOL ret = [self writeBlock:blockid repo:repo];
+            dispatch_async(dispatch_get_main_queue(), ^{
+                if (![self isActiveRound:round]) return;
+                if (!ret) {
+                    // The file changed since it was chunked, chunk it again on retry.
+                    // The saved block list is stale too, the retry must not restore it.
+                    self.allBlocks = nil;
+                    self.blockRanges = nil;
+                    [self removeManifest];
+                    [self failBlocksWithError:[Utils defaultError] round:round];
+                    return;
+                }
+                [self uploadRawBlock:blockid repo:repo round:round];
+            });
+        });
+    }
+}
+
+- (void)uploadRawBlock:(NSString *)blockid repo:(SeafRepo *)repo round:(NSUInteger)round
+{
+    NSString *blockpath = [self blockPath:blockid];
     NSMutableURLRequest *request = [[SeafConnection requestSerializer] multipartFormRequestWithMethod:@"POST" URLString:self.rawBlksUrl parameters:nil constructingBodyWithBlock:^(id<AFMultipartFormData> formData) {
         [formData appendPartWithFormData:[@"n8ba38951c9ba66418311a25195e2e380" dataUsingEncoding:NSUTF8StringEncoding] name:@"csrfmiddlewaretoken"];
-        for (NSString *blockid in arr) {
-            NSString *blockpath = [self blockPath:blockid];
-            [formData appendPartWithFileURL:[NSURL fileURLWithPath:blockpath] name:@"file" error:nil];
-        }
+        [formData appendPartWithFileURL:[NSURL fileURLWithPath:blockpath] name:@"file" error:nil];
     } error:nil];
-    
+
     __weak __typeof__ (self) wself = self;
-    NSURLSessionUploadTask *blockDataUploadTask = [connection.sessionMgr uploadTaskWithStreamedRequest:request progress:^(NSProgress * _Nonnull uploadProgress) {
+    NSURLSessionUploadTask *blockDataUploadTask = [repo.connection.sessionMgr uploadTaskWithStreamedRequest:request progress:^(NSProgress * _Nonnull uploadProgress) {
         __strong __typeof (wself) sself = wself;
-        [sself.uploadFile uploadProgress:1.0f * self.blkidx / self.allBlocks.count];
-        
+        if (![sself isActiveRound:round]) return;
+        [sself updateBlock:blockid progress:uploadProgress.fractionCompleted];
     } completionHandler:^(NSURLResponse * _Nonnull response, id  _Nullable responseObject, NSError * _Nullable error) {
         __strong __typeof (wself) sself = wself;
-        Debug("Upload blocks %@", arr);
-        NSHTTPURLResponse *resp __attribute__((unused)) = (NSHTTPURLResponse *)response;
+        if (!sself || ![sself isActiveRound:round]) return;
+        [[NSFileManager defaultManager] removeItemAtPath:blockpath error:nil];
         if (error) {
-            Debug("Upload failed :%@,code=%ld, res=%@\n", error, (long)resp.statusCode, responseObject);
+            Debug("Upload block %@ failed :%@,code=%ld, res=%@\n", blockid, error, (long)((NSHTTPURLResponse *)response).statusCode, responseObject);
             [sself showDeserializedError:error];
-            [sself finishUpload:NO oid:nil error:error];
+            [sself failBlocksWithError:error round:round];
         } else {
-            sself.blkidx += count;
-            [sself performSelector:@selector(uploadRawBlocks:) withObject:connection afterDelay:0.0];
+            [sself finishBlock:blockid repo:repo round:round];
         }
     }];
-    
+
     [blockDataUploadTask resume];
-    
+
     @synchronized (self.taskList) {
         [self.taskList addObject:blockDataUploadTask];
     }
 }
 
+- (void)updateBlock:(NSString *)blockid progress:(double)fraction
+{
+    @synchronized (self) {
+        if (![self.inflightBlocks objectForKey:blockid]) return;
+        [self.inflightBlocks setObject:@(fraction) forKey:blockid];
+    }
+    [self reportBlocksProgress];
+}
+
+- (void)reportBlocksProgress
+{
+    float progress;
+    @synchronized (self) {
+        if (self.allBlocks.count == 0) return;
+        // Blocks the server already had count as uploaded.
+        double done = self.allBlocks.count - self.missingBlocks.count + self.uploadedBlockCount;
+        for (NSNumber *inflight in self.inflightBlocks.allValues) {
+            done += inflight.doubleValue;
+        }
+        progress = (float)(done / self.allBlocks.count);
+    }
+    [self.uploadFile uploadProgress:progress];
+}
+
+- (void)finishBlock:(NSString *)blockid repo:(SeafRepo *)repo round:(NSUInteger)round
+{
+    @synchronized (self) {
+        if (![self isActiveRound:round]) return;
+        [self.inflightBlocks removeObjectForKey:blockid];
+        [self.uploadedBlocks addObject:blockid];
+        self.uploadedBlockCount++;
+    }
+    [self reportBlocksProgress];
+    [self saveManifestIfDue:repo];
+    [self scheduleRawBlocks:repo round:round];
+}
+
+#pragma mark - Upload Manifest
+
+// Persist the block state so that startLastTimeUnfinshTaskWithConnection: resumes this upload after a restart.
+- (void)saveManifest:(SeafRepo *)repo
+{
+    if (!self.uploadFile.retryable) return;
+
+    NSMutableDictionary *manifest = [NSMutableDictionary dictionary];
+    @synchronized (self) {
+        if (!self.allBlocks || !self.blockRanges) return;
+        NSMutableDictionary *ranges = [NSMutableDictionary dictionaryWithCapacity:self.blockRanges.count];
+        for (NSString *blockid in self.blockRanges) {
+            NSRange range = [[self.blockRanges objectForKey:blockid] rangeValue];
+            [ranges setObject:@[@(range.location), @(range.length)] forKey:blockid];
+        }
+        [Utils dict:manifest setObject:repo.repoId forKey:@"repoId"];
+        [Utils dict:manifest setObject:self.uploadpath forKey:@"path"];
+        [Utils dict:manifest setObject:@(self.uploadFile.filesize) forKey:@"fileSize"];
+        [Utils dict:manifest setObject:self.allBlocks forKey:@"blockids"];
+        [Utils dict:manifest setObject:ranges forKey:@"ranges"];
+        [Utils dict:manifest setObject:self.missingBlocks forKey:@"missing"];
+        [Utils dict:manifest setObject:self.uploadedBlocks.allObjects ?: @[] forKey:@"uploaded"];
+        [Utils dict:manifest setObject:self.rawBlksUrl forKey:@"rawBlksUrl"];
+        [Utils dict:manifest setObject:self.commitUrl forKey:@"commitUrl"];
+        [Utils dict:manifest setObject:@(self.linkTimestamp) forKey:@"linkTimestamp"];
+        self.blocksSinceManifestSave = 0;
+        self.manifestSaveTime = [[NSDate date] timeIntervalSince1970];
+    }
+    SeafUploadFile *ufile = self.uploadFile;
+    dispatch_async(self.chunkQueue, ^{
+        [SeafDataTaskManager.sharedObject saveUploadManifest:manifest forFile:ufile];
+    });
+}
+
+// Rewriting the whole manifest after every block costs O(n²) writes, finished blocks are saved in batches.
+// A block missing from the manifest is only sent again, and the manifest is always saved on failure or pause.
+- (void)saveManifestIfDue:(SeafRepo *)repo
+{
+    BOOL due;
+    @synchronized (self) {
+        self.blocksSinceManifestSave++;
+        due = self.blocksSinceManifestSave >= MANIFEST_SAVE_BLOCK_INTERVAL
+            || [[NSDate date] timeIntervalSince1970] - self.manifestSaveTime >= MANIFEST_SAVE_TIME_INTERVAL;
+    }
+    if (due) [self saveManifest:repo];
+}
+
+- (void)removeManifest
+{
+    SeafUploadFile *ufile = self.uploadFile;
+    // Queued behind any pending manifest writes.
+    dispatch_async(self.chunkQueue, ^{
+        [SeafDataTaskManager.sharedObject removeUploadManifestForFile:ufile];
+    });
+}
+
+- (BOOL)restoreManifest:(SeafRepo *)repo
+{
+    NSDictionary *manifest = [SeafDataTaskManager.sharedObject uploadManifestForFile:self.uploadFile];
+    if (!manifest) return NO;
+
+    // Photos are exported again on every launch, so the content is not compared here:
+    // writeBlock:repo: verifies the id of every block before it is sent.
+    BOOL sameFile = [repo.repoId isEqualToString:[manifest objectForKey:@"repoId"]]
+        && [self.uploadpath isEqualToString:[manifest objectForKey:@"path"]]
+        && [[manifest objectForKey:@"fileSize"] longLongValue] == self.uploadFile.filesize;
+    NSArray *blockids = [manifest objectForKey:@"blockids"];
+    NSDictionary *ranges = [manifest objectForKey:@"ranges"];
+    if (!sameFile || ![blockids isKindOfClass:[NSArray class]] || ![ranges isKindOfClass:[NSDictionary class]]) {
+        [SeafDataTaskManager.sharedObject removeUploadManifestForFile:self.uploadFile];
+        return NO;
+    }
+
+    NSMutableDictionary *blockRanges = [NSMutableDictionary dictionaryWithCapacity:ranges.count];
+    for (NSString *blockid in blockids) {
+        NSArray *range = [ranges objectForKey:blockid];
+        if (![range isKindOfClass:[NSArray class]] || range.count != 2) {
+            [SeafDataTaskManager.sharedObject removeUploadManifestForFile:self.uploadFile];
+            return NO;
+        }
+        [blockRanges setObject:[NSValue valueWithRange:NSMakeRange([range[0] unsignedIntegerValue], [range[1] unsignedIntegerValue])] forKey:blockid];
+    }
+
+    self.allBlocks = blockids;
+    self.blockRanges = blockRanges;
+    self.uploadedBlocks = [NSMutableSet setWithArray:[manifest objectForKey:@"uploaded"] ?: @[]];
+    self.missingBlocks = [manifest objectForKey:@"missing"];
+    self.rawBlksUrl = [manifest objectForKey:@"rawBlksUrl"];
+    self.commitUrl = [manifest objectForKey:@"commitUrl"];
+    self.linkTimestamp = [[manifest objectForKey:@"linkTimestamp"] doubleValue];
+    return YES;
+}
+
+- (void)failBlocksWithError:(NSError *)error round:(NSUInteger)round
+{
+    @synchronized (self) {
+        if (![self isActiveRound:round]) return;
+        self.blocksFinished = YES;
+    }
+    [self cancelAllRequests];
+    [self finishUpload:NO oid:nil error:error];
+}
+
 -(void)showDeserializedError:(NSError *)error
 {
     if (!error)
@@ -251,13 +532,16 @@
     return [self.blockDir stringByAppendingPathComponent:blkId];
 }
 
+// Used from chunkQueue and main, and removed by dataCleanup.
 - (NSString *)blockDir
 {
-    if (!_blockDir) {
-        _blockDir = [SeafStorage uniqueDirUnder:SeafStorage.sharedObject.tempDir];
-        [Utils checkMakeDir:_blockDir];
+    @synchronized (self) {
+        if (!_blockDir) {
+            _blockDir = [SeafStorage uniqueDirUnder:SeafStorage.sharedObject.tempDir];
+            [Utils checkMakeDir:_blockDir];
+        }
+        return _blockDir;
     }
-    return _blockDir;
 }
 
 - (void)uploadBlocksCommit:(SeafConnection *)connection
@@ -315,32 +599,90 @@
     return [self.uploadFile.lpath lastPathComponent];
 }
 
-- (BOOL)chunkFile:(NSString *)path repo:(SeafRepo *)repo blockids:(NSMutableArray *)blockids paths:(NSMutableArray *)paths
+- (dispatch_queue_t)chunkQueue
+{
+    @synchronized (self) {
+        if (!_chunkQueue) {
+            _chunkQueue = dispatch_queue_create("com.seafile.uploadChunk", DISPATCH_QUEUE_SERIAL);
+        }
+        return _chunkQueue;
+    }
+}
+
+- (id<SeafChunkingStrategy>)chunker
+{
+    if (!_chunker) {
+        _chunker = [[SeafContentDefinedChunker alloc] initWithMinSize:CDC_MIN_BLOCK_SIZE averageSize:CDC_AVG_BLOCK_SIZE maxSize:CDC_MAX_BLOCK_SIZE];
+    }
+    return _chunker;
+}
+
+// Compute the block ids and their ranges in the file without writing the blocks to disk.
+- (BOOL)chunkFile:(NSString *)path repo:(SeafRepo *)repo blockids:(NSMutableArray *)blockids ranges:(NSMutableDictionary *)ranges
 {
-    NSString *password = [repo.connection getRepoPassword:repo.repoId];
-    if (repo.encrypted && !password)
+    SeafRepoKey *repoKey = [repo.connection repoKeyForRepo:repo.repoId];
+    if (repo.encrypted && !repoKey)
         return false;
-    BOOL ret = YES;
-    int CHUNK_LENGTH = 2*1024*1024;
-    NSFileHandle *fileHandle = [NSFileHandle fileHandleForReadingAtPath:path];
-    if (!fileHandle)
+    NSError *error = nil;
+    // Mapped, so only the pages being hashed are resident.
+    NSData *content = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedAlways error:&error];
+    if (!content) {
+        Warning("Failed to map %@: %@", path, error);
         return NO;
-    while (YES) {
+    }
+    id<SeafChunkingStrategy> chunker = self.chunker;
+    const uint8_t *bytes = content.bytes;
+    NSUInteger length = content.length;
+    NSUInteger offset = 0;
+    while (offset < length) {
         @autoreleasepool {
-            NSData *data = [fileHandle readDataOfLength:CHUNK_LENGTH];
-            if (!data || data.length == 0) break;
-            if (password)
-                data = [data encrypt:password encKey:repo.encKey version:repo.encVersion];
-            if (!data) {
-                ret = NO;
-                break;
-            }
+            NSUInteger blockLength = [chunker nextBlockLength:bytes + offset length:length - offset];
+            if (blockLength == 0) return NO;
+            NSRange range = NSMakeRange(offset, blockLength);
+            offset += blockLength;
+            NSData *data = [NSData dataWithBytesNoCopy:(void *)(bytes + range.location) length:range.length freeWhenDone:NO];
+            if (repoKey)
+                data = [data encryptWithRepoKey:repoKey];
+            if (!data)
+                return NO;
             NSString *blockid = [data SHA1];
-            NSString *blockpath = [self blockPath:blockid];
-            Debug("Chunk file blockid=%@, path=%@, len=%lu\n", blockid, blockpath, (unsigned long)data.length);
             [blockids addObject:blockid];
-            [paths addObject:blockpath];
-            [data writeToFile:blockpath atomically:YES];
+            // Repeated content keeps the range of its first occurrence.
+            if (![ranges objectForKey:blockid])
+                [ranges setObject:[NSValue valueWithRange:range] forKey:blockid];
+        }
+    }
+    return YES;
+}
+
+// Materialize one block in the temp block dir right before it is sent, called on chunkQueue.
+- (BOOL)writeBlock:(NSString *)blockid repo:(SeafRepo *)repo
+{
+    NSValue *value = [self.blockRanges objectForKey:blockid];
+    if (!value) return NO;
+    NSRange range = value.rangeValue;
+    SeafRepoKey *repoKey = [repo.connection repoKeyForRepo:repo.repoId];
+    if (repo.encrypted && !repoKey) return NO;
+
+    NSFileHandle *fileHandle = [NSFileHandle fileHandleForReadingAtPath:self.uploadFile.lpath];
+    if (!fileHandle) return NO;
+    BOOL ret = NO;
+    @autoreleasepool {
+        NSData *data = nil;
+        @try {
+            [fileHandle seekToFileOffset:range.location];
+            data = [fileHandle readDataOfLength:range.length];
+        } @catch (NSException *exception) {
+            Warning("Failed to read block %@: %@", blockid, exception);
+        }
+        if (data.length == range.length) {
+            if (repoKey)
+                data = [data encryptWithRepoKey:repoKey];
+            if (data && [[data SHA1] isEqualToString:blockid]) {
+                ret = [data writeToFile:[self blockPath:blockid] atomically:YES];
+            } else {
+                Warning("Block %@ of %@ changed since chunking", blockid, self.uploadFile.lpath);
+            }
         }
     }
     [fileHandle closeFile];
@@ -409,11 +751,22 @@
 //after upload
 - (void)finishUpload:(BOOL)result oid:(NSString *)oid error:(NSError *)error {
     if (result) {
+        [self removeManifest];
         [self.uploadFile finishUpload:result oid:oid error:error];
         [self completeOperation];
     } else {
+        if (!self.isCancelled || self.preempted) {
+            // Keep the blocks sent so far for the retry, or for resuming after a pause
+            [self saveManifest:[self.uploadFile.udir.connection getRepo:self.uploadFile.udir.repoId]];
+        }
         if (self.isCancelled) {
-            [self.uploadFile finishUpload:result oid:oid error:error];
+            if (self.preempted) {
+                // A preempted upload resumes from its manifest, it is not a failure.
+                [self.uploadFile pauseUpload];
+            } else {
+                [self removeManifest];
+                [self.uploadFile finishUpload:result oid:oid error:error];
+            }
             [self completeOperation];
             return;
         }
@@ -443,12 +796,18 @@
     self.rawBlksUrl = nil;
     self.commitUrl = nil;
     self.missingBlocks = nil;
+    self.allBlocks = nil;
+    self.blockRanges = nil;
     self.blkidx = 0;
-    if (_blockDir) {
-        [[NSFileManager defaultManager] removeItemAtPath:_blockDir error:nil];
+    NSString *blockDir;
+    @synchronized (self) {
+        blockDir = _blockDir;
         _blockDir = nil;
     }
-    
+    if (blockDir) {
+        [[NSFileManager defaultManager] removeItemAtPath:blockDir error:nil];
+    }
+
 }
 
 @end
@@ -597,15 +597,17 @@ static CustomInputViewPresenterBlock _sharedCustomInputPresenter = nil;
         }
 
         if ([[NSFileManager defaultManager] fileExistsAtPath:path]) {
-            NSData *data = [NSData dataWithContentsOfFile:path];
-            // Use Image I/O framework to decode the image
-            CGImageSourceRef source = CGImageSourceCreateWithData((CFDataRef)data, NULL);
+            // Use Image I/O framework to decode the image, reading the file as it is decoded
+            NSDictionary *sourceOptions = @{(NSString *)kCGImageSourceShouldCache: @NO};
+            CGImageSourceRef source = CGImageSourceCreateWithURL((__bridge CFURLRef)[NSURL fileURLWithPath:path], (__bridge CFDictionaryRef)sourceOptions);
             if (source) {
                 CGSize maxSize = CGSizeMake(length, length);
+                // Decoded right here on the background queue, so it needs no redraw before display
                 NSDictionary *thumbnailOptions = @{
                     (NSString *)kCGImageSourceCreateThumbnailFromImageAlways: @YES,
                     (NSString *)kCGImageSourceThumbnailMaxPixelSize: @(MAX(maxSize.width, maxSize.height)),
-                    (NSString *)kCGImageSourceCreateThumbnailWithTransform: @YES
+                    (NSString *)kCGImageSourceCreateThumbnailWithTransform: @YES,
+                    (NSString *)kCGImageSourceShouldCacheImmediately: @YES
                 };
                 // Create a thumbnail of the image with the given options
                 CGImageRef cgImage = CGImageSourceCreateThumbnailAtIndex(source, 0, (CFDictionaryRef)thumbnailOptions);
@@ -615,13 +617,10 @@ static CustomInputViewPresenterBlock _sharedCustomInputPresenter = nil;
                 }
                 CFRelease(source);
             }
-            
-            // Decode the image
-            image = [Utils decodedImageWithImage:image];
 
-            // Save the processed image to the cache path
+            // Save the processed image to the cache path, zooming past it is served by tiles of the original
             if (image) {
-                NSData *imageData = UIImageJPEGRepresentation(image, 1.0);
+                NSData *imageData = UIImageJPEGRepresentation(image, 0.9);
                 [imageData writeToFile:cachePath atomically:YES];
             }
             completion(image);
@@ -19,6 +19,7 @@
 #import "SeafStorage.h"
 #import <MobileCoreServices/MobileCoreServices.h>
 #import "SeafFileProviderUtility.h"
+#import "SeafThumbFetcher.h"
 #import "SeafThumb.h"
 #import "SeafDataTaskManager.h"
 #import "SeafFileOperationManager.h"
@@ -589,57 +590,43 @@
 
 - (NSProgress *)fetchThumbnailsForItemIdentifiers:(NSArray<NSFileProviderItemIdentifier> *)itemIdentifiers requestedSize:(CGSize)size perThumbnailCompletionHandler:(void (^)(NSFileProviderItemIdentifier _Nonnull, NSData * _Nullable, NSError * _Nullable))perThumbnailCompletionHandler completionHandler:(void (^)(NSError * _Nullable))completionHandler {
     NSProgress *progress = [NSProgress progressWithTotalUnitCount:itemIdentifiers.count];
-    __block NSInteger counterProgress = 0;
-    
+    if (itemIdentifiers.count == 0) {
+        completionHandler(nil);
+        return progress;
+    }
+    CGFloat pixelSize = MAX(size.width, size.height) * [[UIScreen mainScreen] scale];
+    // Items finish on different queues, the last one calls completionHandler.
+    __block int64_t remaining = (int64_t)itemIdentifiers.count;
+    NSObject *lock = [NSObject new];
+    void (^itemDone)(NSFileProviderItemIdentifier, NSData *, NSError *) = ^(NSFileProviderItemIdentifier itemIdentifier, NSData *imageData, NSError *error) {
+        BOOL last;
+        @synchronized(lock) {
+            if (!progress.isCancelled) {
+                perThumbnailCompletionHandler(itemIdentifier, imageData, error);
+            }
+            progress.completedUnitCount += 1;
+            last = (--remaining == 0);
+        }
+        if (last) {
+            completionHandler(progress.isCancelled ? [NSError errorWithDomain:NSCocoaErrorDomain code:NSUserCancelledError userInfo:nil] : nil);
+        }
+    };
+
     for (NSString *itemIdentifier in itemIdentifiers) {
         Debug("fetch thumb itemIdentifier: %@", itemIdentifier);
         SeafItem *item = [[SeafItem alloc] initWithItemIdentity:itemIdentifier];
-        if (!item.isFile) {
-            counterProgress += 1;
-            if (counterProgress == progress.totalUnitCount) {
-                completionHandler(nil);
-            }
+        SeafFile *sfile = item.isFile ? (SeafFile *)[item toSeafObj] : nil;
+        if (!sfile || ![sfile isImageFile] || progress.isCancelled) {
+            itemDone(itemIdentifier, nil, nil);
             continue;
         }
-        
-        SeafFile *sfile = (SeafFile *)[item toSeafObj];
-        if ([sfile isImageFile]) {
-            if (sfile.thumb) {
-                counterProgress += 1;
-                NSData *imageData = UIImagePNGRepresentation(sfile.thumb);
-                perThumbnailCompletionHandler(itemIdentifier, imageData, nil);
-                if (counterProgress == progress.totalUnitCount) {
-                    completionHandler(nil);
-                }
-            } else {
-                __weak typeof(sfile) weakFile = sfile;
-                [weakFile setThumbCompleteBlock:^(BOOL ret) {
-                    counterProgress += 1;
-                    if (ret) {
-                        NSString *thumbFilePath = weakFile.oid ? [weakFile thumbPath:weakFile.oid] : nil;
-                        if (!thumbFilePath) {
-                            thumbFilePath = [SeafStorage.sharedObject.thumbsDir stringByAppendingPathComponent:[NSString stringWithFormat:@"/%@-%lld", weakFile.name, weakFile.mtime]];
-                        }
-                        NSData *imageData = [NSData dataWithContentsOfFile:thumbFilePath];
-                        perThumbnailCompletionHandler(itemIdentifier, imageData, nil);
-                    } else {
-                        Warning("Failed fetch thumb itemIdentifier: %@", itemIdentifier);
-                        perThumbnailCompletionHandler(itemIdentifier, nil, [NSError fileProvierErrorServerUnreachable]);
-                    }
-                    if (counterProgress == progress.totalUnitCount) {
-                        completionHandler(nil);
-                    }
-                }];
-                SeafThumb *thb = [[SeafThumb alloc] initWithSeafFile:weakFile];
-                [SeafDataTaskManager.sharedObject addThumbTask:thb];
-
+        // Cached thumbnails are handed over as stored, misses are downloaded in batches.
+        [SeafThumbFetcher.sharedFetcher fetchThumbDataForFile:sfile pixelSize:pixelSize completion:^(NSData *data, NSError *error) {
+            if (!data) {
+                Warning("Failed fetch thumb itemIdentifier: %@", itemIdentifier);
             }
-        } else {
-            counterProgress += 1;
-            if (counterProgress == progress.totalUnitCount) {
-                completionHandler(nil);
-            }
-        }
+            itemDone(itemIdentifier, data, data ? nil : [NSError fileProvierErrorServerUnreachable]);
+        }];
     }
     return progress;
 }
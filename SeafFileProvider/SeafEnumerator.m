@@ -14,11 +14,199 @@
 #import "NSError+SeafFileProvierError.h"
 #import "SeafStorage.h"
 #import "SeafFileProviderUtility.h"
+#import "SeafChangeTracker.h"
+#import "Utils.h"
+#import "NSData+Encryption.h"
+
+// Items served per page, the listing is paged out of a snapshot in memory.
+static const NSUInteger SeafEnumeratorPageSize = 500;
+
+// Deletions remembered per container for older anchors, anchors before the dropped ones are expired.
+static const NSUInteger SeafContainerMaxDeletions = 1000;
+
+/// What the system was told about the items of a container, shared by the enumerators of the container.
+/// All but the snapshot is stored, so that the anchors handed out stay valid across launches of the extension.
+@interface SeafContainerState : NSObject
+/// Prefix of the page cursors into items, a new snapshot expires the cursors of the old one.
+@property (nonatomic, copy) NSString *session;
+/// The listing the pages are served from, and its sorted copies by sort key.
+@property (nonatomic, strong) NSArray<SeafBase *> *items;
+@property (nonatomic, strong) NSMutableDictionary<NSString *, NSArray<SeafBase *> *> *sortedItems;
+/// Versions of the items known to the system, by identifier; nil before the first enumeration.
+@property (nonatomic, strong) NSDictionary<NSFileProviderItemIdentifier, NSString *> *versions;
+/// Bumped whenever changes are reported, the sync anchor of the container.
+@property (nonatomic, assign) NSUInteger generation;
+/// Identifies the stored state, the anchors of a state which was lost are expired.
+@property (nonatomic, copy) NSString *epoch;
+/// The generation each item last changed in, and each removed item was deleted in.
+@property (nonatomic, strong) NSMutableDictionary<NSFileProviderItemIdentifier, NSNumber *> *changedGenerations;
+@property (nonatomic, strong) NSMutableDictionary<NSFileProviderItemIdentifier, NSNumber *> *deletedGenerations;
+/// Anchors older than this are expired, some of their deletions were dropped.
+@property (nonatomic, assign) NSUInteger oldestGeneration;
+@end
+
+@implementation SeafContainerState
+
+- (instancetype)init
+{
+    if (self = [super init]) {
+        _epoch = [NSUUID UUID].UUIDString;
+        _changedGenerations = [NSMutableDictionary dictionary];
+        _deletedGenerations = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (instancetype)initWithDict:(NSDictionary *)dict
+{
+    NSString *epoch = [dict objectForKey:@"epoch"];
+    NSDictionary *versions = [dict objectForKey:@"versions"];
+    NSDictionary *changed = [dict objectForKey:@"changed"];
+    NSDictionary *deleted = [dict objectForKey:@"deleted"];
+    if (![epoch isKindOfClass:[NSString class]] || ![versions isKindOfClass:[NSDictionary class]]
+        || ![changed isKindOfClass:[NSDictionary class]] || ![deleted isKindOfClass:[NSDictionary class]]) {
+        return nil;
+    }
+    if (self = [super init]) {
+        _epoch = epoch;
+        _versions = versions;
+        _generation = [[dict objectForKey:@"generation"] unsignedIntegerValue];
+        _oldestGeneration = [[dict objectForKey:@"oldestGeneration"] unsignedIntegerValue];
+        _changedGenerations = [changed mutableCopy];
+        _deletedGenerations = [deleted mutableCopy];
+    }
+    return self;
+}
+
+// Called with self locked.
+- (NSDictionary *)toDict
+{
+    return @{
+        @"epoch": self.epoch,
+        @"generation": @(self.generation),
+        @"oldestGeneration": @(self.oldestGeneration),
+        @"versions": self.versions ?: @{},
+        @"changed": [self.changedGenerations copy],
+        @"deleted": [self.deletedGenerations copy],
+    };
+}
+
+- (NSData *)syncAnchor
+{
+    @synchronized(self) {
+        return [[NSString stringWithFormat:@"%@:%lu", self.epoch, (unsigned long)self.generation] dataUsingEncoding:NSUTF8StringEncoding];
+    }
+}
+
+// Called with self locked, the generation of an anchor the changes since which are known; NSNotFound otherwise.
+- (NSUInteger)generationOfAnchor:(NSData *)anchor
+{
+    if (!self.versions || !anchor) return NSNotFound;
+    NSArray<NSString *> *parts = [[[NSString alloc] initWithData:anchor encoding:NSUTF8StringEncoding] componentsSeparatedByString:@":"];
+    if (parts.count != 2 || ![parts[0] isEqualToString:self.epoch]) return NSNotFound;
+    long long generation = [parts[1] longLongValue];
+    if (generation < (long long)self.oldestGeneration || generation > (long long)self.generation) return NSNotFound;
+    return (NSUInteger)generation;
+}
+
+// Called with self locked. Records the differences to the versions known to the system in a new
+// generation, returns whether there were any.
+- (BOOL)updateVersions:(NSDictionary<NSFileProviderItemIdentifier, NSString *> *)versions
+{
+    NSDictionary *old = self.versions;
+    self.versions = versions;
+    // The first enumeration reports everything.
+    if (!old) return NO;
+
+    NSNumber *next = @(self.generation + 1);
+    __block BOOL changed = NO;
+    [versions enumerateKeysAndObjectsUsingBlock:^(NSFileProviderItemIdentifier identifier, NSString *version, BOOL *stop) {
+        if (![version isEqualToString:[old objectForKey:identifier]]) {
+            [self.changedGenerations setObject:next forKey:identifier];
+            [self.deletedGenerations removeObjectForKey:identifier];
+            changed = YES;
+        }
+    }];
+    for (NSFileProviderItemIdentifier identifier in old) {
+        if (![versions objectForKey:identifier]) {
+            [self.deletedGenerations setObject:next forKey:identifier];
+            [self.changedGenerations removeObjectForKey:identifier];
+            changed = YES;
+        }
+    }
+    if (changed) {
+        self.generation += 1;
+        [self dropOldDeletions];
+    }
+    return changed;
+}
+
+// Called with self locked.
+- (void)dropOldDeletions
+{
+    if (self.deletedGenerations.count <= SeafContainerMaxDeletions) return;
+    NSArray *identifiers = [self.deletedGenerations keysSortedByValueUsingSelector:@selector(compare:)];
+    NSUInteger dropCount = identifiers.count - SeafContainerMaxDeletions;
+    for (NSUInteger i = 0; i < dropCount; i++) {
+        NSFileProviderItemIdentifier identifier = identifiers[i];
+        self.oldestGeneration = MAX(self.oldestGeneration, [[self.deletedGenerations objectForKey:identifier] unsignedIntegerValue]);
+        [self.deletedGenerations removeObjectForKey:identifier];
+    }
+}
+
+@end
+
+static NSString *seafContainerStatePath(NSFileProviderItemIdentifier identifier) {
+    NSString *dir = [SeafStorage.sharedObject.rootPath stringByAppendingPathComponent:@"provider"];
+    [Utils checkMakeDir:dir];
+    NSString *name = [[[identifier dataUsingEncoding:NSUTF8StringEncoding] SHA1] stringByAppendingPathExtension:@"plist"];
+    return [dir stringByAppendingPathComponent:name];
+}
+
+static dispatch_queue_t seafContainerStateQueue(void) {
+    static dispatch_queue_t queue;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        queue = dispatch_queue_create("com.seafile.fileprovider.containerState", DISPATCH_QUEUE_SERIAL);
+    });
+    return queue;
+}
+
+static SeafContainerState *seafContainerState(NSFileProviderItemIdentifier identifier) {
+    static NSMutableDictionary<NSString *, SeafContainerState *> *states;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        states = [NSMutableDictionary dictionary];
+    });
+    @synchronized(states) {
+        SeafContainerState *state = [states objectForKey:identifier];
+        if (!state) {
+            NSData *data = [NSData dataWithContentsOfFile:seafContainerStatePath(identifier)];
+            NSDictionary *dict = data ? [NSPropertyListSerialization propertyListWithData:data options:NSPropertyListImmutable format:nil error:nil] : nil;
+            state = [dict isKindOfClass:[NSDictionary class]] ? [[SeafContainerState alloc] initWithDict:dict] : nil;
+            if (!state) state = [SeafContainerState new];
+            [states setObject:state forKey:identifier];
+        }
+        return state;
+    }
+}
+
+// Called with state locked, the state is written in the background.
+static void seafSaveContainerState(NSFileProviderItemIdentifier identifier, SeafContainerState *state) {
+    NSDictionary *dict = [state toDict];
+    dispatch_async(seafContainerStateQueue(), ^{
+        NSError *error = nil;
+        NSData *data = [NSPropertyListSerialization dataWithPropertyList:dict format:NSPropertyListBinaryFormat_v1_0 options:0 error:&error];
+        if (!data || ![data writeToFile:seafContainerStatePath(identifier) atomically:YES]) {
+            Warning("Failed to save the state of %@: %@", identifier, error);
+        }
+    });
+}
 
 @interface SeafEnumerator ()
 @property (nonatomic, copy) NSFileProviderItemIdentifier itemIdentifier;
 @property (nonatomic, strong) SeafItem* item;
-@property (nonatomic, assign) NSInteger maxItemCount;
+@property (nonatomic, strong) SeafDir *trackedDir;
 @end
 
 
@@ -30,7 +218,6 @@
     if (self) {
         self.itemIdentifier = itemIdentifier;
         self.item = [[SeafItem alloc] initWithItemIdentity:itemIdentifier];
-        self.maxItemCount = 20;
     }
     return self;
 }
@@ -38,6 +225,11 @@
 - (void)invalidate
 {
     Debug("invalidate %@", self.itemIdentifier);
+    if (_trackedDir) {
+        [[NSNotificationCenter defaultCenter] removeObserver:self name:SeafChangeTrackerDidUpdateDirNotification object:nil];
+        [_trackedDir.connection.changeTracker untrackDir:_trackedDir];
+        _trackedDir = nil;
+    }
     _item = nil;
     _itemIdentifier = nil;
 }
@@ -53,6 +245,7 @@
                 [observer finishEnumeratingWithError:[NSError fileProvierErrorNoAccount]];
             } else {
                 [observer didEnumerateItems:accounts];
+                [self markEnumerated];
                 [observer finishEnumeratingUpToPage:nil];
             }
         } else if ([_itemIdentifier isEqualToString: NSFileProviderWorkingSetContainerItemIdentifier]) {
@@ -75,16 +268,33 @@
             
             if (_item.isFile) {
                 [observer didEnumerateItems:@[[[SeafProviderItem alloc] initWithSeafItem:_item]]];
+                [self markEnumerated];
                 [observer finishEnumeratingUpToPage:nil];
                 return;
             }
             
+            SeafContainerState *state = seafContainerState(_itemIdentifier);
+            if (![page isEqual:NSFileProviderInitialPageSortedByDate] && ![page isEqual:NSFileProviderInitialPageSortedByName]) {
+                // Later pages are served from the snapshot taken for the first one.
+                NSArray<NSString *> *cursor = [[[NSString alloc] initWithData:page encoding:NSUTF8StringEncoding] componentsSeparatedByString:@":"];
+                @synchronized(state) {
+                    if (cursor.count == 3 && [cursor[0] isEqualToString:state.session]) {
+                        [self enumerateItemsForObserver:observer inState:state sortKey:cursor[1] offset:(NSUInteger)[cursor[2] longLongValue]];
+                        return;
+                    }
+                }
+                [observer finishEnumeratingWithError:[NSError errorWithDomain:NSFileProviderErrorDomain code:NSFileProviderErrorPageExpired userInfo:nil]];
+                return;
+            }
+
+            NSString *sortKey = [page isEqual:NSFileProviderInitialPageSortedByDate] ? @"MTIME" : @"NAME";
             SeafDir *dir = (SeafDir *)[_item toSeafObj];
+            [self trackDir:dir];
             [dir loadContentSuccess: ^(SeafDir *d) {
-                [self enumerateItemsForObserver:observer startingAtPage:page inSeafDir:d];
+                [self enumerateItemsForObserver:observer inState:state sortKey:sortKey snapshotOfDir:d];
             } failure:^(SeafDir *d, NSError *error) {
                 if (d.hasCache) {
-                    [self enumerateItemsForObserver:observer startingAtPage:page inSeafDir:d];
+                    [self enumerateItemsForObserver:observer inState:state sortKey:sortKey snapshotOfDir:d];
                 } else {
                     [observer finishEnumeratingWithError:[NSError fileProvierErrorServerUnreachable]];
                 }
@@ -93,17 +303,97 @@
     }
 }
 
-- (void)enumerateItemsForObserver:(id<NSFileProviderEnumerationObserver>)observer startingAtPage:(NSFileProviderPage)page inSeafDir:(SeafDir *)dir {
-    [self getItemsFromSeafDir:dir startingAtPage:page result:^(NSArray *items, BOOL isLastPage) {
-        [observer didEnumerateItems:items];
-        if (isLastPage) {
-            [observer finishEnumeratingUpToPage:nil];
-        } else {
-            NSInteger numPage = [[NSString stringWithUTF8String:[page bytes]] integerValue] + 1;
-            NSData *providerPage = [[NSString stringWithFormat:@"%ld", (long)numPage] dataUsingEncoding:NSUTF8StringEncoding];
-            [observer finishEnumeratingUpToPage:providerPage];
-        }
-    }];
+// Signal the enumerated folder when the change tracker finds it changed on the server.
+- (void)trackDir:(SeafDir *)dir
+{
+    if (_trackedDir || !dir) return;
+    _trackedDir = dir;
+    [[NSNotificationCenter defaultCenter] addObserver:self
+                                             selector:@selector(dirDidUpdate:)
+                                                 name:SeafChangeTrackerDidUpdateDirNotification
+                                               object:dir.connection.changeTracker];
+    [dir.connection.changeTracker trackDir:dir];
+}
+
+- (void)dirDidUpdate:(NSNotification *)note
+{
+    SeafDir *dir = _trackedDir;
+    if (!dir || ![[note.userInfo objectForKey:SeafChangeTrackerRepoIdKey] isEqualToString:dir.repoId]
+        || ![[note.userInfo objectForKey:SeafChangeTrackerPathKey] isEqualToString:dir.path]) {
+        return;
+    }
+    // The changes are worked out from the updated listing when the system asks for them.
+    if (@available(iOS 11.0, *)) {
+        NSFileProviderItemIdentifier identifier = self.itemIdentifier;
+        [NSFileProviderManager.defaultManager signalEnumeratorForContainerItemIdentifier:identifier completionHandler:^(NSError * _Nullable error) {
+            if (error) {
+                Debug("signalEnumerator itemIdentifier: %@ error: %@", identifier, error);
+            }
+        }];
+    }
+}
+
+// Takes a new snapshot of the listing of dir for the enumeration, and serves its first page.
+- (void)enumerateItemsForObserver:(id<NSFileProviderEnumerationObserver>)observer inState:(SeafContainerState *)state sortKey:(NSString *)sortKey snapshotOfDir:(SeafDir *)dir {
+    NSArray<SeafBase *> *items = [[self getAccessiableSubItems:dir] copy];
+    NSDictionary *versions = [self versionsOfItems:items providerItems:nil];
+    @synchronized(state) {
+        state.session = [NSUUID UUID].UUIDString;
+        state.items = items;
+        state.sortedItems = [NSMutableDictionary dictionary];
+        // The enumeration hands all of them to the system, the changes are kept for older anchors.
+        [state updateVersions:versions];
+        seafSaveContainerState(_itemIdentifier, state);
+        [self enumerateItemsForObserver:observer inState:state sortKey:sortKey offset:0];
+    }
+}
+
+// Called with state locked.
+- (void)enumerateItemsForObserver:(id<NSFileProviderEnumerationObserver>)observer inState:(SeafContainerState *)state sortKey:(NSString *)sortKey offset:(NSUInteger)offset {
+    NSArray<SeafBase *> *array = [state.sortedItems objectForKey:sortKey];
+    if (!array) {
+        NSMutableArray *sorted = [NSMutableArray arrayWithArray:state.items];
+        [sorted sortUsingComparator:[SeafDir comparatorForSortKey:sortKey]];
+        array = sorted;
+        [state.sortedItems setObject:array forKey:sortKey];
+    }
+
+    NSUInteger stop = MIN(offset + SeafEnumeratorPageSize, array.count);
+    NSMutableArray *items = [NSMutableArray new];
+    for (NSUInteger idx = offset; idx < stop; ++idx) {
+        SeafBase *obj = [array objectAtIndex:idx];
+        [obj loadCache];
+        [items addObject: [[SeafProviderItem alloc] initWithSeafItem:[SeafItem fromSeafBase:obj]]];
+    }
+    [observer didEnumerateItems:items];
+    if (stop >= array.count) {
+        [observer finishEnumeratingUpToPage:nil];
+    } else {
+        NSString *cursor = [NSString stringWithFormat:@"%@:%@:%lu", state.session, sortKey, (unsigned long)stop];
+        [observer finishEnumeratingUpToPage:[cursor dataUsingEncoding:NSUTF8StringEncoding]];
+    }
+}
+
+// Versions of the items by identifier, the provider items are collected if providerItems is given.
+- (NSDictionary<NSFileProviderItemIdentifier, NSString *> *)versionsOfItems:(NSArray<SeafBase *> *)items providerItems:(NSMutableDictionary<NSFileProviderItemIdentifier, SeafItem *> *)providerItems {
+    NSMutableDictionary *versions = [NSMutableDictionary dictionaryWithCapacity:items.count];
+    for (SeafBase *obj in items) {
+        SeafItem *item = [SeafItem fromSeafBase:obj];
+        if (!item.itemIdentifier) continue;
+        [versions setObject:obj.oid ?: @"" forKey:item.itemIdentifier];
+        [providerItems setObject:item forKey:item.itemIdentifier];
+    }
+    return versions;
+}
+
+// For containers which are not listings, only the changes made by the extension are reported.
+- (void)markEnumerated {
+    SeafContainerState *state = seafContainerState(_itemIdentifier);
+    @synchronized(state) {
+        if (state.versions) return;
+        state.versions = @{};
+        seafSaveContainerState(_itemIdentifier, state);
+    }
 }
 
 - (NSArray *)getRootProviderItems
@@ -130,58 +420,97 @@
     return dir.items;
 }
 
-- (void)getItemsFromSeafDir:(SeafDir *)dir startingAtPage:(NSFileProviderPage)page result:(void (^)(NSArray *items, BOOL isLastPage))resultBlock {
-    if (@available(iOS 11.0, *)) {
-        if (NSFileProviderInitialPageSortedByDate == page) {
-            [dir reSortItemsByMtime];
-        } else {
-            [dir reSortItemsByName];
-        }
-    }
-    
-    NSInteger numPage = [[NSString stringWithUTF8String:[page bytes]] integerValue];
-    NSInteger start = numPage * self.maxItemCount;
-    NSInteger stop = start + (self.maxItemCount - 1);
-
-    NSMutableArray *items = [NSMutableArray new];
-    NSArray *array = [self getAccessiableSubItems:dir];
-    BOOL isLastPage = array.count == 0 ? YES : (stop >= array.count - 1);
-    for (NSUInteger idx = start; idx <= stop && idx < array.count; ++idx) {
-        SeafBase *obj = [array objectAtIndex:idx];
-        [obj loadCache];
-        [items addObject: [[SeafProviderItem alloc] initWithSeafItem:[SeafItem fromSeafBase:obj]]];
-    }
-    resultBlock(items, isLastPage);
-}
-
 - (void)enumerateChangesForObserver:(id<NSFileProviderChangeObserver>)observer fromSyncAnchor:(NSFileProviderSyncAnchor)syncAnchor {
     NSMutableArray *itemsUpdate = [NSMutableArray array];
     
     if (@available(iOS 11.0, *)) {
-        if (_itemIdentifier == NSFileProviderWorkingSetContainerItemIdentifier) {
+        if ([_itemIdentifier isEqualToString:NSFileProviderWorkingSetContainerItemIdentifier]) {
             NSDictionary *filesStorage = [SeafStorage.sharedObject objectForKey:SEAF_FILE_PROVIDER];
             for (NSDictionary *dict in filesStorage.allValues) {
                 SeafItem *item = [[SeafItem alloc] convertFromDict:dict];
                 [itemsUpdate addObject:[[SeafProviderItem alloc] initWithSeafItem:item]];
             }
+            for (SeafProviderItem *item in [SeafFileProviderUtility.shared takeUpdateItemsInContainer:_itemIdentifier]) {
+                Debug(@"allUpdateItem itemIdentifier: %@ parentItemIdentifier: %@",  item.itemIdentifier ,item.parentItemIdentifier);
+                [itemsUpdate addObject:item];
+            }
+
+            [observer didUpdateItems:itemsUpdate];
+            NSData *currentAnchor = [[NSString stringWithFormat:@"%ld",(long)SeafFileProviderUtility.shared.currentAnchor
+                                     ] dataUsingEncoding:NSUTF8StringEncoding];
+            [observer finishEnumeratingChangesUpToSyncAnchor:currentAnchor moreComing:false];
+            return;
         }
+
+        SeafContainerState *state = seafContainerState(_itemIdentifier);
+        NSUInteger anchorGeneration;
+        @synchronized(state) {
+            anchorGeneration = [state generationOfAnchor:syncAnchor];
+        }
+        if (anchorGeneration == NSNotFound) {
+            // The system re-enumerates the container.
+            [observer finishEnumeratingWithError:[NSError errorWithDomain:NSFileProviderErrorDomain code:NSFileProviderErrorSyncAnchorExpired userInfo:nil]];
+            return;
+        }
+
+        // The listing kept fresh by the change tracker, or the cached one; no request is sent.
+        NSArray<SeafBase *> *items = nil;
+        if (!_item.isRoot && !_item.isFile) {
+            SeafDir *dir = _trackedDir ?: (SeafDir *)[_item toSeafObj];
+            if (!dir.items) [dir loadCache];
+            items = [[self getAccessiableSubItems:dir] copy];
+        }
+        NSMutableDictionary<NSFileProviderItemIdentifier, SeafItem *> *seafItems = [NSMutableDictionary dictionary];
+        NSDictionary<NSFileProviderItemIdentifier, NSString *> *versions = items ? [self versionsOfItems:items providerItems:seafItems] : nil;
+
+        NSMutableArray<NSFileProviderItemIdentifier> *deleted = [NSMutableArray array];
+        @synchronized(state) {
+            BOOL changed = versions ? [state updateVersions:versions] : NO;
+            if (changed) {
+                state.items = items;
+                state.sortedItems = [NSMutableDictionary dictionary];
+                state.session = [NSUUID UUID].UUIDString;
+            }
+            // Items changed by the extension itself, which may not be in the listing yet.
+            NSMutableDictionary<NSFileProviderItemIdentifier, SeafProviderItem *> *extensionItems = [NSMutableDictionary dictionary];
+            for (SeafProviderItem *item in [SeafFileProviderUtility.shared takeUpdateItemsInContainer:_itemIdentifier]) {
+                [extensionItems setObject:item forKey:item.itemIdentifier];
+            }
+            if (extensionItems.count > 0) {
+                if (!changed) state.generation += 1;
+                changed = YES;
+                for (NSFileProviderItemIdentifier identifier in extensionItems) {
+                    [state.changedGenerations setObject:@(state.generation) forKey:identifier];
+                }
+            }
+            if (changed) seafSaveContainerState(_itemIdentifier, state);
+
+            // Everything changed after the anchor, which may be from an earlier launch.
+            [state.changedGenerations enumerateKeysAndObjectsUsingBlock:^(NSFileProviderItemIdentifier identifier, NSNumber *generation, BOOL *stop) {
+                if (generation.unsignedIntegerValue <= anchorGeneration) return;
+                SeafItem *seafItem = [seafItems objectForKey:identifier];
+                SeafProviderItem *item = seafItem ? [[SeafProviderItem alloc] initWithSeafItem:seafItem] : [extensionItems objectForKey:identifier];
+                if (item) [itemsUpdate addObject:item];
+            }];
+            [state.deletedGenerations enumerateKeysAndObjectsUsingBlock:^(NSFileProviderItemIdentifier identifier, NSNumber *generation, BOOL *stop) {
+                if (generation.unsignedIntegerValue > anchorGeneration) [deleted addObject:identifier];
+            }];
+        }
+        Debug("%@: %lu updated, %lu deleted", _itemIdentifier, (unsigned long)itemsUpdate.count, (unsigned long)deleted.count);
+        if (deleted.count > 0) [observer didDeleteItemsWithIdentifiers:deleted];
+        if (itemsUpdate.count > 0) [observer didUpdateItems:itemsUpdate];
+        [observer finishEnumeratingChangesUpToSyncAnchor:[state syncAnchor] moreComing:false];
     }
-    for (SeafProviderItem *item in [SeafFileProviderUtility.shared allUpdateItems]) {
-        Debug(@"allUpdateItem itemIdentifier: %@ parentItemIdentifier: %@",  item.itemIdentifier ,item.parentItemIdentifier);
-        [itemsUpdate addObject:item];
-    }
-    [SeafFileProviderUtility.shared removeAllUpdateItems];
-    
-    [observer didUpdateItems:itemsUpdate];
-    NSData *currentAnchor = [[NSString stringWithFormat:@"%ld",(long)SeafFileProviderUtility.shared.currentAnchor
-                             ] dataUsingEncoding:NSUTF8StringEncoding];
-    [observer finishEnumeratingChangesUpToSyncAnchor:currentAnchor moreComing:false];
 }
 
 - (void)currentSyncAnchorWithCompletionHandler:(void(^)(_Nullable NSFileProviderSyncAnchor currentAnchor))completionHandler
 {
-    NSData *currentAnchor = [[NSString stringWithFormat:@"%ld",(long)SeafFileProviderUtility.shared.currentAnchor] dataUsingEncoding:NSUTF8StringEncoding];
-    completionHandler(currentAnchor);
+    if ([_itemIdentifier isEqualToString:NSFileProviderWorkingSetContainerItemIdentifier]) {
+        NSData *currentAnchor = [[NSString stringWithFormat:@"%ld",(long)SeafFileProviderUtility.shared.currentAnchor] dataUsingEncoding:NSUTF8StringEncoding];
+        completionHandler(currentAnchor);
+        return;
+    }
+    completionHandler([seafContainerState(_itemIdentifier) syncAnchor]);
 }
 
 @end
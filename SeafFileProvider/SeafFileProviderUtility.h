@@ -7,6 +7,7 @@
 //
 
 #import <Foundation/Foundation.h>
+#import <FileProvider/FileProvider.h>
 @class SeafProviderItem;
 
 NS_ASSUME_NONNULL_BEGIN
@@ -17,11 +18,12 @@ NS_ASSUME_NONNULL_BEGIN
 
 +(instancetype)shared;
 
+/// Records an item changed by the extension, pending for its parent container and for the working set.
 - (void)saveUpdateItem:(SeafProviderItem *)item;
 
-- (NSArray *)allUpdateItems;
-
-- (void)removeAllUpdateItems;
+/// Removes and returns the update items pending for the container, or for the working set.
+/// Items taken by one container stay pending for the other.
+- (NSArray *)takeUpdateItemsInContainer:(NSFileProviderItemIdentifier)containerIdentifier;
 
 @end
 
@@ -11,7 +11,7 @@
 
 @interface SeafFileProviderUtility()
 
-@property (nonatomic, strong) NSMutableArray *updateItems;
+@property (nonatomic, strong) NSMutableDictionary<NSFileProviderItemIdentifier, NSMutableArray *> *updateItems;///< Pending update items by container, guarded by self.
 
 @end
 
@@ -29,24 +29,36 @@
 - (instancetype)init {
     self = [super init];
     if (self) {
-        self.updateItems = [NSMutableArray array];
+        self.updateItems = [NSMutableDictionary dictionary];
         self.currentAnchor = 0;
     }
     return self;
 }
 
 - (void)saveUpdateItem:(SeafProviderItem *)item {
-    if (item && ![self.updateItems containsObject:item]) {
-        [self.updateItems addObject:item];
+    if (!item) return;
+    NSMutableArray *containers = [NSMutableArray arrayWithObject:NSFileProviderWorkingSetContainerItemIdentifier];
+    if (item.parentItemIdentifier) [containers addObject:item.parentItemIdentifier];
+    @synchronized (self) {
+        for (NSFileProviderItemIdentifier container in containers) {
+            NSMutableArray *items = [self.updateItems objectForKey:container];
+            if (!items) {
+                items = [NSMutableArray array];
+                [self.updateItems setObject:items forKey:container];
+            }
+            if (![items containsObject:item]) {
+                [items addObject:item];
+            }
+        }
     }
 }
 
-- (NSArray *)allUpdateItems {
-    return [self.updateItems copy];
-}
-
-- (void)removeAllUpdateItems {
-    [self.updateItems removeAllObjects];
+- (NSArray *)takeUpdateItemsInContainer:(NSFileProviderItemIdentifier)containerIdentifier {
+    @synchronized (self) {
+        NSArray *items = [self.updateItems objectForKey:containerIdentifier] ?: @[];
+        [self.updateItems removeObjectForKey:containerIdentifier];
+        return items;
+    }
 }
 
 @end
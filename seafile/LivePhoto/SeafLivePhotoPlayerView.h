@@ -11,6 +11,7 @@
 NS_ASSUME_NONNULL_BEGIN
 
 @class SeafLivePhotoPlayerView;
+@class SeafMediaFeatures;
 
 @protocol SeafLivePhotoPlayerViewDelegate <NSObject>
 @optional
@@ -60,6 +61,13 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (void)loadMotionPhotoFromPath:(NSString *)path;
 
+/**
+ * Load an indexed Motion Photo, reading only its still image and its video by range.
+ * @param path Path to Motion Photo file
+ * @param features Recorded features of the file
+ */
+- (void)loadMotionPhotoFromPath:(NSString *)path features:(SeafMediaFeatures *)features;
+
 /**
  * Load static image only (for non-Motion Photos).
  * @param image Static image to display
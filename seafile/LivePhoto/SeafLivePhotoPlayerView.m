@@ -8,6 +8,8 @@
 #import "SeafLivePhotoPlayerView.h"
 #import "Debug.h"
 #import "SeafMotionPhotoExtractor.h"
+#import "SeafMotionPhotoIndex.h"
+#import "SeafMediaFeatures.h"
 #import "SeafTheme.h"
 
 /// Length of the silent "hint" preview run when the page becomes visible in the
@@ -222,6 +224,32 @@ static const NSTimeInterval kSeafLivePhotoHintPreviewDuration = 1.2;
     [self loadMotionPhotoFromData:data];
 }
 
+- (void)loadMotionPhotoFromPath:(NSString *)path features:(SeafMediaFeatures *)features {
+    [self cleanup];
+    
+    if (!features.isMotionPhoto) {
+        // Not a Motion Photo, just display as static image
+        [self loadStaticImage:[UIImage imageWithContentsOfFile:path]];
+        return;
+    }
+    
+    _hasMotionPhotoContent = YES;
+    
+    // The parts are where the index found them, nothing is parsed again
+    NSData *imageData = [SeafMotionPhotoIndex imageDataAtPath:path features:features];
+    _staticImage = imageData ? [UIImage imageWithData:imageData] : [UIImage imageWithContentsOfFile:path];
+    _imageView.image = _staticImage;
+    
+    _tempVideoPath = [SeafMotionPhotoIndex extractVideoToTempFileAtPath:path features:features];
+    if (_tempVideoPath) {
+        _videoURL = [NSURL fileURLWithPath:_tempVideoPath];
+    } else {
+        Warning("Failed to extract the video of a Motion Photo at %@", path);
+    }
+    
+    [self updateLiveBadgeVisibility];
+}
+
 - (void)loadStaticImage:(UIImage *)image {
     [self cleanup];
     
@@ -50,6 +50,8 @@
 #import "SeafUploadOperation.h"
 #import "SeafFileOperationManager.h"
 #import "SeafUploadFileModel.h"
+#import "SeafDirentDiff.h"
+#import "SeafChangeTracker.h"
 #import "SeafNavLeftItem.h"
 #import "SeafHeaderView.h"
 #import "SeafEditNavRightItem.h"
@@ -65,6 +67,8 @@
 #define kCustomTabToolWithTopPadding 15
 #define kCustomTabToolButtonHeight 40
 #define kCustomTabToolTotalHeight 130
+// Above this many row changes the table is reloaded instead of animated
+#define MAX_ROW_CHANGES 100
 
 
 enum {
@@ -116,6 +120,8 @@ enum {
 @property (strong, retain) NSArray *thumbs;// Array of thumbnail entries.
 @property SeafUploadFile *ufile; // The file being uploaded.
 @property (nonatomic, strong) NSArray *allItems;// All items in the current directory.
+@property (nonatomic, strong) NSArray *displayedItems;// The items the table view currently shows rows for.
+@property (nonatomic, strong) SeafDir *trackedDirectory;// The directory kept fresh by the change tracker while on screen.
 
 //@property (nonatomic, strong) NSMutableDictionary *expandedSections; // Dictionary to store expanded sections
 
@@ -256,6 +262,20 @@ enum {
     [self checkUploadfiles];
     [self refreshDownloadStatus];
     [self refreshEncryptedThumb];
+    [self trackDirectory:_directory];
+}
+
+// Keep the directory on screen fresh, one directory per view controller.
+- (void)trackDirectory:(SeafDir *)directory
+{
+    if (self.trackedDirectory == directory) return;
+    if (self.trackedDirectory) {
+        [self.trackedDirectory.connection.changeTracker untrackDir:self.trackedDirectory];
+    }
+    self.trackedDirectory = directory;
+    if (directory) {
+        [directory.connection.changeTracker trackDir:directory];
+    }
 }
 
 - (void)viewDidUnload
@@ -427,6 +447,7 @@ enum {
 - (NSInteger)tableView:(UITableView *)tableView numberOfRowsInSection:(NSInteger)section
 {
     if (![_directory isKindOfClass:[SeafRepos class]]) {
+        self.displayedItems = self.allItems;
         return self.allItems.count;
     }
     
@@ -854,6 +875,9 @@ enum {
 
     _directory = directory;
     _connection = directory.connection;
+    if (self.isViewLoaded && self.view.window) {
+        [self trackDirectory:directory];
+    }
     self.searchResultController.connection = _connection;
     self.searchResultController.directory = _directory;
     
@@ -1041,10 +1065,48 @@ enum {
 {
     _allItems = nil;
     dispatch_async(dispatch_get_main_queue(), ^{
-        [self.tableView reloadData];
+        if (![self updateTableRows]) {
+            [self.tableView reloadData];
+        }
     });
 }
 
+// Animates only the rows which changed since the table was last loaded, returns NO if it has to be reloaded.
+- (BOOL)updateTableRows
+{
+    NSArray *oldItems = self.displayedItems;
+    if (!oldItems || self.editing || [_directory isKindOfClass:[SeafRepos class]] || !self.tableView.window
+        || [self.tableView numberOfRowsInSection:0] != oldItems.count) {
+        return NO;
+    }
+    NSArray *newItems = self.allItems;
+    SeafRowChanges *changes = [SeafRowChanges changesFromItems:oldItems toItems:newItems updated:_directory.changedItems limit:MAX_ROW_CHANGES];
+    if (!changes) {
+        return NO;
+    }
+    if (changes.isEmpty) {
+        self.displayedItems = newItems;
+        return YES;
+    }
+    NSArray *(^indexPaths)(NSIndexSet *) = ^NSArray *(NSIndexSet *indexes) {
+        NSMutableArray *paths = [NSMutableArray arrayWithCapacity:indexes.count];
+        [indexes enumerateIndexesUsingBlock:^(NSUInteger idx, BOOL *stop) {
+            [paths addObject:[NSIndexPath indexPathForRow:idx inSection:0]];
+        }];
+        return paths;
+    };
+    [self.tableView performBatchUpdates:^{
+        [self.tableView deleteRowsAtIndexPaths:indexPaths(changes.deletedIndexes) withRowAnimation:UITableViewRowAnimationFade];
+        [self.tableView insertRowsAtIndexPaths:indexPaths(changes.insertedIndexes) withRowAnimation:UITableViewRowAnimationFade];
+        [self.tableView reloadRowsAtIndexPaths:indexPaths(changes.reloadedIndexes) withRowAnimation:UITableViewRowAnimationNone];
+        for (NSArray<NSNumber *> *move in changes.moves) {
+            [self.tableView moveRowAtIndexPath:[NSIndexPath indexPathForRow:move[0].unsignedIntegerValue inSection:0]
+                                   toIndexPath:[NSIndexPath indexPathForRow:move[1].unsignedIntegerValue inSection:0]];
+        }
+    } completion:nil];
+    return YES;
+}
+
 
 #pragma mark - Edit / CRUD Operations
 
@@ -3808,6 +3870,7 @@ typedef NS_ENUM(NSInteger, ToolButtonTag) {
 
 - (void)viewWillDisappear:(BOOL)animated {
     [super viewWillDisappear:animated];
+    [self trackDirectory:nil];
     // On iPad, the master list (SeafFileViewController) can be hidden when the user focuses on the detail view.
     // If we are in editing mode (custom bottom toolbar is visible), make sure we exit editing mode so the toolbar
     // is dismissed together with the view.
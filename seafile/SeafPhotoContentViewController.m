@@ -23,6 +23,9 @@
 #import "SeafErrorPlaceholderView.h"
 #import "SeafLivePhotoPlayerView.h"
 #import "SeafMotionPhotoExtractor.h"
+#import "SeafMotionPhotoIndex.h"
+#import "SeafMediaFeatures.h"
+#import "SeafTiledImageView.h"
 #import "SeafSdocService.h"
 #import "SeafSdocProfileAssembler.h"
 
@@ -43,6 +46,9 @@
 @property (nonatomic, assign) BOOL wasImmersiveBeforeZoom; // Snapshot of chrome state captured right before a zoom-in begins
 @property (nonatomic, strong) UIPanGestureRecognizer *dismissPanGesture; // Pull-down-to-dismiss gesture
 
+/// Tiles of the original photo over the preview in imageView, for zooming past the preview's resolution
+@property (nonatomic, strong, nullable) SeafTiledImageView *tiledImageView;
+
 /// Live Photo badge displayed in top-left corner (below navigation bar)
 /// Contains icon + "LIVE" text, similar to iOS native style
 @property (nonatomic, strong) UIView *livePhotoBadge;
@@ -52,7 +58,7 @@
 
 /// YES if `didBecomeCurrentVisiblePage` was called before the live photo
 /// player view was set up. The auto-preview will be triggered later, once
-/// `setupLivePhotoPlayerViewWithData:` finishes initializing the player.
+/// `setupLivePhotoPlayerViewLoading:` finishes initializing the player.
 @property (nonatomic, assign) BOOL pendingAutoPreview;
 
 /// Previous hidden state of `livePhotoBadge` captured when the underlying
@@ -861,6 +867,7 @@
     }
     self.isDisplayingPlaceholderOrErrorImage = NO; // Reset flag
 
+    [self removeTiledImageView];
     self.imageView.image = nil; // Clear previous image before loading new one
     // If seafFile is available, use it to load the image
     if (self.seafFile && [self.seafFile isKindOfClass:[SeafFile class]]) {
@@ -914,16 +921,27 @@
                         self.isDisplayingPlaceholderOrErrorImage = NO; // Ensure flag is cleared on success
 
                         // If we have the file path, get the data to display EXIF info and check for Motion Photo
-                        if (((SeafFile *)self.seafFile).ooid) {
-                            NSString *path = [SeafStorage.sharedObject documentPath:((SeafFile *)self.seafFile).ooid];
-                            NSData *data = [NSData dataWithContentsOfFile:path];
-                            if (data) {
-                                [self displayExifData:data];
+                        SeafFile *file = (SeafFile *)self.seafFile;
+                        if (file.ooid) {
+                            NSString *path = [SeafStorage.sharedObject documentPath:file.ooid];
+                            // Usually indexed after download, so this is a lookup rather than a parse
+                            [SeafMotionPhotoIndex featuresForFileAtPath:path oid:file.ooid name:file.name completion:^(SeafMediaFeatures *features) {
+                                if (!self.seafFile || ![self.seafFile.name isEqualToString:expectedName]) return;
+                                // EXIF only needs the still image, not the embedded video
+                                NSData *data = features.isMotionPhoto ? [SeafMotionPhotoIndex imageDataAtPath:path features:features] : nil;
+                                if (!data) {
+                                    data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:nil];
+                                }
+                                if (data) {
+                                    [self displayExifData:data];
+                                }
                                 
                                 // Check if this is a Motion Photo and setup player
-                                [self checkAndSetupMotionPhotoWithData:data];
-                            } else {
-                            }
+                                [self checkAndSetupMotionPhotoAtPath:path features:features];
+                                if (!self.isMotionPhoto) {
+                                    [self setupTiledImageViewAtPath:path];
+                                }
+                            }];
                         }
                         // Explicitly hide indicator AFTER image is set
                         [self hideLoadingIndicator];
@@ -2101,6 +2119,9 @@
     self.isMotionPhoto = NO;
     self.pendingAutoPreview = NO;
     self.isCurrentVisiblePage = NO;
+
+    // Tiles belong to the previous photo
+    [self removeTiledImageView];
     
     // Hide Live Photo icon
     [self hideLivePhotoIcon];
@@ -2177,6 +2198,7 @@
     }
 
     // Clear the image data to free memory
+    [self removeTiledImageView];
     if (self.imageView) {
         self.imageView.image = nil;
         // Reset placeholder flag since we're clearing the image
@@ -2540,12 +2562,17 @@
     // For wide / panoramic images, also ensure max is large enough to let double-tap
     // fill the screen height (clamped by the same 10x memory cap).
     CGFloat maxByResolution = 1.0 / fitScale;  // Scale needed to show original pixels
+    if (self.tiledImageView) {
+        // Tiles show the original pixels beyond those of the preview
+        maxByResolution = MAX(maxByResolution, self.tiledImageView.imageSize.width / fitWidth);
+    }
     CGFloat heightFillScale = (fitHeight > 0 && fitHeight < boundsSize.height)
         ? (boundsSize.height / fitHeight)
         : 0.0;
     CGFloat maxScale = MAX(MAX(maxByResolution, 3.0), heightFillScale);
     maxScale = MIN(maxScale, 10.0); // Cap at 10x to limit memory
     self.scrollView.maximumZoomScale = maxScale;
+    self.tiledImageView.maximumZoomScale = maxScale;
     
     // ⑦ Center the image using contentInset
     [self centerImageInScrollViewForReason:@"configureForImage"];
@@ -2600,6 +2627,39 @@
     [self configureForImage:self.imageView.image];
 }
 
+#pragma mark - Tiled Full Resolution
+
+// The preview is at most IMAGE_MAX_SIZE wide, larger photos are drawn from tiles of the
+// original once zoomed in, so that memory does not grow with the size of the photo.
+- (void)setupTiledImageViewAtPath:(NSString *)path {
+    [self removeTiledImageView];
+    
+    UIImage *preview = self.imageView.image;
+    SeafImageTileSource *source = preview ? [[SeafImageTileSource alloc] initWithPath:path] : nil;
+    if (!source) {
+        return;
+    }
+    
+    CGSize previewPixelSize = CGSizeMake(preview.size.width * preview.scale, preview.size.height * preview.scale);
+    SeafTiledImageView *tiledImageView = [[SeafTiledImageView alloc] initWithFrame:self.imageView.bounds tileSource:source];
+    if (tiledImageView.imageSize.width <= previewPixelSize.width) {
+        // The preview already has every pixel
+        return;
+    }
+    tiledImageView.previewPixelSize = previewPixelSize;
+    tiledImageView.autoresizingMask = UIViewAutoresizingFlexibleWidth | UIViewAutoresizingFlexibleHeight;
+    [self.imageView addSubview:tiledImageView];
+    self.tiledImageView = tiledImageView;
+    
+    // Allow zooming to the original pixels
+    [self configureForImage:preview];
+}
+
+- (void)removeTiledImageView {
+    [self.tiledImageView removeFromSuperview];
+    self.tiledImageView = nil;
+}
+
 - (void)updateZoomScalesForSize:(CGSize)size {
     [self configureForImage:self.imageView.image];
 }
@@ -2651,7 +2711,40 @@
     [self setupLivePhotoPlayerViewWithData:data];
 }
 
+- (void)checkAndSetupMotionPhotoAtPath:(NSString *)path features:(SeafMediaFeatures *)features {
+#if !ENABLE_MOTION_PHOTO_FEATURE
+    // Motion Photo / Live Photo playback feature is temporarily disabled, code preserved for future restoration
+    self.isMotionPhoto = NO;
+    [self hideLivePhotoIcon];
+    return;
+#endif
+    
+    // Whether this is a Motion Photo was recorded by the index
+    self.isMotionPhoto = features.isMotionPhoto;
+    
+    if (!self.isMotionPhoto) {
+        // Remove any existing live photo player view
+        [self removeLivePhotoPlayerView];
+        [self hideLivePhotoIcon];
+        return;
+    }
+    
+    // Show Live Photo icon
+    [self showLivePhotoIcon];
+    
+    // Setup Live Photo Player View
+    [self setupLivePhotoPlayerViewLoading:^(SeafLivePhotoPlayerView *player) {
+        [player loadMotionPhotoFromPath:path features:features];
+    }];
+}
+
 - (void)setupLivePhotoPlayerViewWithData:(NSData *)data {
+    [self setupLivePhotoPlayerViewLoading:^(SeafLivePhotoPlayerView *player) {
+        [player loadMotionPhotoFromData:data];
+    }];
+}
+
+- (void)setupLivePhotoPlayerViewLoading:(void (^)(SeafLivePhotoPlayerView *player))load {
     // Remove any existing player view first (but don't hide the badge)
     if (self.livePhotoPlayerView) {
         [self.livePhotoPlayerView cleanup];
@@ -2668,8 +2761,8 @@
     self.livePhotoPlayerView.showLiveBadge = NO;  // Disable built-in badge, we use our own Live Photo badge
     self.livePhotoPlayerView.longPressToPlayEnabled = YES;
     
-    // Load the Motion Photo data
-    [self.livePhotoPlayerView loadMotionPhotoFromData:data];
+    // Load the Motion Photo
+    load(self.livePhotoPlayerView);
     
     // Add as subview of imageView (the zoom target returned by viewForZoomingInScrollView:)
     // so it naturally participates in the scroll view's zoom transform.
@@ -2738,7 +2831,7 @@
     // If the live photo player is already in place, kick off a silent
     // auto-preview right away (mirrors iOS Photos behavior on swipe).
     // Otherwise queue the request so it runs as soon as
-    // setupLivePhotoPlayerViewWithData: finishes initializing the player.
+    // setupLivePhotoPlayerViewLoading: finishes initializing the player.
     if (self.livePhotoPlayerView && self.livePhotoPlayerView.hasMotionPhotoContent) {
         self.pendingAutoPreview = NO;
         [self.livePhotoPlayerView playMuted];
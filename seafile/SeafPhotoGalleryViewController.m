@@ -1482,7 +1482,7 @@ static inline CGFloat seaf_lerp(CGFloat a, CGFloat b, CGFloat t) { return a + (b
 // Save file to album - handles both regular images and Motion Photos (Live Photos)
 - (void)saveFileToAlbumAtPath:(NSString *)path file:(SeafFile *)file {
     // Check if this is a Motion Photo (Live Photo) - HEIC format with embedded video
-    if ([SeafLivePhotoSaver canSaveAsLivePhotoAtPath:path]) {
+    if ([SeafLivePhotoSaver canSaveAsLivePhotoAtPath:path oid:file.ooid name:file.name]) {
         dispatch_async(dispatch_get_main_queue(), ^{
             [SVProgressHUD showInfoWithStatus:NSLocalizedString(@"Saving Live Photo to album", @"Seafile")];
         });
@@ -1528,7 +1528,7 @@ static inline CGFloat seaf_lerp(CGFloat a, CGFloat b, CGFloat t) { return a + (b
 - (void)saveLivePhotoToAlbum:(SeafFile *)file atPath:(NSString *)path {
     NSString *fileName = file.name;
     
-    [SeafLivePhotoSaver saveLivePhotoFromPath:path completion:^(BOOL success, NSError * _Nullable error) {
+    [SeafLivePhotoSaver saveLivePhotoFromPath:path oid:file.ooid name:fileName completion:^(BOOL success, NSError * _Nullable error) {
         dispatch_async(dispatch_get_main_queue(), ^{
             if (success) {
                 [SVProgressHUD showSuccessWithStatus:[NSString stringWithFormat:NSLocalizedString(@"Succeeded to save %@ to album", @"Seafile"), fileName]];
@@ -29,6 +29,7 @@
 #import "SeafPrivacyPolicyViewController.h"
 #import "SeafBackupGuideViewController.h"
 #import "SeafRealmManager.h"
+#import "SeafCacheManager.h"
 #import "SeafTheme.h"
 #import "SeafNavigationBarStyler.h"
 
@@ -503,7 +504,7 @@ enum {
     _enableTouchIDSwitch.on = _connection.touchIdEnabled;
 
     Debug("Account : %@, %lld, quota: %lld", _connection.username, _connection.usage, _connection.quota);
-    long long cacheSize = [SeafStorage.sharedObject cacheSize];
+    long long cacheSize = [[SeafCacheManager sharedManager] totalCacheSize];
     Debug("Total cache: %lld", cacheSize);
     if (_connection.quota <= 0) {
         if (_connection.usage < 0)
@@ -916,7 +917,7 @@ enum {
                 SeafAppDelegate *appdelegate = (SeafAppDelegate *)[[UIApplication sharedApplication] delegate];
                 [(SeafDetailViewController *)[appdelegate detailViewControllerAtIndex:TABBED_SETTINGS] setPreViewItem:nil master:nil];
                 [_connection clearAccountCache];
-                long long cacheSize = [SeafStorage.sharedObject cacheSize];
+                long long cacheSize = [[SeafCacheManager sharedManager] totalCacheSize];
                 _cacheCell.detailTextLabel.text = [FileSizeFormatter stringFromLongLong:cacheSize];
             } no:nil];
         }
@@ -677,7 +677,7 @@ typedef NS_ENUM(NSInteger, SeafSelectionMediaClass) {
     }
     if ([file isImageFile]) {
         // Check if this is a Motion Photo (Live Photo) - HEIC format with embedded video
-        if (exists && [SeafLivePhotoSaver canSaveAsLivePhotoAtPath:path]) {
+        if (exists && [SeafLivePhotoSaver canSaveAsLivePhotoAtPath:path oid:file.ooid name:file.name]) {
             Debug(@"Detected Motion Photo, saving as Live Photo: %@", file.name);
             [self saveLivePhotoToAlbum:file atPath:path];
             return;
@@ -731,7 +731,7 @@ typedef NS_ENUM(NSInteger, SeafSelectionMediaClass) {
 {
     __weak typeof(self) weakSelf = self;
     
-    [SeafLivePhotoSaver saveLivePhotoFromPath:path completion:^(BOOL success, NSError * _Nullable error) {
+    [SeafLivePhotoSaver saveLivePhotoFromPath:path oid:file.ooid name:file.name completion:^(BOOL success, NSError * _Nullable error) {
         __strong typeof(weakSelf) self = weakSelf;
         if (!self) return;
         